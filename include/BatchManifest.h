@@ -0,0 +1,46 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* Module for reading the list of tests to be run by pinkySim --batch and the job requests sent to --fork-server. */
+#ifndef _BATCH_MANIFEST_H_
+#define _BATCH_MANIFEST_H_
+
+#include <stdint.h>
+#include <try_catch.h>
+
+
+typedef struct BatchManifestEntry
+{
+    /* Arguments for the test as they would be given to pinkySim on the command line: [options] imageFilename [args] */
+    const char** ppArgs;
+    int          argCount;
+    uint32_t     lineNumber;
+} BatchManifestEntry;
+
+typedef struct BatchManifest
+{
+    char*               pText;
+    const char**        ppArgs;
+    BatchManifestEntry* pEntries;
+    uint32_t            entryCount;
+} BatchManifest;
+
+
+/* Each non-blank line of the manifest is one test.  Arguments are separated by spaces or tabs and can be surrounded
+   by double quotes if they contain spaces.  Lines starting with # are comments. */
+__throws void BatchManifest_Init(BatchManifest* pThis, const char* pFilename);
+/* Parses a copy of pText instead of reading a file. */
+__throws void BatchManifest_InitFromText(BatchManifest* pThis, const char* pText);
+         void BatchManifest_Uninit(BatchManifest* pThis);
+
+
+#endif /* _BATCH_MANIFEST_H_ */
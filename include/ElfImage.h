@@ -0,0 +1,47 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* Module for loading the PT_LOAD segments of an ARM ELF executable into MemorySim and looking up its symbols. */
+#ifndef _ELF_IMAGE_H_
+#define _ELF_IMAGE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <IMemory.h>
+#include <try_catch.h>
+
+
+typedef struct ElfImageInfo
+{
+    uint32_t entryPoint;
+    /* Lowest address and total span of the read-only regions created for the image. */
+    uint32_t flashBaseAddress;
+    uint32_t flashSize;
+} ElfImageInfo;
+
+
+/* Returns non-zero if pFile starts with the ELF magic number.  The current file position is left unchanged. */
+         int  ElfImage_IsElfFile(FILE* pFile);
+/* Creates a read-only region for each non-writable segment (at its load address) which is a private mapping of the
+   file, so nothing is copied.  The load image of initialised writable segments (.data) is mapped the same way.  A
+   read-write region is created from the initial stack pointer just like MemorySim_CreateRegionsFromFlashImage() and
+   writable segments are copied into it.  Writable segments which don't fit in that region get a region of their own.
+   Read-write regions start out zeroed so .bss costs nothing until it is touched. */
+__throws void ElfImage_CreateRegions(IMemory* pMemory, FILE* pFile, uint32_t fileSize, ElfImageInfo* pInfo);
+/* Copies each segment into regions which have already been created (the --flash/--ram case).  Initialised writable
+   segments are copied to both their load and run addresses. */
+__throws void ElfImage_Load(IMemory* pMemory, FILE* pFile, uint32_t fileSize, ElfImageInfo* pInfo);
+/* Returns the value of the defined symbol called pName from the image's symbol table.  Thumb function symbols have
+   bit 0 set.  Throws notFoundException if there is no such symbol (or the image has been stripped). */
+__throws uint32_t ElfImage_FindSymbol(FILE* pFile, uint32_t fileSize, const char* pName);
+
+#endif /* _ELF_IMAGE_H_ */
@@ -15,6 +15,7 @@
 #define _FILE_FAILURE_INJECT_H_
 
 #include <stdio.h>
+#include <sys/mman.h>
 
 /* Pointer to file I/O routines which can intercepted by this module. */
 extern FILE*  (*hook_fopen)(const char* filename, const char* mode);
@@ -22,6 +23,7 @@ extern int    (*hook_fseek)(FILE* stream, long offset, int whence);
 extern long   (*hook_ftell)(FILE* stream);
 extern size_t (*hook_fwrite)(const void* ptr, size_t size, size_t nitems, FILE* stream);
 extern size_t (*hook_fread)(void* ptr, size_t size, size_t nitems, FILE* stream);
+extern void*  (*hook_mmap)(void* addr, size_t len, int prot, int flags, int fd, off_t offset);
 
 void fopenFail(FILE* pFailureReturn);
 void fopenRestore(void);
@@ -40,6 +42,10 @@ void freadFail(size_t failureReturn);
 void freadToFail(int readToFail);
 void freadRestore(void);
 
+void mmapFail(void* pFailureReturn);
+void mmapSetCallsBeforeFailure(int callCountToAllowBeforeFailing);
+void mmapRestore(void);
+
 
 /* Force file I/O routines to go through hooking routines in unit tests. */
 #define fopen  hook_fopen
@@ -47,6 +53,7 @@ void freadRestore(void);
 #define ftell  hook_ftell
 #define fwrite hook_fwrite
 #define fread  hook_fread
+#define mmap   hook_mmap
 
 
 #endif /* _FILE_FAILURE_INJECT_H_ */
@@ -18,6 +18,27 @@
 
 typedef struct IMemory IMemory;
 
+/* Range of simulated addresses [start, start + size) described by IMemory_GetFetchWindow().  pHost points to the host
+   memory backing start when instructions in the range can be fetched by reading it directly.  It is NULL when the
+   fetches must still go through IMemory_Fetch16() (breakpoints, read counting, etc). */
+typedef struct IMemoryFetchWindow
+{
+    const uint8_t* pHost;
+    uint32_t       start;
+    uint32_t       size;
+} IMemoryFetchWindow;
+
+/* Range of simulated addresses [start, start + size) described by IMemory_GetDataWindow().  pHost points to the host
+   memory backing start when data accesses of the requested type in the range can be made by accessing it directly.  It
+   is NULL when they must still go through the read and write methods (MMIO, watchpoints, read-only memory, etc).  The
+   start and size are word aligned so that an aligned access which starts in the window also ends in it. */
+typedef struct IMemoryDataWindow
+{
+    uint8_t* pHost;
+    uint32_t start;
+    uint32_t size;
+} IMemoryDataWindow;
+
 typedef struct IMemoryVTable
 {
     __throws uint32_t (* read32)(IMemory* pThis, uint32_t address);
@@ -27,6 +48,20 @@ typedef struct IMemoryVTable
     __throws void (* write32)(IMemory* pThis, uint32_t address, uint32_t value);
     __throws void (* write16)(IMemory* pThis, uint32_t address, uint16_t value);
     __throws void (* write8)(IMemory* pThis, uint32_t address, uint8_t value);
+
+    /* Optional, can be NULL if instruction fetches don't need to be treated differently from data reads. */
+    __throws uint16_t (* fetch16)(IMemory* pThis, uint32_t address);
+    void (* getFetchWindow)(IMemory* pThis, uint32_t address, IMemoryFetchWindow* pWindow);
+
+    /* Optional, can be NULL in which case the block accesses are broken up into read8/write8 calls and the word
+       accesses into read32/write32 calls. */
+    __throws void (* readBlock)(IMemory* pThis, uint32_t address, void* pBuffer, uint32_t size);
+    __throws void (* writeBlock)(IMemory* pThis, uint32_t address, const void* pBuffer, uint32_t size);
+    __throws void (* readWords)(IMemory* pThis, uint32_t address, uint32_t* pWords, uint32_t count);
+    __throws void (* writeWords)(IMemory* pThis, uint32_t address, const uint32_t* pWords, uint32_t count);
+
+    /* Optional, can be NULL if data accesses must always go through the read and write methods. */
+    void (* getDataWindow)(IMemory* pThis, uint32_t address, int forWriting, IMemoryDataWindow* pWindow);
 } IMemoryVTable;
 
 struct IMemory
@@ -65,5 +100,98 @@ static __throws __inline void IMemory_Write8(IMemory* pThis, uint32_t address, u
     pThis->pVTable->write8(pThis, address, value);
 }
 
+/* Reads a halfword of an instruction being fetched for execution.  Unlike IMemory_Read16() this can hit breakpoints. */
+static __throws __inline uint16_t IMemory_Fetch16(IMemory* pThis, uint32_t address)
+{
+    if (pThis->pVTable->fetch16)
+        return pThis->pVTable->fetch16(pThis, address);
+    return pThis->pVTable->read16(pThis, address);
+}
+
+/* Fills in *pWindow with the range around address for which instruction fetches can be handled the same way.  The
+   window is only valid until the memory map, its breakpoints or its watchpoints are next modified. */
+static __inline void IMemory_GetFetchWindow(IMemory* pThis, uint32_t address, IMemoryFetchWindow* pWindow)
+{
+    if (pThis->pVTable->getFetchWindow)
+    {
+        pThis->pVTable->getFetchWindow(pThis, address, pWindow);
+        return;
+    }
+    pWindow->pHost = NULL;
+    pWindow->start = 0;
+    pWindow->size = 0xFFFFFFFF;
+}
+
+/* Fills in *pWindow with the range around address for which data reads (or writes when forWriting is non-zero) can be
+   handled the same way.  Handing out a window for writing counts as writing to all of it.  The window is only valid
+   until the memory map, its watchpoints or its checkpoint are next modified. */
+static __inline void IMemory_GetDataWindow(IMemory* pThis, uint32_t address, int forWriting, IMemoryDataWindow* pWindow)
+{
+    if (pThis->pVTable->getDataWindow)
+    {
+        pThis->pVTable->getDataWindow(pThis, address, forWriting, pWindow);
+        return;
+    }
+    pWindow->pHost = NULL;
+    pWindow->start = 0;
+    pWindow->size = 0xFFFFFFFF;
+}
+
+/* Reads size bytes starting at address.  Behaves like a sequence of IMemory_Read8() calls (including which
+   watchpoints are hit) but can be done as a single copy when nothing needs to see the individual accesses.  If an
+   exception is thrown, part of the buffer may already have been filled in. */
+static __throws __inline void IMemory_ReadBlock(IMemory* pThis, uint32_t address, void* pBuffer, uint32_t size)
+{
+    uint8_t* pDest = (uint8_t*)pBuffer;
+
+    if (pThis->pVTable->readBlock)
+    {
+        pThis->pVTable->readBlock(pThis, address, pBuffer, size);
+        return;
+    }
+    while (size--)
+        *pDest++ = pThis->pVTable->read8(pThis, address++);
+}
+
+/* Writes size bytes starting at address.  Behaves like a sequence of IMemory_Write8() calls. */
+static __throws __inline void IMemory_WriteBlock(IMemory* pThis, uint32_t address, const void* pBuffer, uint32_t size)
+{
+    const uint8_t* pSrc = (const uint8_t*)pBuffer;
+
+    if (pThis->pVTable->writeBlock)
+    {
+        pThis->pVTable->writeBlock(pThis, address, pBuffer, size);
+        return;
+    }
+    while (size--)
+        pThis->pVTable->write8(pThis, address++, *pSrc++);
+}
+
+/* Reads count consecutive words starting at address.  Behaves like a sequence of IMemory_Read32() calls so MMIO
+   regions still see word sized accesses. */
+static __throws __inline void IMemory_ReadWords(IMemory* pThis, uint32_t address, uint32_t* pWords, uint32_t count)
+{
+    if (pThis->pVTable->readWords)
+    {
+        pThis->pVTable->readWords(pThis, address, pWords, count);
+        return;
+    }
+    for ( ; count > 0 ; count--, address += sizeof(uint32_t))
+        *pWords++ = pThis->pVTable->read32(pThis, address);
+}
+
+/* Writes count consecutive words starting at address.  Behaves like a sequence of IMemory_Write32() calls. */
+static __throws __inline void IMemory_WriteWords(IMemory* pThis, uint32_t address, const uint32_t* pWords,
+                                                 uint32_t count)
+{
+    if (pThis->pVTable->writeWords)
+    {
+        pThis->pVTable->writeWords(pThis, address, pWords, count);
+        return;
+    }
+    for ( ; count > 0 ; count--, address += sizeof(uint32_t))
+        pThis->pVTable->write32(pThis, address, *pWords++);
+}
+
 
 #endif /* _IMEMORY_H_ */
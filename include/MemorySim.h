@@ -14,6 +14,7 @@
 #define _MEMORY_SIM_H_
 
 
+#include <stdio.h>
 #include <IMemory.h>
 
 
@@ -30,24 +31,99 @@ typedef enum WatchpointType
     WATCHPOINT_READ_WRITE = 3
 } WatchpointType;
 
+/* Callbacks used by memory mapped peripheral (MMIO) regions.  offset is relative to the start of the region, size is
+   the access width in bytes (1, 2 or 4) and values are right aligned.  Either callback can throw busErrorException to
+   fault the access. */
+typedef uint32_t (*MemorySimMmioRead)(void* pContext, uint32_t offset, uint32_t size);
+typedef void     (*MemorySimMmioWrite)(void* pContext, uint32_t offset, uint32_t size, uint32_t value);
 
-IMemory*                     MemorySim_Init(void);
+/* How instruction fetches from read-only (FLASH) regions are recorded for code coverage. */
+typedef enum FlashReadCountMode
+{
+    FLASH_READ_COUNT_NONE = 0,  /* Default.  Nothing is recorded and MemorySim_GetFlashReadCount() always returns 0. */
+    FLASH_READ_COUNT_FULL,      /* Count every fetch of each halfword (4 bytes of bookkeeping per halfword). */
+    FLASH_READ_COUNT_HITS       /* Only record whether each halfword was ever fetched (1 bit per halfword). */
+} FlashReadCountMode;
+
+
+/* Each call returns a new, independent object.  An object must only be used by one thread at a time. */
+__throws IMemory*            MemorySim_Init(void);
 void                         MemorySim_Uninit(IMemory* pMemory);
 __throws void                MemorySim_CreateRegion(IMemory* pMemory, uint32_t baseAddress, uint32_t size);
+/* Creates a region which is a private mapping of size bytes starting at fileOffset within pFile.  The offset doesn't
+   need to be aligned to a host page. */
+__throws void                MemorySim_CreateRegionFromFile(IMemory* pMemory, uint32_t baseAddress, uint32_t size,
+                                                            FILE* pFile, uint32_t fileOffset);
 void                         MemorySim_MakeRegionReadOnly(IMemory* pMemory, uint32_t baseAddress);
 __throws void                MemorySim_LoadFromFlashImage(IMemory* pMemory, const void* pFlashImage, uint32_t flashImageSize);
+/* Creates a region whose loads and stores are handed to the callbacks instead of memory.  A NULL callback makes that
+   type of access fault.  Instructions can't be fetched from these regions and they can't be mapped to host memory. */
+__throws void                MemorySim_CreateMmioRegion(IMemory* pMemory, uint32_t baseAddress, uint32_t size,
+                                                        MemorySimMmioRead readCallback, MemorySimMmioWrite writeCallback,
+                                                        void* pContext);
+/* Creates an MMIO region made up of registerCount 32-bit registers which needs no callbacks.  Each register reads back
+   the last value written to it except for the bits clear in its entry of pWriteMasks (such as status flags) which the
+   program can't change.  A NULL pWriteMasks makes every bit writable.  All registers start out as 0. */
+__throws void                MemorySim_CreateRegisterFileRegion(IMemory* pMemory, uint32_t baseAddress,
+                                                                uint32_t registerCount, const uint32_t* pWriteMasks);
+/* Host side access to a register file register which ignores its write mask. */
+__throws uint32_t            MemorySim_GetRegisterFileValue(IMemory* pMemory, uint32_t address);
+__throws void                MemorySim_SetRegisterFileValue(IMemory* pMemory, uint32_t address, uint32_t value);
+/* Copies the image into existing regions starting at address.  Read-only regions can be loaded too. */
+__throws void                MemorySim_LoadImage(IMemory* pMemory, uint32_t address, const void* pImage, uint32_t imageSize);
 __throws void                MemorySim_CreateRegionsFromFlashImage(IMemory* pMemory, const void* pFlashImage, uint32_t flashImageSize);
+/* The *File() variants mmap() the image file rather than requiring it to be read into a buffer first.  The FLASH region
+   created by MemorySim_CreateRegionsFromFlashImageFile() is a private mapping of the file so writes to it never make it
+   back to the file. */
+__throws void                MemorySim_LoadFromFlashImageFile(IMemory* pMemory, FILE* pFile, uint32_t flashImageSize);
+__throws void                MemorySim_CreateRegionsFromFlashImageFile(IMemory* pMemory, FILE* pFile, uint32_t flashImageSize);
 __throws const char*         MemorySim_GetMemoryMapXML(IMemory* pMemory);
 __throws void*               MemorySim_MapSimulatedAddressToHostAddressForWrite(IMemory* pMemory, uint32_t address, uint32_t size);
 __throws const void*         MemorySim_MapSimulatedAddressToHostAddressForRead(IMemory* pMemory, uint32_t address, uint32_t size);
 __throws uint32_t            MemorySim_GetFlashReadCount(IMemory* pMemory, uint32_t address);
+/* Any counts already recorded are discarded.  Applies to existing read-only regions and those created later. */
+__throws void                MemorySim_EnableFlashReadCounting(IMemory* pMemory, FlashReadCountMode mode);
 
 __throws void MemorySim_SetHardwareBreakpoint(IMemory* pMemory, uint32_t address, uint32_t size);
 __throws void MemorySim_ClearHardwareBreakpoint(IMemory* pMemory, uint32_t address, uint32_t size);
+/* Reports whether a breakpoint covers the halfword at address. */
+__throws int  MemorySim_IsHardwareBreakpointSet(IMemory* pMemory, uint32_t address);
 
 __throws void MemorySim_SetHardwareWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type);
 __throws void MemorySim_ClearHardwareWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type);
          int  MemorySim_WasWatchpointEncountered(IMemory* pMemory);
 
+/* Read-write regions are backed by memory which the OS only commits once it is touched.  This reports how many bytes
+   of these regions there are in total and roughly how many have been touched (rounded up to host pages). */
+void MemorySim_GetRAMUsage(IMemory* pMemory, uint64_t* pTotalBytes, uint64_t* pTouchedBytes);
+
+/* Returns non-zero if instruction fetches could trigger breakpoints, watchpoints or FLASH read counting and therefore
+   shouldn't be skipped by a decode cache. */
+int MemorySim_HasFetchSideEffects(IMemory* pMemory);
+
+/* Writes the layout of the regions and the contents of every region backed by memory or a register file to pFile,
+   starting at its current position.  Untouched (all zero) pages are left as holes in the file. */
+__throws void MemorySim_SaveState(IMemory* pMemory, FILE* pFile);
+/* Restores the contents saved by MemorySim_SaveState() starting at pFile's current position.  The regions must have
+   the same layout as when they were saved or invalidArgumentException is thrown and nothing is changed.  Regions backed
+   by memory become private mappings of the file so a restore costs nothing until a page is touched and writes never
+   make it back to the file.  Breakpoints, watchpoints and FLASH read counts are left as they were. */
+__throws void MemorySim_RestoreState(IMemory* pMemory, FILE* pFile);
+
+/* Takes a checkpoint of the current contents which MemorySim_ResetToCheckpoint() can cheaply return to, replacing any
+   earlier checkpoint.  Writes are tracked for each 4k page of the regions backed by memory and a page's contents are
+   only copied aside the first time it is written.  Register file values are copied in full and MMIO regions aren't
+   tracked.  Returns a non-zero id for the checkpoint which stays current until another checkpoint is taken, a region is
+   created or MemorySim_RestoreState() replaces the contents. */
+__throws uint32_t MemorySim_Checkpoint(IMemory* pMemory);
+/* Returns the id of the current checkpoint or 0 if there is none. */
+uint32_t MemorySim_GetCheckpoint(IMemory* pMemory);
+/* Fills in pPageAddresses with the start address of up to maxCount 4k pages written since the checkpoint (or the last
+   reset to it) and returns how many such pages there are in total.  Pages are listed in region order. */
+uint32_t MemorySim_GetDirtyPages(IMemory* pMemory, uint32_t* pPageAddresses, uint32_t maxCount);
+/* Copies the checkpoint contents back into the dirty pages and register files and then marks every page clean.  Throws
+   invalidArgumentException if there is no checkpoint.  Decode caches of the memory need to be flushed afterwards. */
+__throws void MemorySim_ResetToCheckpoint(IMemory* pMemory);
+
 
 #endif /* _MEMORY_SIM_H_ */
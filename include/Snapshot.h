@@ -0,0 +1,43 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* Module for saving and restoring the state of a whole simulated machine: the registers in a PinkySimContext and the
+   contents of every region in the MemorySim object that it is attached to. */
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <pinkySim.h>
+#include <try_catch.h>
+
+
+typedef struct Snapshot Snapshot;
+
+
+/* State files are written in the host's byte order and can only be loaded on a similar host.  Loading requires a
+   MemorySim object with the same regions as the one which was saved.  Its memory becomes a private mapping of the
+   file so loading costs nothing until pages are touched.  Any decode cache attached to the context is flushed.  All
+   failures throw stateException and leave a description for Snapshot_GetErrorText(). */
+__throws void      Snapshot_Save(PinkySimContext* pContext, const char* pFilename);
+__throws void      Snapshot_Load(PinkySimContext* pContext, const char* pFilename);
+
+/* In-process snapshots work the same way but are kept in an unnamed temporary file.  A snapshot can be restored any
+   number of times, to any context whose memory has the same regions.  Taking or restoring a snapshot also takes a
+   MemorySim checkpoint so that restoring it again into the same memory only copies back the pages written since, for
+   as long as that checkpoint is current. */
+__throws Snapshot* Snapshot_Take(PinkySimContext* pContext);
+__throws void      Snapshot_Restore(Snapshot* pThis, PinkySimContext* pContext);
+         void      Snapshot_Free(Snapshot* pThis);
+
+const char* Snapshot_GetErrorText(void);
+
+
+#endif /* _SNAPSHOT_H_ */
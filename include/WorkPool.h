@@ -0,0 +1,34 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* Module for running a list of independent work items on a pool of threads. */
+#ifndef _WORK_POOL_H_
+#define _WORK_POOL_H_
+
+#include <stdint.h>
+#include <try_catch.h>
+
+
+/* Called once for each item in the range 0 to itemCount - 1.  Calls are made from several threads at once. */
+typedef void (*WorkPoolCallback)(void* pContext, uint32_t itemIndex);
+
+
+/* Each thread starts out owning an equal share of the items and works through it from the front.  A thread which
+   runs out of items steals the back half of the largest share left so that a few slow items don't leave the rest of
+   the threads idle.  The calling thread is used as one of the threadCount threads and the call returns once every
+   item has been run.  A threadCount of 0 uses WorkPool_GetDefaultThreadCount(). */
+__throws void     WorkPool_Run(uint32_t threadCount, uint32_t itemCount, WorkPoolCallback callback, void* pContext);
+/* Number of processors which are currently online on the host. */
+         uint32_t WorkPool_GetDefaultThreadCount(void);
+
+
+#endif /* _WORK_POOL_H_ */
@@ -19,10 +19,40 @@
 #include <try_catch.h>
 
 
-__throws void mri4simInit(IMemory* pMem);
-         void mri4simRun(IComm* pComm, int breakOnStart);
-
-PinkySimContext* mri4simGetContext(void);
+typedef struct Mri4Sim Mri4Sim;
+
+/* Each Mri4Sim is an independent simulation of the program in pMem and can be run on its own thread.  The MRI core
+   which handles GDB and semihost requests is shared by all of them though so only one at a time is let into it and
+   GDB should only be connected to one of them. */
+__throws Mri4Sim* mri4simInit(IMemory* pMem, IComm* pComm);
+         void     mri4simUninit(Mri4Sim* pThis);
+__throws void     mri4simRun(Mri4Sim* pThis, int breakOnStart);
+         void     mri4simEnableJit(Mri4Sim* pThis);
+         void     mri4simSetInstructionLimit(Mri4Sim* pThis, uint64_t maxInstructions);
+         int      mri4simWasInstructionLimitReached(Mri4Sim* pThis);
+/* Returns from mri4simRun() on faults and breakpoints instead of waiting for GDB to connect.  Semihost requests are
+   still handled. */
+         void     mri4simStopOnDebugEvent(Mri4Sim* pThis);
+/* Sends the program's stdout and stderr to outputFileDescriptor and reads its stdin from inputFileDescriptor when
+   GDB isn't connected. */
+         void     mri4simRedirectConsole(Mri4Sim* pThis, int inputFileDescriptor, int outputFileDescriptor);
+/* Non-zero if the last mri4simRun() ended because the program called exit().  Its exit code is then in R0. */
+         int      mri4simDidProgramExit(Mri4Sim* pThis);
+/* One of the PINKYSIM_STEP_* or PINKYSIM_RUN_* codes for why the last run of the simulator stopped. */
+         int      mri4simGetRunResult(Mri4Sim* pThis);
+/* Saves the machine state to pFilename with Snapshot_Save() the first time that execution reaches address and then
+   carries on running.  Uses a hardware breakpoint so the decode cache is bypassed until then.  A GDB breakpoint at the
+   same address is left in place and still reported.  mri4simRun() throws stateException if the save fails. */
+__throws void     mri4simSaveStateAt(Mri4Sim* pThis, const char* pFilename, uint32_t address);
+/* Makes mri4simRun() return the first time that execution reaches address, before that instruction is run, or the
+   first time that the program tries to read from stdin, before the semihost request is handled.  A following
+   mri4simRun() carries on from there as if nothing had happened, first reporting any GDB breakpoint at address. */
+__throws void     mri4simStopAt(Mri4Sim* pThis, uint32_t address);
+         void     mri4simStopBeforeInput(Mri4Sim* pThis);
+/* Non-zero if the last mri4simRun() ended at a stop requested with one of the above. */
+         int      mri4simWasStopReached(Mri4Sim* pThis);
+
+PinkySimContext* mri4simGetContext(Mri4Sim* pThis);
 
 
 #endif /* _MRI4SIM_H_ */
@@ -30,6 +30,9 @@
 #define APSR_NC     (APSR_N | APSR_C)
 #define APSR_ZC     (APSR_Z | APSR_C)
 
+/* Address of the DWT cycle count register which is simulated while cycle counting is enabled. */
+#define DWT_CYCCNT  0xE0001004
+
 /* Bits in PinkySimContext::PRIMASK */
 #define PRIMASK_PM (1 << 0)
 
@@ -81,6 +84,35 @@
 #define LR  14
 #define PC  15
 
+/* Opaque cache of predecoded instructions which can be attached to a PinkySimContext. */
+typedef struct PinkySimDecodeCache PinkySimDecodeCache;
+
+/* Operands of flag setting instructions whose APSR flags haven't been folded into PinkySimContext::xPSR yet.  Only
+   used while pinkySimStep() or pinkySimRun*() is executing instructions.  xPSR is always up to date once they return
+   and before any callback is made. */
+typedef struct PinkySimLazyFlags
+{
+    uint32_t pending;
+    uint32_t result;
+    uint32_t carry;
+    uint32_t operand1;
+    uint32_t operand2;
+    uint32_t carryIn;
+} PinkySimLazyFlags;
+
+/* Estimated Cortex-M0 clock cycle count maintained while cycle counting is enabled.  count is the total since counting
+   was enabled and cyccntBase is the value of count when the simulated DWT_CYCCNT register was last written. */
+typedef struct PinkySimCycleCounter
+{
+    uint64_t count;
+    uint64_t cyccntBase;
+    uint32_t enabled;
+    uint32_t flashBase;
+    uint32_t flashSize;
+    uint32_t flashWaitStates;
+    uint32_t lastFetchWord;
+} PinkySimCycleCounter;
+
 typedef struct PinkySimContext
 {
     IMemory* pMemory;
@@ -92,6 +124,18 @@ typedef struct PinkySimContext
     uint32_t newPC;
     uint32_t PRIMASK;
     uint32_t CONTROL;
+    PinkySimDecodeCache* pDecodeCache;
+    PinkySimLazyFlags    lazyFlags;
+    PinkySimCycleCounter cycleCounter;
+    /* Host memory window for sequential instruction fetches.  Refilled from the IMemory object when the PC leaves it
+       and discarded each time pinkySimStep() or pinkySimRun*() is called so that changes made to the memory map or
+       breakpoints between calls are seen.  Callbacks must not make such changes while a run is in progress. */
+    IMemoryFetchWindow   fetchWindow;
+    /* Host memory windows for the data reads and writes made by JIT generated code, refilled and discarded just like
+       the fetch window.  The write window never covers code held in the decode cache so the generated code can write
+       through it without invalidating anything. */
+    IMemoryDataWindow    readWindow;
+    IMemoryDataWindow    writeWindow;
 } PinkySimContext;
 
 
@@ -106,10 +150,64 @@ typedef struct PinkySimContext
 #define PINKYSIM_RUN_INTERRUPT      7   /* pinkySimRun() callback signalled interrupt. */
 #define PINKYSIM_RUN_WATCHPOINT     8   /* pinkySimRun() callback signalled watchpoint event. */
 #define PINKYSIM_RUN_SINGLESTEP     9   /* pinkySimRun() callback signalled single step. */
+#define PINKYSIM_RUN_LIMIT          10  /* pinkySimRunFor() executed the requested number of instructions. */
 
 
 int pinkySimStep(PinkySimContext* pContext);
 int pinkySimRun(PinkySimContext* pContext, int (*callback)(PinkySimContext*));
 
+/* Like pinkySimRun() but executes a whole basic block (a straight-line run of instructions up to the next branch) from
+   the decode cache between each call to the callback.  Architectural state and fault reporting are the same as for
+   pinkySimStep() but the callback can no longer be used to stop after each instruction (single stepping, etc).  Falls
+   back to pinkySimRun() if the decode cache isn't enabled. */
+int pinkySimRunBlocks(PinkySimContext* pContext, int (*callback)(PinkySimContext*));
+
+/* Like pinkySimRun() but returns PINKYSIM_RUN_LIMIT once maxInstructions instructions have completed successfully.  The
+   callback can be NULL to run at full speed until the limit or the next event that stops pinkySimRun().  The number of
+   instructions which completed is returned in *pInstructionsRetired if it isn't NULL. */
+int pinkySimRunFor(PinkySimContext* pContext,
+                   int              (*callback)(PinkySimContext*),
+                   uint64_t         maxInstructions,
+                   uint64_t*        pInstructionsRetired);
+
+/* Like pinkySimRunFor() but executes a block at a time like pinkySimRunBlocks(), cutting the last block short so that
+   no more than maxInstructions are executed.  The callback is only called between blocks.  Falls back to
+   pinkySimRunFor() if the decode cache isn't enabled. */
+int pinkySimRunBlocksFor(PinkySimContext* pContext,
+                         int              (*callback)(PinkySimContext*),
+                         uint64_t         maxInstructions,
+                         uint64_t*        pInstructionsRetired);
+
+/* The decode cache remembers the handler for each instruction fetched so that it doesn't need to be fetched and
+   decoded again the next time it is executed.  Writes made by the simulated code itself invalidate the affected
+   entries automatically but writes made directly to the IMemory object (by a debugger for example) require a call to
+   pinkySimInvalidateDecodeCache() or pinkySimFlushDecodeCache() before execution resumes.  The cache also bypasses the
+   IMemory object for the instruction fetches that it satisfies so it shouldn't be enabled when those fetches have side
+   effects such as breakpoints. */
+__throws void pinkySimEnableDecodeCache(PinkySimContext* pContext);
+         void pinkySimDisableDecodeCache(PinkySimContext* pContext);
+         void pinkySimFlushDecodeCache(PinkySimContext* pContext);
+         void pinkySimInvalidateDecodeCache(PinkySimContext* pContext, uint32_t address, uint32_t size);
+
+/* The JIT translates basic blocks which pinkySimRunBlocks() executes often into native code.  Data processing and
+   load/store instructions are translated inline while the rest call the instruction handlers directly.  Loads and
+   stores which land in plain RAM access the host memory behind it directly (see IMemory_GetDataWindow()) while those
+   to MMIO, read-only or watched pages still call through the IMemory object.  It lives in the decode cache so it must
+   be enabled after pinkySimEnableDecodeCache() and it is released along with the cache.  It is only supported on
+   x86-64 hosts and enabling it elsewhere has no effect. */
+__throws void pinkySimEnableJit(PinkySimContext* pContext);
+         void pinkySimDisableJit(PinkySimContext* pContext);
+         int  pinkySimIsJitSupported(void);
+
+/* Cycle counting charges each executed instruction with the number of cycles it would take on a Cortex-M0 (2 for loads
+   and stores, 1+N for LDM/STM/PUSH/POP, 2 extra to refill the pipeline after a taken branch, etc) plus
+   flashWaitStates for every instruction word fetched and every data read from the flash region.  The total is kept in
+   PinkySimContext::cycleCounter.count and the simulated code can read the low 32 bits from the DWT_CYCCNT register at
+   0xE0001004 (writing to it restarts that view of the count from the written value).  The JIT is bypassed while
+   counting is enabled.  When disabled, the only cost is a single test per instruction. */
+void pinkySimEnableCycleCounter(PinkySimContext* pContext, uint32_t flashBase, uint32_t flashSize,
+                                uint32_t flashWaitStates);
+void pinkySimDisableCycleCounter(PinkySimContext* pContext);
+
 
 #endif /* _PINKY_SIM_H_ */
@@ -22,17 +22,32 @@ typedef struct pinkySimCommandLine
     const char*  pImageFilename;
     const char*  pCoverageElfFilename;
     const char*  pCoverageResultsDirectory;
+    const char*  pSaveStateFilename;
+    const char*  pLoadStateFilename;
     const char** ppCoverageRestrictPaths;
     IMemory*     pMemory;
     int          breakOnStart;
+    int          coverageHitsOnly;
+    int          useJit;
+    int          countCycles;
+    int          reportRamUsage;
+    int          isElfImage;
     int          manualMemoryRegions;
     int          argIndexOfImageFilename;
     uint32_t     coverageRestrictPathCount;
+    uint32_t     entryPoint;
+    uint32_t     flashBaseAddress;
+    uint32_t     flashSize;
+    uint32_t     flashWaitStates;
+    uint32_t     saveStateAddress;
+    uint64_t     maxInstructions;
     uint16_t     gdbPort;
 } pinkySimCommandLine;
 
 
 __throws void pinkySimCommandLine_Init(pinkySimCommandLine* pThis, int argc, const char** argv);
+/* Same as pinkySimCommandLine_Init() except that the usage text isn't displayed when the arguments are invalid. */
+__throws void pinkySimCommandLine_InitQuietly(pinkySimCommandLine* pThis, int argc, const char** argv);
          void pinkySimCommandLine_Uninit(pinkySimCommandLine* pThis);
 
 
@@ -32,6 +32,7 @@
 #define socketException                     (mriMaxException + 11)
 #define fileException                       (mriMaxException + 12)
 #define coverageException                   (mriMaxException + 13)
+#define stateException                      (mriMaxException + 14)
 
 
 #ifndef __debugbreak
@@ -46,8 +47,10 @@ typedef struct ExceptionHandler
 } ExceptionHandler;
 
 
-extern ExceptionHandler* g_pExceptionHandlers;
-extern int               g_exceptionCode;
+/* Each thread has its own chain of handlers and exception code so that separate simulations can run on separate
+   threads. */
+extern __thread ExceptionHandler* g_pExceptionHandlers;
+extern __thread int               g_exceptionCode;
 
 
 /* On Linux, it is possible that __try and __catch are already defined. */
@@ -12,6 +12,7 @@
 */
 /* Module for injecting failures into file I/O calls. */
 #include <stdio.h>
+#include <sys/mman.h>
 
 
 #define FAIL_ALL_CALLS -1
@@ -22,6 +23,7 @@ int    (*hook_fseek)(FILE* stream, long offset, int whence) = fseek;
 long   (*hook_ftell)(FILE* stream) = ftell;
 size_t (*hook_fwrite)(const void* ptr, size_t size, size_t nitems, FILE* stream) = fwrite;
 size_t (*hook_fread)(void* ptr, size_t size, size_t nitems, FILE* stream) = fread;
+void*  (*hook_mmap)(void* addr, size_t len, int prot, int flags, int fd, off_t offset) = mmap;
 
 
 static FILE*  g_fopenFailureReturn;
@@ -31,6 +33,8 @@ static long   g_ftellFailureReturn;
 static size_t g_fwriteFailureReturn;
 static size_t g_freadFailureReturn;
 static int    g_freadToFail;
+static void*  g_mmapFailureReturn;
+static int    g_mmapCallsToPass;
 
 void freadRestore(void);
 
@@ -157,3 +161,35 @@ void freadRestore(void)
     hook_fread = fread;
     g_freadToFail = 0;
 }
+
+
+static void* mock_mmap(void* addr, size_t len, int prot, int flags, int fd, off_t offset);
+void mmapFail(void* pFailureReturn)
+{
+    g_mmapFailureReturn = pFailureReturn;
+    hook_mmap = mock_mmap;
+}
+
+static void* mock_mmap(void* addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+    if (g_mmapCallsToPass > 0)
+    {
+        g_mmapCallsToPass--;
+        return mmap(addr, len, prot, flags, fd, offset);
+    }
+
+    return g_mmapFailureReturn;
+}
+
+
+void mmapSetCallsBeforeFailure(int callCountToAllowBeforeFailing)
+{
+    g_mmapCallsToPass = callCountToAllowBeforeFailing;
+}
+
+
+void mmapRestore(void)
+{
+    hook_mmap = mmap;
+    g_mmapCallsToPass = 0;
+}
@@ -151,3 +151,36 @@ TEST(FileFailureInject, FailSecondOutOfThreeFReads)
     LONGS_EQUAL(1, hook_fread(buffer, 1, 1, m_pFile));
     freadRestore();
 }
+
+TEST(FileFailureInject, SuccessfulMMap)
+{
+    void* pMapping;
+
+    createSmallTestFile();
+    pMapping = hook_mmap(NULL, 5, PROT_READ, MAP_PRIVATE, fileno(m_pFile), 0);
+    CHECK(pMapping != MAP_FAILED);
+    CHECK_EQUAL(0, memcmp(pMapping, "12345", 5));
+    munmap(pMapping, 5);
+}
+
+TEST(FileFailureInject, FailMMap)
+{
+    createSmallTestFile();
+    mmapFail(MAP_FAILED);
+    POINTERS_EQUAL(MAP_FAILED, hook_mmap(NULL, 5, PROT_READ, MAP_PRIVATE, fileno(m_pFile), 0));
+    mmapRestore();
+}
+
+TEST(FileFailureInject, FailSecondMMap)
+{
+    void* pMapping;
+
+    createSmallTestFile();
+    mmapFail(MAP_FAILED);
+    mmapSetCallsBeforeFailure(1);
+    pMapping = hook_mmap(NULL, 5, PROT_READ, MAP_PRIVATE, fileno(m_pFile), 0);
+    CHECK(pMapping != MAP_FAILED);
+    POINTERS_EQUAL(MAP_FAILED, hook_mmap(NULL, 5, PROT_READ, MAP_PRIVATE, fileno(m_pFile), 0));
+    mmapRestore();
+    munmap(pMapping, 5);
+}
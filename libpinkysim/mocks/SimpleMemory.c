@@ -24,8 +24,10 @@ static void write32(IMemory* pMem, uint32_t address, uint32_t value);
 static void write16(IMemory* pMem, uint32_t address, uint16_t value);
 static void write8(IMemory* pMem, uint32_t address, uint8_t value);
 static void write(SimpleMemory* pThis, uint32_t address, uint32_t alignedValue, uint32_t mask);
+static void getDataWindow(IMemory* pMem, uint32_t address, int forWriting, IMemoryDataWindow* pWindow);
 
-static IMemoryVTable g_vTable = {read32, read16, read8, write32, write16, write8};
+static IMemoryVTable g_vTable = {read32, read16, read8, write32, write16, write8, NULL, NULL,
+                                 NULL, NULL, NULL, NULL, getDataWindow};
 
 typedef struct MemoryEntry
 {
@@ -131,3 +133,26 @@ static void write(SimpleMemory* pThis, uint32_t address, uint32_t value, uint32_
     }
     __throw(busErrorException);
 }
+
+static void getDataWindow(IMemory* pMem, uint32_t address, int forWriting, IMemoryDataWindow* pWindow)
+{
+    SimpleMemory* pThis = (SimpleMemory*)pMem;
+    uint32_t      alignedAddress = address & 0xFFFFFFFC;
+    size_t        i;
+
+    /* Each word is its own window so that accesses to it can be made directly on its value. */
+    pWindow->pHost = NULL;
+    pWindow->start = address;
+    pWindow->size = 0;
+    for (i = 0 ; i < pThis->entryCount ; i++)
+    {
+        if (pThis->entries[i].address == alignedAddress)
+        {
+            pWindow->start = alignedAddress;
+            pWindow->size = sizeof(uint32_t);
+            if (!forWriting || !pThis->entries[i].readOnly)
+                pWindow->pHost = (uint8_t*)&pThis->entries[i].value;
+            return;
+        }
+    }
+}
@@ -21,6 +21,7 @@ int             g_bindReturn;
 int             g_listenReturn;
 int             g_acceptReturn;
 int             g_selectReturn;
+int             g_fcntlReturn;
 ssize_t         g_recvReturnValues[4];
 const uint8_t*  g_pRecvCurr;
 const uint8_t*  g_pRecvEnd;
@@ -43,6 +44,7 @@ static int mock_select(int nfds,
 static ssize_t mock_recv(int socket, void *buffer, size_t length, int flags);
 static ssize_t popRecvReturnValue(void);
 static ssize_t mock_send(int socket, const void *buffer, size_t length, int flags);
+static int mock_fcntl(int fildes, int cmd, ...);
 
 
 int (*hook_socket)(int domain, int type, int protocol) = mock_socket;
@@ -61,6 +63,7 @@ int (*hook_select)(int nfds,
                    struct timeval* timeout) = mock_select;
 ssize_t (*hook_recv)(int socket, void *buffer, size_t length, int flags) = mock_recv;
 ssize_t (*hook_send)(int socket, const void *buffer, size_t length, int flags) = mock_send;
+int (*hook_fcntl)(int fildes, int cmd, ...) = mock_fcntl;
 
 
 void mockSock_Init(size_t sendDataBufferSize)
@@ -70,6 +73,7 @@ void mockSock_Init(size_t sendDataBufferSize)
     g_listenReturn = 0;
     g_acceptReturn = 0;
     g_selectReturn = 1;
+    g_fcntlReturn = -1;
     memset(g_recvReturnValues, 0, sizeof(g_recvReturnValues));
     g_pRecvCurr = g_pRecvEnd = NULL;
     g_sendCallToFail = 0;
@@ -114,6 +118,11 @@ void mockSock_selectSetReturn(int returnValue)
     g_selectReturn = returnValue;
 }
 
+void mockSock_fcntlSetReturn(int returnValue)
+{
+    g_fcntlReturn = returnValue;
+}
+
 void mockSock_recvSetBuffer(const void* pBuffer, size_t bufferSize)
 {
     g_pRecvCurr = pBuffer;
@@ -213,3 +222,8 @@ static ssize_t mock_send(int socket, const void *buffer, size_t length, int flag
 
     return (ssize_t)length;
 }
+
+static int mock_fcntl(int fildes, int cmd, ...)
+{
+    return g_fcntlReturn;
+}
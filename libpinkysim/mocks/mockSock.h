@@ -14,6 +14,7 @@
 #define _MOCK_SOCK_H_
 
 
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <unistd.h>
@@ -27,6 +28,7 @@ void        mockSock_bindSetReturn(int returnValue);
 void        mockSock_listenSetReturn(int returnValue);
 void        mockSock_acceptSetReturn(int returnValue);
 void        mockSock_selectSetReturn(int returnValue);
+void        mockSock_fcntlSetReturn(int returnValue);
 void        mockSock_recvSetBuffer(const void* pBuffer, size_t bufferSize);
 void        mockSock_recvSetReturnValues(ssize_t ret1, ssize_t ret2, ssize_t ret3, ssize_t ret4);
 void        mockSock_sendFailIteration(int callToFail);
@@ -46,6 +48,7 @@ extern int (*hook_select)(int nfds,
 extern int (*hook_close)(int fildes);
 extern ssize_t (*hook_recv)(int socket, void *buffer, size_t length, int flags);
 extern ssize_t (*hook_send)(int socket, const void *buffer, size_t length, int flags);
+extern int (*hook_fcntl)(int fildes, int cmd, ...);
 
 
 /* Redirect calls to socket APIs to the mocks instead */
@@ -58,6 +61,7 @@ extern ssize_t (*hook_send)(int socket, const void *buffer, size_t length, int f
 #define close       hook_close
 #define recv        hook_recv
 #define send        hook_send
+#define fcntl       hook_fcntl
 
 
 #endif /* _MOCK_SOCK_H_ */
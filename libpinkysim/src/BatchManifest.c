@@ -0,0 +1,250 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <BatchManifest.h>
+#include <common.h>
+#include <FileFailureInject.h>
+#include <MallocFailureInject.h>
+#include <string.h>
+
+
+/* While parsing, entries hold the index of their first argument in ppArgs since it can move when it grows. */
+typedef struct ManifestParser
+{
+    BatchManifest* pManifest;
+    size_t         argCount;
+    size_t         argsAllocated;
+    size_t         entriesAllocated;
+} ManifestParser;
+
+
+static void readManifestText(BatchManifest* pThis, const char* pFilename);
+static void copyManifestText(BatchManifest* pThis, const char* pText);
+static void parseManifestText(BatchManifest* pThis);
+static void parseLines(ManifestParser* pParser);
+static char* terminateLine(char* pLine);
+static void parseLine(ManifestParser* pParser, char* pLine, uint32_t lineNumber);
+static char* skipBlanks(char* p);
+static int isBlank(char c);
+static char* parseArgument(char* p, const char** ppArg);
+static void addArgument(ManifestParser* pParser, const char* pArg);
+static void addEntry(ManifestParser* pParser, size_t firstArg, uint32_t lineNumber);
+static void* growArray(void* pArray, size_t* pAllocated, size_t elementSize);
+static void fixupArgumentPointers(ManifestParser* pParser);
+
+
+__throws void BatchManifest_Init(BatchManifest* pThis, const char* pFilename)
+{
+    memset(pThis, 0, sizeof(*pThis));
+    __try
+    {
+        readManifestText(pThis, pFilename);
+        parseManifestText(pThis);
+    }
+    __catch
+    {
+        BatchManifest_Uninit(pThis);
+        __rethrow;
+    }
+}
+
+__throws void BatchManifest_InitFromText(BatchManifest* pThis, const char* pText)
+{
+    memset(pThis, 0, sizeof(*pThis));
+    __try
+    {
+        copyManifestText(pThis, pText);
+        parseManifestText(pThis);
+    }
+    __catch
+    {
+        BatchManifest_Uninit(pThis);
+        __rethrow;
+    }
+}
+
+static void readManifestText(BatchManifest* pThis, const char* pFilename)
+{
+    FILE* volatile pFile = NULL;
+
+    __try
+    {
+        long fileSize = 0;
+
+        pFile = fopen(pFilename, "r");
+        if (!pFile)
+            __throw(fileException);
+        fileSize = GetFileSize(pFile);
+        pThis->pText = malloc(fileSize + 1);
+        if (!pThis->pText)
+            __throw(outOfMemoryException);
+        if ((size_t)fileSize != fread(pThis->pText, 1, fileSize, pFile))
+            __throw(fileException);
+        pThis->pText[fileSize] = '\0';
+        fclose(pFile);
+    }
+    __catch
+    {
+        if (pFile)
+            fclose(pFile);
+        __rethrow;
+    }
+}
+
+static void copyManifestText(BatchManifest* pThis, const char* pText)
+{
+    size_t size = strlen(pText) + 1;
+
+    pThis->pText = malloc(size);
+    if (!pThis->pText)
+        __throw(outOfMemoryException);
+    memcpy(pThis->pText, pText, size);
+}
+
+static void parseManifestText(BatchManifest* pThis)
+{
+    ManifestParser parser;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.pManifest = pThis;
+    parseLines(&parser);
+    fixupArgumentPointers(&parser);
+}
+
+static void parseLines(ManifestParser* pParser)
+{
+    char*    pLine = pParser->pManifest->pText;
+    uint32_t lineNumber = 1;
+
+    while (*pLine)
+    {
+        char* pNextLine = terminateLine(pLine);
+
+        parseLine(pParser, pLine, lineNumber++);
+        pLine = pNextLine;
+    }
+}
+
+static char* terminateLine(char* pLine)
+{
+    char* pEnd = pLine + strcspn(pLine, "\r\n");
+    char* pNext = pEnd;
+
+    if (*pNext == '\r')
+        pNext++;
+    if (*pNext == '\n')
+        pNext++;
+    *pEnd = '\0';
+
+    return pNext;
+}
+
+static void parseLine(ManifestParser* pParser, char* pLine, uint32_t lineNumber)
+{
+    size_t firstArg = pParser->argCount;
+    char*  p = skipBlanks(pLine);
+
+    if (*p == '\0' || *p == '#')
+        return;
+    while (*p)
+    {
+        const char* pArg;
+
+        p = skipBlanks(parseArgument(p, &pArg));
+        addArgument(pParser, pArg);
+    }
+    addEntry(pParser, firstArg, lineNumber);
+}
+
+static char* skipBlanks(char* p)
+{
+    while (isBlank(*p))
+        p++;
+    return p;
+}
+
+static int isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static char* parseArgument(char* p, const char** ppArg)
+{
+    if (*p == '"')
+    {
+        char* pClosingQuote = strchr(p + 1, '"');
+
+        if (!pClosingQuote)
+            __throw(invalidArgumentException);
+        *pClosingQuote = '\0';
+        *ppArg = p + 1;
+        return pClosingQuote + 1;
+    }
+
+    *ppArg = p;
+    while (*p && !isBlank(*p))
+        p++;
+    if (*p)
+        *p++ = '\0';
+    return p;
+}
+
+static void addArgument(ManifestParser* pParser, const char* pArg)
+{
+    BatchManifest* pManifest = pParser->pManifest;
+
+    if (pParser->argCount == pParser->argsAllocated)
+        pManifest->ppArgs = growArray(pManifest->ppArgs, &pParser->argsAllocated, sizeof(*pManifest->ppArgs));
+    pManifest->ppArgs[pParser->argCount++] = pArg;
+}
+
+static void addEntry(ManifestParser* pParser, size_t firstArg, uint32_t lineNumber)
+{
+    BatchManifest*      pManifest = pParser->pManifest;
+    BatchManifestEntry* pEntry;
+
+    if (pManifest->entryCount == pParser->entriesAllocated)
+        pManifest->pEntries = growArray(pManifest->pEntries, &pParser->entriesAllocated, sizeof(*pManifest->pEntries));
+    pEntry = &pManifest->pEntries[pManifest->entryCount++];
+    pEntry->ppArgs = (const char**)firstArg;
+    pEntry->argCount = pParser->argCount - firstArg;
+    pEntry->lineNumber = lineNumber;
+}
+
+static void* growArray(void* pArray, size_t* pAllocated, size_t elementSize)
+{
+    size_t newAllocated = *pAllocated ? *pAllocated * 2 : 16;
+    void*  pRealloc = realloc(pArray, newAllocated * elementSize);
+
+    if (!pRealloc)
+        __throw(outOfMemoryException);
+    *pAllocated = newAllocated;
+    return pRealloc;
+}
+
+static void fixupArgumentPointers(ManifestParser* pParser)
+{
+    BatchManifest* pManifest = pParser->pManifest;
+    uint32_t       i;
+
+    for (i = 0 ; i < pManifest->entryCount ; i++)
+        pManifest->pEntries[i].ppArgs = pManifest->ppArgs + (size_t)pManifest->pEntries[i].ppArgs;
+}
+
+
+void BatchManifest_Uninit(BatchManifest* pThis)
+{
+    free(pThis->pEntries);
+    free(pThis->ppArgs);
+    free(pThis->pText);
+    memset(pThis, 0, sizeof(*pThis));
+}
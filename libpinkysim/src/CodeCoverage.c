@@ -41,7 +41,8 @@ typedef struct PrivateData
     uint32_t     minCount;
 } PrivateData;
 
-static char g_errorText[256];
+/* Thread local so that pinkySim --batch can run tests with coverage on several threads. */
+static __thread char g_errorText[256];
 
 static ElfLines* parseElfAndDisplayMsgOnErrors(const char* pElfFilename);
 static void initPrivateData(PrivateData* pData,
@@ -0,0 +1,416 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <common.h>
+#include <ElfImage.h>
+#include <FileFailureInject.h>
+#include <MemorySim.h>
+#include <string.h>
+
+
+/* Only the parts of the ELF specification needed to find the loadable segments and symbols of a little endian ARM
+   executable.  Defined here rather than pulled in from <elf.h> since OS X doesn't have that header. */
+#define EI_NIDENT       16
+#define EI_CLASS        4
+#define EI_DATA         5
+#define ELFCLASS32      1
+#define ELFDATA2LSB     1
+#define EM_ARM          40
+#define PT_LOAD         1
+#define PF_W            2
+#define SHT_SYMTAB      2
+#define SHN_UNDEF       0
+
+static const uint8_t g_elfMagic[4] = { 0x7F, 'E', 'L', 'F' };
+
+typedef struct Elf32Header
+{
+    uint8_t  e_ident[EI_NIDENT];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} Elf32Header;
+
+typedef struct Elf32ProgramHeader
+{
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} Elf32ProgramHeader;
+
+typedef struct Elf32SectionHeader
+{
+    uint32_t sh_name;
+    uint32_t sh_type;
+    uint32_t sh_flags;
+    uint32_t sh_addr;
+    uint32_t sh_offset;
+    uint32_t sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    uint32_t sh_addralign;
+    uint32_t sh_entsize;
+} Elf32SectionHeader;
+
+typedef struct Elf32Symbol
+{
+    uint32_t st_name;
+    uint32_t st_value;
+    uint32_t st_size;
+    uint8_t  st_info;
+    uint8_t  st_other;
+    uint16_t st_shndx;
+} Elf32Symbol;
+
+typedef struct ElfImage
+{
+    const uint8_t*            pFileData;
+    const Elf32ProgramHeader* pProgramHeaders;
+    uint32_t                  fileSize;
+    uint32_t                  programHeaderCount;
+    uint32_t                  entryPoint;
+} ElfImage;
+
+
+static void openElfImage(ElfImage* pElf, FILE* pFile, uint32_t fileSize);
+static void validateHeader(ElfImage* pElf, const Elf32Header* pHeader);
+static void validateProgramHeaders(ElfImage* pElf);
+static void closeElfImage(ElfImage* pElf);
+static int isLoadable(const Elf32ProgramHeader* pSegment);
+static int isWritable(const Elf32ProgramHeader* pSegment);
+static int hasSeparateLoadAddress(const Elf32ProgramHeader* pSegment);
+static void createFlashRegions(IMemory* pMemory, ElfImage* pElf, FILE* pFile, ElfImageInfo* pInfo);
+static void createRamRegions(IMemory* pMemory, ElfImage* pElf);
+static int rangeContains(uint32_t baseAddress, uint32_t endAddress, uint32_t address, uint32_t size);
+static const void* segmentData(ElfImage* pElf, const Elf32ProgramHeader* pSegment);
+static uint32_t findSymbol(ElfImage* pElf, const char* pName);
+static const Elf32SectionHeader* getSectionHeaders(ElfImage* pElf, uint32_t* pSectionCount);
+static int isSectionInFile(ElfImage* pElf, const Elf32SectionHeader* pSection);
+static int findSymbolInTable(ElfImage* pElf, const Elf32SectionHeader* pSymbols, const Elf32SectionHeader* pStrings,
+                             const char* pName, uint32_t* pAddress);
+static int isNameAt(const char* pStrings, uint32_t stringsSize, uint32_t offset, const char* pName);
+
+
+int ElfImage_IsElfFile(FILE* pFile)
+{
+    uint8_t magic[sizeof(g_elfMagic)];
+    long    position = ftell(pFile);
+    int     isElf;
+
+    isElf = fread(magic, 1, sizeof(magic), pFile) == sizeof(magic) &&
+            0 == memcmp(magic, g_elfMagic, sizeof(magic));
+    fseek(pFile, position, SEEK_SET);
+    return isElf;
+}
+
+
+__throws void ElfImage_CreateRegions(IMemory* pMemory, FILE* pFile, uint32_t fileSize, ElfImageInfo* pInfo)
+{
+    ElfImage elf;
+
+    memset(pInfo, 0, sizeof(*pInfo));
+    openElfImage(&elf, pFile, fileSize);
+    __try
+    {
+        createFlashRegions(pMemory, &elf, pFile, pInfo);
+        createRamRegions(pMemory, &elf);
+        pInfo->entryPoint = elf.entryPoint;
+    }
+    __catch
+    {
+        closeElfImage(&elf);
+        __rethrow;
+    }
+    closeElfImage(&elf);
+}
+
+static void openElfImage(ElfImage* pElf, FILE* pFile, uint32_t fileSize)
+{
+    void* pMapping;
+
+    memset(pElf, 0, sizeof(*pElf));
+    if (fileSize < sizeof(Elf32Header))
+        __throw(fileException);
+    pMapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileno(pFile), 0);
+    if (pMapping == MAP_FAILED)
+        __throw(fileException);
+    pElf->pFileData = pMapping;
+    pElf->fileSize = fileSize;
+
+    __try
+    {
+        validateHeader(pElf, (const Elf32Header*)pElf->pFileData);
+        validateProgramHeaders(pElf);
+    }
+    __catch
+    {
+        closeElfImage(pElf);
+        __rethrow;
+    }
+}
+
+static void validateHeader(ElfImage* pElf, const Elf32Header* pHeader)
+{
+    if (0 != memcmp(pHeader->e_ident, g_elfMagic, sizeof(g_elfMagic)) ||
+        pHeader->e_ident[EI_CLASS] != ELFCLASS32 ||
+        pHeader->e_ident[EI_DATA] != ELFDATA2LSB ||
+        pHeader->e_machine != EM_ARM ||
+        pHeader->e_phentsize != sizeof(Elf32ProgramHeader) ||
+        pHeader->e_phoff > pElf->fileSize ||
+        (pElf->fileSize - pHeader->e_phoff) / sizeof(Elf32ProgramHeader) < pHeader->e_phnum)
+    {
+        __throw(fileException);
+    }
+    pElf->pProgramHeaders = (const Elf32ProgramHeader*)(pElf->pFileData + pHeader->e_phoff);
+    pElf->programHeaderCount = pHeader->e_phnum;
+    pElf->entryPoint = pHeader->e_entry;
+}
+
+static void validateProgramHeaders(ElfImage* pElf)
+{
+    uint32_t i;
+
+    for (i = 0 ; i < pElf->programHeaderCount ; i++)
+    {
+        const Elf32ProgramHeader* pSegment = &pElf->pProgramHeaders[i];
+
+        if (!isLoadable(pSegment))
+            continue;
+        if (pSegment->p_filesz > pSegment->p_memsz ||
+            pSegment->p_offset > pElf->fileSize ||
+            pSegment->p_filesz > pElf->fileSize - pSegment->p_offset)
+        {
+            __throw(fileException);
+        }
+    }
+}
+
+static void closeElfImage(ElfImage* pElf)
+{
+    if (pElf->pFileData)
+        munmap((void*)pElf->pFileData, pElf->fileSize);
+    pElf->pFileData = NULL;
+}
+
+static int isLoadable(const Elf32ProgramHeader* pSegment)
+{
+    return pSegment->p_type == PT_LOAD && pSegment->p_memsz > 0;
+}
+
+static int isWritable(const Elf32ProgramHeader* pSegment)
+{
+    return pSegment->p_flags & PF_W;
+}
+
+static int hasSeparateLoadAddress(const Elf32ProgramHeader* pSegment)
+{
+    return pSegment->p_paddr != pSegment->p_vaddr;
+}
+
+static void createFlashRegions(IMemory* pMemory, ElfImage* pElf, FILE* pFile, ElfImageInfo* pInfo)
+{
+    uint32_t flashEndAddress = 0;
+    uint32_t i;
+
+    pInfo->flashBaseAddress = ~0U;
+    for (i = 0 ; i < pElf->programHeaderCount ; i++)
+    {
+        const Elf32ProgramHeader* pSegment = &pElf->pProgramHeaders[i];
+
+        if (!isLoadable(pSegment) || pSegment->p_filesz == 0)
+            continue;
+        if (isWritable(pSegment) && !hasSeparateLoadAddress(pSegment))
+            continue;
+        MemorySim_CreateRegionFromFile(pMemory, pSegment->p_paddr, pSegment->p_filesz, pFile, pSegment->p_offset);
+        MemorySim_MakeRegionReadOnly(pMemory, pSegment->p_paddr);
+        if (pSegment->p_paddr < pInfo->flashBaseAddress)
+            pInfo->flashBaseAddress = pSegment->p_paddr;
+        if (pSegment->p_paddr + pSegment->p_filesz > flashEndAddress)
+            flashEndAddress = pSegment->p_paddr + pSegment->p_filesz;
+    }
+    if (flashEndAddress == 0)
+        __throw(fileException);
+    pInfo->flashSize = flashEndAddress - pInfo->flashBaseAddress;
+}
+
+static void createRamRegions(IMemory* pMemory, ElfImage* pElf)
+{
+    uint32_t endRAMAddress = IMemory_Read32(pMemory, FLASH_BASE_ADDRESS);
+    uint32_t baseRAMAddress = endRAMAddress & RAM_ADDRESS_MASK;
+    uint32_t i;
+
+    MemorySim_CreateRegion(pMemory, baseRAMAddress, endRAMAddress - baseRAMAddress);
+    for (i = 0 ; i < pElf->programHeaderCount ; i++)
+    {
+        const Elf32ProgramHeader* pSegment = &pElf->pProgramHeaders[i];
+
+        if (!isLoadable(pSegment) || !isWritable(pSegment))
+            continue;
+        if (!rangeContains(baseRAMAddress, endRAMAddress, pSegment->p_vaddr, pSegment->p_memsz))
+            MemorySim_CreateRegion(pMemory, pSegment->p_vaddr, pSegment->p_memsz);
+        /* Only .data needs to be copied.  The rest of the segment (.bss) is already zero. */
+        MemorySim_LoadImage(pMemory, pSegment->p_vaddr, segmentData(pElf, pSegment), pSegment->p_filesz);
+    }
+}
+
+static int rangeContains(uint32_t baseAddress, uint32_t endAddress, uint32_t address, uint32_t size)
+{
+    return address >= baseAddress && (uint64_t)address + size <= endAddress;
+}
+
+static const void* segmentData(ElfImage* pElf, const Elf32ProgramHeader* pSegment)
+{
+    return pElf->pFileData + pSegment->p_offset;
+}
+
+
+__throws void ElfImage_Load(IMemory* pMemory, FILE* pFile, uint32_t fileSize, ElfImageInfo* pInfo)
+{
+    ElfImage elf;
+
+    memset(pInfo, 0, sizeof(*pInfo));
+    openElfImage(&elf, pFile, fileSize);
+    __try
+    {
+        uint32_t i;
+
+        for (i = 0 ; i < elf.programHeaderCount ; i++)
+        {
+            const Elf32ProgramHeader* pSegment = &elf.pProgramHeaders[i];
+
+            if (!isLoadable(pSegment))
+                continue;
+            MemorySim_LoadImage(pMemory, pSegment->p_paddr, segmentData(&elf, pSegment), pSegment->p_filesz);
+            if (isWritable(pSegment) && hasSeparateLoadAddress(pSegment))
+                MemorySim_LoadImage(pMemory, pSegment->p_vaddr, segmentData(&elf, pSegment), pSegment->p_filesz);
+        }
+        pInfo->entryPoint = elf.entryPoint;
+    }
+    __catch
+    {
+        closeElfImage(&elf);
+        __rethrow;
+    }
+    closeElfImage(&elf);
+}
+
+
+__throws uint32_t ElfImage_FindSymbol(FILE* pFile, uint32_t fileSize, const char* pName)
+{
+    ElfImage elf;
+    uint32_t address;
+
+    openElfImage(&elf, pFile, fileSize);
+    __try
+    {
+        address = findSymbol(&elf, pName);
+    }
+    __catch
+    {
+        closeElfImage(&elf);
+        __rethrow;
+    }
+    closeElfImage(&elf);
+
+    return address;
+}
+
+static uint32_t findSymbol(ElfImage* pElf, const char* pName)
+{
+    const Elf32SectionHeader* pSections;
+    uint32_t                  sectionCount;
+    uint32_t                  address;
+    uint32_t                  i;
+
+    pSections = getSectionHeaders(pElf, &sectionCount);
+    for (i = 0 ; i < sectionCount ; i++)
+    {
+        const Elf32SectionHeader* pSymbols = &pSections[i];
+
+        if (pSymbols->sh_type != SHT_SYMTAB)
+            continue;
+        if (pSymbols->sh_link >= sectionCount)
+            __throw(fileException);
+        if (findSymbolInTable(pElf, pSymbols, &pSections[pSymbols->sh_link], pName, &address))
+            return address;
+    }
+    __throw(notFoundException);
+}
+
+static const Elf32SectionHeader* getSectionHeaders(ElfImage* pElf, uint32_t* pSectionCount)
+{
+    const Elf32Header* pHeader = (const Elf32Header*)pElf->pFileData;
+
+    /* Stripped images have no section headers at all. */
+    *pSectionCount = 0;
+    if (pHeader->e_shnum == 0)
+        return NULL;
+    if (pHeader->e_shentsize != sizeof(Elf32SectionHeader) ||
+        pHeader->e_shoff > pElf->fileSize ||
+        (pElf->fileSize - pHeader->e_shoff) / sizeof(Elf32SectionHeader) < pHeader->e_shnum)
+    {
+        __throw(fileException);
+    }
+    *pSectionCount = pHeader->e_shnum;
+    return (const Elf32SectionHeader*)(pElf->pFileData + pHeader->e_shoff);
+}
+
+static int isSectionInFile(ElfImage* pElf, const Elf32SectionHeader* pSection)
+{
+    return pSection->sh_offset <= pElf->fileSize && pSection->sh_size <= pElf->fileSize - pSection->sh_offset;
+}
+
+static int findSymbolInTable(ElfImage* pElf, const Elf32SectionHeader* pSymbols, const Elf32SectionHeader* pStrings,
+                             const char* pName, uint32_t* pAddress)
+{
+    const Elf32Symbol* pSymbol;
+    const char*        pNames;
+    uint32_t           symbolCount;
+    uint32_t           i;
+
+    if (!isSectionInFile(pElf, pSymbols) || !isSectionInFile(pElf, pStrings))
+        __throw(fileException);
+    pSymbol = (const Elf32Symbol*)(pElf->pFileData + pSymbols->sh_offset);
+    pNames = (const char*)(pElf->pFileData + pStrings->sh_offset);
+    symbolCount = pSymbols->sh_size / sizeof(Elf32Symbol);
+    for (i = 0 ; i < symbolCount ; i++, pSymbol++)
+    {
+        if (pSymbol->st_shndx != SHN_UNDEF && isNameAt(pNames, pStrings->sh_size, pSymbol->st_name, pName))
+        {
+            *pAddress = pSymbol->st_value;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static int isNameAt(const char* pStrings, uint32_t stringsSize, uint32_t offset, const char* pName)
+{
+    size_t nameSize = strlen(pName) + 1;
+
+    return offset < stringsSize && stringsSize - offset >= nameSize && 0 == memcmp(pStrings + offset, pName, nameSize);
+}
@@ -13,28 +13,52 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <common.h>
 #include <MemorySim.h>
+#include <FileFailureInject.h>
 #include <MallocFailureInject.h>
 
-/* Bit that can be set in Watchpoint::type field to flag as breakpoint and not watchpoint. */
-#define WATCHPOINT_BREAKPOINT (WatchpointType)((1 << 31) | WATCHPOINT_READ)
-
 /* Memory access types are based on watchpoint types so that watchpoint can be used as mask. */
 #define AccessType WatchpointType
 #define READING    WATCHPOINT_READ
 #define WRITING    WATCHPOINT_WRITE
-/* Even though loading data into FLASH is a write operation, we don't want bus exceptions generated. */
-#define LOADING    WATCHPOINT_READ
+/* Instruction fetches are reads which also need to be checked against the breakpoints. */
+#define FETCHING   (AccessType)((1 << 31) | WATCHPOINT_READ)
 
 /* Should this memory access be checked for break/watchpoints? */
 #define ENABLE_WATCHPOINT_CHECK     1
 #define DISABLE_WATCHPOINT_CHECK    0
 
+/* The simulated address space is split into 4k pages which are mapped to their regions through a two level page
+   table.  Each page table covers 4MB (1024 pages) and is only allocated once a region overlaps it. */
+#define PAGE_SHIFT                  12
+#define PAGE_TABLE_SHIFT            10
+#define PAGE_SIZE_BYTES             (1 << PAGE_SHIFT)
+#define PAGE_TABLE_ENTRIES          (1 << PAGE_TABLE_SHIFT)
+#define PAGE_DIRECTORY_ENTRIES      (1 << (32 - PAGE_SHIFT - PAGE_TABLE_SHIFT))
+
+/* MemorySim_SaveState() stores the contents of each region on this boundary within the file so that they can be mapped
+   back in on hosts with pages of up to 64k. */
+#define STATE_ALIGNMENT             (64 * 1024)
+
+/* The residency vector filled in by mincore() is declared differently on OS X. */
+#ifdef __APPLE__
+typedef char          MincoreVector;
+#else
+typedef unsigned char MincoreVector;
+#endif
+
 static const char g_xmlHeader[] = "<?xml version=\"1.0\"?>"
                                 "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">"
                                 "<memory-map>";
 static const char g_xmlTrailer[] = "</memory-map>";
 
+/* Checkpoint ids are unique across instances so that one can't be mistaken for an id from an earlier instance which
+   was allocated at the same address.  Updated atomically since pinkySim --batch runs simulations on several threads. */
+static uint32_t g_lastCheckpoint;
+
 
 typedef struct SizedBuffer
 {
@@ -50,35 +74,116 @@ typedef enum MatchResult
 
 } MatchResult;
 
+typedef enum RegionStateType
+{
+    REGION_STATE_MEMORY,
+    REGION_STATE_REGISTER_FILE,
+    REGION_STATE_MMIO           /* Has no contents to be saved. */
+} RegionStateType;
+
+/* MemorySim_SaveState() writes a uint64_t region count followed by one of these for each region in list order. */
+typedef struct RegionState
+{
+    uint32_t baseAddress;
+    uint32_t size;
+    uint32_t type;
+    uint32_t readOnly;
+    uint64_t contentsOffset;
+} RegionState;
+
 /* Forward Declarations */
 typedef struct MemorySim MemorySim;
 typedef struct MemoryRegion MemoryRegion;
 typedef struct Watchpoint Watchpoint;
+typedef struct RegisterFile RegisterFile;
 
 static void freeRegion(MemoryRegion* pRegion);
+static void createRegion(MemorySim* pThis, uint32_t baseAddress, uint32_t size, FILE* pImageFile, uint32_t fileOffset);
+static void createMmioRegion(MemorySim* pThis, uint32_t baseAddress, uint32_t size,
+                             MemorySimMmioRead readCallback, MemorySimMmioWrite writeCallback, void* pContext);
+static void addNewRegion(MemorySim* pThis, MemoryRegion* pRegion);
+static RegisterFile* allocateRegisterFile(uint32_t registerCount, const uint32_t* pWriteMasks);
+static uint32_t registerFileRead(void* pContext, uint32_t offset, uint32_t size);
+static void registerFileWrite(void* pContext, uint32_t offset, uint32_t size, uint32_t value);
+static void throwIfAccessStraddlesRegister(uint32_t offset, uint32_t size);
+static uint32_t accessSizeMask(uint32_t size);
+static uint32_t* findRegisterFileValue(MemorySim* pThis, uint32_t address);
 static void* throwingZeroedMalloc(size_t size);
+static void* mapImageFile(FILE* pFile, uint64_t fileOffset, uint32_t size, int protection);
+static void* mapZeroedMemory(uint32_t size);
+static void unmapMemory(void* pData, uint32_t size);
+static size_t hostPageSize(void);
 static void addRegionToTail(MemorySim* pThis, MemoryRegion* pRegion);
 static MemoryRegion* findMatchingRegion(MemorySim* pThis, uint32_t address, uint32_t size);
-static void allocateReadCountArrayForReadOnlyRegion(MemoryRegion* pRegion);
-static void load32(IMemory* pMemory, uint32_t address, uint32_t value);
-static void load8(IMemory* pMemory, uint32_t address, uint8_t value);
+static MemoryRegion* lookupPage(MemorySim* pThis, uint32_t address);
+static int regionContains(MemoryRegion* pRegion, uint32_t address, uint32_t size);
+static MemoryRegion* searchRegionList(MemorySim* pThis, uint32_t address, uint32_t size);
+static void mapRegionPages(MemorySim* pThis, MemoryRegion* pRegion);
+static MemoryRegion** allocatePageTableEntry(MemorySim* pThis, uint32_t page);
+static void unmapRegionPages(MemorySim* pThis, MemoryRegion* pRegion);
+static uint32_t lastPageOfRegion(MemoryRegion* pRegion);
+static void freePageTableIfEmpty(MemorySim* pThis, uint32_t directoryIndex);
+static void freePageTables(MemorySim* pThis);
+static void allocateReadCountArrayForReadOnlyRegion(MemorySim* pThis, MemoryRegion* pRegion);
+static void recordFlashRead(MemorySim* pThis, MemoryRegion* pRegion, uint32_t halfWordIndex);
+static void makeLastRegionFlashAndCreateRAMRegion(MemorySim* pThis, uint32_t initialStackPointer);
 static void freeLastRegion(MemorySim* pThis);
+static uint64_t countTouchedBytes(MemoryRegion* pRegion);
+static uint64_t currentFilePosition(FILE* pFile);
+static void fillRegionStates(MemorySim* pThis, RegionState* pStates, uint64_t contentsOffset);
+static void writeRegionStates(FILE* pFile, const RegionState* pStates, uint64_t regionCount);
+static RegionStateType regionStateType(MemoryRegion* pRegion);
+static void writeRegionContents(MemorySim* pThis, const RegionState* pStates, FILE* pFile);
+static uint8_t* regionContents(MemoryRegion* pRegion);
+static void writeSkippingZeroPages(FILE* pFile, const uint8_t* pData, uint32_t size);
+static int isZeroFilled(const uint8_t* pData, uint32_t size);
+static void writeToFile(FILE* pFile, const void* pData, size_t size);
+static void readRegionStates(MemorySim* pThis, RegionState* pStates, uint64_t regionCount, FILE* pFile);
+static uint64_t fileSize(FILE* pFile);
+static void readFromFile(FILE* pFile, void* pData, size_t size);
+static void loadRegionContents(MemorySim* pThis, const RegionState* pStates, void** ppContents, FILE* pFile);
+static void* readRegisterFileValues(FILE* pFile, const RegionState* pState);
+static void freeRegionContents(MemorySim* pThis, const RegionState* pStates, void** ppContents);
+static void swapRegionContents(MemorySim* pThis, const RegionState* pStates, void** ppContents);
+static void startTrackingWrites(MemoryRegion* pRegion);
+static uint32_t pageBitmapWords(MemoryRegion* pRegion);
+static void discardCheckpoint(MemorySim* pThis);
+static void freeCheckpointData(MemoryRegion* pRegion);
+static void markPagesDirty(MemoryRegion* pRegion, uint32_t address, uint32_t size);
+static int isPageBitSet(const uint32_t* pBitmap, uint32_t page);
+static void setPageBit(uint32_t* pBitmap, uint32_t page);
+static void getPageExtent(MemoryRegion* pRegion, uint32_t page, uint32_t* pOffset, uint32_t* pLength);
+static void resetDirtyPages(MemoryRegion* pRegion);
 static size_t countRegions(MemorySim* pThis);
 static void allocateMemoryMapXML(MemorySim* pThis, size_t allocSize);
 static void appendMemoryMapXmlHeader(MemorySim* pThis, SizedBuffer* pBuffer);
 static void appendMemoryMapRegions(MemorySim* pThis, SizedBuffer* pBuffer);
 static void appendMemoryMapXmlTrailer(MemorySim* pThis, SizedBuffer* pBuffer);
+static void allocateBreakpointShadowIfNeeded(MemoryRegion* pRegion);
+static uint32_t breakpointBitmapWords(MemoryRegion* pRegion);
+static uint32_t halfWordIndexInRegion(MemoryRegion* pRegion, uint32_t address);
+static void updateBreakpointBits(MemoryRegion* pRegion, uint32_t address, uint32_t size, int set);
 static void setWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type);
 static MatchResult findMatchingOrHigherWatchpoint(MemoryRegion* pRegion, Watchpoint* pKey, uint32_t* pIndex);
 static int compareWatchpoints(const void* pvKey, const void* pvCurr);
 static int watchpointsMatch(const Watchpoint* p1, const Watchpoint* p2);
 static void growWatchpointArrayIfNeeded(MemoryRegion* pRegion, uint32_t requiredSize);
+static void allocateWatchedPagesIfNeeded(MemoryRegion* pRegion);
+static uint32_t regionPageCount(MemoryRegion* pRegion);
+static uint32_t pageIndexInRegion(MemoryRegion* pRegion, uint32_t address);
+static void rebuildWatchedPages(MemoryRegion* pRegion);
 static void clearWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type);
 static void* getDataPointer(MemorySim* pThis, uint32_t address, uint32_t size, AccessType type, int checkWatchpoints);
+static void* getHostPointer(MemorySim* pThis, uint32_t address, uint32_t size, AccessType type);
+static uint32_t readMmio(MemorySim* pThis, uint32_t address, uint32_t size);
+static void writeMmio(MemorySim* pThis, uint32_t address, uint32_t size, uint32_t value);
 static void checkForBreakWatchPoint(MemorySim* pThis,
                                     MemoryRegion* pRegion,
                                     uint32_t address, uint32_t size, AccessType type);
 static int accessInRange(Watchpoint* pWatchpoint, uint32_t startAddress, uint32_t endAddress);
+static int pageHasWatchpoints(MemoryRegion* pRegion, uint32_t address);
+static int pageHasBreakpoints(MemoryRegion* pRegion, uint32_t address);
+static int isBreakpointSet(MemoryRegion* pRegion, uint32_t address);
 
 static uint32_t read32(IMemory* pMemory, uint32_t address);
 static uint16_t read16(IMemory* pMemory, uint32_t address);
@@ -86,8 +191,17 @@ static uint8_t read8(IMemory* pMemory, uint32_t address);
 static void write32(IMemory* pMemory, uint32_t address, uint32_t value);
 static void write16(IMemory* pMemory, uint32_t address, uint16_t value);
 static void write8(IMemory* pMemory, uint32_t address, uint8_t value);
-
-static IMemoryVTable g_vTable = {read32, read16, read8, write32, write16, write8};
+static uint16_t fetch16(IMemory* pMemory, uint32_t address);
+static void getFetchWindow(IMemory* pMemory, uint32_t address, IMemoryFetchWindow* pWindow);
+static void readBlock(IMemory* pMemory, uint32_t address, void* pBuffer, uint32_t size);
+static void writeBlock(IMemory* pMemory, uint32_t address, const void* pBuffer, uint32_t size);
+static void readWords(IMemory* pMemory, uint32_t address, uint32_t* pWords, uint32_t count);
+static void writeWords(IMemory* pMemory, uint32_t address, const uint32_t* pWords, uint32_t count);
+static void* getBlockPointer(MemorySim* pThis, uint32_t address, uint32_t size, AccessType type);
+static void getDataWindow(IMemory* pMemory, uint32_t address, int forWriting, IMemoryDataWindow* pWindow);
+
+static IMemoryVTable g_vTable = {read32, read16, read8, write32, write16, write8, fetch16, getFetchWindow,
+                                 readBlock, writeBlock, readWords, writeWords, getDataWindow};
 
 struct Watchpoint
 {
@@ -97,37 +211,71 @@ struct Watchpoint
 
 };
 
+struct RegisterFile
+{
+    uint32_t* pWriteMasks;
+    uint32_t  registerCount;
+    /* The write masks follow the values in the same allocation. */
+    uint32_t  values[1];
+};
+
 struct MemoryRegion
 {
     struct MemoryRegion* pNext;
+    /* Always a mmap() so that untouched pages cost nothing.  Either a private mapping of the image file or anonymous
+       memory which the OS zero fills on first touch.  NULL for MMIO regions which use the callbacks below instead. */
     uint8_t*             pData;
+    MemorySimMmioRead    mmioRead;
+    MemorySimMmioWrite   mmioWrite;
+    void*                pMmioContext;
+    /* Set for regions created by MemorySim_CreateRegisterFileRegion() and freed along with the region. */
+    RegisterFile*        pRegisterFile;
     Watchpoint*          pWatchpoints;
+    /* Non-zero for each page of the region overlapped by a watchpoint so that accesses to the other pages don't need
+       to search pWatchpoints. */
+    uint8_t*             pWatchedPages;
+    /* Breakpoints are kept apart from the watchpoints as one bit per halfword of the region and are only checked by
+       instruction fetches.  pBreakpointPageCounts follows the bitmap in the same allocation and counts the bits set in
+       each page. */
+    uint32_t*            pBreakpointBitmap;
+    uint16_t*            pBreakpointPageCounts;
     uint32_t*            pReadCounts;
+    /* Only allocated while there is a checkpoint.  pDirtyPages has a bit for each page written since the checkpoint (or
+       the last reset to it) and pSavedPages follows it in the same allocation with a bit for each page whose contents
+       at the checkpoint have already been copied into pCheckpointData.  Register files copy all of their values into
+       pCheckpointData instead. */
+    uint32_t*            pDirtyPages;
+    uint32_t*            pSavedPages;
+    uint8_t*             pCheckpointData;
     uint32_t             baseAddress;
     uint32_t             size;
     uint32_t             watchpointCount;
     uint32_t             watchpointAlloc;
+    uint32_t             breakpointCount;
     uint32_t             readCounts;
     int                  readOnly;
 };
 
 struct MemorySim
 {
-    IMemoryVTable* pVTable;
-    MemoryRegion*  pHeadRegion;
-    MemoryRegion*  pTailRegion;
-    char*          pMemoryMapXML;
-    int            watchpointEncountered;
+    IMemoryVTable*     pVTable;
+    MemoryRegion*      pHeadRegion;
+    MemoryRegion*      pTailRegion;
+    char*              pMemoryMapXML;
+    int                watchpointEncountered;
+    FlashReadCountMode flashReadCountMode;
+    uint32_t           checkpoint;
+    /* Each page maps to the first region in the list which overlaps it (or NULL). */
+    MemoryRegion**     pageDirectory[PAGE_DIRECTORY_ENTRIES];
 };
 
-static MemorySim g_object;
-
 
-IMemory* MemorySim_Init(void)
+__throws IMemory* MemorySim_Init(void)
 {
-    memset(&g_object, 0, sizeof(g_object));
-    g_object.pVTable = &g_vTable;
-    return (IMemory*)&g_object;
+    MemorySim* pThis = throwingZeroedMalloc(sizeof(*pThis));
+
+    pThis->pVTable = &g_vTable;
+    return (IMemory*)pThis;
 }
 
 
@@ -146,10 +294,9 @@ void MemorySim_Uninit(IMemory* pMemory)
         freeRegion(pCurr);
         pCurr = pNext;
     }
-    pThis->pHeadRegion = pThis->pTailRegion = NULL;
-
+    freePageTables(pThis);
     free(pThis->pMemoryMapXML);
-    pThis->pMemoryMapXML = NULL;
+    free(pThis);
 }
 
 static void freeRegion(MemoryRegion* pRegion)
@@ -157,16 +304,31 @@ static void freeRegion(MemoryRegion* pRegion)
     if (!pRegion)
         return;
 
+    freeCheckpointData(pRegion);
     free(pRegion->pReadCounts);
+    free(pRegion->pBreakpointBitmap);
+    free(pRegion->pWatchedPages);
     free(pRegion->pWatchpoints);
-    free(pRegion->pData);
+    free(pRegion->pRegisterFile);
+    if (pRegion->pData)
+        unmapMemory(pRegion->pData, pRegion->size);
     free(pRegion);
 }
 
 
 void MemorySim_CreateRegion(IMemory* pMemory, uint32_t baseAddress, uint32_t size)
 {
-    MemorySim*             pThis = (MemorySim*)pMemory;
+    createRegion((MemorySim*)pMemory, baseAddress, size, NULL, 0);
+}
+
+__throws void MemorySim_CreateRegionFromFile(IMemory* pMemory, uint32_t baseAddress, uint32_t size,
+                                             FILE* pFile, uint32_t fileOffset)
+{
+    createRegion((MemorySim*)pMemory, baseAddress, size, pFile, fileOffset);
+}
+
+static void createRegion(MemorySim* pThis, uint32_t baseAddress, uint32_t size, FILE* pImageFile, uint32_t fileOffset)
+{
     MemoryRegion* volatile pRegion = NULL;
 
     __try
@@ -174,14 +336,34 @@ void MemorySim_CreateRegion(IMemory* pMemory, uint32_t baseAddress, uint32_t siz
         pRegion = throwingZeroedMalloc(sizeof(*pRegion));
         pRegion->baseAddress = baseAddress;
         pRegion->size = size;
-        pRegion->pData = throwingZeroedMalloc(size);
-        addRegionToTail(pThis, pRegion);
+        if (pImageFile)
+            pRegion->pData = mapImageFile(pImageFile, fileOffset, size, PROT_READ | PROT_WRITE);
+        else
+            pRegion->pData = mapZeroedMemory(size);
+    }
+    __catch
+    {
+        freeRegion(pRegion);
+        __rethrow;
+    }
+    addNewRegion(pThis, pRegion);
+}
+
+static void addNewRegion(MemorySim* pThis, MemoryRegion* pRegion)
+{
+    /* The checkpoint no longer covers every region. */
+    discardCheckpoint(pThis);
+    __try
+    {
+        mapRegionPages(pThis, pRegion);
     }
     __catch
     {
+        unmapRegionPages(pThis, pRegion);
         freeRegion(pRegion);
         __rethrow;
     }
+    addRegionToTail(pThis, pRegion);
 }
 
 static void* throwingZeroedMalloc(size_t size)
@@ -193,6 +375,39 @@ static void* throwingZeroedMalloc(size_t size)
     return pvAlloc;
 }
 
+static void* mapImageFile(FILE* pFile, uint64_t fileOffset, uint32_t size, int protection)
+{
+    /* mmap() needs a page aligned file offset so map from the start of the page and skip over the extra bytes. */
+    uint32_t pageOffset = fileOffset & (hostPageSize() - 1);
+    uint8_t* pMapping = mmap(NULL, size + pageOffset, protection, MAP_PRIVATE, fileno(pFile), fileOffset - pageOffset);
+    if (pMapping == MAP_FAILED)
+        __throw(fileException);
+    return pMapping + pageOffset;
+}
+
+static void* mapZeroedMemory(uint32_t size)
+{
+    void* pMapping;
+
+    if (size == 0)
+        return NULL;
+    pMapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMapping == MAP_FAILED)
+        __throw(outOfMemoryException);
+    return pMapping;
+}
+
+static void unmapMemory(void* pData, uint32_t size)
+{
+    size_t pageOffset = (uintptr_t)pData & (hostPageSize() - 1);
+    munmap((uint8_t*)pData - pageOffset, size + pageOffset);
+}
+
+static size_t hostPageSize(void)
+{
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
 static void addRegionToTail(MemorySim* pThis, MemoryRegion* pRegion)
 {
     if (!pThis->pTailRegion)
@@ -203,55 +418,274 @@ static void addRegionToTail(MemorySim* pThis, MemoryRegion* pRegion)
 }
 
 
+__throws void MemorySim_CreateMmioRegion(IMemory* pMemory, uint32_t baseAddress, uint32_t size,
+                                         MemorySimMmioRead readCallback, MemorySimMmioWrite writeCallback, void* pContext)
+{
+    createMmioRegion((MemorySim*)pMemory, baseAddress, size, readCallback, writeCallback, pContext);
+}
+
+static void createMmioRegion(MemorySim* pThis, uint32_t baseAddress, uint32_t size,
+                             MemorySimMmioRead readCallback, MemorySimMmioWrite writeCallback, void* pContext)
+{
+    MemoryRegion* pRegion = throwingZeroedMalloc(sizeof(*pRegion));
+
+    pRegion->baseAddress = baseAddress;
+    pRegion->size = size;
+    pRegion->mmioRead = readCallback;
+    pRegion->mmioWrite = writeCallback;
+    pRegion->pMmioContext = pContext;
+    addNewRegion(pThis, pRegion);
+}
+
+
+__throws void MemorySim_CreateRegisterFileRegion(IMemory* pMemory, uint32_t baseAddress,
+                                                 uint32_t registerCount, const uint32_t* pWriteMasks)
+{
+    MemorySim*             pThis = (MemorySim*)pMemory;
+    RegisterFile* volatile pRegisterFile = NULL;
+
+    __try
+    {
+        pRegisterFile = allocateRegisterFile(registerCount, pWriteMasks);
+        createMmioRegion(pThis, baseAddress, registerCount * sizeof(uint32_t),
+                         registerFileRead, registerFileWrite, pRegisterFile);
+    }
+    __catch
+    {
+        free(pRegisterFile);
+        __rethrow;
+    }
+    pThis->pTailRegion->pRegisterFile = pRegisterFile;
+}
+
+static RegisterFile* allocateRegisterFile(uint32_t registerCount, const uint32_t* pWriteMasks)
+{
+    RegisterFile* pRegisterFile;
+    uint32_t      i;
+
+    if (registerCount == 0 || registerCount > 0x40000000)
+        __throw(invalidArgumentException);
+    pRegisterFile = throwingZeroedMalloc(sizeof(*pRegisterFile) + (2 * registerCount - 1) * sizeof(uint32_t));
+    pRegisterFile->registerCount = registerCount;
+    pRegisterFile->pWriteMasks = &pRegisterFile->values[registerCount];
+    for (i = 0 ; i < registerCount ; i++)
+        pRegisterFile->pWriteMasks[i] = pWriteMasks ? pWriteMasks[i] : 0xFFFFFFFF;
+    return pRegisterFile;
+}
+
+static uint32_t registerFileRead(void* pContext, uint32_t offset, uint32_t size)
+{
+    RegisterFile* pRegisterFile = (RegisterFile*)pContext;
+    uint32_t      shift = (offset % sizeof(uint32_t)) * 8;
+
+    throwIfAccessStraddlesRegister(offset, size);
+    return (pRegisterFile->values[offset / sizeof(uint32_t)] >> shift) & accessSizeMask(size);
+}
+
+static void registerFileWrite(void* pContext, uint32_t offset, uint32_t size, uint32_t value)
+{
+    RegisterFile* pRegisterFile = (RegisterFile*)pContext;
+    uint32_t      index = offset / sizeof(uint32_t);
+    uint32_t      shift = (offset % sizeof(uint32_t)) * 8;
+    uint32_t      mask = (accessSizeMask(size) << shift) & pRegisterFile->pWriteMasks[index];
+
+    throwIfAccessStraddlesRegister(offset, size);
+    pRegisterFile->values[index] = (pRegisterFile->values[index] & ~mask) | ((value << shift) & mask);
+}
+
+static void throwIfAccessStraddlesRegister(uint32_t offset, uint32_t size)
+{
+    if (offset % sizeof(uint32_t) + size > sizeof(uint32_t))
+        __throw(busErrorException);
+}
+
+static uint32_t accessSizeMask(uint32_t size)
+{
+    return size >= sizeof(uint32_t) ? 0xFFFFFFFF : (1U << (size * 8)) - 1;
+}
+
+
+__throws uint32_t MemorySim_GetRegisterFileValue(IMemory* pMemory, uint32_t address)
+{
+    return *findRegisterFileValue((MemorySim*)pMemory, address);
+}
+
+__throws void MemorySim_SetRegisterFileValue(IMemory* pMemory, uint32_t address, uint32_t value)
+{
+    *findRegisterFileValue((MemorySim*)pMemory, address) = value;
+}
+
+static uint32_t* findRegisterFileValue(MemorySim* pThis, uint32_t address)
+{
+    MemoryRegion* pRegion = findMatchingRegion(pThis, address, sizeof(uint32_t));
+    uint32_t      offset = address - pRegion->baseAddress;
+
+    if (!pRegion->pRegisterFile || offset % sizeof(uint32_t) != 0)
+        __throw(busErrorException);
+    return &pRegion->pRegisterFile->values[offset / sizeof(uint32_t)];
+}
+
+
 void MemorySim_MakeRegionReadOnly(IMemory* pMemory, uint32_t baseAddress)
 {
     MemorySim* pThis = (MemorySim*)pMemory;
     MemoryRegion* pRegion = findMatchingRegion(pThis, baseAddress, 1);
     pRegion->readOnly = 1;
-    allocateReadCountArrayForReadOnlyRegion(pRegion);
+    allocateReadCountArrayForReadOnlyRegion(pThis, pRegion);
 }
 
 static MemoryRegion* findMatchingRegion(MemorySim* pThis, uint32_t address, uint32_t size)
+{
+    MemoryRegion* pRegion = lookupPage(pThis, address);
+
+    if (pRegion && regionContains(pRegion, address, size))
+        return pRegion;
+    /* Only pages shared by more than one region or accesses which straddle the end of a region get here. */
+    return searchRegionList(pThis, address, size);
+}
+
+static MemoryRegion* lookupPage(MemorySim* pThis, uint32_t address)
+{
+    uint32_t       page = address >> PAGE_SHIFT;
+    MemoryRegion** pPageTable = pThis->pageDirectory[page >> PAGE_TABLE_SHIFT];
+
+    if (!pPageTable)
+        return NULL;
+    return pPageTable[page & (PAGE_TABLE_ENTRIES - 1)];
+}
+
+static int regionContains(MemoryRegion* pRegion, uint32_t address, uint32_t size)
+{
+    return address >= pRegion->baseAddress &&
+           (uint64_t)address + size <= (uint64_t)pRegion->baseAddress + pRegion->size;
+}
+
+static MemoryRegion* searchRegionList(MemorySim* pThis, uint32_t address, uint32_t size)
 {
     MemoryRegion* pCurr = pThis->pHeadRegion;
 
     while (pCurr)
     {
         MemoryRegion* pNext = pCurr->pNext;
-        if (address >= pCurr->baseAddress && (uint64_t)address + size <= (uint64_t)pCurr->baseAddress + pCurr->size)
+        if (regionContains(pCurr, address, size))
             return pCurr;
         pCurr = pNext;
     }
     __throw(busErrorException);
 }
 
-static void allocateReadCountArrayForReadOnlyRegion(MemoryRegion* pRegion)
+static void mapRegionPages(MemorySim* pThis, MemoryRegion* pRegion)
+{
+    uint32_t lastPage = lastPageOfRegion(pRegion);
+    uint32_t page;
+
+    if (pRegion->size == 0)
+        return;
+    for (page = pRegion->baseAddress >> PAGE_SHIFT ; page <= lastPage ; page++)
+    {
+        MemoryRegion** ppEntry = allocatePageTableEntry(pThis, page);
+
+        /* Regions earlier in the list take precedence, just like searchRegionList(). */
+        if (!*ppEntry)
+            *ppEntry = pRegion;
+    }
+}
+
+static MemoryRegion** allocatePageTableEntry(MemorySim* pThis, uint32_t page)
+{
+    MemoryRegion*** ppPageTable = &pThis->pageDirectory[page >> PAGE_TABLE_SHIFT];
+
+    if (!*ppPageTable)
+        *ppPageTable = throwingZeroedMalloc(PAGE_TABLE_ENTRIES * sizeof(**ppPageTable));
+    return &(*ppPageTable)[page & (PAGE_TABLE_ENTRIES - 1)];
+}
+
+static void unmapRegionPages(MemorySim* pThis, MemoryRegion* pRegion)
+{
+    uint32_t lastPage = lastPageOfRegion(pRegion);
+    uint32_t page;
+    uint32_t i;
+
+    if (pRegion->size == 0)
+        return;
+    for (page = pRegion->baseAddress >> PAGE_SHIFT ; page <= lastPage ; page++)
+    {
+        MemoryRegion** pPageTable = pThis->pageDirectory[page >> PAGE_TABLE_SHIFT];
+
+        if (pPageTable && pPageTable[page & (PAGE_TABLE_ENTRIES - 1)] == pRegion)
+            pPageTable[page & (PAGE_TABLE_ENTRIES - 1)] = NULL;
+    }
+    for (i = pRegion->baseAddress >> (PAGE_SHIFT + PAGE_TABLE_SHIFT) ; i <= lastPage >> PAGE_TABLE_SHIFT ; i++)
+        freePageTableIfEmpty(pThis, i);
+}
+
+static uint32_t lastPageOfRegion(MemoryRegion* pRegion)
+{
+    return (uint32_t)(((uint64_t)pRegion->baseAddress + pRegion->size - 1) >> PAGE_SHIFT);
+}
+
+static void freePageTableIfEmpty(MemorySim* pThis, uint32_t directoryIndex)
+{
+    MemoryRegion** pPageTable = pThis->pageDirectory[directoryIndex];
+    uint32_t       i;
+
+    if (!pPageTable)
+        return;
+    for (i = 0 ; i < PAGE_TABLE_ENTRIES ; i++)
+    {
+        if (pPageTable[i])
+            return;
+    }
+    free(pPageTable);
+    pThis->pageDirectory[directoryIndex] = NULL;
+}
+
+static void freePageTables(MemorySim* pThis)
+{
+    size_t i;
+
+    for (i = 0 ; i < PAGE_DIRECTORY_ENTRIES ; i++)
+    {
+        free(pThis->pageDirectory[i]);
+        pThis->pageDirectory[i] = NULL;
+    }
+}
+
+static void allocateReadCountArrayForReadOnlyRegion(MemorySim* pThis, MemoryRegion* pRegion)
 {
     uint32_t halfWordCount = pRegion->size / sizeof(uint16_t);
-    pRegion->pReadCounts = throwingZeroedMalloc(halfWordCount * sizeof(uint32_t));
+    size_t   allocSize;
+
+    if (pThis->flashReadCountMode == FLASH_READ_COUNT_NONE || pRegion->pReadCounts)
+        return;
+    if (pThis->flashReadCountMode == FLASH_READ_COUNT_HITS)
+        allocSize = (halfWordCount + 31) / 32 * sizeof(uint32_t);
+    else
+        allocSize = halfWordCount * sizeof(uint32_t);
+    pRegion->pReadCounts = throwingZeroedMalloc(allocSize);
     pRegion->readCounts = halfWordCount;
 }
 
 
 __throws void MemorySim_CreateRegionsFromFlashImage(IMemory* pMemory, const void* pFlashImage, uint32_t flashImageSize)
 {
-    MemorySim*      pThis = (MemorySim*)pMemory;
-
     if (flashImageSize < sizeof(uint32_t))
         __throw(bufferOverrunException);
 
     MemorySim_CreateRegion(pMemory, FLASH_BASE_ADDRESS, flashImageSize);
     MemorySim_LoadFromFlashImage(pMemory, pFlashImage, flashImageSize);
+    makeLastRegionFlashAndCreateRAMRegion((MemorySim*)pMemory, *(uint32_t*)pFlashImage);
+}
 
+static void makeLastRegionFlashAndCreateRAMRegion(MemorySim* pThis, uint32_t initialStackPointer)
+{
     __try
     {
-        uint32_t endRAMAddress;
-        uint32_t baseRAMAddress;
+        uint32_t endRAMAddress = initialStackPointer;
+        uint32_t baseRAMAddress = endRAMAddress & RAM_ADDRESS_MASK;
 
-        MemorySim_MakeRegionReadOnly(pMemory, FLASH_BASE_ADDRESS);
-        endRAMAddress = *(uint32_t*)pFlashImage;
-        baseRAMAddress =  endRAMAddress & RAM_ADDRESS_MASK;
-        MemorySim_CreateRegion(pMemory, baseRAMAddress, endRAMAddress - baseRAMAddress);
+        MemorySim_MakeRegionReadOnly((IMemory*)pThis, FLASH_BASE_ADDRESS);
+        MemorySim_CreateRegion((IMemory*)pThis, baseRAMAddress, endRAMAddress - baseRAMAddress);
     }
     __catch
     {
@@ -260,32 +694,65 @@ __throws void MemorySim_CreateRegionsFromFlashImage(IMemory* pMemory, const void
     }
 }
 
-__throws void MemorySim_LoadFromFlashImage(IMemory* pMemory, const void* pFlashImage, uint32_t flashImageSize)
+__throws void MemorySim_CreateRegionsFromFlashImageFile(IMemory* pMemory, FILE* pFile, uint32_t flashImageSize)
 {
-    const uint32_t* pSrcWord = (uint32_t*)pFlashImage;
-    uint32_t        address = FLASH_BASE_ADDRESS;
-    const uint8_t*  pSrcByte;
+    MemorySim* pThis = (MemorySim*)pMemory;
 
-    while (flashImageSize > sizeof(uint32_t))
-    {
-        load32(pMemory, address, *pSrcWord++);
-        address += sizeof(uint32_t);
-        flashImageSize -= sizeof(uint32_t);
-    }
+    if (flashImageSize < sizeof(uint32_t))
+        __throw(bufferOverrunException);
+
+    createRegion(pThis, FLASH_BASE_ADDRESS, flashImageSize, pFile, 0);
+    makeLastRegionFlashAndCreateRAMRegion(pThis, *(uint32_t*)pThis->pTailRegion->pData);
+}
 
-    pSrcByte = (const uint8_t*)pSrcWord;
-    while (flashImageSize--)
-        load8(pMemory, address++, *pSrcByte++);
+__throws void MemorySim_LoadFromFlashImage(IMemory* pMemory, const void* pFlashImage, uint32_t flashImageSize)
+{
+    MemorySim_LoadImage(pMemory, FLASH_BASE_ADDRESS, pFlashImage, flashImageSize);
 }
 
-static void load32(IMemory* pMemory, uint32_t address, uint32_t value)
+__throws void MemorySim_LoadImage(IMemory* pMemory, uint32_t address, const void* pImage, uint32_t imageSize)
 {
-    *(uint32_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint32_t), LOADING, DISABLE_WATCHPOINT_CHECK) = value;
+    MemorySim*     pThis = (MemorySim*)pMemory;
+    const uint8_t* pSrc = (const uint8_t*)pImage;
+
+    /* Copy as much as fits in each region with a single memcpy().  Loading into read-only regions is allowed. */
+    while (imageSize > 0)
+    {
+        MemoryRegion* pRegion = findMatchingRegion(pThis, address, 1);
+        uint32_t      regionOffset = address - pRegion->baseAddress;
+        uint32_t      chunkSize = pRegion->size - regionOffset;
+
+        if (chunkSize > imageSize)
+            chunkSize = imageSize;
+        if (!pRegion->pData)
+            __throw(busErrorException);
+        if (pRegion->pDirtyPages)
+            markPagesDirty(pRegion, address, chunkSize);
+        memcpy(pRegion->pData + regionOffset, pSrc, chunkSize);
+        pSrc += chunkSize;
+        address += chunkSize;
+        imageSize -= chunkSize;
+    }
 }
 
-static void load8(IMemory* pMemory, uint32_t address, uint8_t value)
+__throws void MemorySim_LoadFromFlashImageFile(IMemory* pMemory, FILE* pFile, uint32_t flashImageSize)
 {
-    *(uint8_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint8_t), LOADING, DISABLE_WATCHPOINT_CHECK) = value;
+    void* volatile pImage = NULL;
+
+    if (flashImageSize == 0)
+        return;
+
+    pImage = mapImageFile(pFile, 0, flashImageSize, PROT_READ);
+    __try
+    {
+        MemorySim_LoadFromFlashImage(pMemory, pImage, flashImageSize);
+    }
+    __catch
+    {
+        unmapMemory(pImage, flashImageSize);
+        __rethrow;
+    }
+    unmapMemory(pImage, flashImageSize);
 }
 
 static void freeLastRegion(MemorySim* pThis)
@@ -303,6 +770,8 @@ static void freeLastRegion(MemorySim* pThis)
     else
         pPrev->pNext = NULL;
     pThis->pTailRegion = pPrev;
+    if (pCurr)
+        unmapRegionPages(pThis, pCurr);
     freeRegion(pCurr);
 }
 
@@ -385,15 +854,69 @@ static void appendMemoryMapXmlTrailer(MemorySim* pThis, SizedBuffer* pBuffer)
 }
 
 
+void MemorySim_GetRAMUsage(IMemory* pMemory, uint64_t* pTotalBytes, uint64_t* pTouchedBytes)
+{
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pCurr = pThis->pHeadRegion;
+
+    *pTotalBytes = 0;
+    *pTouchedBytes = 0;
+    while (pCurr)
+    {
+        if (!pCurr->readOnly && pCurr->pData)
+        {
+            *pTotalBytes += pCurr->size;
+            *pTouchedBytes += countTouchedBytes(pCurr);
+        }
+        pCurr = pCurr->pNext;
+    }
+}
+
+static uint64_t countTouchedBytes(MemoryRegion* pRegion)
+{
+    MincoreVector residency[256];
+    size_t        pageSize = hostPageSize();
+    size_t        chunkSize = pageSize * ARRAY_SIZE(residency);
+    size_t        offset;
+    uint64_t      touchedBytes = 0;
+
+    for (offset = 0 ; offset < pRegion->size ; offset += chunkSize)
+    {
+        size_t length = pRegion->size - offset < chunkSize ? pRegion->size - offset : chunkSize;
+        size_t pageCount = (length + pageSize - 1) / pageSize;
+        size_t i;
+
+        if (mincore(pRegion->pData + offset, length, residency) != 0)
+            break;
+        for (i = 0 ; i < pageCount ; i++)
+        {
+            if (residency[i] & 1)
+                touchedBytes += pageSize;
+        }
+    }
+    return touchedBytes < pRegion->size ? touchedBytes : pRegion->size;
+}
+
+
 __throws void* MemorySim_MapSimulatedAddressToHostAddressForWrite(IMemory* pMemory, uint32_t address, uint32_t size)
 {
-    return getDataPointer((MemorySim*)pMemory, address, size, WRITING, DISABLE_WATCHPOINT_CHECK);
+    return getHostPointer((MemorySim*)pMemory, address, size, WRITING);
 }
 
 
 __throws const void* MemorySim_MapSimulatedAddressToHostAddressForRead(IMemory* pMemory, uint32_t address, uint32_t size)
 {
-    return getDataPointer((MemorySim*)pMemory, address, size, READING, DISABLE_WATCHPOINT_CHECK);
+    return getHostPointer((MemorySim*)pMemory, address, size, READING);
+}
+
+static void* getHostPointer(MemorySim* pThis, uint32_t address, uint32_t size, AccessType type)
+{
+    void* pData = getDataPointer(pThis, address, size, type, DISABLE_WATCHPOINT_CHECK);
+
+    /* MMIO regions have no host memory to hand out. */
+    if (!pData)
+        __throw(busErrorException);
+    return pData;
 }
 
 
@@ -401,64 +924,169 @@ __throws uint32_t MemorySim_GetFlashReadCount(IMemory* pMemory, uint32_t address
 {
     MemorySim*    pThis = (MemorySim*)pMemory;
     MemoryRegion* pRegion = findMatchingRegion(pThis, address, 2);
-    uint32_t      regionOffset = address - pRegion->baseAddress;
+    uint32_t      halfWordIndex = (address - pRegion->baseAddress) / sizeof(uint16_t);
 
     if (!pRegion->readOnly)
         __throw(busErrorException);
-    return pRegion->pReadCounts[regionOffset / sizeof(uint16_t)];
+    if (!pRegion->pReadCounts)
+        return 0;
+    if (pThis->flashReadCountMode == FLASH_READ_COUNT_HITS)
+        return (pRegion->pReadCounts[halfWordIndex / 32] >> (halfWordIndex % 32)) & 1;
+    return pRegion->pReadCounts[halfWordIndex];
 }
 
 
-__throws void MemorySim_SetHardwareBreakpoint(IMemory* pMemory, uint32_t address, uint32_t size)
+__throws void MemorySim_EnableFlashReadCounting(IMemory* pMemory, FlashReadCountMode mode)
 {
-    setWatchpoint(pMemory, address, size, WATCHPOINT_BREAKPOINT);
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pCurr = pThis->pHeadRegion;
+
+    pThis->flashReadCountMode = mode;
+    while (pCurr)
+    {
+        free(pCurr->pReadCounts);
+        pCurr->pReadCounts = NULL;
+        pCurr->readCounts = 0;
+        if (pCurr->readOnly)
+            allocateReadCountArrayForReadOnlyRegion(pThis, pCurr);
+        pCurr = pCurr->pNext;
+    }
 }
 
-static void setWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
+
+__throws void MemorySim_SetHardwareBreakpoint(IMemory* pMemory, uint32_t address, uint32_t size)
 {
     MemoryRegion* pRegion = findMatchingRegion((MemorySim*)pMemory, address, size);
-    uint32_t      endAddress = address + size;
-    Watchpoint    watchpoint = {type, address, endAddress};
-    uint32_t      i;
-    MatchResult   match = findMatchingOrHigherWatchpoint(pRegion, &watchpoint, &i);
 
-    if (match == FOUND)
+    allocateBreakpointShadowIfNeeded(pRegion);
+    updateBreakpointBits(pRegion, address, size, 1);
+}
+
+static void allocateBreakpointShadowIfNeeded(MemoryRegion* pRegion)
+{
+    uint32_t bitmapWords = breakpointBitmapWords(pRegion);
+
+    if (pRegion->pBreakpointBitmap)
         return;
-    growWatchpointArrayIfNeeded(pRegion, pRegion->watchpointCount + 1);
-    memmove(&pRegion->pWatchpoints[i+1],
-            &pRegion->pWatchpoints[i],
-            sizeof(*pRegion->pWatchpoints) * (pRegion->watchpointCount - i));
-    pRegion->pWatchpoints[i] = watchpoint;
-    pRegion->watchpointCount++;
+    pRegion->pBreakpointBitmap = throwingZeroedMalloc(bitmapWords * sizeof(uint32_t) +
+                                                      regionPageCount(pRegion) * sizeof(uint16_t));
+    pRegion->pBreakpointPageCounts = (uint16_t*)(pRegion->pBreakpointBitmap + bitmapWords);
 }
 
+static uint32_t breakpointBitmapWords(MemoryRegion* pRegion)
+{
+    uint64_t endAddress = (uint64_t)pRegion->baseAddress + pRegion->size;
+    uint32_t halfWordCount = (uint32_t)((endAddress + 1) >> 1) - (pRegion->baseAddress >> 1);
 
-static MatchResult findMatchingOrHigherWatchpoint(MemoryRegion* pRegion, Watchpoint* pKey, uint32_t* pIndex)
+    return (halfWordCount + 31) / 32;
+}
+
+static uint32_t halfWordIndexInRegion(MemoryRegion* pRegion, uint32_t address)
 {
-    uint32_t           i;
+    return (address >> 1) - (pRegion->baseAddress >> 1);
+}
 
-    for (i = 0 ; i < pRegion->watchpointCount ; i++)
+static void updateBreakpointBits(MemoryRegion* pRegion, uint32_t address, uint32_t size, int set)
+{
+    uint64_t endAddress = (uint64_t)address + size;
+    uint64_t halfWord;
+
+    /* Mark each halfword lying entirely within the breakpoint.  A 4-byte breakpoint therefore covers both halves of a
+       32-bit instruction while a 3-byte one (GDB's kind for 32-bit Thumb-2 instructions) only covers the first. */
+    for (halfWord = (address + 1) & ~1 ; halfWord + sizeof(uint16_t) <= endAddress ; halfWord += sizeof(uint16_t))
     {
-        int result = compareWatchpoints(pKey, &pRegion->pWatchpoints[i]);
-        if (result == 0)
+        uint32_t  index = halfWordIndexInRegion(pRegion, (uint32_t)halfWord);
+        uint32_t* pWord = &pRegion->pBreakpointBitmap[index / 32];
+        uint32_t  mask = 1 << (index % 32);
+        uint16_t* pPageCount = &pRegion->pBreakpointPageCounts[pageIndexInRegion(pRegion, (uint32_t)halfWord)];
+
+        if (set == ((*pWord & mask) != 0))
+            continue;
+        *pWord ^= mask;
+        if (set)
         {
-            *pIndex = i;
-            return FOUND;
+            (*pPageCount)++;
+            pRegion->breakpointCount++;
         }
-        else if (result < 0)
+        else
         {
-            *pIndex = i;
-            return FOUND_HIGHER;
+            (*pPageCount)--;
+            pRegion->breakpointCount--;
         }
     }
-    *pIndex = i;
-    return NOT_FOUND;
 }
 
-static int compareWatchpoints(const void* pvKey, const void* pvCurr)
+
+__throws void MemorySim_ClearHardwareBreakpoint(IMemory* pMemory, uint32_t address, uint32_t size)
 {
-    const Watchpoint* pKey = (const Watchpoint*)pvKey;
-    const Watchpoint* pCurr = (const Watchpoint*)pvCurr;
+    MemoryRegion* pRegion = findMatchingRegion((MemorySim*)pMemory, address, size);
+
+    if (!pRegion->pBreakpointBitmap)
+        return;
+    updateBreakpointBits(pRegion, address, size, 0);
+}
+
+
+__throws int MemorySim_IsHardwareBreakpointSet(IMemory* pMemory, uint32_t address)
+{
+    MemoryRegion* pRegion = findMatchingRegion((MemorySim*)pMemory, address, sizeof(uint16_t));
+
+    return isBreakpointSet(pRegion, address);
+}
+
+
+__throws void MemorySim_SetHardwareWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
+{
+    setWatchpoint(pMemory, address, size, type);
+}
+
+static void setWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
+{
+    MemoryRegion* pRegion = findMatchingRegion((MemorySim*)pMemory, address, size);
+    uint32_t      endAddress = address + size;
+    Watchpoint    watchpoint = {type, address, endAddress};
+    uint32_t      i;
+    MatchResult   match = findMatchingOrHigherWatchpoint(pRegion, &watchpoint, &i);
+
+    if (match == FOUND)
+        return;
+    allocateWatchedPagesIfNeeded(pRegion);
+    growWatchpointArrayIfNeeded(pRegion, pRegion->watchpointCount + 1);
+    memmove(&pRegion->pWatchpoints[i+1],
+            &pRegion->pWatchpoints[i],
+            sizeof(*pRegion->pWatchpoints) * (pRegion->watchpointCount - i));
+    pRegion->pWatchpoints[i] = watchpoint;
+    pRegion->watchpointCount++;
+    rebuildWatchedPages(pRegion);
+}
+
+
+static MatchResult findMatchingOrHigherWatchpoint(MemoryRegion* pRegion, Watchpoint* pKey, uint32_t* pIndex)
+{
+    uint32_t           i;
+
+    for (i = 0 ; i < pRegion->watchpointCount ; i++)
+    {
+        int result = compareWatchpoints(pKey, &pRegion->pWatchpoints[i]);
+        if (result == 0)
+        {
+            *pIndex = i;
+            return FOUND;
+        }
+        else if (result < 0)
+        {
+            *pIndex = i;
+            return FOUND_HIGHER;
+        }
+    }
+    *pIndex = i;
+    return NOT_FOUND;
+}
+
+static int compareWatchpoints(const void* pvKey, const void* pvCurr)
+{
+    const Watchpoint* pKey = (const Watchpoint*)pvKey;
+    const Watchpoint* pCurr = (const Watchpoint*)pvCurr;
 
     if (watchpointsMatch(pKey, pCurr))
         return 0;
@@ -485,10 +1113,50 @@ static void growWatchpointArrayIfNeeded(MemoryRegion* pRegion, uint32_t required
     }
 }
 
+static void allocateWatchedPagesIfNeeded(MemoryRegion* pRegion)
+{
+    if (pRegion->pWatchedPages)
+        return;
+    pRegion->pWatchedPages = throwingZeroedMalloc(regionPageCount(pRegion));
+}
 
-__throws void MemorySim_ClearHardwareBreakpoint(IMemory* pMemory, uint32_t address, uint32_t size)
+static uint32_t regionPageCount(MemoryRegion* pRegion)
+{
+    uint64_t endAddress = (uint64_t)pRegion->baseAddress + pRegion->size;
+
+    return (uint32_t)((endAddress + PAGE_SIZE_BYTES - 1) >> PAGE_SHIFT) - (pRegion->baseAddress >> PAGE_SHIFT);
+}
+
+static uint32_t pageIndexInRegion(MemoryRegion* pRegion, uint32_t address)
+{
+    return (address >> PAGE_SHIFT) - (pRegion->baseAddress >> PAGE_SHIFT);
+}
+
+static void rebuildWatchedPages(MemoryRegion* pRegion)
+{
+    uint32_t i;
+
+    /* Watchpoints are only set and cleared by the debugger so it is simpler to recalculate all of the page flags than
+       to keep reference counts for overlapping watchpoints. */
+    memset(pRegion->pWatchedPages, 0, regionPageCount(pRegion));
+    for (i = 0 ; i < pRegion->watchpointCount ; i++)
+    {
+        Watchpoint* pWatchpoint = &pRegion->pWatchpoints[i];
+        uint32_t    lastPage = pageIndexInRegion(pRegion, pWatchpoint->endAddress - 1);
+        uint32_t    page;
+
+        /* Zero length watchpoints can never be hit. */
+        if (pWatchpoint->endAddress == pWatchpoint->startAddress)
+            continue;
+        for (page = pageIndexInRegion(pRegion, pWatchpoint->startAddress) ; page <= lastPage ; page++)
+            pRegion->pWatchedPages[page] = 1;
+    }
+}
+
+
+__throws void MemorySim_ClearHardwareWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
 {
-    clearWatchpoint(pMemory, address, size, WATCHPOINT_BREAKPOINT);
+    clearWatchpoint(pMemory, address, size, type);
 }
 
 static void clearWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
@@ -505,28 +1173,476 @@ static void clearWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, W
             &pRegion->pWatchpoints[i+1],
             sizeof(*pRegion->pWatchpoints) * (pRegion->watchpointCount - i - 1));
     pRegion->watchpointCount--;
+    rebuildWatchedPages(pRegion);
 }
 
 
-__throws void MemorySim_SetHardwareWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
+int  MemorySim_WasWatchpointEncountered(IMemory* pMemory)
 {
-    setWatchpoint(pMemory, address, size, type);
+    MemorySim* pThis = (MemorySim*)pMemory;
+    int        wasEncountered = pThis->watchpointEncountered;
+
+    pThis->watchpointEncountered = 0;
+    return wasEncountered;
 }
 
 
-__throws void MemorySim_ClearHardwareWatchpoint(IMemory* pMemory, uint32_t address, uint32_t size, WatchpointType type)
+int MemorySim_HasFetchSideEffects(IMemory* pMemory)
 {
-    clearWatchpoint(pMemory, address, size, type);
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pCurr = pThis->pHeadRegion;
+
+    while (pCurr)
+    {
+        if (pCurr->watchpointCount || pCurr->breakpointCount || pCurr->pReadCounts)
+            return 1;
+        pCurr = pCurr->pNext;
+    }
+    return 0;
 }
 
 
-int  MemorySim_WasWatchpointEncountered(IMemory* pMemory)
+__throws void MemorySim_SaveState(IMemory* pMemory, FILE* pFile)
 {
-    MemorySim* pThis = (MemorySim*)pMemory;
-    int        wasEncountered = pThis->watchpointEncountered;
+    MemorySim*            pThis = (MemorySim*)pMemory;
+    RegionState* volatile pStates = NULL;
 
-    pThis->watchpointEncountered = 0;
-    return wasEncountered;
+    __try
+    {
+        uint64_t regionCount = countRegions(pThis);
+
+        pStates = throwingZeroedMalloc(regionCount * sizeof(*pStates));
+        fillRegionStates(pThis, pStates,
+                         currentFilePosition(pFile) + sizeof(regionCount) + regionCount * sizeof(*pStates));
+        writeRegionStates(pFile, pStates, regionCount);
+        writeRegionContents(pThis, pStates, pFile);
+    }
+    __catch
+    {
+        free(pStates);
+        __rethrow;
+    }
+    free(pStates);
+}
+
+static uint64_t currentFilePosition(FILE* pFile)
+{
+    long position = ftell(pFile);
+
+    if (position < 0)
+        __throw(fileException);
+    return position;
+}
+
+static void fillRegionStates(MemorySim* pThis, RegionState* pStates, uint64_t contentsOffset)
+{
+    MemoryRegion* pCurr;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext, pStates++)
+    {
+        pStates->baseAddress = pCurr->baseAddress;
+        pStates->size = pCurr->size;
+        pStates->type = regionStateType(pCurr);
+        pStates->readOnly = pCurr->readOnly;
+        if (pStates->type == REGION_STATE_MMIO)
+            continue;
+        contentsOffset = (contentsOffset + STATE_ALIGNMENT - 1) & ~(uint64_t)(STATE_ALIGNMENT - 1);
+        pStates->contentsOffset = contentsOffset;
+        contentsOffset += pCurr->size;
+    }
+}
+
+static void writeRegionStates(FILE* pFile, const RegionState* pStates, uint64_t regionCount)
+{
+    writeToFile(pFile, &regionCount, sizeof(regionCount));
+    writeToFile(pFile, pStates, regionCount * sizeof(*pStates));
+}
+
+static RegionStateType regionStateType(MemoryRegion* pRegion)
+{
+    if (pRegion->pRegisterFile)
+        return REGION_STATE_REGISTER_FILE;
+    /* Empty memory regions have no mapping and are treated like MMIO regions since they have no contents either. */
+    return pRegion->pData ? REGION_STATE_MEMORY : REGION_STATE_MMIO;
+}
+
+static void writeRegionContents(MemorySim* pThis, const RegionState* pStates, FILE* pFile)
+{
+    MemoryRegion* pCurr;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext, pStates++)
+    {
+        if (pStates->type == REGION_STATE_MMIO)
+            continue;
+        if (0 != fseek(pFile, (long)pStates->contentsOffset, SEEK_SET))
+            __throw(fileException);
+        writeSkippingZeroPages(pFile, regionContents(pCurr), pCurr->size);
+    }
+}
+
+static uint8_t* regionContents(MemoryRegion* pRegion)
+{
+    if (pRegion->pRegisterFile)
+        return (uint8_t*)pRegion->pRegisterFile->values;
+    return pRegion->pData;
+}
+
+static void writeSkippingZeroPages(FILE* pFile, const uint8_t* pData, uint32_t size)
+{
+    /* Pages which are all zero read back from holes in the file just the same so they are skipped over.  The last page
+       is always written so that the file extends to the end of the region. */
+    uint64_t offset;
+
+    for (offset = 0 ; offset < size ; offset += PAGE_SIZE_BYTES)
+    {
+        uint32_t chunkSize = size - offset < PAGE_SIZE_BYTES ? size - offset : PAGE_SIZE_BYTES;
+
+        if (offset + chunkSize < size && isZeroFilled(pData + offset, chunkSize))
+        {
+            if (0 != fseek(pFile, chunkSize, SEEK_CUR))
+                __throw(fileException);
+        }
+        else
+        {
+            writeToFile(pFile, pData + offset, chunkSize);
+        }
+    }
+}
+
+static int isZeroFilled(const uint8_t* pData, uint32_t size)
+{
+    return pData[0] == 0 && 0 == memcmp(pData, pData + 1, size - 1);
+}
+
+static void writeToFile(FILE* pFile, const void* pData, size_t size)
+{
+    if (size != fwrite(pData, 1, size, pFile))
+        __throw(fileException);
+}
+
+
+__throws void MemorySim_RestoreState(IMemory* pMemory, FILE* pFile)
+{
+    MemorySim*            pThis = (MemorySim*)pMemory;
+    RegionState* volatile pStates = NULL;
+    void** volatile       ppContents = NULL;
+
+    /* Everything is read or mapped before any region is changed so that a failure leaves the regions as they were. */
+    __try
+    {
+        uint64_t regionCount = countRegions(pThis);
+
+        pStates = throwingZeroedMalloc(regionCount * sizeof(*pStates));
+        ppContents = throwingZeroedMalloc(regionCount * sizeof(*ppContents));
+        readRegionStates(pThis, pStates, regionCount, pFile);
+        loadRegionContents(pThis, pStates, ppContents, pFile);
+    }
+    __catch
+    {
+        if (ppContents)
+            freeRegionContents(pThis, pStates, ppContents);
+        free(ppContents);
+        free(pStates);
+        __rethrow;
+    }
+    swapRegionContents(pThis, pStates, ppContents);
+    free(ppContents);
+    free(pStates);
+    discardCheckpoint(pThis);
+}
+
+static void readRegionStates(MemorySim* pThis, RegionState* pStates, uint64_t regionCount, FILE* pFile)
+{
+    uint64_t      savedRegionCount = 0;
+    uint64_t      savedFileSize = fileSize(pFile);
+    MemoryRegion* pCurr;
+
+    readFromFile(pFile, &savedRegionCount, sizeof(savedRegionCount));
+    if (savedRegionCount != regionCount)
+        __throw(invalidArgumentException);
+    readFromFile(pFile, pStates, regionCount * sizeof(*pStates));
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext, pStates++)
+    {
+        if (pStates->baseAddress != pCurr->baseAddress || pStates->size != pCurr->size ||
+            pStates->type != (uint32_t)regionStateType(pCurr) || pStates->readOnly != (uint32_t)pCurr->readOnly)
+        {
+            __throw(invalidArgumentException);
+        }
+        /* Touching a mapping past the end of the file would crash rather than fail so check before mapping it. */
+        if (pStates->type != REGION_STATE_MMIO &&
+            (pStates->contentsOffset % STATE_ALIGNMENT != 0 || pStates->contentsOffset + pStates->size > savedFileSize))
+        {
+            __throw(fileException);
+        }
+    }
+}
+
+static uint64_t fileSize(FILE* pFile)
+{
+    struct stat fileStats;
+
+    if (0 != fstat(fileno(pFile), &fileStats))
+        __throw(fileException);
+    return fileStats.st_size;
+}
+
+static void readFromFile(FILE* pFile, void* pData, size_t size)
+{
+    if (size != fread(pData, 1, size, pFile))
+        __throw(fileException);
+}
+
+static void loadRegionContents(MemorySim* pThis, const RegionState* pStates, void** ppContents, FILE* pFile)
+{
+    MemoryRegion* pCurr;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext, pStates++, ppContents++)
+    {
+        if (pStates->type == REGION_STATE_MEMORY)
+            *ppContents = mapImageFile(pFile, pStates->contentsOffset, pStates->size, PROT_READ | PROT_WRITE);
+        else if (pStates->type == REGION_STATE_REGISTER_FILE)
+            *ppContents = readRegisterFileValues(pFile, pStates);
+    }
+}
+
+static void* readRegisterFileValues(FILE* pFile, const RegionState* pState)
+{
+    void* volatile pValues = throwingZeroedMalloc(pState->size);
+
+    __try
+    {
+        if (0 != fseek(pFile, (long)pState->contentsOffset, SEEK_SET))
+            __throw(fileException);
+        readFromFile(pFile, pValues, pState->size);
+    }
+    __catch
+    {
+        free(pValues);
+        __rethrow;
+    }
+    return pValues;
+}
+
+static void freeRegionContents(MemorySim* pThis, const RegionState* pStates, void** ppContents)
+{
+    MemoryRegion* pCurr;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext, pStates++, ppContents++)
+    {
+        if (!*ppContents)
+            continue;
+        if (pStates->type == REGION_STATE_MEMORY)
+            unmapMemory(*ppContents, pCurr->size);
+        else
+            free(*ppContents);
+    }
+}
+
+static void swapRegionContents(MemorySim* pThis, const RegionState* pStates, void** ppContents)
+{
+    MemoryRegion* pCurr;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext, pStates++, ppContents++)
+    {
+        if (pStates->type == REGION_STATE_MEMORY)
+        {
+            unmapMemory(pCurr->pData, pCurr->size);
+            pCurr->pData = *ppContents;
+        }
+        else if (pStates->type == REGION_STATE_REGISTER_FILE)
+        {
+            memcpy(pCurr->pRegisterFile->values, *ppContents, pCurr->size);
+            free(*ppContents);
+        }
+    }
+}
+
+
+__throws uint32_t MemorySim_Checkpoint(IMemory* pMemory)
+{
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pCurr;
+
+    discardCheckpoint(pThis);
+    __try
+    {
+        for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext)
+            startTrackingWrites(pCurr);
+    }
+    __catch
+    {
+        discardCheckpoint(pThis);
+        __rethrow;
+    }
+    pThis->checkpoint = __sync_add_and_fetch(&g_lastCheckpoint, 1);
+    return pThis->checkpoint;
+}
+
+static void startTrackingWrites(MemoryRegion* pRegion)
+{
+    if (pRegion->pRegisterFile)
+    {
+        pRegion->pCheckpointData = throwingZeroedMalloc(pRegion->size);
+        memcpy(pRegion->pCheckpointData, pRegion->pRegisterFile->values, pRegion->size);
+    }
+    else if (pRegion->pData)
+    {
+        uint32_t words = pageBitmapWords(pRegion);
+
+        /* The saved copy is anonymous memory so only the pages actually written cost anything. */
+        pRegion->pDirtyPages = throwingZeroedMalloc(2 * words * sizeof(*pRegion->pDirtyPages));
+        pRegion->pSavedPages = pRegion->pDirtyPages + words;
+        pRegion->pCheckpointData = mapZeroedMemory(pRegion->size);
+    }
+}
+
+static uint32_t pageBitmapWords(MemoryRegion* pRegion)
+{
+    return (regionPageCount(pRegion) + 31) / 32;
+}
+
+static void discardCheckpoint(MemorySim* pThis)
+{
+    MemoryRegion* pCurr;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext)
+        freeCheckpointData(pCurr);
+    pThis->checkpoint = 0;
+}
+
+static void freeCheckpointData(MemoryRegion* pRegion)
+{
+    if (pRegion->pRegisterFile)
+        free(pRegion->pCheckpointData);
+    else if (pRegion->pCheckpointData)
+        unmapMemory(pRegion->pCheckpointData, pRegion->size);
+    free(pRegion->pDirtyPages);
+    pRegion->pCheckpointData = NULL;
+    pRegion->pDirtyPages = NULL;
+    pRegion->pSavedPages = NULL;
+}
+
+static void markPagesDirty(MemoryRegion* pRegion, uint32_t address, uint32_t size)
+{
+    uint32_t lastPage;
+    uint32_t page;
+
+    if (size == 0)
+        return;
+    lastPage = pageIndexInRegion(pRegion, address + size - 1);
+    for (page = pageIndexInRegion(pRegion, address) ; page <= lastPage ; page++)
+    {
+        uint32_t offset;
+        uint32_t length;
+
+        if (isPageBitSet(pRegion->pDirtyPages, page))
+            continue;
+        /* A page keeps its saved copy across resets since it is put back to the same contents each time. */
+        if (!isPageBitSet(pRegion->pSavedPages, page))
+        {
+            getPageExtent(pRegion, page, &offset, &length);
+            memcpy(pRegion->pCheckpointData + offset, pRegion->pData + offset, length);
+            setPageBit(pRegion->pSavedPages, page);
+        }
+        setPageBit(pRegion->pDirtyPages, page);
+    }
+}
+
+static int isPageBitSet(const uint32_t* pBitmap, uint32_t page)
+{
+    return (pBitmap[page / 32] & (1 << (page % 32))) != 0;
+}
+
+static void setPageBit(uint32_t* pBitmap, uint32_t page)
+{
+    pBitmap[page / 32] |= 1 << (page % 32);
+}
+
+static void getPageExtent(MemoryRegion* pRegion, uint32_t page, uint32_t* pOffset, uint32_t* pLength)
+{
+    /* Pages are aligned in the simulated address space so the first and last pages of a region can be partial. */
+    uint64_t regionEnd = (uint64_t)pRegion->baseAddress + pRegion->size;
+    uint64_t start = (uint64_t)((pRegion->baseAddress >> PAGE_SHIFT) + page) << PAGE_SHIFT;
+    uint64_t end = start + PAGE_SIZE_BYTES;
+
+    if (start < pRegion->baseAddress)
+        start = pRegion->baseAddress;
+    if (end > regionEnd)
+        end = regionEnd;
+    *pOffset = (uint32_t)(start - pRegion->baseAddress);
+    *pLength = (uint32_t)(end - start);
+}
+
+
+uint32_t MemorySim_GetCheckpoint(IMemory* pMemory)
+{
+    return ((MemorySim*)pMemory)->checkpoint;
+}
+
+
+uint32_t MemorySim_GetDirtyPages(IMemory* pMemory, uint32_t* pPageAddresses, uint32_t maxCount)
+{
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pCurr;
+    uint32_t      dirtyCount = 0;
+
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext)
+    {
+        uint32_t pageCount = pCurr->pDirtyPages ? regionPageCount(pCurr) : 0;
+        uint32_t page;
+
+        for (page = 0 ; page < pageCount ; page++)
+        {
+            if (!isPageBitSet(pCurr->pDirtyPages, page))
+                continue;
+            if (dirtyCount < maxCount)
+                pPageAddresses[dirtyCount] = ((pCurr->baseAddress >> PAGE_SHIFT) + page) << PAGE_SHIFT;
+            dirtyCount++;
+        }
+    }
+    return dirtyCount;
+}
+
+
+__throws void MemorySim_ResetToCheckpoint(IMemory* pMemory)
+{
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pCurr;
+
+    if (!pThis->checkpoint)
+        __throw(invalidArgumentException);
+    for (pCurr = pThis->pHeadRegion ; pCurr ; pCurr = pCurr->pNext)
+    {
+        if (pCurr->pRegisterFile)
+            memcpy(pCurr->pRegisterFile->values, pCurr->pCheckpointData, pCurr->size);
+        else if (pCurr->pDirtyPages)
+            resetDirtyPages(pCurr);
+    }
+}
+
+static void resetDirtyPages(MemoryRegion* pRegion)
+{
+    uint32_t words = pageBitmapWords(pRegion);
+    uint32_t i;
+
+    /* Whole words of clean pages are skipped so that a large region with a few dirty pages is quick to reset. */
+    for (i = 0 ; i < words ; i++)
+    {
+        uint32_t bits = pRegion->pDirtyPages[i];
+        uint32_t bit;
+
+        for (bit = 0 ; bits ; bit++, bits >>= 1)
+        {
+            uint32_t offset;
+            uint32_t length;
+
+            if ((bits & 1) == 0)
+                continue;
+            getPageExtent(pRegion, i * 32 + bit, &offset, &length);
+            memcpy(pRegion->pData + offset, pRegion->pCheckpointData + offset, length);
+        }
+        pRegion->pDirtyPages[i] = 0;
+    }
 }
 
 
@@ -534,32 +1650,203 @@ int  MemorySim_WasWatchpointEncountered(IMemory* pMemory)
 /* IMemory interface methods */
 static uint32_t read32(IMemory* pMemory, uint32_t address)
 {
-    return *(uint32_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint32_t), READING, ENABLE_WATCHPOINT_CHECK);
+    uint32_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint32_t), READING, ENABLE_WATCHPOINT_CHECK);
+    return pData ? *pData : readMmio((MemorySim*)pMemory, address, sizeof(uint32_t));
 }
 
 static uint16_t read16(IMemory* pMemory, uint32_t address)
 {
-    return *(uint16_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint16_t), READING, ENABLE_WATCHPOINT_CHECK);
+    uint16_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint16_t), READING, ENABLE_WATCHPOINT_CHECK);
+    return pData ? *pData : (uint16_t)readMmio((MemorySim*)pMemory, address, sizeof(uint16_t));
 }
 
 static uint8_t read8(IMemory* pMemory, uint32_t address)
 {
-    return *(uint8_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint8_t), READING, ENABLE_WATCHPOINT_CHECK);
+    uint8_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint8_t), READING, ENABLE_WATCHPOINT_CHECK);
+    return pData ? *pData : (uint8_t)readMmio((MemorySim*)pMemory, address, sizeof(uint8_t));
 }
 
 static void write32(IMemory* pMemory, uint32_t address, uint32_t value)
 {
-    *(uint32_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint32_t), WRITING, ENABLE_WATCHPOINT_CHECK) = value;
+    uint32_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint32_t), WRITING, ENABLE_WATCHPOINT_CHECK);
+    if (pData)
+        *pData = value;
+    else
+        writeMmio((MemorySim*)pMemory, address, sizeof(uint32_t), value);
 }
 
 static void write16(IMemory* pMemory, uint32_t address, uint16_t value)
 {
-    *(uint16_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint16_t), WRITING, ENABLE_WATCHPOINT_CHECK) = value;
+    uint16_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint16_t), WRITING, ENABLE_WATCHPOINT_CHECK);
+    if (pData)
+        *pData = value;
+    else
+        writeMmio((MemorySim*)pMemory, address, sizeof(uint16_t), value);
 }
 
 static void write8(IMemory* pMemory, uint32_t address, uint8_t value)
 {
-    *(uint8_t*)getDataPointer((MemorySim*)pMemory, address, sizeof(uint8_t), WRITING, ENABLE_WATCHPOINT_CHECK) = value;
+    uint8_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint8_t), WRITING, ENABLE_WATCHPOINT_CHECK);
+    if (pData)
+        *pData = value;
+    else
+        writeMmio((MemorySim*)pMemory, address, sizeof(uint8_t), value);
+}
+
+static uint16_t fetch16(IMemory* pMemory, uint32_t address)
+{
+    uint16_t* pData = getDataPointer((MemorySim*)pMemory, address, sizeof(uint16_t), FETCHING, ENABLE_WATCHPOINT_CHECK);
+
+    /* Code can't be executed from MMIO regions. */
+    if (!pData)
+        __throw(busErrorException);
+    return *pData;
+}
+
+static void getFetchWindow(IMemory* pMemory, uint32_t address, IMemoryFetchWindow* pWindow)
+{
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pRegion = lookupPage(pThis, address);
+    uint64_t      pageStart = address & ~(PAGE_SIZE_BYTES - 1);
+    uint64_t      start;
+    uint64_t      end;
+
+    /* An empty window sends every fetch back through here.  That is fine for unmapped pages, where the fetch is going
+       to fault anyway, and for the rare pages shared by more than one region. */
+    pWindow->pHost = NULL;
+    pWindow->start = address;
+    pWindow->size = 0;
+    if (!pRegion || !pRegion->pData || !regionContains(pRegion, address, sizeof(uint16_t)))
+        return;
+
+    /* Clip the window to the part of this page covered by the region, keeping it halfword aligned. */
+    start = pageStart > pRegion->baseAddress ? pageStart : pRegion->baseAddress;
+    end = pageStart + PAGE_SIZE_BYTES;
+    if (end > (uint64_t)pRegion->baseAddress + pRegion->size)
+        end = (uint64_t)pRegion->baseAddress + pRegion->size;
+    start = (start + 1) & ~1;
+    end &= ~1;
+    if (start > address || end <= address)
+        return;
+    pWindow->start = (uint32_t)start;
+    pWindow->size = (uint32_t)(end - start);
+
+    /* Fetches which need to hit breakpoints or bump read counts must still go through fetch16(). */
+    if (!pageHasWatchpoints(pRegion, address) && !pageHasBreakpoints(pRegion, address) && !pRegion->pReadCounts)
+        pWindow->pHost = pRegion->pData + (pWindow->start - pRegion->baseAddress);
+}
+
+static void readBlock(IMemory* pMemory, uint32_t address, void* pBuffer, uint32_t size)
+{
+    const void* pData = getBlockPointer((MemorySim*)pMemory, address, size, READING);
+    uint8_t*    pDest = (uint8_t*)pBuffer;
+
+    if (pData)
+    {
+        memcpy(pBuffer, pData, size);
+        return;
+    }
+    while (size--)
+        *pDest++ = read8(pMemory, address++);
+}
+
+static void writeBlock(IMemory* pMemory, uint32_t address, const void* pBuffer, uint32_t size)
+{
+    void*          pData = getBlockPointer((MemorySim*)pMemory, address, size, WRITING);
+    const uint8_t* pSrc = (const uint8_t*)pBuffer;
+
+    if (pData)
+    {
+        memcpy(pData, pBuffer, size);
+        return;
+    }
+    while (size--)
+        write8(pMemory, address++, *pSrc++);
+}
+
+static void readWords(IMemory* pMemory, uint32_t address, uint32_t* pWords, uint32_t count)
+{
+    const void* pData = getBlockPointer((MemorySim*)pMemory, address, count * sizeof(uint32_t), READING);
+
+    if (pData && (address & 3) == 0)
+    {
+        memcpy(pWords, pData, count * sizeof(uint32_t));
+        return;
+    }
+    for ( ; count > 0 ; count--, address += sizeof(uint32_t))
+        *pWords++ = read32(pMemory, address);
+}
+
+static void writeWords(IMemory* pMemory, uint32_t address, const uint32_t* pWords, uint32_t count)
+{
+    void* pData = getBlockPointer((MemorySim*)pMemory, address, count * sizeof(uint32_t), WRITING);
+
+    if (pData && (address & 3) == 0)
+    {
+        memcpy(pData, pWords, count * sizeof(uint32_t));
+        return;
+    }
+    for ( ; count > 0 ; count--, address += sizeof(uint32_t))
+        write32(pMemory, address, *pWords++);
+}
+
+/* Returns the host memory behind [address, address + size) when the whole block can be copied at once or NULL when
+   it has to be split into individual accesses instead: it isn't all in one memory backed region, it is a write to a
+   read-only region or one of its pages has watchpoints which need to see each access. */
+static void* getBlockPointer(MemorySim* pThis, uint32_t address, uint32_t size, AccessType type)
+{
+    MemoryRegion* pRegion = lookupPage(pThis, address);
+    uint64_t      endAddress = (uint64_t)address + size;
+    uint64_t      pageAddress;
+
+    if (size == 0 || !pRegion || !pRegion->pData || !regionContains(pRegion, address, size))
+        return NULL;
+    if (type == WRITING && pRegion->readOnly)
+        return NULL;
+    for (pageAddress = address & ~(PAGE_SIZE_BYTES - 1) ; pageAddress < endAddress ; pageAddress += PAGE_SIZE_BYTES)
+    {
+        if (pageHasWatchpoints(pRegion, (uint32_t)pageAddress))
+            return NULL;
+    }
+    if (type == WRITING && pRegion->pDirtyPages)
+        markPagesDirty(pRegion, address, size);
+    return pRegion->pData + (address - pRegion->baseAddress);
+}
+
+static void getDataWindow(IMemory* pMemory, uint32_t address, int forWriting, IMemoryDataWindow* pWindow)
+{
+    MemorySim*    pThis = (MemorySim*)pMemory;
+    MemoryRegion* pRegion = lookupPage(pThis, address);
+    uint64_t      pageStart = address & ~(PAGE_SIZE_BYTES - 1);
+    uint64_t      start;
+    uint64_t      end;
+
+    /* An empty window sends every access back through here.  That is fine for unmapped pages, where the access is
+       going to fault anyway, and for the rare pages shared by more than one region. */
+    pWindow->pHost = NULL;
+    pWindow->start = address;
+    pWindow->size = 0;
+    if (!pRegion || !regionContains(pRegion, address, sizeof(uint8_t)))
+        return;
+
+    /* Clip the window to the part of this page covered by the region, keeping it word aligned. */
+    start = pageStart > pRegion->baseAddress ? pageStart : pRegion->baseAddress;
+    end = pageStart + PAGE_SIZE_BYTES;
+    if (end > (uint64_t)pRegion->baseAddress + pRegion->size)
+        end = (uint64_t)pRegion->baseAddress + pRegion->size;
+    start = (start + 3) & ~3;
+    end &= ~3;
+    if (start > address || end <= address)
+        return;
+    pWindow->start = (uint32_t)start;
+    pWindow->size = (uint32_t)(end - start);
+
+    /* MMIO, read-only and watched pages still need the checks made by the read and write methods. */
+    if (!pRegion->pData || (forWriting && pRegion->readOnly) || pageHasWatchpoints(pRegion, address))
+        return;
+    if (forWriting && pRegion->pDirtyPages)
+        markPagesDirty(pRegion, pWindow->start, pWindow->size);
+    pWindow->pHost = pRegion->pData + (pWindow->start - pRegion->baseAddress);
 }
 
 
@@ -569,13 +1856,44 @@ static void* getDataPointer(MemorySim* pThis, uint32_t address, uint32_t size, A
     uint32_t regionOffset = address - pRegion->baseAddress;
     if (type == WRITING && pRegion->readOnly)
         __throw(busErrorException);
-    if (type == READING && size == sizeof(uint16_t) && pRegion->pReadCounts)
-        pRegion->pReadCounts[regionOffset / sizeof(uint16_t)]++;
+    if (type == FETCHING && pRegion->pReadCounts)
+        recordFlashRead(pThis, pRegion, regionOffset / sizeof(uint16_t));
     if (checkWatchpoints)
         checkForBreakWatchPoint(pThis, pRegion, address, size, type);
+    /* MMIO regions have no memory behind them so the caller hands the access to the region's callbacks instead. */
+    if (!pRegion->pData)
+        return NULL;
+    if (type == WRITING && pRegion->pDirtyPages)
+        markPagesDirty(pRegion, address, size);
     return pRegion->pData + regionOffset;
 }
 
+static uint32_t readMmio(MemorySim* pThis, uint32_t address, uint32_t size)
+{
+    MemoryRegion* pRegion = findMatchingRegion(pThis, address, size);
+
+    if (!pRegion->mmioRead)
+        __throw(busErrorException);
+    return pRegion->mmioRead(pRegion->pMmioContext, address - pRegion->baseAddress, size);
+}
+
+static void writeMmio(MemorySim* pThis, uint32_t address, uint32_t size, uint32_t value)
+{
+    MemoryRegion* pRegion = findMatchingRegion(pThis, address, size);
+
+    if (!pRegion->mmioWrite)
+        __throw(busErrorException);
+    pRegion->mmioWrite(pRegion->pMmioContext, address - pRegion->baseAddress, size, value);
+}
+
+static void recordFlashRead(MemorySim* pThis, MemoryRegion* pRegion, uint32_t halfWordIndex)
+{
+    if (pThis->flashReadCountMode == FLASH_READ_COUNT_HITS)
+        pRegion->pReadCounts[halfWordIndex / 32] |= 1U << (halfWordIndex % 32);
+    else
+        pRegion->pReadCounts[halfWordIndex]++;
+}
+
 static void checkForBreakWatchPoint(MemorySim* pThis,
                                     MemoryRegion* pRegion,
                                     uint32_t address, uint32_t size, AccessType type)
@@ -583,25 +1901,20 @@ static void checkForBreakWatchPoint(MemorySim* pThis,
     uint32_t endAddress = address + size;
     uint32_t i;
 
+    if (type == FETCHING && isBreakpointSet(pRegion, address))
+        __throw(hardwareBreakpointException);
+    /* Accesses to pages without any watchpoints, which is almost all of them, don't need any further checks. */
+    if (!pageHasWatchpoints(pRegion, address) && !pageHasWatchpoints(pRegion, endAddress - 1))
+        return;
+
     for (i = 0 ; i < pRegion->watchpointCount ; i++)
     {
         Watchpoint* pWatchpoint = &pRegion->pWatchpoints[i];
 
-        if ((type & pWatchpoint->type) == 0)
-            continue;
-        if (pWatchpoint->type == WATCHPOINT_BREAKPOINT)
-        {
-            if (size == sizeof(uint16_t) && accessInRange(pWatchpoint, address, endAddress))
-                __throw(hardwareBreakpointException);
-        }
-        else if (accessInRange(pWatchpoint, address, endAddress))
-        {
-            pThis->watchpointEncountered++;
-        }
-        else if (pWatchpoint->startAddress > address)
-        {
+        if (pWatchpoint->startAddress > address)
             return;
-        }
+        if ((type & pWatchpoint->type) && accessInRange(pWatchpoint, address, endAddress))
+            pThis->watchpointEncountered++;
     }
 }
 
@@ -609,3 +1922,20 @@ static int accessInRange(Watchpoint* pWatchpoint, uint32_t startAddress, uint32_
 {
     return startAddress >= pWatchpoint->startAddress && endAddress <= pWatchpoint->endAddress;
 }
+
+static int pageHasWatchpoints(MemoryRegion* pRegion, uint32_t address)
+{
+    return pRegion->pWatchedPages && pRegion->pWatchedPages[pageIndexInRegion(pRegion, address)];
+}
+
+static int pageHasBreakpoints(MemoryRegion* pRegion, uint32_t address)
+{
+    return pRegion->breakpointCount && pRegion->pBreakpointPageCounts[pageIndexInRegion(pRegion, address)];
+}
+
+static int isBreakpointSet(MemoryRegion* pRegion, uint32_t address)
+{
+    uint32_t index = halfWordIndexInRegion(pRegion, address);
+
+    return pRegion->breakpointCount && (pRegion->pBreakpointBitmap[index / 32] & (1 << (index % 32)));
+}
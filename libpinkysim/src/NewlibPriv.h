@@ -13,6 +13,8 @@
 #ifndef _NEWLIB_PRIV_H_
 #define _NEWLIB_PRIV_H_
 
+#include <IMemory.h>
+
 
 int handleNewlibSemihostWriteRequest(PlatformSemihostParameters* pSemihostParameters);
 int handleNewlibSemihostReadRequest(PlatformSemihostParameters* pSemihostParameters);
@@ -24,5 +26,13 @@ int handleNewlibSemihostFStatRequest(PlatformSemihostParameters* pSemihostParame
 int handleNewlibSemihostStatRequest(PlatformSemihostParameters* pSemihostParameters);
 int handleNewlibSemihostRenameRequest(PlatformSemihostParameters* pSemihostParameters);
 
+/* Memory of the simulation whose semihost request the MRI core is currently handling. */
+IMemory* mri4simGetActiveMemory(void);
+/* MemorySim_MapSimulatedAddressToHostAddressForWrite() for the active simulation which also drops any decoded
+   instructions in the range since the semihost request is about to write to it. */
+__throws void* mri4simMapActiveAddressForWrite(uint32_t address, uint32_t size);
+/* Host file descriptor to use for fileDescriptor, taking any console redirection of the simulation into account. */
+int      mri4simMapActiveConsoleFileDescriptor(int fileDescriptor);
+
 
 #endif /* _NEWLIB_PRIV_H_ */
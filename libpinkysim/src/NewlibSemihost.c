@@ -18,12 +18,12 @@
 #include <MemorySim.h>
 #include <mockFileIo.h>
 #include <mri.h>
-#include <mri4sim.h>
 #include <NewlibSemihost.h>
 #include <platforms.h>
 #include <semihost.h>
 #include <string.h>
 #include <unistd.h>
+#include "NewlibPriv.h"
 
 
 static int isConsoleOutput(uint32_t fileDescriptor);
@@ -68,8 +68,8 @@ static void writeToFile(PlatformSemihostParameters* pSemihostParameters)
 
     __try
     {
-        const void* pBuffer = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetContext()->pMemory, address, size);
-        int writeResult = write(file, pBuffer, size);
+        const void* pBuffer = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetActiveMemory(), address, size);
+        int writeResult = write(mri4simMapActiveConsoleFileDescriptor(file), pBuffer, size);
         SetSemihostReturnValues(writeResult, errno);
     }
     __catch
@@ -107,8 +107,8 @@ static void readFromFile(PlatformSemihostParameters* pSemihostParameters)
 
     __try
     {
-        void* pBuffer = MemorySim_MapSimulatedAddressToHostAddressForWrite(mri4simGetContext()->pMemory, address, size);
-        ssize_t readResult = read(file, pBuffer, size);
+        void* pBuffer = mri4simMapActiveAddressForWrite(address, size);
+        ssize_t readResult = read(mri4simMapActiveConsoleFileDescriptor(file), pBuffer, size);
         SetSemihostReturnValues(readResult, errno);
     }
     __catch
@@ -125,7 +125,7 @@ int handleNewlibSemihostOpenRequest(PlatformSemihostParameters* pSemihostParamet
     uint32_t mode = pSemihostParameters->parameter3;
     __try
     {
-        const void* pFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetContext()->pMemory,
+        const void* pFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetActiveMemory(),
                                                                                   filenameAddress,
                                                                                   filenameLength);
 
@@ -147,7 +147,7 @@ int handleNewlibSemihostUnlinkRequest(PlatformSemihostParameters* pSemihostParam
 
     __try
     {
-        const void* pFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetContext()->pMemory,
+        const void* pFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetActiveMemory(),
                                                                                   filenameAddress, filenameLength);
         int unlinkResult = unlink(pFilename);
         SetSemihostReturnValues(unlinkResult, errno);
@@ -167,7 +167,7 @@ int handleNewlibSemihostLSeekRequest(PlatformSemihostParameters* pSemihostParame
     uint32_t offset = pSemihostParameters->parameter2;
     uint32_t whence = pSemihostParameters->parameter3;
 
-    int lseekResult = lseek(fileDescriptor, offset, whence);
+    int lseekResult = lseek(mri4simMapActiveConsoleFileDescriptor(fileDescriptor), offset, whence);
     SetSemihostReturnValues(lseekResult, errno);
     FlagSemihostCallAsHandled();
     return 1;
@@ -198,10 +198,8 @@ int handleNewlibSemihostFStatRequest(PlatformSemihostParameters* pSemihostParame
     __try
     {
         struct stat hostStat;
-        CommonStat* pTargetStat = MemorySim_MapSimulatedAddressToHostAddressForWrite(mri4simGetContext()->pMemory,
-                                                                                     fileStatAddress,
-                                                                                     sizeof(*pTargetStat));
-        int fstatResult = fstat(file, &hostStat);
+        CommonStat* pTargetStat = mri4simMapActiveAddressForWrite(fileStatAddress, sizeof(*pTargetStat));
+        int fstatResult = fstat(mri4simMapActiveConsoleFileDescriptor(file), &hostStat);
         copyHostStatToCommonStat(pTargetStat, &hostStat);
         SetSemihostReturnValues(fstatResult, errno);
     }
@@ -222,11 +220,9 @@ int handleNewlibSemihostStatRequest(PlatformSemihostParameters* pSemihostParamet
     __try
     {
         struct stat hostStat;
-        const void* pFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetContext()->pMemory,
+        const void* pFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetActiveMemory(),
                                                                                   filenameAddress, filenameLength);
-        CommonStat* pTargetStat = MemorySim_MapSimulatedAddressToHostAddressForWrite(mri4simGetContext()->pMemory,
-                                                                                     fileStatAddress,
-                                                                                     sizeof(*pTargetStat));
+        CommonStat* pTargetStat = mri4simMapActiveAddressForWrite(fileStatAddress, sizeof(*pTargetStat));
         int statResult = hook_stat(pFilename, &hostStat);
         copyHostStatToCommonStat(pTargetStat, &hostStat);
         SetSemihostReturnValues(statResult, errno);
@@ -256,10 +252,10 @@ int handleNewlibSemihostRenameRequest(PlatformSemihostParameters* pSemihostParam
 
     __try
     {
-        const void* pOrigFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetContext()->pMemory,
+        const void* pOrigFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetActiveMemory(),
                                                                                       origFilenameAddress,
                                                                                       origFilenameLength);
-        const void* pNewFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetContext()->pMemory,
+        const void* pNewFilename = MemorySim_MapSimulatedAddressToHostAddressForRead(mri4simGetActiveMemory(),
                                                                                      newFilenameAddress,
                                                                                      newFilenameLength);
         int renameResult = rename(pOrigFilename, pNewFilename);
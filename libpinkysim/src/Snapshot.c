@@ -0,0 +1,269 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <string.h>
+#include <common.h>
+#include <FileFailureInject.h>
+#include <MallocFailureInject.h>
+#include <MemorySim.h>
+#include <Snapshot.h>
+
+
+#define SNAPSHOT_VERSION 1
+
+static const char g_signature[8] = {'p', 'i', 'n', 'k', 'y', 'S', 'i', 'm'};
+static const char g_temporaryName[] = "temporary snapshot file";
+
+/* Thread local so that pinkySim --batch can load state on several threads. */
+static __thread char g_errorText[256];
+
+
+/* Start of every state file.  It is followed by the memory contents written by MemorySim_SaveState(). */
+typedef struct SnapshotHeader
+{
+    char     signature[8];
+    uint32_t version;
+    uint32_t R[13];
+    uint32_t spMain;
+    uint32_t lr;
+    uint32_t pc;
+    uint32_t xPSR;
+    uint32_t PRIMASK;
+    uint32_t CONTROL;
+    uint64_t cycleCount;
+    uint64_t cyccntBase;
+} SnapshotHeader;
+
+struct Snapshot
+{
+    FILE*          pFile;
+    /* While pMemory's current checkpoint is the one taken along with this snapshot, restoring into it only needs to
+       reset the pages written since then and apply the saved registers. */
+    IMemory*       pMemory;
+    uint32_t       checkpoint;
+    SnapshotHeader header;
+};
+
+
+static void writeState(PinkySimContext* pContext, FILE* pFile, const char* pName);
+static void fillHeader(SnapshotHeader* pHeader, PinkySimContext* pContext);
+static void readState(PinkySimContext* pContext, FILE* pFile, const char* pName);
+static int isValidHeader(const SnapshotHeader* pHeader);
+static void applyHeader(const SnapshotHeader* pHeader, PinkySimContext* pContext);
+static void checkpointMemory(Snapshot* pThis, PinkySimContext* pContext);
+static int isCheckpointCurrent(Snapshot* pThis, PinkySimContext* pContext);
+static void throwStateException(const char* pFormat, const char* pName);
+
+
+__throws void Snapshot_Save(PinkySimContext* pContext, const char* pFilename)
+{
+    FILE* volatile pFile = NULL;
+
+    __try
+    {
+        pFile = fopen(pFilename, "wb");
+        if (!pFile)
+            throwStateException("Failed to create %s.", pFilename);
+        writeState(pContext, pFile, pFilename);
+    }
+    __catch
+    {
+        /* Don't leave a partial state file around to be loaded later. */
+        if (pFile)
+        {
+            fclose(pFile);
+            remove(pFilename);
+        }
+        __rethrow;
+    }
+    fclose(pFile);
+}
+
+static void writeState(PinkySimContext* pContext, FILE* pFile, const char* pName)
+{
+    SnapshotHeader header;
+
+    fillHeader(&header, pContext);
+    __try
+    {
+        if (1 != fwrite(&header, sizeof(header), 1, pFile))
+            __throw(fileException);
+        MemorySim_SaveState(pContext->pMemory, pFile);
+        if (0 != fflush(pFile))
+            __throw(fileException);
+    }
+    __catch
+    {
+        throwStateException("Failed to write machine state to %s.", pName);
+    }
+}
+
+static void fillHeader(SnapshotHeader* pHeader, PinkySimContext* pContext)
+{
+    memset(pHeader, 0, sizeof(*pHeader));
+    memcpy(pHeader->signature, g_signature, sizeof(pHeader->signature));
+    pHeader->version = SNAPSHOT_VERSION;
+    memcpy(pHeader->R, pContext->R, sizeof(pHeader->R));
+    pHeader->spMain = pContext->spMain;
+    pHeader->lr = pContext->lr;
+    pHeader->pc = pContext->pc;
+    pHeader->xPSR = pContext->xPSR;
+    pHeader->PRIMASK = pContext->PRIMASK;
+    pHeader->CONTROL = pContext->CONTROL;
+    pHeader->cycleCount = pContext->cycleCounter.count;
+    pHeader->cyccntBase = pContext->cycleCounter.cyccntBase;
+}
+
+
+__throws void Snapshot_Load(PinkySimContext* pContext, const char* pFilename)
+{
+    FILE* volatile pFile = NULL;
+
+    __try
+    {
+        pFile = fopen(pFilename, "rb");
+        if (!pFile)
+            throwStateException("Failed to open %s.", pFilename);
+        readState(pContext, pFile, pFilename);
+    }
+    __catch
+    {
+        if (pFile)
+            fclose(pFile);
+        __rethrow;
+    }
+    /* The memory regions keep their own mappings of the file so it doesn't need to stay open. */
+    fclose(pFile);
+}
+
+static void readState(PinkySimContext* pContext, FILE* pFile, const char* pName)
+{
+    SnapshotHeader header;
+
+    if (1 != fread(&header, sizeof(header), 1, pFile) || !isValidHeader(&header))
+        throwStateException("%s isn't a pinkySim machine state file.", pName);
+    __try
+    {
+        MemorySim_RestoreState(pContext->pMemory, pFile);
+    }
+    __catch
+    {
+        if (getExceptionCode() == invalidArgumentException)
+            throwStateException("%s was saved from a simulation with different memory regions.", pName);
+        throwStateException("Failed to read machine state from %s.", pName);
+    }
+    applyHeader(&header, pContext);
+    pinkySimFlushDecodeCache(pContext);
+}
+
+static int isValidHeader(const SnapshotHeader* pHeader)
+{
+    return 0 == memcmp(pHeader->signature, g_signature, sizeof(pHeader->signature)) &&
+           pHeader->version == SNAPSHOT_VERSION;
+}
+
+static void applyHeader(const SnapshotHeader* pHeader, PinkySimContext* pContext)
+{
+    memcpy(pContext->R, pHeader->R, sizeof(pContext->R));
+    pContext->spMain = pHeader->spMain;
+    pContext->lr = pHeader->lr;
+    pContext->pc = pHeader->pc;
+    pContext->xPSR = pHeader->xPSR;
+    pContext->PRIMASK = pHeader->PRIMASK;
+    pContext->CONTROL = pHeader->CONTROL;
+    pContext->cycleCounter.count = pHeader->cycleCount;
+    pContext->cycleCounter.cyccntBase = pHeader->cyccntBase;
+}
+
+
+__throws Snapshot* Snapshot_Take(PinkySimContext* pContext)
+{
+    Snapshot* volatile pThis = NULL;
+
+    __try
+    {
+        pThis = malloc(sizeof(*pThis));
+        if (!pThis)
+            throwStateException("Failed to allocate memory for %s.", g_temporaryName);
+        memset(pThis, 0, sizeof(*pThis));
+        pThis->pFile = tmpfile();
+        if (!pThis->pFile)
+            throwStateException("Failed to create %s.", g_temporaryName);
+        writeState(pContext, pThis->pFile, g_temporaryName);
+    }
+    __catch
+    {
+        Snapshot_Free(pThis);
+        __rethrow;
+    }
+    checkpointMemory(pThis, pContext);
+    return pThis;
+}
+
+static void checkpointMemory(Snapshot* pThis, PinkySimContext* pContext)
+{
+    fillHeader(&pThis->header, pContext);
+    pThis->pMemory = pContext->pMemory;
+    __try
+    {
+        pThis->checkpoint = MemorySim_Checkpoint(pContext->pMemory);
+    }
+    __catch
+    {
+        /* Restores just fall back to reading the whole temporary file. */
+        pThis->checkpoint = 0;
+        clearExceptionCode();
+    }
+}
+
+__throws void Snapshot_Restore(Snapshot* pThis, PinkySimContext* pContext)
+{
+    if (isCheckpointCurrent(pThis, pContext))
+    {
+        MemorySim_ResetToCheckpoint(pContext->pMemory);
+        applyHeader(&pThis->header, pContext);
+        pinkySimFlushDecodeCache(pContext);
+        return;
+    }
+    if (0 != fseek(pThis->pFile, 0, SEEK_SET))
+        throwStateException("Failed to read machine state from %s.", g_temporaryName);
+    readState(pContext, pThis->pFile, g_temporaryName);
+    checkpointMemory(pThis, pContext);
+}
+
+static int isCheckpointCurrent(Snapshot* pThis, PinkySimContext* pContext)
+{
+    return pThis->checkpoint && pContext->pMemory == pThis->pMemory &&
+           MemorySim_GetCheckpoint(pContext->pMemory) == pThis->checkpoint;
+}
+
+void Snapshot_Free(Snapshot* pThis)
+{
+    if (!pThis)
+        return;
+    if (pThis->pFile)
+        fclose(pThis->pFile);
+    free(pThis);
+}
+
+
+const char* Snapshot_GetErrorText(void)
+{
+    return g_errorText;
+}
+
+static void throwStateException(const char* pFormat, const char* pName)
+{
+    snprintf(g_errorText, sizeof(g_errorText), pFormat, pName);
+    clearExceptionCode();
+    __throw(stateException);
+}
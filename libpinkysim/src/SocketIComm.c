@@ -12,8 +12,10 @@
 */
 #include <assert.h>
 #include <common.h>
+#include <MallocFailureInject.h>
 #include <mockSock.h>
 #include <netdb.h>
+#include <signal.h>
 #include <SocketIComm.h>
 #include <string.h>
 
@@ -29,27 +31,44 @@ static int  isGdbConnected(IComm* pComm);
 
 static ICommVTable g_icommVTable = {hasReceiveData, receiveChar, sendChar, shouldStopRun, isGdbConnected};
 
-static struct SocketIComm
+struct SocketIComm
 {
     ICommVTable* pVTable;
     void         (*waitingConnectCallback)(void);
     int          listenSocket;
     int          gdbSocket;
-} g_comm = {&g_icommVTable, NULL, -1, -1};
+    int          isSigIoHandlerInstalled;
+    int          isListenSocketAsync;
+    int          isGdbSocketAsync;
+};
 
+/* SIGIO is a process wide resource so only one instance at a time can use it for async notification.  The rest
+   fall back to calling select() on each poll. */
+static SocketIComm* volatile g_pSigIoOwner;
+static struct sigaction      g_oldSigIoAction;
 
+/* Set by the SIGIO handler when one of the sockets has had activity since it was last polled.  It starts out set so
+   that the first poll of each socket always goes out to select(). */
+static volatile sig_atomic_t g_ioSignalled = 1;
+
+
+static SocketIComm* allocateSocketIComm(void);
 static void createListenSocket(SocketIComm* pThis);
 static void bindListenSocket(SocketIComm* pThis, uint16_t gdbPort);
 static void allowBindToReuseAddress(SocketIComm* pThis);
 static void listenOnSocket(SocketIComm* pThis);
+static void installSigIoHandler(SocketIComm* pThis);
+static void sigIoHandler(int signalNumber);
+static int enableAsyncNotification(SocketIComm* pThis, int socket);
 static void waitForGdbConnectIfNecessary(SocketIComm* pThis);
+static int asyncSocketHasDataToRead(int socket, int isAsync);
 static int socketHasDataToRead(int socket);
 static int receiveNextCharFromGdb(SocketIComm* pThis);
 
 
 __throws IComm* SocketIComm_Init(uint16_t gdbPort, void (*waitingConnectCallback)(void))
 {
-    SocketIComm* pThis = &g_comm;
+    SocketIComm* pThis = allocateSocketIComm();
 
     __try
     {
@@ -67,6 +86,19 @@ __throws IComm* SocketIComm_Init(uint16_t gdbPort, void (*waitingConnectCallback
     return (IComm*)pThis;
 }
 
+static SocketIComm* allocateSocketIComm(void)
+{
+    SocketIComm* pThis = malloc(sizeof(*pThis));
+
+    if (!pThis)
+        __throw(outOfMemoryException);
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->pVTable = &g_icommVTable;
+    pThis->listenSocket = -1;
+    pThis->gdbSocket = -1;
+    return pThis;
+}
+
 static void createListenSocket(SocketIComm* pThis)
 {
     pThis->listenSocket = socket(PF_INET, SOCK_STREAM, 0);
@@ -101,6 +133,49 @@ static void listenOnSocket(SocketIComm* pThis)
     int result = listen(pThis->listenSocket, 0);
     if (result == -1)
         __throw(socketException);
+    installSigIoHandler(pThis);
+    pThis->isListenSocketAsync = enableAsyncNotification(pThis, pThis->listenSocket);
+}
+
+static void installSigIoHandler(SocketIComm* pThis)
+{
+    struct sigaction action;
+
+    if (!__sync_bool_compare_and_swap(&g_pSigIoOwner, NULL, pThis))
+        return;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sigIoHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    pThis->isSigIoHandlerInstalled = (sigaction(SIGIO, &action, &g_oldSigIoAction) == 0);
+    if (!pThis->isSigIoHandlerInstalled)
+        g_pSigIoOwner = NULL;
+}
+
+static void sigIoHandler(int signalNumber)
+{
+    g_ioSignalled = 1;
+}
+
+static int enableAsyncNotification(SocketIComm* pThis, int socket)
+{
+    int flags = -1;
+
+    /* Have the kernel send SIGIO to this process on socket activity so that polling for GDB data between instructions
+       only needs to check g_ioSignalled rather than making a select() syscall each time.  Falls back to always polling
+       if any of this isn't supported. */
+    if (!pThis->isSigIoHandlerInstalled)
+        return FALSE;
+    if (fcntl(socket, F_SETOWN, getpid()) == -1)
+        return FALSE;
+    flags = fcntl(socket, F_GETFL);
+    if (flags == -1)
+        return FALSE;
+    if (fcntl(socket, F_SETFL, flags | O_ASYNC) == -1)
+        return FALSE;
+    g_ioSignalled = 1;
+
+    return TRUE;
 }
 
 
@@ -111,17 +186,17 @@ void SocketIComm_Uninit(IComm* pComm)
     if (!pThis)
         return;
 
-    pThis->waitingConnectCallback = NULL;
     if (pThis->gdbSocket != -1)
-    {
         close(pThis->gdbSocket);
-        pThis->gdbSocket = -1;
-    }
     if (pThis->listenSocket != -1)
-    {
         close(pThis->listenSocket);
-        pThis->listenSocket = -1;
+    if (pThis->isSigIoHandlerInstalled)
+    {
+        sigaction(SIGIO, &g_oldSigIoAction, NULL);
+        g_ioSignalled = 1;
+        g_pSigIoOwner = NULL;
     }
+    free(pThis);
 }
 
 
@@ -135,7 +210,7 @@ static int hasReceiveData(IComm* pComm)
     __try
     {
         waitForGdbConnectIfNecessary(pThis);
-        hasData = socketHasDataToRead(pThis->gdbSocket);
+        hasData = asyncSocketHasDataToRead(pThis->gdbSocket, pThis->isGdbSocketAsync);
     }
     __catch
     {
@@ -157,6 +232,26 @@ static void waitForGdbConnectIfNecessary(SocketIComm* pThis)
     pThis->gdbSocket = accept(pThis->listenSocket, (struct sockaddr*)&remoteAddress, &remoteAddressSize);
     if (pThis->gdbSocket == -1)
         __throw(socketException);
+    pThis->isGdbSocketAsync = enableAsyncNotification(pThis, pThis->gdbSocket);
+}
+
+static int asyncSocketHasDataToRead(int socket, int isAsync)
+{
+    int hasData = FALSE;
+
+    if (!isAsync)
+        return socketHasDataToRead(socket);
+    if (!g_ioSignalled)
+        return FALSE;
+
+    /* Clear the flag before polling so that a signal which arrives during the select() isn't lost.  Leave it set while
+       data remains so that the caller keeps seeing it until it has been read. */
+    g_ioSignalled = 0;
+    hasData = socketHasDataToRead(socket);
+    if (hasData)
+        g_ioSignalled = 1;
+
+    return hasData;
 }
 
 static int socketHasDataToRead(int socket)
@@ -194,6 +289,8 @@ static int receiveNextCharFromGdb(SocketIComm* pThis)
         /* GDB has closed its side of the socket connection. */
         close(pThis->gdbSocket);
         pThis->gdbSocket = -1;
+        pThis->isGdbSocketAsync = FALSE;
+        g_ioSignalled = 1;
         return 0;
     }
     return c;
@@ -223,5 +320,5 @@ static int  isGdbConnected(IComm* pComm)
     if (pThis->gdbSocket != -1)
         return TRUE;
 
-    return socketHasDataToRead(pThis->listenSocket);
+    return asyncSocketHasDataToRead(pThis->listenSocket, pThis->isListenSocketAsync);
 }
@@ -0,0 +1,226 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <MallocFailureInject.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <WorkPool.h>
+
+
+typedef struct WorkPool WorkPool;
+
+/* The items [next, end) which are still waiting to be run by this worker. */
+typedef struct Worker
+{
+    WorkPool*       pPool;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    uint32_t        next;
+    uint32_t        end;
+    int             isThreadStarted;
+} Worker;
+
+struct WorkPool
+{
+    Worker*          pWorkers;
+    WorkPoolCallback callback;
+    void*            pContext;
+    uint32_t         workerCount;
+};
+
+
+static void initWorkers(WorkPool* pPool, uint32_t itemCount);
+static void startThreads(WorkPool* pPool);
+static void* threadMain(void* pArg);
+static void runWorker(Worker* pWorker);
+static int takeNextItem(Worker* pWorker, uint32_t* pItem);
+static int stealItems(Worker* pThief, uint32_t* pItem);
+static Worker* findWorkerWithMostItemsLeft(WorkPool* pPool);
+static int stealBackHalf(Worker* pThief, Worker* pVictim, uint32_t* pItem);
+static uint32_t itemsLeft(Worker* pWorker);
+static void waitForThreads(WorkPool* pPool);
+
+
+__throws void WorkPool_Run(uint32_t threadCount, uint32_t itemCount, WorkPoolCallback callback, void* pContext)
+{
+    WorkPool pool;
+
+    if (itemCount == 0)
+        return;
+    if (threadCount == 0)
+        threadCount = WorkPool_GetDefaultThreadCount();
+    if (threadCount > itemCount)
+        threadCount = itemCount;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.pWorkers = malloc(threadCount * sizeof(*pool.pWorkers));
+    if (!pool.pWorkers)
+        __throw(outOfMemoryException);
+    pool.workerCount = threadCount;
+    pool.callback = callback;
+    pool.pContext = pContext;
+
+    initWorkers(&pool, itemCount);
+    startThreads(&pool);
+    runWorker(&pool.pWorkers[0]);
+    waitForThreads(&pool);
+    free(pool.pWorkers);
+}
+
+static void initWorkers(WorkPool* pPool, uint32_t itemCount)
+{
+    uint32_t start = 0;
+    uint32_t i;
+
+    for (i = 0 ; i < pPool->workerCount ; i++)
+    {
+        Worker* pWorker = &pPool->pWorkers[i];
+        /* Spread the remainder over the first few workers so that shares differ by at most one item. */
+        uint32_t share = itemCount / pPool->workerCount + (i < itemCount % pPool->workerCount ? 1 : 0);
+
+        memset(pWorker, 0, sizeof(*pWorker));
+        pWorker->pPool = pPool;
+        pthread_mutex_init(&pWorker->lock, NULL);
+        pWorker->next = start;
+        pWorker->end = start + share;
+        start += share;
+    }
+}
+
+static void startThreads(WorkPool* pPool)
+{
+    uint32_t i;
+
+    /* Worker 0 runs on the calling thread.  If a thread can't be created then the other workers just end up stealing
+       its share. */
+    for (i = 1 ; i < pPool->workerCount ; i++)
+    {
+        Worker* pWorker = &pPool->pWorkers[i];
+
+        pWorker->isThreadStarted = (0 == pthread_create(&pWorker->thread, NULL, threadMain, pWorker));
+    }
+}
+
+static void* threadMain(void* pArg)
+{
+    runWorker((Worker*)pArg);
+    return NULL;
+}
+
+static void runWorker(Worker* pWorker)
+{
+    WorkPool* pPool = pWorker->pPool;
+    uint32_t  item;
+
+    while (takeNextItem(pWorker, &item) || stealItems(pWorker, &item))
+        pPool->callback(pPool->pContext, item);
+}
+
+static int takeNextItem(Worker* pWorker, uint32_t* pItem)
+{
+    int isItemAvailable;
+
+    pthread_mutex_lock(&pWorker->lock);
+    isItemAvailable = pWorker->next < pWorker->end;
+    if (isItemAvailable)
+        *pItem = pWorker->next++;
+    pthread_mutex_unlock(&pWorker->lock);
+
+    return isItemAvailable;
+}
+
+static int stealItems(Worker* pThief, uint32_t* pItem)
+{
+    Worker* pVictim;
+
+    /* The victim may have run out of items since it was picked so keep looking until no worker has any left. */
+    while ((pVictim = findWorkerWithMostItemsLeft(pThief->pPool)) != NULL)
+    {
+        if (stealBackHalf(pThief, pVictim, pItem))
+            return 1;
+    }
+    return 0;
+}
+
+static Worker* findWorkerWithMostItemsLeft(WorkPool* pPool)
+{
+    Worker*  pBusiest = NULL;
+    uint32_t mostItemsLeft = 0;
+    uint32_t i;
+
+    for (i = 0 ; i < pPool->workerCount ; i++)
+    {
+        uint32_t count = itemsLeft(&pPool->pWorkers[i]);
+
+        if (count > mostItemsLeft)
+        {
+            pBusiest = &pPool->pWorkers[i];
+            mostItemsLeft = count;
+        }
+    }
+    return pBusiest;
+}
+
+static int stealBackHalf(Worker* pThief, Worker* pVictim, uint32_t* pItem)
+{
+    uint32_t start;
+    uint32_t end;
+
+    pthread_mutex_lock(&pVictim->lock);
+    end = pVictim->end;
+    start = end - (end - pVictim->next + 1) / 2;
+    pVictim->end = start;
+    pthread_mutex_unlock(&pVictim->lock);
+    if (start == end)
+        return 0;
+
+    pthread_mutex_lock(&pThief->lock);
+    pThief->next = start + 1;
+    pThief->end = end;
+    pthread_mutex_unlock(&pThief->lock);
+    *pItem = start;
+
+    return 1;
+}
+
+static uint32_t itemsLeft(Worker* pWorker)
+{
+    uint32_t count;
+
+    pthread_mutex_lock(&pWorker->lock);
+    count = pWorker->end - pWorker->next;
+    pthread_mutex_unlock(&pWorker->lock);
+
+    return count;
+}
+
+static void waitForThreads(WorkPool* pPool)
+{
+    uint32_t i;
+
+    for (i = 1 ; i < pPool->workerCount ; i++)
+    {
+        if (pPool->pWorkers[i].isThreadStarted)
+            pthread_join(pPool->pWorkers[i].thread, NULL);
+    }
+    for (i = 0 ; i < pPool->workerCount ; i++)
+        pthread_mutex_destroy(&pPool->pWorkers[i].lock);
+}
+
+
+uint32_t WorkPool_GetDefaultThreadCount(void)
+{
+    long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return processorCount > 0 ? (uint32_t)processorCount : 1;
+}
@@ -13,6 +13,8 @@
 #include <common.h>
 #include <gdb_console.h>
 #include <IMemory.h>
+#include <MallocFailureInject.h>
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
 #include <MemorySim.h>
@@ -22,6 +24,8 @@
 #include <platforms.h>
 #include <printfSpy.h>
 #include <semihost.h>
+#include <Snapshot.h>
+#include <unistd.h>
 #include "NewlibPriv.h"
 
 
@@ -81,92 +85,440 @@ static const char g_targetXML[] =
     "</target>\n";
 
 
-static PinkySimContext g_context;
-static IComm*          g_pComm;
-static char            g_packetBuffer[16 * 1024];
-static int             g_runResult;
-static uint32_t        g_pcOrig;
-static int             g_singleStepping;
-static int             g_memoryFaultEncountered;
+/* A breakpoint which the simulator sets for itself.  The breakpoint bitmap doesn't count references so one which
+   shares its address with a GDB breakpoint must be left in place when the simulator is done with it. */
+typedef struct InternalBreakpoint
+{
+    uint32_t address;
+    int      isSet;
+    int      isUserBreakpoint;
+} InternalBreakpoint;
+
+struct Mri4Sim
+{
+    /* First so that the context handed to shouldInterruptRun() can be turned back into its Mri4Sim. */
+    PinkySimContext context;
+    IComm*          pComm;
+    char            packetBuffer[16 * 1024];
+    int             runResult;
+    uint32_t        pcOrig;
+    int             singleStepping;
+    int             memoryFaultEncountered;
+    int             useJit;
+    int             hasInstructionLimit;
+    int             stopOnDebugEvent;
+    uint64_t        instructionsLeft;
+    /* Set by mri4simSaveStateAt() and cleared once the state has been saved. */
+    const char*     pSaveStateFilename;
+    InternalBreakpoint saveStateBreakpoint;
+    /* Set by mri4simStopAt() and mri4simStopBeforeInput() and cleared once that stop has been reached. */
+    InternalBreakpoint stopBreakpoint;
+    int             stopBeforeInput;
+    int             stopReached;
+    /* Host file descriptors used for the program's stdin, stdout and stderr. */
+    int             consoleFileDescriptors[3];
+};
+
+/* The MRI core keeps its state in globals and calls the Platform_*() functions below without any context so only one
+   simulation at a time can be inside of it.  g_pActive is the simulation which last entered it and is only changed
+   while holding g_mriLock. */
+static pthread_mutex_t g_mriLock = PTHREAD_MUTEX_INITIALIZER;
+static Mri4Sim*        g_pActive;
 
 
 /* Core MRI function not exposed in public header since typically called by ASM. */
 void __mriDebugException(void);
 
 /* Forward static function declarations. */
+static void readResetVectors(Mri4Sim* pThis, IMemory* pMem);
+static void enterMriCore(Mri4Sim* pThis);
+static void leaveMriCore(void);
+static void runUntilDebugEvent(Mri4Sim* pThis);
+static void prepareDecodeCacheForRun(Mri4Sim* pThis);
+static int saveStateIfRequested(Mri4Sim* pThis);
+static void setInternalBreakpoint(Mri4Sim* pThis, InternalBreakpoint* pBreakpoint, uint32_t address);
+static void clearInternalBreakpoint(Mri4Sim* pThis, InternalBreakpoint* pBreakpoint);
+static InternalBreakpoint* findInternalBreakpoint(Mri4Sim* pThis, uint32_t address);
+static int isInternalBreakpointInRange(InternalBreakpoint* pBreakpoint, uint32_t address, uint32_t size);
+static int isRequestedStop(Mri4Sim* pThis);
+static int isConsoleInputSemihost(Mri4Sim* pThis);
+static int runForRemainingInstructions(Mri4Sim* pThis);
 static int shouldInterruptRun(PinkySimContext* pContext);
-static int isExitSemihost(void);
+static int isExitSemihost(Mri4Sim* pThis);
+static int isDebugEventToStopOn(Mri4Sim* pThis);
 static void logMessageToLocalAndGdbConsoles(const char* pMessage);
 static int isInstruction32Bit(uint16_t firstWordOfInstruction);
 static void sendRegisterForTResponse(Buffer* pBuffer, uint8_t registerOffset, uint32_t registerValue);
 static void writeBytesToBufferAsHex(Buffer* pBuffer, void* pBytes, size_t byteCount);
 static void readBytesFromBufferAsHex(Buffer* pBuffer, void* pBytes, size_t byteCount);
+static void markInternalBreakpointAsUserIfInRange(InternalBreakpoint* pBreakpoint, uint32_t address, uint32_t size);
+static void restoreInternalBreakpointIfInRange(InternalBreakpoint* pBreakpoint, uint32_t address, uint32_t size);
 static uint32_t convertWatchpointTypeToMemorySimType(PlatformWatchpointType type);
-static uint16_t getFirstHalfWordOfCurrentInstruction(void);
+static uint16_t getFirstHalfWordOfCurrentInstruction(Mri4Sim* pThis);
 static int isInstructionNewlibSemihostBreakpoint(uint16_t instruction);
 static int isInstructionHardcodedBreakpoint(uint16_t instruction);
 
 
-__throws void mri4simInit(IMemory* pMem)
+__throws Mri4Sim* mri4simInit(IMemory* pMem, IComm* pComm)
 {
-    memset(&g_context, 0x00, sizeof(g_context));
-    g_context.spMain = IMemory_Read32(pMem, 0x00000000);
-    g_context.pc = IMemory_Read32(pMem, 0x00000004) & 0xFFFFFFFE;
-    g_context.xPSR |= EPSR_T;
-    g_context.pMemory = pMem;
-    g_singleStepping = 0;
-    g_memoryFaultEncountered = 0;
+    Mri4Sim* pThis = malloc(sizeof(*pThis));
 
+    if (!pThis)
+        __throw(outOfMemoryException);
+    memset(pThis, 0x00, sizeof(*pThis));
+    __try
+    {
+        readResetVectors(pThis, pMem);
+    }
+    __catch
+    {
+        free(pThis);
+        __rethrow;
+    }
+    pThis->context.xPSR |= EPSR_T;
+    pThis->context.pMemory = pMem;
+    pThis->pComm = pComm;
+    pThis->runResult = PINKYSIM_STEP_OK;
+    pThis->consoleFileDescriptors[STDIN_FILENO] = STDIN_FILENO;
+    pThis->consoleFileDescriptors[STDOUT_FILENO] = STDOUT_FILENO;
+    pThis->consoleFileDescriptors[STDERR_FILENO] = STDERR_FILENO;
+
+    pthread_mutex_lock(&g_mriLock);
+    g_pActive = pThis;
     __mriInit("");
+    pthread_mutex_unlock(&g_mriLock);
+
+    return pThis;
+}
+
+static void readResetVectors(Mri4Sim* pThis, IMemory* pMem)
+{
+    pThis->context.spMain = IMemory_Read32(pMem, 0x00000000);
+    pThis->context.pc = IMemory_Read32(pMem, 0x00000004) & 0xFFFFFFFE;
+}
+
+
+void mri4simUninit(Mri4Sim* pThis)
+{
+    if (!pThis)
+        return;
+
+    pinkySimDisableDecodeCache(&pThis->context);
+    pthread_mutex_lock(&g_mriLock);
+    if (g_pActive == pThis)
+        g_pActive = NULL;
+    pthread_mutex_unlock(&g_mriLock);
+    free(pThis);
+}
+
+
+void mri4simEnableJit(Mri4Sim* pThis)
+{
+    pThis->useJit = 1;
+}
+
+
+void mri4simSetInstructionLimit(Mri4Sim* pThis, uint64_t maxInstructions)
+{
+    pThis->hasInstructionLimit = 1;
+    pThis->instructionsLeft = maxInstructions;
+}
+
+
+void mri4simStopOnDebugEvent(Mri4Sim* pThis)
+{
+    pThis->stopOnDebugEvent = 1;
+}
+
+
+void mri4simRedirectConsole(Mri4Sim* pThis, int inputFileDescriptor, int outputFileDescriptor)
+{
+    pThis->consoleFileDescriptors[STDIN_FILENO] = inputFileDescriptor;
+    pThis->consoleFileDescriptors[STDOUT_FILENO] = outputFileDescriptor;
+    pThis->consoleFileDescriptors[STDERR_FILENO] = outputFileDescriptor;
+}
+
+
+int mri4simWasInstructionLimitReached(Mri4Sim* pThis)
+{
+    return pThis->runResult == PINKYSIM_RUN_LIMIT;
+}
+
+
+int mri4simDidProgramExit(Mri4Sim* pThis)
+{
+    return isExitSemihost(pThis);
+}
+
+
+int mri4simGetRunResult(Mri4Sim* pThis)
+{
+    return pThis->runResult;
+}
+
+
+__throws void mri4simSaveStateAt(Mri4Sim* pThis, const char* pFilename, uint32_t address)
+{
+    setInternalBreakpoint(pThis, &pThis->saveStateBreakpoint, address);
+    pThis->pSaveStateFilename = pFilename;
 }
 
 
-void mri4simRun(IComm* pComm, int breakOnStart)
+__throws void mri4simStopAt(Mri4Sim* pThis, uint32_t address)
 {
-    g_pComm = pComm;
+    MemorySim_SetHardwareBreakpoint(pThis->context.pMemory, address, sizeof(uint16_t));
+    setInternalBreakpoint(pThis, &pThis->stopBreakpoint, address);
+}
+
+
+void mri4simStopBeforeInput(Mri4Sim* pThis)
+{
+    pThis->stopBeforeInput = TRUE;
+}
+
+
+int mri4simWasStopReached(Mri4Sim* pThis)
+{
+    return pThis->stopReached;
+}
+
+
+void mri4simRun(Mri4Sim* pThis, int breakOnStart)
+{
+    pThis->stopReached = FALSE;
+    /* An exception can leave the cache behind from the last run and memory may have been changed since then. */
+    pinkySimFlushDecodeCache(&pThis->context);
     do
     {
         if (breakOnStart)
         {
-            g_runResult = PINKYSIM_STEP_BKPT;
+            pThis->runResult = PINKYSIM_STEP_BKPT;
             breakOnStart = FALSE;
         }
         else
         {
-            g_runResult = pinkySimRun(&g_context, shouldInterruptRun);
-            if (isExitSemihost())
+            runUntilDebugEvent(pThis);
+            if (isRequestedStop(pThis))
+                break;
+            if (isExitSemihost(pThis) || pThis->runResult == PINKYSIM_RUN_LIMIT || isDebugEventToStopOn(pThis))
                 break;
         }
+        enterMriCore(pThis);
+    } while (!IComm_ShouldStopRun(pThis->pComm));
+    pinkySimDisableDecodeCache(&pThis->context);
+    /* A fault is reported through runResult so don't leave its exception code behind for the caller's __catch. */
+    clearExceptionCode();
+}
+
+static void runUntilDebugEvent(Mri4Sim* pThis)
+{
+    do
+    {
+        prepareDecodeCacheForRun(pThis);
+        /* Single stepping needs the callback to be invoked before every instruction so it can't execute a whole block
+           at a time.  The instruction limit cuts the last block short instead. */
+        if (pThis->hasInstructionLimit)
+            pThis->runResult = runForRemainingInstructions(pThis);
+        else if (pThis->singleStepping)
+            pThis->runResult = pinkySimRun(&pThis->context, shouldInterruptRun);
+        else
+            pThis->runResult = pinkySimRunBlocks(&pThis->context, shouldInterruptRun);
+    } while (saveStateIfRequested(pThis));
+}
+
+static void enterMriCore(Mri4Sim* pThis)
+{
+    pthread_mutex_lock(&g_mriLock);
+    g_pActive = pThis;
+    __try
+    {
         __mriDebugException();
-    } while (!IComm_ShouldStopRun(pComm));
+    }
+    __catch
+    {
+        leaveMriCore();
+        __rethrow;
+    }
+    leaveMriCore();
+}
+
+static void leaveMriCore(void)
+{
+    pthread_mutex_unlock(&g_mriLock);
+}
+
+static void prepareDecodeCacheForRun(Mri4Sim* pThis)
+{
+    /* The cache skips the IMemory fetch so it can't be used while fetches need to hit breakpoints, etc. */
+    if (MemorySim_HasFetchSideEffects(pThis->context.pMemory))
+    {
+        pinkySimDisableDecodeCache(&pThis->context);
+        return;
+    }
+
+    /* The cache is kept from one debug event to the next since GDB and semihosting calls only invalidate the ranges
+       they write to.  It is created once per mri4simRun() and again after being dropped for fetch side effects. */
+    if (pThis->context.pDecodeCache)
+        return;
+    __try
+    {
+        pinkySimEnableDecodeCache(&pThis->context);
+        if (pThis->useJit)
+            pinkySimEnableJit(&pThis->context);
+    }
+    __catch
+    {
+        /* Just run without the cache if it can't be allocated. */
+        clearExceptionCode();
+    }
+}
+
+static int saveStateIfRequested(Mri4Sim* pThis)
+{
+    const char* pFilename = pThis->pSaveStateFilename;
+
+    int         isUserBreakpoint = pThis->saveStateBreakpoint.isUserBreakpoint;
+
+    if (!pFilename || pThis->runResult != PINKYSIM_STEP_BKPT || pThis->context.pc != pThis->saveStateBreakpoint.address)
+        return FALSE;
+
+    /* Only saved the first time the address is reached.  The program then carries on as if nothing had happened unless
+       GDB also has a breakpoint there, in which case it still needs to be told about the hit. */
+    pThis->pSaveStateFilename = NULL;
+    clearInternalBreakpoint(pThis, &pThis->saveStateBreakpoint);
+    Snapshot_Save(&pThis->context, pFilename);
+    return !isUserBreakpoint;
+}
+
+static void setInternalBreakpoint(Mri4Sim* pThis, InternalBreakpoint* pBreakpoint, uint32_t address)
+{
+    IMemory*            pMemory = pThis->context.pMemory;
+    InternalBreakpoint* pShared;
+    int                 isUserBreakpoint;
+
+    clearInternalBreakpoint(pThis, pBreakpoint);
+    /* The other internal breakpoint may already be at this address and already knows whether GDB has one there. */
+    pShared = findInternalBreakpoint(pThis, address);
+    if (pShared)
+        isUserBreakpoint = pShared->isUserBreakpoint;
+    else
+        isUserBreakpoint = MemorySim_IsHardwareBreakpointSet(pMemory, address);
+    MemorySim_SetHardwareBreakpoint(pMemory, address, sizeof(uint16_t));
+    pBreakpoint->address = address;
+    pBreakpoint->isSet = TRUE;
+    pBreakpoint->isUserBreakpoint = isUserBreakpoint;
+}
+
+static void clearInternalBreakpoint(Mri4Sim* pThis, InternalBreakpoint* pBreakpoint)
+{
+    if (!pBreakpoint->isSet)
+        return;
+    pBreakpoint->isSet = FALSE;
+    if (!pBreakpoint->isUserBreakpoint && !findInternalBreakpoint(pThis, pBreakpoint->address))
+        MemorySim_ClearHardwareBreakpoint(pThis->context.pMemory, pBreakpoint->address, sizeof(uint16_t));
+}
+
+static InternalBreakpoint* findInternalBreakpoint(Mri4Sim* pThis, uint32_t address)
+{
+    if (pThis->saveStateBreakpoint.isSet && pThis->saveStateBreakpoint.address == address)
+        return &pThis->saveStateBreakpoint;
+    if (pThis->stopBreakpoint.isSet && pThis->stopBreakpoint.address == address)
+        return &pThis->stopBreakpoint;
+    return NULL;
+}
+
+static int isInternalBreakpointInRange(InternalBreakpoint* pBreakpoint, uint32_t address, uint32_t size)
+{
+    /* Matches the halfwords which MemorySim_SetHardwareBreakpoint() marks for a breakpoint of this size. */
+    uint64_t startAddress = (address + 1) & ~1;
+    uint64_t endAddress = (uint64_t)address + size;
+
+    return pBreakpoint->isSet &&
+           pBreakpoint->address >= startAddress &&
+           (uint64_t)pBreakpoint->address + sizeof(uint16_t) <= endAddress;
+}
+
+static int isRequestedStop(Mri4Sim* pThis)
+{
+    if (pThis->runResult != PINKYSIM_STEP_BKPT)
+        return FALSE;
+
+    /* Each stop only happens once so that the next mri4simRun() carries on from it. */
+    if (pThis->stopBreakpoint.isSet && pThis->context.pc == pThis->stopBreakpoint.address)
+    {
+        /* A GDB breakpoint here is left set so that GDB is still told about it once the run is carried on. */
+        clearInternalBreakpoint(pThis, &pThis->stopBreakpoint);
+        pThis->stopReached = TRUE;
+    }
+    else if (pThis->stopBeforeInput && isConsoleInputSemihost(pThis))
+    {
+        pThis->stopBeforeInput = FALSE;
+        pThis->stopReached = TRUE;
+    }
+    return pThis->stopReached;
+}
+
+static int isConsoleInputSemihost(Mri4Sim* pThis)
+{
+    static const uint16_t newlibReadBreakpointMachineCode = 0xbe00 | NEWLIB_READ;
+    uint16_t              currentInstruction;
+
+    __try
+    {
+        currentInstruction = getFirstHalfWordOfCurrentInstruction(pThis);
+    }
+    __catch
+    {
+        clearExceptionCode();
+        return FALSE;
+    }
+
+    /* The file descriptor being read is the first parameter of the semihost call. */
+    return currentInstruction == newlibReadBreakpointMachineCode && pThis->context.R[0] == STDIN_FILENO;
+}
+
+static int runForRemainingInstructions(Mri4Sim* pThis)
+{
+    uint64_t retired = 0;
+    int      result;
+
+    if (pThis->singleStepping)
+        result = pinkySimRunFor(&pThis->context, shouldInterruptRun, pThis->instructionsLeft, &retired);
+    else
+        result = pinkySimRunBlocksFor(&pThis->context, shouldInterruptRun, pThis->instructionsLeft, &retired);
+    pThis->instructionsLeft -= retired;
+
+    return result;
 }
 
 static int shouldInterruptRun(PinkySimContext* pContext)
 {
-    if (g_singleStepping > 1)
-        g_singleStepping--;
-    else if (g_singleStepping == 1)
+    Mri4Sim* pThis = (Mri4Sim*)pContext;
+
+    if (pThis->singleStepping > 1)
+        pThis->singleStepping--;
+    else if (pThis->singleStepping == 1)
         return PINKYSIM_RUN_SINGLESTEP;
 
-    if (MemorySim_WasWatchpointEncountered(g_context.pMemory))
+    if (MemorySim_WasWatchpointEncountered(pContext->pMemory))
         return PINKYSIM_RUN_WATCHPOINT;
 
-    if (IComm_IsGdbConnected(g_pComm) && IComm_HasReceiveData(g_pComm))
+    if (IComm_IsGdbConnected(pThis->pComm) && IComm_HasReceiveData(pThis->pComm))
         return PINKYSIM_RUN_INTERRUPT;
     return PINKYSIM_STEP_OK;
 }
 
-static int isExitSemihost(void)
+static int isExitSemihost(Mri4Sim* pThis)
 {
     static const uint16_t newlibExitBreakpointMachineCode = 0xbeff;
     uint16_t              currentInstruction;
 
-    if (g_runResult != PINKYSIM_STEP_BKPT)
+    if (pThis->runResult != PINKYSIM_STEP_BKPT)
         return FALSE;
 
     __try
     {
-        currentInstruction = getFirstHalfWordOfCurrentInstruction();
+        currentInstruction = getFirstHalfWordOfCurrentInstruction(pThis);
     }
     __catch
     {
@@ -178,11 +530,55 @@ static int isExitSemihost(void)
     return currentInstruction == newlibExitBreakpointMachineCode;
 }
 
-PinkySimContext* mri4simGetContext(void)
+static int isDebugEventToStopOn(Mri4Sim* pThis)
 {
-    return &g_context;
+    uint16_t currentInstruction;
+
+    if (!pThis->stopOnDebugEvent)
+        return FALSE;
+    /* Semihost requests are still handed to the MRI core since they don't need GDB. */
+    if (pThis->runResult != PINKYSIM_STEP_BKPT)
+        return TRUE;
+
+    __try
+    {
+        currentInstruction = getFirstHalfWordOfCurrentInstruction(pThis);
+    }
+    __catch
+    {
+        clearExceptionCode();
+        return TRUE;
+    }
+
+    return !isInstructionNewlibSemihostBreakpoint(currentInstruction);
 }
 
+PinkySimContext* mri4simGetContext(Mri4Sim* pThis)
+{
+    return &pThis->context;
+}
+
+IMemory* mri4simGetActiveMemory(void)
+{
+    return g_pActive->context.pMemory;
+}
+
+__throws void* mri4simMapActiveAddressForWrite(uint32_t address, uint32_t size)
+{
+    void* pHost = MemorySim_MapSimulatedAddressToHostAddressForWrite(g_pActive->context.pMemory, address, size);
+
+    pinkySimInvalidateDecodeCache(&g_pActive->context, address, size);
+    return pHost;
+}
+
+int mri4simMapActiveConsoleFileDescriptor(int fileDescriptor)
+{
+    if (fileDescriptor >= STDIN_FILENO && fileDescriptor <= STDERR_FILENO)
+        return g_pActive->consoleFileDescriptors[fileDescriptor];
+    return fileDescriptor;
+}
+
+
 
 
 void Platform_Init(Token* pParameterTokens)
@@ -191,17 +587,17 @@ void Platform_Init(Token* pParameterTokens)
 
 char* Platform_GetPacketBuffer(void)
 {
-    return g_packetBuffer;
+    return g_pActive->packetBuffer;
 }
 
 uint32_t  Platform_GetPacketBufferSize(void)
 {
-    return sizeof(g_packetBuffer);
+    return sizeof(g_pActive->packetBuffer);
 }
 
 void Platform_EnteringDebugger(void)
 {
-    g_pcOrig = g_context.pc;
+    g_pActive->pcOrig = g_pActive->context.pc;
     Platform_DisableSingleStep();
 }
 
@@ -212,10 +608,14 @@ void Platform_LeavingDebugger(void)
 uint32_t Platform_MemRead32(const void* pv)
 {
     uint32_t retVal = 0;
+
+    /* Let GDB read the same simulated cycle counter as the program. */
+    if (g_pActive->context.cycleCounter.enabled && (uint32_t)pv == DWT_CYCCNT)
+        return (uint32_t)(g_pActive->context.cycleCounter.count - g_pActive->context.cycleCounter.cyccntBase);
     __try
-        retVal = IMemory_Read32(g_context.pMemory, (uint32_t)pv);
+        retVal = IMemory_Read32(g_pActive->context.pMemory, (uint32_t)pv);
     __catch
-        g_memoryFaultEncountered++;
+        g_pActive->memoryFaultEncountered++;
     return retVal;
 }
 
@@ -223,9 +623,9 @@ uint16_t Platform_MemRead16(const void* pv)
 {
     uint16_t retVal = 0;
     __try
-        retVal = IMemory_Read16(g_context.pMemory, (uint32_t)pv);
+        retVal = IMemory_Read16(g_pActive->context.pMemory, (uint32_t)pv);
     __catch
-        g_memoryFaultEncountered++;
+        g_pActive->memoryFaultEncountered++;
     return retVal;
 }
 
@@ -233,49 +633,64 @@ uint8_t Platform_MemRead8(const void* pv)
 {
     uint8_t retVal = 0;
     __try
-        retVal = IMemory_Read8(g_context.pMemory, (uint32_t)pv);
+        retVal = IMemory_Read8(g_pActive->context.pMemory, (uint32_t)pv);
     __catch
-        g_memoryFaultEncountered++;
+        g_pActive->memoryFaultEncountered++;
     return retVal;
 }
 
 void Platform_MemWrite32(void* pv, uint32_t value)
 {
     __try
-        IMemory_Write32(g_context.pMemory, (uint32_t)pv, value);
+    {
+        IMemory_Write32(g_pActive->context.pMemory, (uint32_t)pv, value);
+        pinkySimInvalidateDecodeCache(&g_pActive->context, (uint32_t)pv, sizeof(value));
+    }
     __catch
-        g_memoryFaultEncountered++;
+    {
+        g_pActive->memoryFaultEncountered++;
+    }
 }
 
 void Platform_MemWrite16(void* pv, uint16_t value)
 {
     __try
-        IMemory_Write16(g_context.pMemory, (uint32_t)pv, value);
+    {
+        IMemory_Write16(g_pActive->context.pMemory, (uint32_t)pv, value);
+        pinkySimInvalidateDecodeCache(&g_pActive->context, (uint32_t)pv, sizeof(value));
+    }
     __catch
-        g_memoryFaultEncountered++;
+    {
+        g_pActive->memoryFaultEncountered++;
+    }
 }
 
 void Platform_MemWrite8(void* pv, uint8_t value)
 {
     __try
-        IMemory_Write8(g_context.pMemory, (uint32_t)pv, value);
+    {
+        IMemory_Write8(g_pActive->context.pMemory, (uint32_t)pv, value);
+        pinkySimInvalidateDecodeCache(&g_pActive->context, (uint32_t)pv, sizeof(value));
+    }
     __catch
-        g_memoryFaultEncountered++;
+    {
+        g_pActive->memoryFaultEncountered++;
+    }
 }
 
 uint32_t Platform_CommHasReceiveData(void)
 {
-    return IComm_HasReceiveData(g_pComm);
+    return IComm_HasReceiveData(g_pActive->pComm);
 }
 
 int Platform_CommReceiveChar(void)
 {
-    return IComm_ReceiveChar(g_pComm);
+    return IComm_ReceiveChar(g_pActive->pComm);
 }
 
 void Platform_CommSendChar(int character)
 {
-    IComm_SendChar(g_pComm, character);
+    IComm_SendChar(g_pActive->pComm, character);
 }
 
 int Platform_CommCausedInterrupt(void)
@@ -303,7 +718,7 @@ void Platform_CommPrepareToWaitForGdbConnection(void)
 
 int Platform_CommIsWaitingForGdbToConnect(void)
 {
-    return !IComm_IsGdbConnected(g_pComm);
+    return !IComm_IsGdbConnected(g_pActive->pComm);
 }
 
 void Platform_CommWaitForReceiveDataToStop(void)
@@ -315,7 +730,7 @@ uint8_t Platform_DetermineCauseOfException(void)
 {
     uint8_t signal = SIGSTOP;
 
-    switch (g_runResult)
+    switch (g_pActive->runResult)
     {
     case PINKYSIM_STEP_UNDEFINED:
     case PINKYSIM_STEP_UNPREDICTABLE:
@@ -341,7 +756,7 @@ uint8_t Platform_DetermineCauseOfException(void)
 
 void Platform_DisplayFaultCauseToGdbConsole(void)
 {
-    switch (g_runResult)
+    switch (g_pActive->runResult)
     {
     case PINKYSIM_STEP_UNDEFINED:
         logMessageToLocalAndGdbConsoles("\n**Undefined Instruction**\n");
@@ -368,22 +783,22 @@ static void logMessageToLocalAndGdbConsoles(const char* pMessage)
 
 void Platform_EnableSingleStep(void)
 {
-    g_singleStepping = 2;
+    g_pActive->singleStepping = 2;
 }
 
 void Platform_DisableSingleStep(void)
 {
-    g_singleStepping = 0;
+    g_pActive->singleStepping = 0;
 }
 
 int Platform_IsSingleStepping(void)
 {
-    return g_singleStepping > 0;
+    return g_pActive->singleStepping > 0;
 }
 
 void Platform_SetProgramCounter(uint32_t newPC)
 {
-    g_context.pc = newPC;
+    g_pActive->context.pc = newPC;
 }
 
 void Platform_AdvanceProgramCounterToNextInstruction(void)
@@ -392,7 +807,7 @@ void Platform_AdvanceProgramCounterToNextInstruction(void)
 
     __try
     {
-        firstWordOfCurrentInstruction = getFirstHalfWordOfCurrentInstruction();
+        firstWordOfCurrentInstruction = getFirstHalfWordOfCurrentInstruction(g_pActive);
     }
     __catch
     {
@@ -404,12 +819,12 @@ void Platform_AdvanceProgramCounterToNextInstruction(void)
     if (isInstruction32Bit(firstWordOfCurrentInstruction))
     {
         /* 32-bit Instruction. */
-        g_context.pc += 4;
+        g_pActive->context.pc += 4;
     }
     else
     {
         /* 16-bit Instruction. */
-        g_context.pc += 2;
+        g_pActive->context.pc += 2;
     }
 }
 
@@ -426,23 +841,23 @@ static int isInstruction32Bit(uint16_t firstWordOfInstruction)
 
 int Platform_WasProgramCounterModifiedByUser(void)
 {
-    return g_context.pc != g_pcOrig;
+    return g_pActive->context.pc != g_pActive->pcOrig;
 }
 
 int Platform_WasMemoryFaultEncountered(void)
 {
-    int memoryFaultEncountered = g_memoryFaultEncountered;
-    g_memoryFaultEncountered = 0;
+    int memoryFaultEncountered = g_pActive->memoryFaultEncountered;
+    g_pActive->memoryFaultEncountered = 0;
     return memoryFaultEncountered;
 }
 
 
 void Platform_WriteTResponseRegistersToBuffer(Buffer* pBuffer)
 {
-    sendRegisterForTResponse(pBuffer, 12, g_context.R[12]);
-    sendRegisterForTResponse(pBuffer, 13, g_context.spMain);
-    sendRegisterForTResponse(pBuffer, 14, g_context.lr);
-    sendRegisterForTResponse(pBuffer, 15, g_context.pc);
+    sendRegisterForTResponse(pBuffer, 12, g_pActive->context.R[12]);
+    sendRegisterForTResponse(pBuffer, 13, g_pActive->context.spMain);
+    sendRegisterForTResponse(pBuffer, 14, g_pActive->context.lr);
+    sendRegisterForTResponse(pBuffer, 15, g_pActive->context.pc);
 }
 
 static void sendRegisterForTResponse(Buffer* pBuffer, uint8_t registerOffset, uint32_t registerValue)
@@ -465,13 +880,13 @@ static void writeBytesToBufferAsHex(Buffer* pBuffer, void* pBytes, size_t byteCo
 
 void Platform_CopyContextToBuffer(Buffer* pBuffer)
 {
-    writeBytesToBufferAsHex(pBuffer, &g_context.R[0], (16 + 1) * sizeof(uint32_t));
+    writeBytesToBufferAsHex(pBuffer, &g_pActive->context.R[0], (16 + 1) * sizeof(uint32_t));
 }
 
 
 void Platform_CopyContextFromBuffer(Buffer* pBuffer)
 {
-    readBytesFromBufferAsHex(pBuffer, &g_context.R[0], (16 + 1) * sizeof(uint32_t));
+    readBytesFromBufferAsHex(pBuffer, &g_pActive->context.R[0], (16 + 1) * sizeof(uint32_t));
 }
 
 static void readBytesFromBufferAsHex(Buffer* pBuffer, void* pBytes, size_t byteCount)
@@ -486,12 +901,12 @@ static void readBytesFromBufferAsHex(Buffer* pBuffer, void* pBytes, size_t byteC
 
 uint32_t Platform_GetDeviceMemoryMapXmlSize(void)
 {
-    return strlen(MemorySim_GetMemoryMapXML(g_context.pMemory));
+    return strlen(MemorySim_GetMemoryMapXML(g_pActive->context.pMemory));
 }
 
 const char* Platform_GetDeviceMemoryMapXml(void)
 {
-    return MemorySim_GetMemoryMapXML(g_context.pMemory);
+    return MemorySim_GetMemoryMapXML(g_pActive->context.pMemory);
 }
 
 
@@ -526,9 +941,20 @@ __throws void Platform_SetHardwareBreakpoint(uint32_t address, uint32_t kind)
     }
 
     __try
-        MemorySim_SetHardwareBreakpoint(g_context.pMemory, address, size);
+        MemorySim_SetHardwareBreakpoint(g_pActive->context.pMemory, address, size);
     __catch
+    {
         __mriExceptionCode = exceededHardwareResourcesException;
+        return;
+    }
+    markInternalBreakpointAsUserIfInRange(&g_pActive->saveStateBreakpoint, address, size);
+    markInternalBreakpointAsUserIfInRange(&g_pActive->stopBreakpoint, address, size);
+}
+
+static void markInternalBreakpointAsUserIfInRange(InternalBreakpoint* pBreakpoint, uint32_t address, uint32_t size)
+{
+    if (isInternalBreakpointInRange(pBreakpoint, address, size))
+        pBreakpoint->isUserBreakpoint = TRUE;
 }
 
 
@@ -551,16 +977,32 @@ __throws void Platform_ClearHardwareBreakpoint(uint32_t address, uint32_t kind)
     }
 
     __try
-        MemorySim_ClearHardwareBreakpoint(g_context.pMemory, address, size);
+    {
+        MemorySim_ClearHardwareBreakpoint(g_pActive->context.pMemory, address, size);
+        restoreInternalBreakpointIfInRange(&g_pActive->saveStateBreakpoint, address, size);
+        restoreInternalBreakpointIfInRange(&g_pActive->stopBreakpoint, address, size);
+    }
     __catch
+    {
         __mriExceptionCode = invalidArgumentException;
+    }
+}
+
+static void restoreInternalBreakpointIfInRange(InternalBreakpoint* pBreakpoint, uint32_t address, uint32_t size)
+{
+    /* GDB's breakpoint is gone but the simulator still needs its own at the same address. */
+    if (!isInternalBreakpointInRange(pBreakpoint, address, size))
+        return;
+    pBreakpoint->isUserBreakpoint = FALSE;
+    MemorySim_SetHardwareBreakpoint(g_pActive->context.pMemory, pBreakpoint->address, sizeof(uint16_t));
 }
 
 
 __throws void Platform_SetHardwareWatchpoint(uint32_t address, uint32_t size, PlatformWatchpointType type)
 {
     __try
-        MemorySim_SetHardwareWatchpoint(g_context.pMemory, address, size, convertWatchpointTypeToMemorySimType(type));
+        MemorySim_SetHardwareWatchpoint(g_pActive->context.pMemory, address, size,
+                                        convertWatchpointTypeToMemorySimType(type));
     __catch
         __mriExceptionCode = exceededHardwareResourcesException;
 }
@@ -588,7 +1030,8 @@ static WatchpointType convertWatchpointTypeToMemorySimType(PlatformWatchpointTyp
 __throws void Platform_ClearHardwareWatchpoint(uint32_t address, uint32_t size,  PlatformWatchpointType type)
 {
     __try
-        MemorySim_ClearHardwareWatchpoint(g_context.pMemory, address, size, convertWatchpointTypeToMemorySimType(type));
+        MemorySim_ClearHardwareWatchpoint(g_pActive->context.pMemory, address, size,
+                                          convertWatchpointTypeToMemorySimType(type));
     __catch
         __mriExceptionCode = invalidArgumentException;
 }
@@ -600,7 +1043,7 @@ PlatformInstructionType Platform_TypeOfCurrentInstruction(void)
 
     __try
     {
-        currentInstruction = getFirstHalfWordOfCurrentInstruction();
+        currentInstruction = getFirstHalfWordOfCurrentInstruction(g_pActive);
     }
     __catch
     {
@@ -617,9 +1060,9 @@ PlatformInstructionType Platform_TypeOfCurrentInstruction(void)
         return MRI_PLATFORM_INSTRUCTION_OTHER;
 }
 
-static uint16_t getFirstHalfWordOfCurrentInstruction(void)
+static uint16_t getFirstHalfWordOfCurrentInstruction(Mri4Sim* pThis)
 {
-    return IMemory_Read16(g_context.pMemory, g_context.pc);
+    return IMemory_Read16(pThis->context.pMemory, pThis->context.pc);
 }
 
 static int isInstructionNewlibSemihostBreakpoint(uint16_t instruction)
@@ -649,10 +1092,10 @@ PlatformSemihostParameters Platform_GetSemihostCallParameters(void)
 {
     PlatformSemihostParameters parameters;
 
-    parameters.parameter1 = g_context.R[0];
-    parameters.parameter2 = g_context.R[1];
-    parameters.parameter3 = g_context.R[2];
-    parameters.parameter4 = g_context.R[3];
+    parameters.parameter1 = g_pActive->context.R[0];
+    parameters.parameter2 = g_pActive->context.R[1];
+    parameters.parameter3 = g_pActive->context.R[2];
+    parameters.parameter4 = g_pActive->context.R[3];
 
     return parameters;
 }
@@ -660,8 +1103,8 @@ PlatformSemihostParameters Platform_GetSemihostCallParameters(void)
 
 void Platform_SetSemihostCallReturnAndErrnoValues(int returnValue, int err)
 {
-    g_context.R[0] = returnValue;
-    g_context.R[1] = err;
+    g_pActive->context.R[0] = returnValue;
+    g_pActive->context.R[1] = err;
 }
 
 
@@ -679,7 +1122,7 @@ int Semihost_HandleSemihostRequest(void)
     PlatformSemihostParameters parameters = Platform_GetSemihostCallParameters();
     int                        result = 0;
 
-    switch (getFirstHalfWordOfCurrentInstruction() & immediateMask)
+    switch (getFirstHalfWordOfCurrentInstruction(g_pActive) & immediateMask)
     {
     case NEWLIB_WRITE:
         result = handleNewlibSemihostWriteRequest(&parameters);
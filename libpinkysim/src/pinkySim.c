@@ -12,7 +12,17 @@
 */
 #include <assert.h>
 #include <common.h>
+#include <MallocFailureInject.h>
 #include <pinkySim.h>
+#include <pthread.h>
+#include <stddef.h>
+
+/* The JIT emits System V calling convention x86-64 code so it is only available on such hosts. */
+#if defined(__x86_64__) && !defined(_WIN32)
+#define PINKYSIM_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 /* Fields decoded from instructions. */
 typedef struct Fields
@@ -54,13 +64,295 @@ typedef struct ShiftResults
 typedef struct AddResults
 {
     uint32_t result;
-    int      carryOut;
-    int      overflow;
+    uint32_t x;
+    uint32_t y;
+    uint32_t carryIn;
 } AddResults;
 
+/* Bits in PinkySimLazyFlags::pending */
+#define LAZY_NZ     (1 << 0)    /* N and Z come from result. */
+#define LAZY_C      (1 << 1)    /* C comes from carry. */
+#define LAZY_ADD_CV (1 << 2)    /* C and V come from operand1 + operand2 + carryIn (unless LAZY_C is also set). */
+
+/* Handlers which execute an already decoded 16-bit or 32-bit instruction. */
+typedef int (*InstructionHandler16)(PinkySimContext* pContext, uint16_t instr);
+typedef int (*InstructionHandler32)(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
+
+/* Instruction which has been fetched from memory and decoded down to the handler which will execute it.  Only one of
+   the two handler pointers will be non-NULL. */
+typedef struct DecodedInstruction
+{
+    InstructionHandler16 handler16;
+    InstructionHandler32 handler32;
+    uint32_t             address;
+    uint16_t             instr1;
+    uint16_t             instr2;
+} DecodedInstruction;
+
+/* Number of entries in the direct mapped decode cache.  Must be a power of 2. */
+#define DECODE_CACHE_ENTRIES            8192
+/* Instructions are always halfword aligned so an odd address will never match the PC. */
+#define DECODE_CACHE_INVALID_ADDRESS    0xFFFFFFFF
+
+/* Maximum number of instructions in a basic block.  Longer runs of straight-line code are split into several blocks. */
+#define BLOCK_MAX_INSTRUCTIONS  32
+/* Number of entries in the direct mapped basic block cache.  Must be a power of 2. */
+#define BLOCK_CACHE_ENTRIES     1024
+/* Largest number of bytes spanned by a single block. */
+#define BLOCK_MAX_SIZE          (BLOCK_MAX_INSTRUCTIONS * 4)
+/* Size of the pages, as a shift, for which the decode cache tracks whether any cached code overlaps them. */
+#define CODE_PAGE_SHIFT         10
+/* Number of those page counters.  Pages which share a counter just cost an extra invalidation scan or a missing JIT
+   write window.  Must be a power of 2. */
+#define CODE_PAGE_ENTRIES       4096
+
+/* Native code generated by the JIT to execute a whole basic block.  It leaves the number of instructions which
+   completed successfully in PinkySimDecodeCache::jitInstructionsRetired. */
+typedef int (*JitBlockFunction)(PinkySimContext* pContext);
+
+/* Handler which executes a common pair of adjacent 16-bit instructions, starting with pFirst, in a single dispatch. */
+typedef int (*PairHandler)(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+
+/* Pair of instructions, identified by their handlers, which can be executed together by pairHandler. */
+typedef struct InstructionPair
+{
+    InstructionHandler16 first;
+    InstructionHandler16 second;
+    PairHandler          pairHandler;
+} InstructionPair;
+
+/* Straight-line run of decoded instructions which ends at the first instruction that could change the flow of
+   execution.  Covers the addresses from address up to (but not including) endAddress.  pairHandlers[i] is non-NULL
+   when instructions[i] and instructions[i+1] can be executed together. */
+typedef struct DecodedBlock
+{
+    uint32_t           address;
+    uint32_t           endAddress;
+    uint32_t           count;
+    uint32_t           executionCount;
+    JitBlockFunction   jitFunction;
+    DecodedInstruction instructions[BLOCK_MAX_INSTRUCTIONS];
+    PairHandler        pairHandlers[BLOCK_MAX_INSTRUCTIONS];
+} DecodedBlock;
+
+/* Number of times that a block must be executed by the interpreter before the JIT translates it to native code. */
+#define JIT_THRESHOLD           16
+/* Size of the buffer holding the JIT generated code.  It is emptied and refilled from scratch once it fills up. */
+#define JIT_CODE_SIZE           (4 * 1024 * 1024)
+/* Worst case number of bytes of native code emitted by the JIT for each basic block. */
+#define JIT_MAX_BLOCK_CODE_SIZE (64 + BLOCK_MAX_INSTRUCTIONS * 192)
+
+/* x86-64 registers used by the JIT generated code, numbered as in their instruction encodings. */
+#define X86_EAX 0
+#define X86_ECX 1
+#define X86_EDX 2
+#define X86_ESI 6
+/* Opcodes of the x86-64 "op r/m32, r32" instructions used by the JIT. */
+#define X86_ADD 0x01
+#define X86_OR  0x09
+#define X86_AND 0x21
+#define X86_XOR 0x31
+/* ModRM reg field values selecting the x86-64 shift performed by opcode 0xC1. */
+#define X86_SHL 4
+#define X86_SHR 5
+#define X86_SAR 7
+
+/* Native code generated so far by emitBlock() for a block. */
+typedef struct JitBlockState
+{
+    const DecodedBlock* pBlock;
+    /* Jumps to the exits of the block, patched once the exit code has been emitted. */
+    uint8_t*            exitFixups[BLOCK_MAX_INSTRUCTIONS];
+    uint8_t*            exitOkFixups[2 * BLOCK_MAX_INSTRUCTIONS];
+    uint32_t            exitFixupCount;
+    uint32_t            exitOkFixupCount;
+    /* Values last stored into PinkySimContext::pc and R12 by the generated code at this point in the block. */
+    uint32_t            pc;
+    uint32_t            retired;
+} JitBlockState;
+
+/* Value of JitBlockState::pc and retired after paths through the generated code which left different values behind
+   join up again.  It never matches an actual value so the next commit is always emitted. */
+#define JIT_STATE_UNKNOWN   0xFFFFFFFF
+
+/* Emits native code for the instruction at index in the block.  Returns NULL, having emitted nothing, for encodings
+   which are left to the instruction handler instead. */
+typedef uint8_t* (*JitTranslator)(uint8_t* p, JitBlockState* pState, uint32_t index);
+
+/* Instruction, identified by its handler, which translator emits native code for. */
+typedef struct JitTranslation
+{
+    InstructionHandler16 handler;
+    JitTranslator        translator;
+} JitTranslation;
+
+/* Value of PinkySimCycleCounter::lastFetchWord which never matches a word aligned fetch address. */
+#define CYCLE_COUNTER_NO_FETCH  0xFFFFFFFF
+/* Cycles needed to refill the pipeline after a taken branch. */
+#define BRANCH_REFILL_CYCLES    2
+
+struct PinkySimDecodeCache
+{
+    DecodedInstruction entries[DECODE_CACHE_ENTRIES];
+    DecodedBlock       blocks[BLOCK_CACHE_ENTRIES];
+    /* Number of cached instructions and blocks overlapping each page (see codePageIndex()).  Used to quickly skip
+       invalidations of data and to keep the JIT's write window off of code. */
+    uint16_t           codePageCounts[CODE_PAGE_ENTRIES];
+    /* Executable buffer for JIT generated code.  NULL when the JIT isn't enabled. */
+    uint8_t*           pJitCode;
+    size_t             jitCodeUsed;
+    uint32_t           jitInstructionsRetired;
+    /* Block being executed by executeBlockFor() so that the instructions it completed before a fault can be counted. */
+    const DecodedBlock* pExecutingBlock;
+};
+
+/* Handler for every possible 16-bit encoding, indexed by the instruction itself.  The first halfword of each 32-bit
+   instruction maps to NULL.  Filled in from decodeInstruction16() on first use, which can be from any thread. */
+static InstructionHandler16 g_handlers16[0x10000];
+static pthread_once_t       g_handlers16Once = PTHREAD_ONCE_INIT;
+
 /* Function Prototypes */
-static int executeInstruction16(PinkySimContext* pContext, uint16_t instr);
-static int shiftAddSubtractMoveCompare(PinkySimContext* pContext, uint16_t instr);
+static int invokeCallback(PinkySimContext* pContext, int (*callback)(PinkySimContext*));
+static int finishRunFor(PinkySimContext* pContext, int result, uint64_t retired, uint64_t* pInstructionsRetired);
+static int run(PinkySimContext* pContext, int (*callback)(PinkySimContext*), int (*execute)(PinkySimContext*));
+static int executeInstruction(PinkySimContext* pContext);
+static int executeBlock(PinkySimContext* pContext);
+static int executeBlockFor(PinkySimContext* pContext, uint32_t maxCount, uint32_t* pRetired);
+static uint32_t countRetiredBeforeFaultInBlock(PinkySimContext* pContext);
+static DecodedBlock* fetchDecodedBlock(PinkySimContext* pContext);
+static int shouldTranslateBlock(PinkySimDecodeCache* pCache, DecodedBlock* pBlock);
+static uint32_t blockCacheIndex(uint32_t address);
+static void updateCodePageCounts(PinkySimDecodeCache* pCache, uint32_t address, uint32_t endAddress, int delta);
+static uint32_t codePageIndex(uint32_t address);
+static void decodeBlock(PinkySimContext* pContext, DecodedBlock* pBlock, uint32_t address);
+static int tryFetchAndDecodeInstruction(PinkySimContext* pContext, uint32_t address, DecodedInstruction* pDecoded);
+static uint32_t instructionSize(const DecodedInstruction* pDecoded);
+static int isBlockTerminator(const DecodedInstruction* pDecoded);
+static int executeDecodedBlock(PinkySimContext* pContext, const DecodedBlock* pBlock, uint32_t maxCount,
+                               uint32_t* pRetired);
+static void findInstructionPairs(DecodedBlock* pBlock);
+static PairHandler lookupPairHandler(const DecodedInstruction* pFirst, const DecodedInstruction* pSecond);
+static void startSecondOfPair(PinkySimContext* pContext);
+static int cmpImmediateAndConditionalBranch(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+static int cmpRegisterAndConditionalBranch(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+static int subImmediateAndConditionalBranch(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+static int movImmediateAndLslImmediate(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+static int ldrLiteralAndLdrImmediate(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+static int addImmediateAndCmpImmediate(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+static int addImmediateAndCmpRegister(PinkySimContext* pContext, const DecodedInstruction* pFirst);
+#ifdef PINKYSIM_JIT_X64
+static void translateBlock(PinkySimDecodeCache* pCache, DecodedBlock* pBlock);
+static int protectJitCode(uint8_t* pStart, size_t size, int protection);
+static void resetJitCode(PinkySimDecodeCache* pCache);
+static uint8_t* emitBlock(uint8_t* p, PinkySimDecodeCache* pCache, const DecodedBlock* pBlock);
+static uint8_t* emitInstruction(uint8_t* p, JitBlockState* pState, uint32_t index);
+static JitTranslator lookupJitTranslator(const DecodedInstruction* pDecoded);
+static uint8_t* emitHandlerCall(uint8_t* p, JitBlockState* pState, uint32_t index);
+static int isLastInBlock(const JitBlockState* pState, uint32_t index);
+static uint16_t instructionAt(const JitBlockState* pState, uint32_t index);
+static uint8_t* translateMovImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateMovRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAddImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAddImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAddRegisterT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateSubImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateSubImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateSubRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateCmpImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateCmpRegisterT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateCmnRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAndRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateEorRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateOrrRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateBicRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateMvnRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateTstRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLslImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLsrImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAsrImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAddSPT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAddSPT2(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateSubSP(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateAdr(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrLiteral(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrbImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrhImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrbRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateLdrhRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrbImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrhImmediate(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrbRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* translateStrhRegister(uint8_t* p, JitBlockState* pState, uint32_t index);
+static uint8_t* emitUpdateRdAndNZ(uint8_t* p, uint32_t d);
+static uint8_t* emitUpdateNZ(uint8_t* p);
+static uint8_t* emitAddWithCarry(uint8_t* p, uint32_t carryIn);
+static uint8_t* emitLogicalRegister(uint8_t* p, uint16_t instr, uint8_t opcode, int invertM);
+static uint8_t* emitShiftImmediate(uint8_t* p, uint32_t d, uint8_t shiftOpcode, uint32_t shift, uint32_t carryBit);
+static uint8_t* emitImmediateOffsetAddress(uint8_t* p, uint32_t n, uint32_t offset);
+static uint8_t* emitRegisterOffsetAddress(uint8_t* p, uint32_t n, uint32_t m);
+static uint8_t* emitLoad(uint8_t* p, JitBlockState* pState, uint32_t index, uint32_t t, uint32_t size);
+static uint8_t* emitStore(uint8_t* p, JitBlockState* pState, uint32_t index, uint32_t t, uint32_t size);
+static uint8_t* emitDataWindowLookup(uint8_t* p, uint32_t windowOffset, uint32_t size, uint8_t** ppMissFixups,
+                                     uint32_t* pMissFixupCount);
+static uint32_t jitMemRead(PinkySimContext* pContext, uint32_t address, uint32_t size);
+static void jitMemWrite(PinkySimContext* pContext, uint32_t address, uint32_t size, uint32_t value);
+static void mergeCommittedState(JitBlockState* pState, uint32_t pc, uint32_t retired);
+static uint8_t* emitExitIfBlockInvalidated(uint8_t* p, JitBlockState* pState);
+static uint8_t* emitCommitPC(uint8_t* p, JitBlockState* pState, uint32_t address);
+static uint8_t* emitSetRetired(uint8_t* p, JitBlockState* pState, uint32_t retired);
+static uint8_t* emitCall(uint8_t* p, uint64_t function);
+static uint8_t* emitLoadRegister(uint8_t* p, uint8_t x86Reg, uint32_t reg);
+static uint8_t* emitStoreRegister(uint8_t* p, uint32_t reg, uint8_t x86Reg);
+static uint32_t registerOffset(uint32_t reg);
+static uint8_t* emitLoadFromContext(uint8_t* p, uint8_t x86Reg, uint32_t offset);
+static uint8_t* emitStoreToContext(uint8_t* p, uint32_t offset, uint8_t x86Reg);
+static uint8_t* emitStoreImmediateToContext(uint8_t* p, uint32_t offset, uint32_t value);
+static uint8_t* emitOrImmediateToContext(uint8_t* p, uint32_t offset, uint32_t value);
+static uint8_t contextModRM(uint8_t x86Reg);
+static uint8_t* emitMovImmediate32(uint8_t* p, uint8_t x86Reg, uint32_t value);
+static uint8_t* emitAddImmediate(uint8_t* p, uint8_t x86Reg, uint32_t value);
+static uint8_t* emitAluOp(uint8_t* p, uint8_t opcode, uint8_t x86RegDest, uint8_t x86RegSrc);
+static uint8_t* emitNot(uint8_t* p, uint8_t x86Reg);
+static uint8_t* emitShiftByImmediate(uint8_t* p, uint8_t shiftOpcode, uint8_t x86Reg, uint32_t shift);
+static uint8_t* emitByte(uint8_t* p, uint8_t byte);
+static uint8_t* emitUInt32(uint8_t* p, uint32_t value);
+static uint8_t* emitUInt64(uint8_t* p, uint64_t value);
+static uint8_t* emitJneToFixup(uint8_t* p, uint8_t** ppFixup);
+static uint8_t* emitShortJumpToFixup(uint8_t* p, uint8_t opcode, uint8_t** ppFixup);
+static void patchShortFixups(uint8_t** ppStart, uint8_t** ppEnd, uint8_t* pTarget);
+static void patchFixups(uint8_t** ppStart, uint8_t** ppEnd, uint8_t* pTarget);
+#endif /* PINKYSIM_JIT_X64 */
+static int convertExceptionToStepResult(int exceptionCode);
+static const DecodedInstruction* fetchDecodedInstruction(PinkySimContext* pContext, DecodedInstruction* pScratch);
+static uint32_t decodeCacheIndex(uint32_t address);
+static void fetchAndDecodeInstruction(PinkySimContext* pContext, uint32_t address, DecodedInstruction* pDecoded);
+static uint16_t fetchHalfWord(PinkySimContext* pContext, uint32_t address);
+static void discardMemoryWindows(PinkySimContext* pContext);
+static void discardDataWindow(IMemoryDataWindow* pWindow);
+static void invalidateBlocks(PinkySimDecodeCache* pCache, uint32_t address, uint32_t size);
+static int isCodeInPages(const PinkySimDecodeCache* pCache, uint32_t address, uint32_t size);
+static void invalidateBlock(PinkySimDecodeCache* pCache, DecodedBlock* pBlock);
+static void invalidateEntry(PinkySimDecodeCache* pCache, DecodedInstruction* pEntry);
+static InstructionHandler16 lookupHandler16(uint16_t instr);
+static void initHandlers16(void);
+static int isInstruction32Bit(uint16_t instr);
+static int executeDecodedInstruction(PinkySimContext* pContext, const DecodedInstruction* pDecoded);
+static void addInstructionCycles(PinkySimContext* pContext, const DecodedInstruction* pDecoded);
+static uint32_t baseInstructionCycles(const DecodedInstruction* pDecoded);
+static int isSingleLoadStore16(uint16_t instr);
+static void addFetchWaitStates(PinkySimCycleCounter* pCounter, uint32_t address);
+static int isFlashAddress(const PinkySimCycleCounter* pCounter, uint32_t address);
+static InstructionHandler16 decodeInstruction16(uint16_t instr);
+static int undefinedInstruction16(PinkySimContext* pContext, uint16_t instr);
+static int throwUndefined16(PinkySimContext* pContext, uint16_t instr);
+static int throwUnpredictable16(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 shiftAddSubtractMoveCompare(uint16_t instr);
 static int lslImmediate(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeImm10to6_Rm5to3_Rd2to0(uint32_t instr);
 static DecodedImmShift decodeImmshift(uint32_t typeBits, uint32_t imm5);
@@ -88,13 +380,15 @@ static int subImmediateT1(PinkySimContext* pContext, uint16_t instr);
 static int movImmediate(PinkySimContext* pContext, uint16_t instr);
 static void updateRdAndNZ(PinkySimContext* pContext, Fields* pFields, uint32_t results);
 static void updateNZ(PinkySimContext* pContext, Fields* pFields, uint32_t results);
+static void updateFlagsFromLazyFlags(PinkySimContext* pContext);
+static uint32_t getCarryFlag(PinkySimContext* pContext);
 static Fields decodeRd10to8_Imm7to0(uint32_t instr);
 static int cmpImmediate(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRn10to8_Imm7to0(uint32_t instr);
 static int addImmediateT2(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRdn10to8_Imm7to0(uint32_t instr);
 static int subImmediateT2(PinkySimContext* pContext, uint16_t instr);
-static int dataProcessing(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 dataProcessing(uint16_t instr);
 static int andRegister(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRm5to3_Rdn2to0(uint32_t instr);
 static int eorRegister(PinkySimContext* pContext, uint16_t instr);
@@ -114,7 +408,7 @@ static int mulRegister(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRn5to3_Rdm2to0(uint32_t instr);
 static int bicRegister(PinkySimContext* pContext, uint16_t instr);
 static int mvnRegister(PinkySimContext* pContext, uint16_t instr);
-static int specialDataAndBranchExchange(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 specialDataAndBranchExchange(uint16_t instr);
 static int addRegisterT2(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRdn7and2to0_Rm6to3(uint32_t instr);
 static void aluWritePC(PinkySimContext* pContext, uint32_t address);
@@ -132,11 +426,13 @@ static uint32_t align(uint32_t value, uint32_t alignment);
 static uint32_t unalignedMemRead(PinkySimContext* pContext, uint32_t address, uint32_t size);
 static uint32_t alignedMemRead(PinkySimContext* pContext, uint32_t address, uint32_t size);
 static int isAligned(uint32_t address, uint32_t size);
-static int loadStoreSingleDataItem(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 loadStoreSingleDataItem(uint16_t instr);
 static int strRegister(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRm8to6_Rn5to3_Rt2to0(uint32_t instr);
 static void unalignedMemWrite(PinkySimContext* pContext, uint32_t address, uint32_t size, uint32_t value);
 static void alignedMemWrite(PinkySimContext* pContext, uint32_t address, uint32_t size, uint32_t value);
+static void alignedMemReadWords(PinkySimContext* pContext, uint32_t address, uint32_t* pWords, uint32_t count);
+static void alignedMemWriteWords(PinkySimContext* pContext, uint32_t address, const uint32_t* pWords, uint32_t count);
 static int strhRegister(PinkySimContext* pContext, uint16_t instr);
 static int strbRegister(PinkySimContext* pContext, uint16_t instr);
 static int ldrsbRegister(PinkySimContext* pContext, uint16_t instr);
@@ -159,7 +455,7 @@ static int strImmediateT2(PinkySimContext* pContext, uint16_t instr);
 static int ldrImmediateT2(PinkySimContext* pContext, uint16_t instr);
 static int adr(PinkySimContext* pContext, uint16_t instr);
 static int addSPT1(PinkySimContext* pContext, uint16_t instr);
-static int misc16BitInstructions(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 misc16BitInstructions(uint16_t instr);
 static int addSPT2(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRdisSP_Imm6to0Shift2(uint32_t instr);
 static int subSP(PinkySimContext* pContext, uint16_t instr);
@@ -175,8 +471,9 @@ static int rev(PinkySimContext* pContext, uint16_t instr);
 static int rev16(PinkySimContext* pContext, uint16_t instr);
 static int revsh(PinkySimContext* pContext, uint16_t instr);
 static int pop(PinkySimContext* pContext, uint16_t instr);
+static int bkpt(PinkySimContext* pContext, uint16_t instr);
 static void loadWritePC(PinkySimContext* pContext, uint32_t address);
-static int hints(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 hints(uint16_t instr);
 static int nop(PinkySimContext* pContext, uint16_t instr);
 static int yield(PinkySimContext* pContext, uint16_t instr);
 static int wfe(PinkySimContext* pContext, uint16_t instr);
@@ -187,15 +484,17 @@ static int stm(PinkySimContext* pContext, uint16_t instr);
 static Fields decodeRn10to8RegisterList7to0(uint32_t instr);
 static int isNotLowestBitSet(uint32_t bits, uint32_t i);
 static int ldm(PinkySimContext* pContext, uint16_t instr);
-static int conditionalBranchAndSupervisor(PinkySimContext* pContext, uint16_t instr);
+static InstructionHandler16 conditionalBranchAndSupervisor(uint16_t instr);
 static int svc(PinkySimContext* pContext, uint16_t instr);
 static int conditionalBranch(PinkySimContext* pContext, uint16_t instr);
 static int conditionPassedForBranchInstr(PinkySimContext* pContext, uint16_t instr);
 static int unconditionalBranch(PinkySimContext* pContext, uint16_t instr);
-static int executeInstruction32(PinkySimContext* pContext, uint16_t instr1);
-static int branchAndMiscellaneousControl(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
+static InstructionHandler32 decodeInstruction32(uint16_t instr1, uint16_t instr2);
+static int undefinedInstruction32(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
+static int throwUndefined32(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
+static InstructionHandler32 branchAndMiscellaneousControl(uint16_t instr1, uint16_t instr2);
 static int msr(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
-static int miscellaneousControl(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
+static InstructionHandler32 miscellaneousControl(uint16_t instr2);
 static int dsb(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
 static int dmb(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
 static int isb(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
@@ -203,116 +502,1851 @@ static int mrs(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
 static int bl(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2);
 
 
-int pinkySimRun(PinkySimContext* pContext, int (*callback)(PinkySimContext*))
+int pinkySimRun(PinkySimContext* pContext, int (*callback)(PinkySimContext*))
+{
+    return run(pContext, callback, executeInstruction);
+}
+
+
+int pinkySimRunBlocks(PinkySimContext* pContext, int (*callback)(PinkySimContext*))
+{
+    if (!pContext->pDecodeCache)
+        return pinkySimRun(pContext, callback);
+    return run(pContext, callback, executeBlock);
+}
+
+int pinkySimRunFor(PinkySimContext* pContext,
+                   int              (*callback)(PinkySimContext*),
+                   uint64_t         maxInstructions,
+                   uint64_t*        pInstructionsRetired)
+{
+    int               result = PINKYSIM_STEP_OK;
+    volatile uint64_t retired = 0;
+
+    discardMemoryWindows(pContext);
+    __try
+    {
+        while (retired < maxInstructions)
+        {
+            result = invokeCallback(pContext, callback);
+            if (result == PINKYSIM_STEP_OK)
+                result = executeInstruction(pContext);
+            if (result != PINKYSIM_STEP_OK)
+                break;
+            retired++;
+        }
+        if (result == PINKYSIM_STEP_OK)
+            result = PINKYSIM_RUN_LIMIT;
+    }
+    __catch
+    {
+        return finishRunFor(pContext, convertExceptionToStepResult(getExceptionCode()), retired, pInstructionsRetired);
+    }
+    return finishRunFor(pContext, result, retired, pInstructionsRetired);
+}
+
+int pinkySimRunBlocksFor(PinkySimContext* pContext,
+                         int              (*callback)(PinkySimContext*),
+                         uint64_t         maxInstructions,
+                         uint64_t*        pInstructionsRetired)
+{
+    int               result = PINKYSIM_STEP_OK;
+    volatile uint64_t retired = 0;
+
+    if (!pContext->pDecodeCache)
+        return pinkySimRunFor(pContext, callback, maxInstructions, pInstructionsRetired);
+
+    pContext->pDecodeCache->pExecutingBlock = NULL;
+    discardMemoryWindows(pContext);
+    __try
+    {
+        while (retired < maxInstructions)
+        {
+            uint64_t remaining = maxInstructions - retired;
+            uint32_t maxCount = remaining < BLOCK_MAX_INSTRUCTIONS ? (uint32_t)remaining : BLOCK_MAX_INSTRUCTIONS;
+            uint32_t blockRetired = 0;
+
+            result = invokeCallback(pContext, callback);
+            if (result == PINKYSIM_STEP_OK)
+                result = executeBlockFor(pContext, maxCount, &blockRetired);
+            retired += blockRetired;
+            if (result != PINKYSIM_STEP_OK)
+                break;
+        }
+        if (result == PINKYSIM_STEP_OK)
+            result = PINKYSIM_RUN_LIMIT;
+    }
+    __catch
+    {
+        retired += countRetiredBeforeFaultInBlock(pContext);
+        return finishRunFor(pContext, convertExceptionToStepResult(getExceptionCode()), retired, pInstructionsRetired);
+    }
+    return finishRunFor(pContext, result, retired, pInstructionsRetired);
+}
+
+static uint32_t countRetiredBeforeFaultInBlock(PinkySimContext* pContext)
+{
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    const DecodedBlock*  pBlock = pCache->pExecutingBlock;
+    uint32_t             i;
+
+    /* Instructions in a block run in address order and the PC is left pointing at the one which faulted. */
+    pCache->pExecutingBlock = NULL;
+    if (!pBlock)
+        return 0;
+    for (i = 0 ; i < pBlock->count ; i++)
+    {
+        if (pBlock->instructions[i].address == pContext->pc)
+            return i;
+    }
+    return 0;
+}
+
+static int invokeCallback(PinkySimContext* pContext, int (*callback)(PinkySimContext*))
+{
+    if (!callback)
+        return PINKYSIM_STEP_OK;
+
+    /* The callback is free to inspect the APSR flags. */
+    updateFlagsFromLazyFlags(pContext);
+    return callback(pContext);
+}
+
+static int finishRunFor(PinkySimContext* pContext, int result, uint64_t retired, uint64_t* pInstructionsRetired)
+{
+    updateFlagsFromLazyFlags(pContext);
+    if (pInstructionsRetired)
+        *pInstructionsRetired = retired;
+    return result;
+}
+
+static int run(PinkySimContext* pContext, int (*callback)(PinkySimContext*), int (*execute)(PinkySimContext*))
+{
+    int result = PINKYSIM_STEP_OK;
+
+    discardMemoryWindows(pContext);
+    /* A single exception frame covers the whole run rather than paying for a setjmp() on every instruction.  The PC
+       is only committed once an instruction completes so it is still left pointing at any instruction which faults. */
+    __try
+    {
+        do
+        {
+            result = invokeCallback(pContext, callback);
+            if (result == PINKYSIM_STEP_OK)
+                result = execute(pContext);
+        } while (result == PINKYSIM_STEP_OK);
+    }
+    __catch
+    {
+        updateFlagsFromLazyFlags(pContext);
+        return convertExceptionToStepResult(getExceptionCode());
+    }
+    updateFlagsFromLazyFlags(pContext);
+    return result;
+}
+
+static int executeBlock(PinkySimContext* pContext)
+{
+    uint32_t retired;
+
+    return executeBlockFor(pContext, BLOCK_MAX_INSTRUCTIONS, &retired);
+}
+
+static int executeBlockFor(PinkySimContext* pContext, uint32_t maxCount, uint32_t* pRetired)
+{
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    DecodedBlock*        pBlock;
+    int                  result;
+
+    *pRetired = 0;
+    if (!(pContext->xPSR & EPSR_T))
+        return PINKYSIM_STEP_HARDFAULT;
+
+    pBlock = fetchDecodedBlock(pContext);
+    pCache->pExecutingBlock = pBlock;
+    /* The generated code always runs the whole block so it can only be used when that fits in the budget. */
+    if (pBlock->jitFunction && !pContext->cycleCounter.enabled && pBlock->count <= maxCount)
+    {
+        result = pBlock->jitFunction(pContext);
+        *pRetired = pCache->jitInstructionsRetired;
+    }
+    else
+    {
+        result = executeDecodedBlock(pContext, pBlock, maxCount, pRetired);
+    }
+    pCache->pExecutingBlock = NULL;
+    return result;
+}
+
+static DecodedBlock* fetchDecodedBlock(PinkySimContext* pContext)
+{
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    DecodedBlock*        pBlock = &pCache->blocks[blockCacheIndex(pContext->pc)];
+
+    if (pBlock->address != pContext->pc)
+    {
+        invalidateBlock(pCache, pBlock);
+        decodeBlock(pContext, pBlock, pContext->pc);
+        updateCodePageCounts(pCache, pBlock->address, pBlock->endAddress, 1);
+        /* The write window may cover the code which was just decoded. */
+        discardDataWindow(&pContext->writeWindow);
+    }
+#ifdef PINKYSIM_JIT_X64
+    else if (shouldTranslateBlock(pCache, pBlock))
+    {
+        translateBlock(pCache, pBlock);
+    }
+#endif /* PINKYSIM_JIT_X64 */
+    return pBlock;
+}
+
+static int shouldTranslateBlock(PinkySimDecodeCache* pCache, DecodedBlock* pBlock)
+{
+    if (!pCache->pJitCode || pBlock->jitFunction)
+        return 0;
+    return ++pBlock->executionCount >= JIT_THRESHOLD;
+}
+
+static uint32_t blockCacheIndex(uint32_t address)
+{
+    return (address >> 1) & (BLOCK_CACHE_ENTRIES - 1);
+}
+
+static void updateCodePageCounts(PinkySimDecodeCache* pCache, uint32_t address, uint32_t endAddress, int delta)
+{
+    uint32_t firstPage = codePageIndex(address);
+    uint32_t lastPage = codePageIndex(endAddress - 1);
+
+    /* Instructions and blocks are never larger than a page so they can only straddle two of them. */
+    pCache->codePageCounts[firstPage] += delta;
+    if (lastPage != firstPage)
+        pCache->codePageCounts[lastPage] += delta;
+}
+
+static uint32_t codePageIndex(uint32_t address)
+{
+    return (address >> CODE_PAGE_SHIFT) & (CODE_PAGE_ENTRIES - 1);
+}
+
+static void decodeBlock(PinkySimContext* pContext, DecodedBlock* pBlock, uint32_t address)
+{
+    DecodedInstruction* pDecoded = &pBlock->instructions[0];
+
+    /* A fault fetching the first instruction is reported to the caller and leaves the entry invalid. */
+    pBlock->address = DECODE_CACHE_INVALID_ADDRESS;
+    fetchAndDecodeInstruction(pContext, address, pDecoded);
+    address += instructionSize(pDecoded);
+    pBlock->count = 1;
+
+    /* A fault fetching any of the following instructions just ends the block early.  It will be reported if execution
+       actually reaches that address. */
+    while (!isBlockTerminator(pDecoded) && pBlock->count < ARRAY_SIZE(pBlock->instructions))
+    {
+        pDecoded = &pBlock->instructions[pBlock->count];
+        if (!tryFetchAndDecodeInstruction(pContext, address, pDecoded))
+            break;
+        address += instructionSize(pDecoded);
+        pBlock->count++;
+    }
+    pBlock->address = pBlock->instructions[0].address;
+    pBlock->endAddress = address;
+    pBlock->executionCount = 0;
+    pBlock->jitFunction = NULL;
+    findInstructionPairs(pBlock);
+}
+
+static int tryFetchAndDecodeInstruction(PinkySimContext* pContext, uint32_t address, DecodedInstruction* pDecoded)
+{
+    __try
+    {
+        fetchAndDecodeInstruction(pContext, address, pDecoded);
+    }
+    __catch
+    {
+        clearExceptionCode();
+        return 0;
+    }
+    return 1;
+}
+
+static uint32_t instructionSize(const DecodedInstruction* pDecoded)
+{
+    return pDecoded->handler32 ? 4 : 2;
+}
+
+static int isBlockTerminator(const DecodedInstruction* pDecoded)
+{
+    InstructionHandler16 handler16 = pDecoded->handler16;
+    InstructionHandler32 handler32 = pDecoded->handler32;
+    uint16_t             instr = pDecoded->instr1;
+
+    if (handler32)
+        return handler32 != msr && handler32 != mrs && handler32 != dsb && handler32 != dmb && handler32 != isb;
+    if (handler16 == addRegisterT2 || handler16 == movRegister)
+        return (instr & 0x87) == 0x87;
+    if (handler16 == pop)
+        return instr & (1 << 8);
+    return handler16 == conditionalBranch ||
+           handler16 == unconditionalBranch ||
+           handler16 == bx ||
+           handler16 == blx ||
+           handler16 == svc ||
+           handler16 == bkpt ||
+           handler16 == undefinedInstruction16 ||
+           handler16 == throwUndefined16 ||
+           handler16 == throwUnpredictable16;
+}
+
+static int executeDecodedBlock(PinkySimContext* pContext, const DecodedBlock* pBlock, uint32_t maxCount,
+                               uint32_t* pRetired)
+{
+    uint32_t blockAddress = pBlock->address;
+    uint32_t count = pBlock->count < maxCount ? pBlock->count : maxCount;
+    int      result = PINKYSIM_STEP_OK;
+    uint32_t i;
+
+    /* i ends up as the number of instructions which completed successfully however the loop is left. */
+    for (i = 0 ; i < count ; i++)
+    {
+        const DecodedInstruction* pDecoded = &pBlock->instructions[i];
+
+        /* Stop early if the previous instruction branched or overwrote code in this block. */
+        if (pContext->pc != pDecoded->address || pBlock->address != blockAddress)
+            break;
+        if (pBlock->pairHandlers[i] && i + 1 < count && !pContext->cycleCounter.enabled)
+        {
+            result = pBlock->pairHandlers[i](pContext, pDecoded);
+            i++;
+        }
+        else
+        {
+            result = executeDecodedInstruction(pContext, pDecoded);
+            if (pContext->cycleCounter.enabled)
+                addInstructionCycles(pContext, pDecoded);
+        }
+        pContext->pc = pContext->newPC;
+        if (result != PINKYSIM_STEP_OK)
+            break;
+    }
+    *pRetired = i;
+    return result;
+}
+
+static void findInstructionPairs(DecodedBlock* pBlock)
+{
+    uint32_t i = 0;
+
+    while (i < pBlock->count)
+    {
+        PairHandler pairHandler = NULL;
+
+        if (i + 1 < pBlock->count)
+            pairHandler = lookupPairHandler(&pBlock->instructions[i], &pBlock->instructions[i + 1]);
+        pBlock->pairHandlers[i++] = pairHandler;
+        if (pairHandler)
+            pBlock->pairHandlers[i++] = NULL;
+    }
+}
+
+static PairHandler lookupPairHandler(const DecodedInstruction* pFirst, const DecodedInstruction* pSecond)
+{
+    /* Common pairs in compiled Cortex-M0 code.  The first instruction of each pair never branches or writes to memory
+       so there is no need to check the PC or for modified code between the two. */
+    static const InstructionPair pairs[] =
+    {
+        { cmpImmediate,   conditionalBranch, cmpImmediateAndConditionalBranch },
+        { cmpRegisterT1,  conditionalBranch, cmpRegisterAndConditionalBranch },
+        { subImmediateT2, conditionalBranch, subImmediateAndConditionalBranch },
+        { movImmediate,   lslImmediate,      movImmediateAndLslImmediate },
+        { ldrLiteral,     ldrImmediateT1,    ldrLiteralAndLdrImmediate },
+        { addImmediateT2, cmpImmediate,      addImmediateAndCmpImmediate },
+        { addImmediateT2, cmpRegisterT1,     addImmediateAndCmpRegister }
+    };
+    size_t i;
+
+    for (i = 0 ; i < ARRAY_SIZE(pairs) ; i++)
+    {
+        if (pFirst->handler16 == pairs[i].first && pSecond->handler16 == pairs[i].second)
+            return pairs[i].pairHandler;
+    }
+    return NULL;
+}
+
+/* Each pair handler calls the two instruction handlers directly rather than through the decoded handler pointers.
+   The PC is committed between the two so that a fault in the second instruction is reported at its own address.  The
+   first instruction of each pair always returns PINKYSIM_STEP_OK (or throws) so its result isn't checked. */
+static void startSecondOfPair(PinkySimContext* pContext)
+{
+    pContext->pc = pContext->newPC;
+    pContext->newPC = pContext->pc + 2;
+}
+
+static int cmpImmediateAndConditionalBranch(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    cmpImmediate(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return conditionalBranch(pContext, pFirst[1].instr1);
+}
+
+static int cmpRegisterAndConditionalBranch(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    cmpRegisterT1(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return conditionalBranch(pContext, pFirst[1].instr1);
+}
+
+static int subImmediateAndConditionalBranch(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    subImmediateT2(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return conditionalBranch(pContext, pFirst[1].instr1);
+}
+
+static int movImmediateAndLslImmediate(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    movImmediate(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return lslImmediate(pContext, pFirst[1].instr1);
+}
+
+static int ldrLiteralAndLdrImmediate(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    ldrLiteral(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return ldrImmediateT1(pContext, pFirst[1].instr1);
+}
+
+static int addImmediateAndCmpImmediate(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    addImmediateT2(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return cmpImmediate(pContext, pFirst[1].instr1);
+}
+
+static int addImmediateAndCmpRegister(PinkySimContext* pContext, const DecodedInstruction* pFirst)
+{
+    pContext->newPC = pContext->pc + 2;
+    addImmediateT2(pContext, pFirst[0].instr1);
+    startSecondOfPair(pContext);
+    return cmpRegisterT1(pContext, pFirst[1].instr1);
+}
+
+#ifdef PINKYSIM_JIT_X64
+/* The JIT translates a basic block into native code, generating the equivalent of executeDecodedBlock() unrolled for
+   that particular block.  The data processing and load/store instructions which make up most blocks are translated
+   inline (see lookupJitTranslator()) and the rest become direct calls to the same handlers used by the interpreter.
+   The context pointer is kept in RBX (callee saved) for the duration of the block. */
+static void translateBlock(PinkySimDecodeCache* pCache, DecodedBlock* pBlock)
+{
+    uint8_t* pStart;
+    uint8_t* pEnd;
+
+    if (pCache->jitCodeUsed + JIT_MAX_BLOCK_CODE_SIZE > JIT_CODE_SIZE)
+        resetJitCode(pCache);
+    pStart = pCache->pJitCode + pCache->jitCodeUsed;
+
+    /* The buffer is never writable and executable at the same time.  The pages which this block lands in are made
+       writable just while it is generated and are then switched back to executable. */
+    if (!protectJitCode(pStart, JIT_MAX_BLOCK_CODE_SIZE, PROT_READ | PROT_WRITE))
+    {
+        pBlock->executionCount = 0;
+        return;
+    }
+    pEnd = emitBlock(pStart, pCache, pBlock);
+    assert ( pEnd - pStart <= JIT_MAX_BLOCK_CODE_SIZE );
+    if (!protectJitCode(pStart, JIT_MAX_BLOCK_CODE_SIZE, PROT_READ | PROT_EXEC))
+    {
+        /* Earlier blocks sharing these pages can't be run from them any more either. */
+        resetJitCode(pCache);
+        return;
+    }
+    pCache->jitCodeUsed += pEnd - pStart;
+    pBlock->jitFunction = (JitBlockFunction)(void*)pStart;
+}
+
+static int protectJitCode(uint8_t* pStart, size_t size, int protection)
+{
+    size_t    pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t startPage = (uintptr_t)pStart & ~(pageSize - 1);
+    uintptr_t endPage = ((uintptr_t)pStart + size + pageSize - 1) & ~(pageSize - 1);
+
+    return mprotect((void*)startPage, endPage - startPage, protection) == 0;
+}
+
+static void resetJitCode(PinkySimDecodeCache* pCache)
+{
+    size_t i;
+
+    for (i = 0 ; i < ARRAY_SIZE(pCache->blocks) ; i++)
+    {
+        pCache->blocks[i].jitFunction = NULL;
+        pCache->blocks[i].executionCount = 0;
+    }
+    pCache->jitCodeUsed = 0;
+}
+
+static uint8_t* emitBlock(uint8_t* p, PinkySimDecodeCache* pCache, const DecodedBlock* pBlock)
+{
+    JitBlockState state;
+    uint32_t      i;
+
+    state.pBlock = pBlock;
+    state.exitFixupCount = 0;
+    state.exitOkFixupCount = 0;
+    state.pc = pBlock->address;
+    state.retired = 0;
+
+    /* R12 holds the number of instructions which have completed at each point where the generated code can exit.  The
+       extra 8 bytes keep the stack 16-byte aligned for calls.
+       push rbx; push r12; sub rsp, 8; mov rbx, rdi; xor r12d, r12d */
+    p = emitByte(p, 0x53);
+    p = emitByte(p, 0x41); p = emitByte(p, 0x54);
+    p = emitByte(p, 0x48); p = emitByte(p, 0x83); p = emitByte(p, 0xEC); p = emitByte(p, 0x08);
+    p = emitByte(p, 0x48); p = emitByte(p, 0x89); p = emitByte(p, 0xFB);
+    p = emitByte(p, 0x45); p = emitByte(p, 0x31); p = emitByte(p, 0xE4);
+    for (i = 0 ; i < pBlock->count ; i++)
+        p = emitInstruction(p, &state, i);
+    /* Instructions translated inline don't update the PC unless they need to so it may still be behind here. */
+    p = emitCommitPC(p, &state, pBlock->endAddress);
+    p = emitSetRetired(p, &state, pBlock->count);
+
+    /* exitOk: xor eax, eax */
+    patchFixups(state.exitOkFixups, state.exitOkFixups + state.exitOkFixupCount, p);
+    p = emitByte(p, 0x31); p = emitByte(p, 0xC0);
+    /* exit: mov rdx, &pCache->jitInstructionsRetired; mov [rdx], r12d; add rsp, 8; pop r12; pop rbx; ret */
+    patchFixups(state.exitFixups, state.exitFixups + state.exitFixupCount, p);
+    p = emitByte(p, 0x48); p = emitByte(p, 0xBA); p = emitUInt64(p, (uint64_t)(size_t)&pCache->jitInstructionsRetired);
+    p = emitByte(p, 0x44); p = emitByte(p, 0x89); p = emitByte(p, 0x22);
+    p = emitByte(p, 0x48); p = emitByte(p, 0x83); p = emitByte(p, 0xC4); p = emitByte(p, 0x08);
+    p = emitByte(p, 0x41); p = emitByte(p, 0x5C);
+    p = emitByte(p, 0x5B);
+    p = emitByte(p, 0xC3);
+    return p;
+}
+
+static uint8_t* emitInstruction(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    JitTranslator translator = lookupJitTranslator(&pState->pBlock->instructions[index]);
+    uint8_t*      pEnd = NULL;
+
+    if (translator)
+        pEnd = translator(p, pState, index);
+    if (!pEnd)
+        pEnd = emitHandlerCall(p, pState, index);
+    return pEnd;
+}
+
+static JitTranslator lookupJitTranslator(const DecodedInstruction* pDecoded)
+{
+    /* Instructions which only touch registers, flags and memory.  These include the first instruction of every pair in
+       lookupPairHandler() so the generated code never needs to call the pair handlers. */
+    static const JitTranslation translations[] =
+    {
+        { movImmediate,   translateMovImmediate },
+        { movRegister,    translateMovRegister },
+        { addImmediateT1, translateAddImmediateT1 },
+        { addImmediateT2, translateAddImmediateT2 },
+        { addRegisterT1,  translateAddRegisterT1 },
+        { subImmediateT1, translateSubImmediateT1 },
+        { subImmediateT2, translateSubImmediateT2 },
+        { subRegister,    translateSubRegister },
+        { cmpImmediate,   translateCmpImmediate },
+        { cmpRegisterT1,  translateCmpRegisterT1 },
+        { cmnRegister,    translateCmnRegister },
+        { andRegister,    translateAndRegister },
+        { eorRegister,    translateEorRegister },
+        { orrRegister,    translateOrrRegister },
+        { bicRegister,    translateBicRegister },
+        { mvnRegister,    translateMvnRegister },
+        { tstRegister,    translateTstRegister },
+        { lslImmediate,   translateLslImmediate },
+        { lsrImmediate,   translateLsrImmediate },
+        { asrImmediate,   translateAsrImmediate },
+        { addSPT1,        translateAddSPT1 },
+        { addSPT2,        translateAddSPT2 },
+        { subSP,          translateSubSP },
+        { adr,            translateAdr },
+        { ldrLiteral,     translateLdrLiteral },
+        { ldrImmediateT1, translateLdrImmediateT1 },
+        { ldrImmediateT2, translateLdrImmediateT2 },
+        { ldrbImmediate,  translateLdrbImmediate },
+        { ldrhImmediate,  translateLdrhImmediate },
+        { ldrRegister,    translateLdrRegister },
+        { ldrbRegister,   translateLdrbRegister },
+        { ldrhRegister,   translateLdrhRegister },
+        { strImmediateT1, translateStrImmediateT1 },
+        { strImmediateT2, translateStrImmediateT2 },
+        { strbImmediate,  translateStrbImmediate },
+        { strhImmediate,  translateStrhImmediate },
+        { strRegister,    translateStrRegister },
+        { strbRegister,   translateStrbRegister },
+        { strhRegister,   translateStrhRegister }
+    };
+    size_t i;
+
+    if (pDecoded->handler32)
+        return NULL;
+    for (i = 0 ; i < ARRAY_SIZE(translations) ; i++)
+    {
+        if (pDecoded->handler16 == translations[i].handler)
+            return translations[i].translator;
+    }
+    return NULL;
+}
+
+static uint8_t* emitHandlerCall(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    const DecodedInstruction* pDecoded = &pState->pBlock->instructions[index];
+    uint32_t                  nextAddress = pDecoded->address + instructionSize(pDecoded);
+
+    /* The handler can read the PC and a failing instruction doesn't count as completed. */
+    p = emitCommitPC(p, pState, pDecoded->address);
+    p = emitSetRetired(p, pState, index);
+    /* mov dword [rbx + newPC], nextAddress; mov esi, instr1; mov edx, instr2; call handler */
+    p = emitStoreImmediateToContext(p, offsetof(PinkySimContext, newPC), nextAddress);
+    p = emitMovImmediate32(p, X86_ESI, pDecoded->instr1);
+    if (pDecoded->handler32)
+    {
+        p = emitMovImmediate32(p, X86_EDX, pDecoded->instr2);
+        p = emitCall(p, (uint64_t)(size_t)pDecoded->handler32);
+    }
+    else
+    {
+        p = emitCall(p, (uint64_t)(size_t)pDecoded->handler16);
+    }
+    /* mov ecx, [rbx + newPC]; mov [rbx + pc], ecx; test eax, eax; jne exit */
+    p = emitLoadFromContext(p, X86_ECX, offsetof(PinkySimContext, newPC));
+    p = emitStoreToContext(p, offsetof(PinkySimContext, pc), X86_ECX);
+    p = emitByte(p, 0x85); p = emitByte(p, 0xC0);
+    p = emitJneToFixup(p, &pState->exitFixups[pState->exitFixupCount++]);
+    /* Past this point the PC either matches nextAddress or the block has been exited. */
+    pState->pc = nextAddress;
+    if (isLastInBlock(pState, index))
+        return p;
+
+    /* Stop early if this instruction branched or overwrote code in this block, just like executeDecodedBlock().
+       cmp ecx, nextAddress; jne exitOk */
+    p = emitSetRetired(p, pState, index + 1);
+    p = emitByte(p, 0x81); p = emitByte(p, 0xF9); p = emitUInt32(p, nextAddress);
+    p = emitJneToFixup(p, &pState->exitOkFixups[pState->exitOkFixupCount++]);
+    return emitExitIfBlockInvalidated(p, pState);
+}
+
+static int isLastInBlock(const JitBlockState* pState, uint32_t index)
+{
+    return index == pState->pBlock->count - 1;
+}
+
+static uint16_t instructionAt(const JitBlockState* pState, uint32_t index)
+{
+    return pState->pBlock->instructions[index].instr1;
+}
+
+static uint8_t* translateMovImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRd10to8_Imm7to0(instructionAt(pState, index));
+
+    p = emitMovImmediate32(p, X86_EAX, fields.imm);
+    return emitUpdateRdAndNZ(p, fields.d);
+}
+
+static uint8_t* translateMovRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRdn7and2to0_Rm6to3(instructionAt(pState, index));
+
+    /* Reading the PC or writing it (which ends the block) is left to the handler. */
+    if (fields.d == PC || fields.m == PC)
+        return NULL;
+    p = emitLoadRegister(p, X86_EAX, fields.m);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateAddImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm8to6_Rn5to3_Rd2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitMovImmediate32(p, X86_ECX, fields.imm);
+    p = emitAddWithCarry(p, 0);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateAddImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRdn10to8_Imm7to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitMovImmediate32(p, X86_ECX, fields.imm);
+    p = emitAddWithCarry(p, 0);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateAddRegisterT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rd2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitLoadRegister(p, X86_ECX, fields.m);
+    p = emitAddWithCarry(p, 0);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateSubImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm8to6_Rn5to3_Rd2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitMovImmediate32(p, X86_ECX, ~fields.imm);
+    p = emitAddWithCarry(p, 1);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateSubImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRdn10to8_Imm7to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitMovImmediate32(p, X86_ECX, ~fields.imm);
+    p = emitAddWithCarry(p, 1);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateSubRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rd2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitLoadRegister(p, X86_ECX, fields.m);
+    p = emitNot(p, X86_ECX);
+    p = emitAddWithCarry(p, 1);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateCmpImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRn10to8_Imm7to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitMovImmediate32(p, X86_ECX, ~fields.imm);
+    return emitAddWithCarry(p, 1);
+}
+
+static uint8_t* translateCmpRegisterT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm5to3_Rdn2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitLoadRegister(p, X86_ECX, fields.m);
+    p = emitNot(p, X86_ECX);
+    return emitAddWithCarry(p, 1);
+}
+
+static uint8_t* translateCmnRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm5to3_Rdn2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitLoadRegister(p, X86_ECX, fields.m);
+    return emitAddWithCarry(p, 0);
+}
+
+static uint8_t* translateAndRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    return emitLogicalRegister(p, instructionAt(pState, index), X86_AND, 0);
+}
+
+static uint8_t* translateEorRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    return emitLogicalRegister(p, instructionAt(pState, index), X86_XOR, 0);
+}
+
+static uint8_t* translateOrrRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    return emitLogicalRegister(p, instructionAt(pState, index), X86_OR, 0);
+}
+
+static uint8_t* translateBicRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    return emitLogicalRegister(p, instructionAt(pState, index), X86_AND, 1);
+}
+
+static uint8_t* translateMvnRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm5to3_Rdn2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.m);
+    p = emitNot(p, X86_EAX);
+    return emitUpdateRdAndNZ(p, fields.d);
+}
+
+static uint8_t* translateTstRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm5to3_Rdn2to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitLoadRegister(p, X86_ECX, fields.m);
+    p = emitAluOp(p, X86_AND, X86_EAX, X86_ECX);
+    return emitUpdateNZ(p);
+}
+
+static uint8_t* translateLslImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rm5to3_Rd2to0(instructionAt(pState, index));
+
+    /* A shift of 0 is just a MOVS which leaves the carry flag alone. */
+    p = emitLoadRegister(p, X86_EAX, fields.m);
+    if (fields.imm == 0)
+        return emitUpdateRdAndNZ(p, fields.d);
+    return emitShiftImmediate(p, fields.d, X86_SHL, fields.imm, 32 - fields.imm);
+}
+
+static uint8_t* translateLsrImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rm5to3_Rd2to0(instructionAt(pState, index));
+
+    /* A shift of 0 encodes a shift by 32 which is left to the handler. */
+    if (fields.imm == 0)
+        return NULL;
+    p = emitLoadRegister(p, X86_EAX, fields.m);
+    return emitShiftImmediate(p, fields.d, X86_SHR, fields.imm, fields.imm - 1);
+}
+
+static uint8_t* translateAsrImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rm5to3_Rd2to0(instructionAt(pState, index));
+
+    /* A shift of 0 encodes a shift by 32 which is left to the handler. */
+    if (fields.imm == 0)
+        return NULL;
+    p = emitLoadRegister(p, X86_EAX, fields.m);
+    return emitShiftImmediate(p, fields.d, X86_SAR, fields.imm, fields.imm - 1);
+}
+
+static uint8_t* translateAddSPT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRd10to8_Imm7to0(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, SP);
+    p = emitAddImmediate(p, X86_EAX, fields.imm << 2);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateAddSPT2(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRdisSP_Imm6to0Shift2(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, SP);
+    p = emitAddImmediate(p, X86_EAX, fields.imm);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateSubSP(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRdisSP_Imm6to0Shift2(instructionAt(pState, index));
+
+    p = emitLoadRegister(p, X86_EAX, SP);
+    p = emitAddImmediate(p, X86_EAX, ~fields.imm + 1);
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateAdr(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    const DecodedInstruction* pDecoded = &pState->pBlock->instructions[index];
+    Fields                    fields = decodeRd10to8_Imm7to0(pDecoded->instr1);
+
+    p = emitMovImmediate32(p, X86_EAX, align(pDecoded->address + 4, 4) + (fields.imm << 2));
+    return emitStoreRegister(p, fields.d, X86_EAX);
+}
+
+static uint8_t* translateLdrLiteral(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    const DecodedInstruction* pDecoded = &pState->pBlock->instructions[index];
+    Fields                    fields = decodeRt10to8_Imm7to0Shift2(pDecoded->instr1);
+
+    p = emitMovImmediate32(p, X86_ESI, align(pDecoded->address + 4, 4) + fields.imm);
+    return emitLoad(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateLdrImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, fields.n, fields.imm << 2);
+    return emitLoad(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateLdrImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRt10to8_Imm7to0Shift2(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, SP, fields.imm);
+    return emitLoad(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateLdrbImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, fields.n, fields.imm);
+    return emitLoad(p, pState, index, fields.t, 1);
+}
+
+static uint8_t* translateLdrhImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, fields.n, fields.imm << 1);
+    return emitLoad(p, pState, index, fields.t, 2);
+}
+
+static uint8_t* translateLdrRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitRegisterOffsetAddress(p, fields.n, fields.m);
+    return emitLoad(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateLdrbRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitRegisterOffsetAddress(p, fields.n, fields.m);
+    return emitLoad(p, pState, index, fields.t, 1);
+}
+
+static uint8_t* translateLdrhRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitRegisterOffsetAddress(p, fields.n, fields.m);
+    return emitLoad(p, pState, index, fields.t, 2);
+}
+
+static uint8_t* translateStrImmediateT1(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, fields.n, fields.imm << 2);
+    return emitStore(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateStrImmediateT2(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRt10to8_Imm7to0Shift2(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, SP, fields.imm);
+    return emitStore(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateStrbImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, fields.n, fields.imm);
+    return emitStore(p, pState, index, fields.t, 1);
+}
+
+static uint8_t* translateStrhImmediate(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeImm10to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitImmediateOffsetAddress(p, fields.n, fields.imm << 1);
+    return emitStore(p, pState, index, fields.t, 2);
+}
+
+static uint8_t* translateStrRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitRegisterOffsetAddress(p, fields.n, fields.m);
+    return emitStore(p, pState, index, fields.t, 4);
+}
+
+static uint8_t* translateStrbRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitRegisterOffsetAddress(p, fields.n, fields.m);
+    return emitStore(p, pState, index, fields.t, 1);
+}
+
+static uint8_t* translateStrhRegister(uint8_t* p, JitBlockState* pState, uint32_t index)
+{
+    Fields fields = decodeRm8to6_Rn5to3_Rt2to0(instructionAt(pState, index));
+
+    p = emitRegisterOffsetAddress(p, fields.n, fields.m);
+    return emitStore(p, pState, index, fields.t, 2);
+}
+
+static uint8_t* emitUpdateRdAndNZ(uint8_t* p, uint32_t d)
+{
+    /* Same as updateRdAndNZ() for the result in EAX. */
+    p = emitStoreRegister(p, d, X86_EAX);
+    return emitUpdateNZ(p);
+}
+
+static uint8_t* emitUpdateNZ(uint8_t* p)
+{
+    /* mov [rbx + lazyFlags.result], eax; or dword [rbx + lazyFlags.pending], LAZY_NZ */
+    p = emitStoreToContext(p, offsetof(PinkySimContext, lazyFlags.result), X86_EAX);
+    return emitOrImmediateToContext(p, offsetof(PinkySimContext, lazyFlags.pending), LAZY_NZ);
+}
+
+static uint8_t* emitAddWithCarry(uint8_t* p, uint32_t carryIn)
+{
+    /* Same as addWithCarry() followed by updateNZCV() for x in EAX and y in ECX.  Leaves the result in EAX. */
+    p = emitStoreToContext(p, offsetof(PinkySimContext, lazyFlags.operand1), X86_EAX);
+    p = emitStoreToContext(p, offsetof(PinkySimContext, lazyFlags.operand2), X86_ECX);
+    p = emitStoreImmediateToContext(p, offsetof(PinkySimContext, lazyFlags.carryIn), carryIn);
+    p = emitAluOp(p, X86_ADD, X86_EAX, X86_ECX);
+    if (carryIn)
+        p = emitAddImmediate(p, X86_EAX, 1);
+    p = emitStoreToContext(p, offsetof(PinkySimContext, lazyFlags.result), X86_EAX);
+    return emitStoreImmediateToContext(p, offsetof(PinkySimContext, lazyFlags.pending), LAZY_NZ | LAZY_ADD_CV);
+}
+
+static uint8_t* emitLogicalRegister(uint8_t* p, uint16_t instr, uint8_t opcode, int invertM)
+{
+    Fields fields = decodeRm5to3_Rdn2to0(instr);
+
+    p = emitLoadRegister(p, X86_EAX, fields.n);
+    p = emitLoadRegister(p, X86_ECX, fields.m);
+    if (invertM)
+        p = emitNot(p, X86_ECX);
+    p = emitAluOp(p, opcode, X86_EAX, X86_ECX);
+    return emitUpdateRdAndNZ(p, fields.d);
+}
+
+static uint8_t* emitShiftImmediate(uint8_t* p, uint32_t d, uint8_t shiftOpcode, uint32_t shift, uint32_t carryBit)
+{
+    /* Same as updateRdAndNZC() for the value in EAX shifted by 1 to 31 bits.  The carry is the last bit shifted out.
+       mov ecx, eax; shr ecx, carryBit; and ecx, 1; shift eax, shift */
+    p = emitByte(p, 0x89); p = emitByte(p, 0xC1);
+    p = emitShiftByImmediate(p, X86_SHR, X86_ECX, carryBit);
+    p = emitByte(p, 0x83); p = emitByte(p, 0xE1); p = emitByte(p, 0x01);
+    p = emitShiftByImmediate(p, shiftOpcode, X86_EAX, shift);
+    p = emitStoreRegister(p, d, X86_EAX);
+    p = emitStoreToContext(p, offsetof(PinkySimContext, lazyFlags.result), X86_EAX);
+    p = emitStoreToContext(p, offsetof(PinkySimContext, lazyFlags.carry), X86_ECX);
+    return emitOrImmediateToContext(p, offsetof(PinkySimContext, lazyFlags.pending), LAZY_NZ | LAZY_C);
+}
+
+static uint8_t* emitImmediateOffsetAddress(uint8_t* p, uint32_t n, uint32_t offset)
+{
+    p = emitLoadRegister(p, X86_ESI, n);
+    return emitAddImmediate(p, X86_ESI, offset);
+}
+
+static uint8_t* emitRegisterOffsetAddress(uint8_t* p, uint32_t n, uint32_t m)
+{
+    /* mov esi, [rbx + Rn]; add esi, [rbx + Rm] */
+    p = emitLoadRegister(p, X86_ESI, n);
+    p = emitByte(p, 0x03); p = emitByte(p, contextModRM(X86_ESI));
+    return emitUInt32(p, registerOffset(m));
+}
+
+static uint8_t* emitLoad(uint8_t* p, JitBlockState* pState, uint32_t index, uint32_t t, uint32_t size)
+{
+    uint8_t* missFixups[3];
+    uint32_t missFixupCount;
+    uint8_t* pDoneFixup;
+    uint32_t pc = pState->pc;
+    uint32_t retired = pState->retired;
+
+    /* The address is already in ESI.  Reads which hit the read window are made straight from the host memory behind
+       it.  mov/movzx eax, [rdx + rax]; jmp done */
+    p = emitDataWindowLookup(p, offsetof(PinkySimContext, readWindow), size, missFixups, &missFixupCount);
+    if (size == 4)
+    {
+        p = emitByte(p, 0x8B);
+    }
+    else
+    {
+        p = emitByte(p, 0x0F);
+        p = emitByte(p, size == 2 ? 0xB7 : 0xB6);
+    }
+    p = emitByte(p, 0x04); p = emitByte(p, 0x02);
+    p = emitShortJumpToFixup(p, 0xEB, &pDoneFixup);
+
+    /* miss: The PC is left pointing at this instruction if the read faults.
+       mov edx, size; call jitMemRead */
+    patchShortFixups(missFixups, missFixups + missFixupCount, p);
+    p = emitCommitPC(p, pState, pState->pBlock->instructions[index].address);
+    p = emitMovImmediate32(p, X86_EDX, size);
+    p = emitCall(p, (uint64_t)(size_t)jitMemRead);
+    mergeCommittedState(pState, pc, retired);
+
+    /* done: mov [rbx + Rt], eax */
+    patchShortFixups(&pDoneFixup, &pDoneFixup + 1, p);
+    return emitStoreRegister(p, t, X86_EAX);
+}
+
+static uint8_t* emitStore(uint8_t* p, JitBlockState* pState, uint32_t index, uint32_t t, uint32_t size)
+{
+    const DecodedInstruction* pDecoded = &pState->pBlock->instructions[index];
+    uint8_t*                  missFixups[3];
+    uint32_t                  missFixupCount;
+    uint8_t*                  pDoneFixup;
+    uint32_t                  pc = pState->pc;
+    uint32_t                  retired = pState->retired;
+
+    /* The address is already in ESI.  Writes which hit the write window are made straight to the host memory behind
+       it.  That window never covers cached code so there is nothing to invalidate either.
+       mov ecx, [rbx + Rt]; mov [rdx + rax], ecx/cx/cl; jmp done */
+    p = emitDataWindowLookup(p, offsetof(PinkySimContext, writeWindow), size, missFixups, &missFixupCount);
+    p = emitLoadRegister(p, X86_ECX, t);
+    if (size == 2)
+        p = emitByte(p, 0x66);
+    p = emitByte(p, size == 1 ? 0x88 : 0x89);
+    p = emitByte(p, 0x0C); p = emitByte(p, 0x02);
+    p = emitShortJumpToFixup(p, 0xEB, &pDoneFixup);
+
+    /* miss: The PC is left pointing at this instruction if the write faults.
+       mov edx, size; mov ecx, [rbx + Rt]; call jitMemWrite */
+    patchShortFixups(missFixups, missFixups + missFixupCount, p);
+    p = emitCommitPC(p, pState, pDecoded->address);
+    p = emitMovImmediate32(p, X86_EDX, size);
+    p = emitLoadRegister(p, X86_ECX, t);
+    p = emitCall(p, (uint64_t)(size_t)jitMemWrite);
+    if (!isLastInBlock(pState, index))
+    {
+        /* Stop early if this instruction overwrote code in this block, just like executeDecodedBlock(). */
+        p = emitCommitPC(p, pState, pDecoded->address + 2);
+        p = emitSetRetired(p, pState, index + 1);
+        p = emitExitIfBlockInvalidated(p, pState);
+    }
+    mergeCommittedState(pState, pc, retired);
+
+    /* done: */
+    patchShortFixups(&pDoneFixup, &pDoneFixup + 1, p);
+    return p;
+}
+
+static uint8_t* emitDataWindowLookup(uint8_t* p, uint32_t windowOffset, uint32_t size, uint8_t** ppMissFixups,
+                                     uint32_t* pMissFixupCount)
+{
+    /* Leaves the offset of the address in ESI from the start of the window in RAX and its host pointer in RDX, or
+       jumps to one of the miss fixups.  Misaligned accesses miss so that they still fault.
+       test esi, size - 1; jnz miss; mov eax, esi; sub eax, [rbx + start]; cmp eax, [rbx + size]; jae miss;
+       mov rdx, [rbx + pHost]; test rdx, rdx; jz miss */
+    *pMissFixupCount = 0;
+    if (size > 1)
+    {
+        p = emitByte(p, 0xF7); p = emitByte(p, 0xC6); p = emitUInt32(p, size - 1);
+        p = emitShortJumpToFixup(p, 0x75, &ppMissFixups[(*pMissFixupCount)++]);
+    }
+    p = emitByte(p, 0x89); p = emitByte(p, 0xF0);
+    p = emitByte(p, 0x2B); p = emitByte(p, contextModRM(X86_EAX));
+    p = emitUInt32(p, windowOffset + offsetof(IMemoryDataWindow, start));
+    p = emitByte(p, 0x3B); p = emitByte(p, contextModRM(X86_EAX));
+    p = emitUInt32(p, windowOffset + offsetof(IMemoryDataWindow, size));
+    p = emitShortJumpToFixup(p, 0x73, &ppMissFixups[(*pMissFixupCount)++]);
+    p = emitByte(p, 0x48); p = emitByte(p, 0x8B); p = emitByte(p, contextModRM(X86_EDX));
+    p = emitUInt32(p, windowOffset + offsetof(IMemoryDataWindow, pHost));
+    p = emitByte(p, 0x48); p = emitByte(p, 0x85); p = emitByte(p, 0xD2);
+    return emitShortJumpToFixup(p, 0x74, &ppMissFixups[(*pMissFixupCount)++]);
+}
+
+static uint32_t jitMemRead(PinkySimContext* pContext, uint32_t address, uint32_t size)
+{
+    IMemoryDataWindow* pWindow = &pContext->readWindow;
+    uint32_t           value = unalignedMemRead(pContext, address, size);
+
+    /* Only move the window once the read has succeeded, when it is known to be to mapped memory. */
+    if (address - pWindow->start >= pWindow->size)
+        IMemory_GetDataWindow(pContext->pMemory, address, 0, pWindow);
+    return value;
+}
+
+static void jitMemWrite(PinkySimContext* pContext, uint32_t address, uint32_t size, uint32_t value)
+{
+    IMemoryDataWindow* pWindow = &pContext->writeWindow;
+
+    unalignedMemWrite(pContext, address, size, value);
+    if (address - pWindow->start < pWindow->size)
+        return;
+    IMemory_GetDataWindow(pContext->pMemory, address, 1, pWindow);
+    /* Writes through the window skip invalidating the decode cache so it can't be allowed to cover any cached code. */
+    if (isCodeInPages(pContext->pDecodeCache, pWindow->start, pWindow->size))
+        pWindow->pHost = NULL;
+}
+
+static void mergeCommittedState(JitBlockState* pState, uint32_t pc, uint32_t retired)
+{
+    /* A path which skipped some commits joins back up here so only values which both paths left alone are known. */
+    if (pState->pc != pc)
+        pState->pc = JIT_STATE_UNKNOWN;
+    if (pState->retired != retired)
+        pState->retired = JIT_STATE_UNKNOWN;
+}
+
+static uint8_t* emitExitIfBlockInvalidated(uint8_t* p, JitBlockState* pState)
+{
+    /* mov rax, &pBlock->address; cmp dword [rax], blockAddress; jne exitOk */
+    p = emitByte(p, 0x48); p = emitByte(p, 0xB8); p = emitUInt64(p, (uint64_t)(size_t)&pState->pBlock->address);
+    p = emitByte(p, 0x81); p = emitByte(p, 0x38); p = emitUInt32(p, pState->pBlock->address);
+    return emitJneToFixup(p, &pState->exitOkFixups[pState->exitOkFixupCount++]);
+}
+
+static uint8_t* emitCommitPC(uint8_t* p, JitBlockState* pState, uint32_t address)
+{
+    /* mov dword [rbx + pc], address */
+    if (pState->pc == address)
+        return p;
+    pState->pc = address;
+    return emitStoreImmediateToContext(p, offsetof(PinkySimContext, pc), address);
+}
+
+static uint8_t* emitSetRetired(uint8_t* p, JitBlockState* pState, uint32_t retired)
+{
+    /* mov r12d, retired */
+    if (pState->retired == retired)
+        return p;
+    pState->retired = retired;
+    p = emitByte(p, 0x41); p = emitByte(p, 0xBC);
+    return emitUInt32(p, retired);
+}
+
+static uint8_t* emitCall(uint8_t* p, uint64_t function)
+{
+    /* mov rdi, rbx; mov rax, function; call rax */
+    p = emitByte(p, 0x48); p = emitByte(p, 0x89); p = emitByte(p, 0xDF);
+    p = emitByte(p, 0x48); p = emitByte(p, 0xB8); p = emitUInt64(p, function);
+    p = emitByte(p, 0xFF);
+    return emitByte(p, 0xD0);
+}
+
+static uint8_t* emitLoadRegister(uint8_t* p, uint8_t x86Reg, uint32_t reg)
+{
+    return emitLoadFromContext(p, x86Reg, registerOffset(reg));
+}
+
+static uint8_t* emitStoreRegister(uint8_t* p, uint32_t reg, uint8_t x86Reg)
+{
+    return emitStoreToContext(p, registerOffset(reg), x86Reg);
+}
+
+static uint32_t registerOffset(uint32_t reg)
+{
+    /* Same mapping as getReg() and setReg().  The generated code never accesses the PC this way. */
+    assert (reg < PC);
+
+    if (reg == LR)
+        return offsetof(PinkySimContext, lr);
+    else if (reg == SP)
+        return offsetof(PinkySimContext, spMain);
+    else
+        return offsetof(PinkySimContext, R) + reg * sizeof(uint32_t);
+}
+
+static uint8_t* emitLoadFromContext(uint8_t* p, uint8_t x86Reg, uint32_t offset)
+{
+    /* mov x86Reg, [rbx + offset] */
+    p = emitByte(p, 0x8B); p = emitByte(p, contextModRM(x86Reg));
+    return emitUInt32(p, offset);
+}
+
+static uint8_t* emitStoreToContext(uint8_t* p, uint32_t offset, uint8_t x86Reg)
+{
+    /* mov [rbx + offset], x86Reg */
+    p = emitByte(p, 0x89); p = emitByte(p, contextModRM(x86Reg));
+    return emitUInt32(p, offset);
+}
+
+static uint8_t* emitStoreImmediateToContext(uint8_t* p, uint32_t offset, uint32_t value)
+{
+    /* mov dword [rbx + offset], value */
+    p = emitByte(p, 0xC7); p = emitByte(p, contextModRM(0));
+    p = emitUInt32(p, offset);
+    return emitUInt32(p, value);
+}
+
+static uint8_t* emitOrImmediateToContext(uint8_t* p, uint32_t offset, uint32_t value)
+{
+    /* or dword [rbx + offset], value */
+    p = emitByte(p, 0x81); p = emitByte(p, contextModRM(1));
+    p = emitUInt32(p, offset);
+    return emitUInt32(p, value);
+}
+
+static uint8_t contextModRM(uint8_t x86Reg)
+{
+    /* ModRM byte for [rbx + disp32] with x86Reg in the reg field. */
+    return 0x80 | (x86Reg << 3) | 0x03;
+}
+
+static uint8_t* emitMovImmediate32(uint8_t* p, uint8_t x86Reg, uint32_t value)
+{
+    /* mov x86Reg, value */
+    p = emitByte(p, 0xB8 + x86Reg);
+    return emitUInt32(p, value);
+}
+
+static uint8_t* emitAddImmediate(uint8_t* p, uint8_t x86Reg, uint32_t value)
+{
+    /* add x86Reg, value */
+    p = emitByte(p, 0x81); p = emitByte(p, 0xC0 | x86Reg);
+    return emitUInt32(p, value);
+}
+
+static uint8_t* emitAluOp(uint8_t* p, uint8_t opcode, uint8_t x86RegDest, uint8_t x86RegSrc)
+{
+    /* op x86RegDest, x86RegSrc */
+    p = emitByte(p, opcode);
+    return emitByte(p, 0xC0 | (x86RegSrc << 3) | x86RegDest);
+}
+
+static uint8_t* emitNot(uint8_t* p, uint8_t x86Reg)
+{
+    /* not x86Reg */
+    p = emitByte(p, 0xF7);
+    return emitByte(p, 0xD0 | x86Reg);
+}
+
+static uint8_t* emitShiftByImmediate(uint8_t* p, uint8_t shiftOpcode, uint8_t x86Reg, uint32_t shift)
+{
+    /* shl/shr/sar x86Reg, shift */
+    p = emitByte(p, 0xC1); p = emitByte(p, 0xC0 | (shiftOpcode << 3) | x86Reg);
+    return emitByte(p, shift);
+}
+
+static uint8_t* emitByte(uint8_t* p, uint8_t byte)
+{
+    *p++ = byte;
+    return p;
+}
+
+static uint8_t* emitUInt32(uint8_t* p, uint32_t value)
+{
+    p = emitByte(p, value & 0xFF);
+    p = emitByte(p, (value >> 8) & 0xFF);
+    p = emitByte(p, (value >> 16) & 0xFF);
+    return emitByte(p, value >> 24);
+}
+
+static uint8_t* emitUInt64(uint8_t* p, uint64_t value)
+{
+    p = emitUInt32(p, (uint32_t)value);
+    return emitUInt32(p, (uint32_t)(value >> 32));
+}
+
+static uint8_t* emitJneToFixup(uint8_t* p, uint8_t** ppFixup)
+{
+    /* jne rel32 with the displacement filled in later by patchFixups(). */
+    p = emitByte(p, 0x0F); p = emitByte(p, 0x85);
+    *ppFixup = p;
+    return emitUInt32(p, 0);
+}
+
+static void patchFixups(uint8_t** ppStart, uint8_t** ppEnd, uint8_t* pTarget)
+{
+    while (ppStart < ppEnd)
+    {
+        uint8_t* pFixup = *ppStart++;
+        emitUInt32(pFixup, (uint32_t)(pTarget - (pFixup + sizeof(uint32_t))));
+    }
+}
+
+static uint8_t* emitShortJumpToFixup(uint8_t* p, uint8_t opcode, uint8_t** ppFixup)
+{
+    /* jmp/jcc rel8 with the displacement filled in later by patchShortFixups(). */
+    p = emitByte(p, opcode);
+    *ppFixup = p;
+    return emitByte(p, 0);
+}
+
+static void patchShortFixups(uint8_t** ppStart, uint8_t** ppEnd, uint8_t* pTarget)
+{
+    while (ppStart < ppEnd)
+    {
+        uint8_t* pFixup = *ppStart++;
+
+        assert ( pTarget - (pFixup + 1) <= 127 );
+        emitByte(pFixup, (uint8_t)(pTarget - (pFixup + 1)));
+    }
+}
+#endif /* PINKYSIM_JIT_X64 */
+
+
+int pinkySimStep(PinkySimContext* pContext)
+{
+    int      result = PINKYSIM_STEP_UNDEFINED;
+
+    discardMemoryWindows(pContext);
+    __try
+    {
+        result = executeInstruction(pContext);
+    }
+    __catch
+    {
+        updateFlagsFromLazyFlags(pContext);
+        return convertExceptionToStepResult(getExceptionCode());
+    }
+    updateFlagsFromLazyFlags(pContext);
+    return result;
+}
+
+static int executeInstruction(PinkySimContext* pContext)
+{
+    DecodedInstruction        decoded;
+    const DecodedInstruction* pDecoded;
+    int                       result;
+
+    if (!(pContext->xPSR & EPSR_T))
+        return PINKYSIM_STEP_HARDFAULT;
+
+    pDecoded = fetchDecodedInstruction(pContext, &decoded);
+    result = executeDecodedInstruction(pContext, pDecoded);
+    if (pContext->cycleCounter.enabled)
+        addInstructionCycles(pContext, pDecoded);
+    pContext->pc = pContext->newPC;
+    return result;
+}
+
+static int convertExceptionToStepResult(int exceptionCode)
+{
+    switch (exceptionCode)
+    {
+    case bkptException:
+    case hardwareBreakpointException:
+        return PINKYSIM_STEP_BKPT;
+    case undefinedException:
+        return PINKYSIM_STEP_UNDEFINED;
+    case unpredictableException:
+        return PINKYSIM_STEP_UNPREDICTABLE;
+    default:
+        return PINKYSIM_STEP_HARDFAULT;
+    }
+}
+
+static const DecodedInstruction* fetchDecodedInstruction(PinkySimContext* pContext, DecodedInstruction* pScratch)
+{
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    DecodedInstruction*  pEntry;
+
+    if (!pCache)
+    {
+        fetchAndDecodeInstruction(pContext, pContext->pc, pScratch);
+        return pScratch;
+    }
+
+    pEntry = &pCache->entries[decodeCacheIndex(pContext->pc)];
+    if (pEntry->address != pContext->pc)
+    {
+        /* Decode into scratch first so that a fetch fault can't leave a partially filled entry in the cache. */
+        fetchAndDecodeInstruction(pContext, pContext->pc, pScratch);
+        invalidateEntry(pCache, pEntry);
+        *pEntry = *pScratch;
+        updateCodePageCounts(pCache, pEntry->address, pEntry->address + instructionSize(pEntry), 1);
+        discardDataWindow(&pContext->writeWindow);
+    }
+    return pEntry;
+}
+
+static uint32_t decodeCacheIndex(uint32_t address)
+{
+    return (address >> 1) & (DECODE_CACHE_ENTRIES - 1);
+}
+
+static void fetchAndDecodeInstruction(PinkySimContext* pContext, uint32_t address, DecodedInstruction* pDecoded)
 {
-    int result;
+    uint16_t             instr1 = fetchHalfWord(pContext, address);
+    InstructionHandler16 handler16 = lookupHandler16(instr1);
 
-    do
+    pDecoded->address = address;
+    pDecoded->instr1 = instr1;
+    if (!handler16)
     {
-        result = callback ? callback(pContext) : PINKYSIM_STEP_OK;
-        if (result == PINKYSIM_STEP_OK)
-            result = pinkySimStep(pContext);
-    } while (result == PINKYSIM_STEP_OK);
-    return result;
+        pDecoded->instr2 = fetchHalfWord(pContext, address + 2);
+        pDecoded->handler16 = NULL;
+        pDecoded->handler32 = decodeInstruction32(instr1, pDecoded->instr2);
+    }
+    else
+    {
+        pDecoded->instr2 = 0;
+        pDecoded->handler16 = handler16;
+        pDecoded->handler32 = NULL;
+    }
 }
 
+static uint16_t fetchHalfWord(PinkySimContext* pContext, uint32_t address)
+{
+    IMemoryFetchWindow* pWindow = &pContext->fetchWindow;
+    uint32_t            offset = address - pWindow->start;
 
-int pinkySimStep(PinkySimContext* pContext)
+    /* The window only needs to be refilled when the PC moves to a different page. */
+    if (offset >= pWindow->size)
+    {
+        IMemory_GetFetchWindow(pContext->pMemory, address, pWindow);
+        offset = address - pWindow->start;
+    }
+    if (pWindow->pHost && offset < pWindow->size)
+        return *(const uint16_t*)(pWindow->pHost + offset);
+    return IMemory_Fetch16(pContext->pMemory, address);
+}
+
+static void discardMemoryWindows(PinkySimContext* pContext)
 {
-    int      result = PINKYSIM_STEP_UNDEFINED;
+    pContext->fetchWindow.pHost = NULL;
+    pContext->fetchWindow.start = 0;
+    pContext->fetchWindow.size = 0;
+    discardDataWindow(&pContext->readWindow);
+    discardDataWindow(&pContext->writeWindow);
+}
 
-    if (!(pContext->xPSR & EPSR_T))
-        return PINKYSIM_STEP_HARDFAULT;
+static void discardDataWindow(IMemoryDataWindow* pWindow)
+{
+    pWindow->pHost = NULL;
+    pWindow->start = 0;
+    pWindow->size = 0;
+}
 
-    __try
+static InstructionHandler16 lookupHandler16(uint16_t instr)
+{
+    pthread_once(&g_handlers16Once, initHandlers16);
+    return g_handlers16[instr];
+}
+
+static void initHandlers16(void)
+{
+    uint32_t instr;
+
+    for (instr = 0 ; instr < ARRAY_SIZE(g_handlers16) ; instr++)
+        g_handlers16[instr] = isInstruction32Bit(instr) ? NULL : decodeInstruction16(instr);
+}
+
+static int isInstruction32Bit(uint16_t instr)
+{
+    return (instr & 0xF800) == 0xE800 ||
+           (instr & 0xF800) == 0xF000 ||
+           (instr & 0xF800) == 0xF800;
+}
+
+static int executeDecodedInstruction(PinkySimContext* pContext, const DecodedInstruction* pDecoded)
+{
+    if (pDecoded->handler32)
     {
-        uint16_t instr =  IMemory_Read16(pContext->pMemory, pContext->pc);
+        pContext->newPC = pContext->pc + 4;
+        return pDecoded->handler32(pContext, pDecoded->instr1, pDecoded->instr2);
+    }
+    pContext->newPC = pContext->pc + 2;
+    return pDecoded->handler16(pContext, pDecoded->instr1);
+}
 
-        if ((instr & 0xF800) == 0xE800 ||
-            (instr & 0xF800) == 0xF000 ||
-            (instr & 0xF800) == 0xF800)
-            result = executeInstruction32(pContext, instr);
-        else
-            result = executeInstruction16(pContext, instr);
-        pContext->pc = pContext->newPC;
+static void addInstructionCycles(PinkySimContext* pContext, const DecodedInstruction* pDecoded)
+{
+    PinkySimCycleCounter* pCounter = &pContext->cycleCounter;
+    uint32_t              size = instructionSize(pDecoded);
+
+    pCounter->count += baseInstructionCycles(pDecoded);
+    if (pContext->newPC != pDecoded->address + size)
+        pCounter->count += BRANCH_REFILL_CYCLES;
+    addFetchWaitStates(pCounter, pDecoded->address);
+    if (size == 4)
+        addFetchWaitStates(pCounter, pDecoded->address + 2);
+}
+
+static uint32_t baseInstructionCycles(const DecodedInstruction* pDecoded)
+{
+    InstructionHandler16 handler16 = pDecoded->handler16;
+    uint16_t             instr = pDecoded->instr1;
+
+    /* Timings are from the Cortex-M0 TRM, less the pipeline refill which is added separately for taken branches. */
+    if (pDecoded->handler32)
+        return pDecoded->handler32 == bl ? 2 : 4;
+    if (handler16 == push || handler16 == pop)
+        return 1 + bitCount(instr & 0x1FF);
+    if (handler16 == stm || handler16 == ldm)
+        return 1 + bitCount(instr & 0xFF);
+    if (isSingleLoadStore16(instr))
+        return 2;
+    return 1;
+}
+
+static int isSingleLoadStore16(uint16_t instr)
+{
+    return (instr & 0xF800) == 0x4800 ||
+           (instr & 0xF000) == 0x5000 ||
+           (instr & 0xE000) == 0x6000 ||
+           (instr & 0xE000) == 0x8000;
+}
+
+static void addFetchWaitStates(PinkySimCycleCounter* pCounter, uint32_t address)
+{
+    /* Instructions are fetched a word at a time so two sequential 16-bit instructions share the wait states. */
+    uint32_t word = address & ~3U;
+
+    if (word == pCounter->lastFetchWord)
+        return;
+    pCounter->lastFetchWord = word;
+    if (isFlashAddress(pCounter, word))
+        pCounter->count += pCounter->flashWaitStates;
+}
+
+static int isFlashAddress(const PinkySimCycleCounter* pCounter, uint32_t address)
+{
+    return address - pCounter->flashBase < pCounter->flashSize;
+}
+
+
+__throws void pinkySimEnableDecodeCache(PinkySimContext* pContext)
+{
+    if (!pContext->pDecodeCache)
+    {
+        pContext->pDecodeCache = malloc(sizeof(*pContext->pDecodeCache));
+        if (!pContext->pDecodeCache)
+            __throw(outOfMemoryException);
+        pContext->pDecodeCache->pJitCode = NULL;
+        pContext->pDecodeCache->jitCodeUsed = 0;
     }
-    __catch
+    pinkySimFlushDecodeCache(pContext);
+}
+
+
+void pinkySimDisableDecodeCache(PinkySimContext* pContext)
+{
+    pinkySimDisableJit(pContext);
+    free(pContext->pDecodeCache);
+    pContext->pDecodeCache = NULL;
+}
+
+
+__throws void pinkySimEnableJit(PinkySimContext* pContext)
+{
+#ifdef PINKYSIM_JIT_X64
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    void*                pCode;
+
+    if (!pCache || pCache->pJitCode)
+        return;
+    /* Starts out writable.  translateBlock() makes each part executable once code has been generated into it. */
+    pCode = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (pCode == MAP_FAILED)
+        __throw(outOfMemoryException);
+    pCache->pJitCode = pCode;
+    resetJitCode(pCache);
+#endif /* PINKYSIM_JIT_X64 */
+}
+
+
+void pinkySimDisableJit(PinkySimContext* pContext)
+{
+#ifdef PINKYSIM_JIT_X64
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+
+    if (!pCache || !pCache->pJitCode)
+        return;
+    resetJitCode(pCache);
+    munmap(pCache->pJitCode, JIT_CODE_SIZE);
+    pCache->pJitCode = NULL;
+#endif /* PINKYSIM_JIT_X64 */
+}
+
+
+int pinkySimIsJitSupported(void)
+{
+#ifdef PINKYSIM_JIT_X64
+    return 1;
+#else
+    return 0;
+#endif /* PINKYSIM_JIT_X64 */
+}
+
+
+void pinkySimEnableCycleCounter(PinkySimContext* pContext, uint32_t flashBase, uint32_t flashSize,
+                                uint32_t flashWaitStates)
+{
+    PinkySimCycleCounter* pCounter = &pContext->cycleCounter;
+
+    pCounter->count = 0;
+    pCounter->cyccntBase = 0;
+    pCounter->flashBase = flashBase;
+    pCounter->flashSize = flashSize;
+    pCounter->flashWaitStates = flashWaitStates;
+    pCounter->lastFetchWord = CYCLE_COUNTER_NO_FETCH;
+    pCounter->enabled = 1;
+}
+
+
+void pinkySimDisableCycleCounter(PinkySimContext* pContext)
+{
+    pContext->cycleCounter.enabled = 0;
+}
+
+
+void pinkySimFlushDecodeCache(PinkySimContext* pContext)
+{
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    size_t               i;
+
+    if (!pCache)
+        return;
+    for (i = 0 ; i < ARRAY_SIZE(pCache->entries) ; i++)
+        pCache->entries[i].address = DECODE_CACHE_INVALID_ADDRESS;
+    for (i = 0 ; i < ARRAY_SIZE(pCache->blocks) ; i++)
+        pCache->blocks[i].address = DECODE_CACHE_INVALID_ADDRESS;
+    for (i = 0 ; i < ARRAY_SIZE(pCache->codePageCounts) ; i++)
+        pCache->codePageCounts[i] = 0;
+    pCache->pExecutingBlock = NULL;
+    /* No blocks are left to reference any of the generated code so start filling the buffer again from the top. */
+    pCache->jitCodeUsed = 0;
+}
+
+
+void pinkySimInvalidateDecodeCache(PinkySimContext* pContext, uint32_t address, uint32_t size)
+{
+    PinkySimDecodeCache* pCache = pContext->pDecodeCache;
+    /* Start one halfword early since it could be the first half of a 32-bit instruction overlapping this range. */
+    uint32_t             startAddress = (address & ~1U) - 2;
+    uint32_t             halfWordCount = (address + size - startAddress + 1) / 2;
+    uint32_t             i;
+
+    if (!pCache || !isCodeInPages(pCache, address, size))
+        return;
+    if (halfWordCount >= DECODE_CACHE_ENTRIES)
+    {
+        pinkySimFlushDecodeCache(pContext);
+        return;
+    }
+    for (i = 0 ; i < halfWordCount ; i++)
+    {
+        uint32_t            entryAddress = startAddress + 2 * i;
+        DecodedInstruction* pEntry = &pCache->entries[decodeCacheIndex(entryAddress)];
+
+        if (pEntry->address == entryAddress)
+            invalidateEntry(pCache, pEntry);
+    }
+    invalidateBlocks(pCache, address, size);
+}
+
+static void invalidateBlocks(PinkySimDecodeCache* pCache, uint32_t address, uint32_t size)
+{
+    /* Only blocks starting less than BLOCK_MAX_SIZE bytes before the range can overlap it. */
+    uint32_t startAddress = (address & ~1U) - (BLOCK_MAX_SIZE - 2);
+    uint32_t halfWordCount = (address + size - startAddress + 1) / 2;
+    uint32_t i;
+
+    if (halfWordCount > BLOCK_CACHE_ENTRIES)
+        halfWordCount = BLOCK_CACHE_ENTRIES;
+    for (i = 0 ; i < halfWordCount ; i++)
     {
-        switch (getExceptionCode())
+        DecodedBlock* pBlock = &pCache->blocks[blockCacheIndex(startAddress + 2 * i)];
+
+        if (pBlock->address != DECODE_CACHE_INVALID_ADDRESS &&
+            address < pBlock->endAddress && address + size > pBlock->address)
         {
-        case bkptException:
-        case hardwareBreakpointException:
-            return PINKYSIM_STEP_BKPT;
-        case undefinedException:
-            return PINKYSIM_STEP_UNDEFINED;
-        case unpredictableException:
-            return PINKYSIM_STEP_UNPREDICTABLE;
-        default:
-            return PINKYSIM_STEP_HARDFAULT;
+            invalidateBlock(pCache, pBlock);
         }
     }
-    return result;
 }
 
-static int executeInstruction16(PinkySimContext* pContext, uint16_t instr)
+static int isCodeInPages(const PinkySimDecodeCache* pCache, uint32_t address, uint32_t size)
 {
-    int result = PINKYSIM_STEP_UNDEFINED;
+    uint32_t pageCount = ((address + size - 1) >> CODE_PAGE_SHIFT) - (address >> CODE_PAGE_SHIFT) + 1;
+    uint32_t i;
 
-    pContext->newPC = pContext->pc + 2;
+    if (pageCount > CODE_PAGE_ENTRIES)
+        pageCount = CODE_PAGE_ENTRIES;
+    for (i = 0 ; i < pageCount ; i++)
+    {
+        if (pCache->codePageCounts[codePageIndex(address + (i << CODE_PAGE_SHIFT))])
+            return 1;
+    }
+    return 0;
+}
+
+static void invalidateBlock(PinkySimDecodeCache* pCache, DecodedBlock* pBlock)
+{
+    if (pBlock->address == DECODE_CACHE_INVALID_ADDRESS)
+        return;
+    updateCodePageCounts(pCache, pBlock->address, pBlock->endAddress, -1);
+    pBlock->address = DECODE_CACHE_INVALID_ADDRESS;
+}
+
+static void invalidateEntry(PinkySimDecodeCache* pCache, DecodedInstruction* pEntry)
+{
+    if (pEntry->address == DECODE_CACHE_INVALID_ADDRESS)
+        return;
+    updateCodePageCounts(pCache, pEntry->address, pEntry->address + instructionSize(pEntry), -1);
+    pEntry->address = DECODE_CACHE_INVALID_ADDRESS;
+}
+
+
+static InstructionHandler16 decodeInstruction16(uint16_t instr)
+{
     if ((instr & 0xC000) == 0x0000)
-        result = shiftAddSubtractMoveCompare(pContext, instr);
+        return shiftAddSubtractMoveCompare(instr);
     else if ((instr & 0xFC00) == 0x4000)
-        result = dataProcessing(pContext, instr);
+        return dataProcessing(instr);
     else if ((instr & 0xFC00) == 0x4400)
-        result = specialDataAndBranchExchange(pContext, instr);
+        return specialDataAndBranchExchange(instr);
     else if ((instr & 0xF800) == 0x4800)
-        result = ldrLiteral(pContext, instr);
+        return ldrLiteral;
     else if (((instr & 0xF000) == 0x5000) || ((instr & 0xE000) == 0x6000) || ((instr & 0xE000) == 0x8000))
-        result = loadStoreSingleDataItem(pContext, instr);
+        return loadStoreSingleDataItem(instr);
     else if ((instr & 0xF800) == 0xA000)
-        result = adr(pContext, instr);
+        return adr;
     else if ((instr & 0xF800) == 0xA800)
-        result = addSPT1(pContext, instr);
+        return addSPT1;
     else if ((instr & 0xF000) == 0xB000)
-        result = misc16BitInstructions(pContext, instr);
+        return misc16BitInstructions(instr);
     else if ((instr & 0xF800) == 0xC000)
-        result = stm(pContext, instr);
+        return stm;
     else if ((instr & 0xF800) == 0xC800)
-        result = ldm(pContext, instr);
+        return ldm;
     else if ((instr & 0xF000) == 0xD000)
-        result = conditionalBranchAndSupervisor(pContext, instr);
+        return conditionalBranchAndSupervisor(instr);
     else if ((instr & 0xF800) == 0xE000)
-        result = unconditionalBranch(pContext, instr);
-    return result;
+        return unconditionalBranch;
+    return undefinedInstruction16;
+}
+
+static int undefinedInstruction16(PinkySimContext* pContext, uint16_t instr)
+{
+    return PINKYSIM_STEP_UNDEFINED;
+}
+
+static int throwUndefined16(PinkySimContext* pContext, uint16_t instr)
+{
+    __throw(undefinedException);
 }
 
-static int shiftAddSubtractMoveCompare(PinkySimContext* pContext, uint16_t instr)
+static int throwUnpredictable16(PinkySimContext* pContext, uint16_t instr)
 {
-    int result = PINKYSIM_STEP_UNDEFINED;
+    __throw(unpredictableException);
+}
 
+static InstructionHandler16 shiftAddSubtractMoveCompare(uint16_t instr)
+{
     if ((instr & 0x3800) == 0x0000)
-        result = lslImmediate(pContext, instr);
+        return lslImmediate;
     else if ((instr & 0x3800) == 0x0800)
-        result = lsrImmediate(pContext, instr);
+        return lsrImmediate;
     else if ((instr & 0x3800) == 0x1000)
-        result = asrImmediate(pContext, instr);
+        return asrImmediate;
     else if ((instr & 0x3E00) == 0x1800)
-        result = addRegisterT1(pContext, instr);
+        return addRegisterT1;
     else if ((instr & 0x3E00) == 0x1A00)
-        result = subRegister(pContext, instr);
+        return subRegister;
     else if ((instr & 0x3E00) == 0x1C00)
-        result = addImmediateT1(pContext, instr);
+        return addImmediateT1;
     else if ((instr & 0x3E00) == 0x1E00)
-        result = subImmediateT1(pContext, instr);
+        return subImmediateT1;
     else if ((instr & 0x3800) == 0x2000)
-        result = movImmediate(pContext, instr);
+        return movImmediate;
     else if ((instr & 0x3800) == 0x2800)
-        result = cmpImmediate(pContext, instr);
+        return cmpImmediate;
     else if ((instr & 0x3800) == 0x3000)
-        result = addImmediateT2(pContext, instr);
-    else if ((instr & 0x3800) == 0x3800)
-        result = subImmediateT2(pContext, instr);
-    return result;
+        return addImmediateT2;
+    else
+        return subImmediateT2;
 }
 
 static int lslImmediate(PinkySimContext* pContext, uint16_t instr)
@@ -321,7 +2355,7 @@ static int lslImmediate(PinkySimContext* pContext, uint16_t instr)
     DecodedImmShift decodedShift = decodeImmshift(0x0, fields.imm);
     ShiftResults    shiftResults;
 
-    shiftResults = shift_C(getReg(pContext, fields.m), SRType_LSL, decodedShift.n, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.m), SRType_LSL, decodedShift.n, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -506,13 +2540,9 @@ static void setReg(PinkySimContext* pContext, uint32_t reg, uint32_t value)
 static void updateRdAndNZC(PinkySimContext* pContext, Fields* pFields, const ShiftResults* pShiftResults)
 {
     setReg(pContext, pFields->d, pShiftResults->result);
-    pContext->xPSR &= ~APSR_NZC;
-    if (pShiftResults->result & (1 << 31))
-        pContext->xPSR |= APSR_N;
-    if (pShiftResults->result == 0)
-        pContext->xPSR |= APSR_Z;
-    if (pShiftResults->carryOut)
-        pContext->xPSR |= APSR_C;
+    pContext->lazyFlags.pending |= LAZY_NZ | LAZY_C;
+    pContext->lazyFlags.result = pShiftResults->result;
+    pContext->lazyFlags.carry = pShiftResults->carryOut;
 }
 
 static int lsrImmediate(PinkySimContext* pContext, uint16_t instr)
@@ -521,7 +2551,7 @@ static int lsrImmediate(PinkySimContext* pContext, uint16_t instr)
     DecodedImmShift decodedShift = decodeImmshift(0x1, fields.imm);
     ShiftResults    shiftResults;
 
-    shiftResults = shift_C(getReg(pContext, fields.m), SRType_LSR, decodedShift.n, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.m), SRType_LSR, decodedShift.n, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -532,7 +2562,7 @@ static int asrImmediate(PinkySimContext* pContext, uint16_t instr)
     DecodedImmShift decodedShift = decodeImmshift(0x2, fields.imm);
     ShiftResults    shiftResults;
 
-    shiftResults = shift_C(getReg(pContext, fields.m), SRType_ASR, decodedShift.n, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.m), SRType_ASR, decodedShift.n, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -559,15 +2589,13 @@ static Fields decodeRm8to6_Rn5to3_Rd2to0(uint32_t instr)
 
 static AddResults addWithCarry(uint32_t x, uint32_t y, uint32_t carryInAsBit)
 {
-    int        carryIn = carryInAsBit ? 1 : 0;
-    uint64_t   unsignedSum = (uint64_t)x + (uint64_t)y + (uint64_t)carryIn;
-    int64_t    signedSum = (int64_t)(int32_t)x + (int64_t)(int32_t)y + (int64_t)carryIn;
-    uint32_t   result = (uint32_t)unsignedSum;
     AddResults results;
 
-    results.result = result;
-    results.carryOut = ((uint64_t)result == unsignedSum) ? 0 : 1;
-    results.overflow = ((int64_t)(int32_t)result == signedSum) ? 0 : 1;
+    /* Carry and overflow are only calculated if something reads them (see updateFlagsFromLazyFlags()). */
+    results.x = x;
+    results.y = y;
+    results.carryIn = carryInAsBit ? 1 : 0;
+    results.result = x + y + results.carryIn;
     return results;
 }
 
@@ -579,15 +2607,11 @@ static void updateRdAndNZCV(PinkySimContext* pContext, Fields* pFields, const Ad
 
 static void updateNZCV(PinkySimContext* pContext, Fields* pFields, const AddResults* pAddResults)
 {
-    pContext->xPSR &= ~APSR_NZCV;
-    if (pAddResults->result & (1 << 31))
-        pContext->xPSR |= APSR_N;
-    if (pAddResults->result == 0)
-        pContext->xPSR |= APSR_Z;
-    if (pAddResults->carryOut)
-        pContext->xPSR |= APSR_C;
-    if (pAddResults->overflow)
-        pContext->xPSR |= APSR_V;
+    pContext->lazyFlags.pending = LAZY_NZ | LAZY_ADD_CV;
+    pContext->lazyFlags.result = pAddResults->result;
+    pContext->lazyFlags.operand1 = pAddResults->x;
+    pContext->lazyFlags.operand2 = pAddResults->y;
+    pContext->lazyFlags.carryIn = pAddResults->carryIn;
 }
 
 static int subRegister(PinkySimContext* pContext, uint16_t instr)
@@ -647,11 +2671,54 @@ static void updateRdAndNZ(PinkySimContext* pContext, Fields* pFields, uint32_t r
 
 static void updateNZ(PinkySimContext* pContext, Fields* pFields, uint32_t results)
 {
-    pContext->xPSR &= ~APSR_NZ;
-    if (results & (1 << 31))
-        pContext->xPSR |= APSR_N;
-    if (results == 0)
-        pContext->xPSR |= APSR_Z;
+    pContext->lazyFlags.pending |= LAZY_NZ;
+    pContext->lazyFlags.result = results;
+}
+
+static void updateFlagsFromLazyFlags(PinkySimContext* pContext)
+{
+    PinkySimLazyFlags* pLazy = &pContext->lazyFlags;
+    uint32_t           xPSR;
+
+    /* Flag setting instructions just record their results and operands in lazyFlags since most flags are overwritten
+       by a later instruction before anything reads them.  This folds any such pending flags into xPSR. */
+    if (!pLazy->pending)
+        return;
+
+    xPSR = pContext->xPSR;
+    if (pLazy->pending & LAZY_NZ)
+    {
+        xPSR &= ~APSR_NZ;
+        if (pLazy->result & (1 << 31))
+            xPSR |= APSR_N;
+        if (pLazy->result == 0)
+            xPSR |= APSR_Z;
+    }
+    if (pLazy->pending & LAZY_ADD_CV)
+    {
+        uint32_t sum = pLazy->operand1 + pLazy->operand2 + pLazy->carryIn;
+        int      carryOut = pLazy->carryIn ? sum <= pLazy->operand1 : sum < pLazy->operand1;
+
+        xPSR &= ~(APSR_C | APSR_V);
+        if (carryOut)
+            xPSR |= APSR_C;
+        if ((pLazy->operand1 ^ sum) & (pLazy->operand2 ^ sum) & (1U << 31))
+            xPSR |= APSR_V;
+    }
+    if (pLazy->pending & LAZY_C)
+    {
+        xPSR &= ~APSR_C;
+        if (pLazy->carry)
+            xPSR |= APSR_C;
+    }
+    pContext->xPSR = xPSR;
+    pLazy->pending = 0;
+}
+
+static uint32_t getCarryFlag(PinkySimContext* pContext)
+{
+    updateFlagsFromLazyFlags(pContext);
+    return pContext->xPSR & APSR_C;
 }
 
 static Fields decodeRd10to8_Imm7to0(uint32_t instr)
@@ -712,62 +2779,29 @@ static int subImmediateT2(PinkySimContext* pContext, uint16_t instr)
     return PINKYSIM_STEP_OK;
 }
 
-static int dataProcessing(PinkySimContext* pContext, uint16_t instr)
+static InstructionHandler16 dataProcessing(uint16_t instr)
 {
-    int result = PINKYSIM_STEP_UNDEFINED;
-
-    switch ((instr & 0x03C0) >> 6)
+    static const InstructionHandler16 handlers[16] =
     {
-    case 0:
-        result = andRegister(pContext, instr);
-        break;
-    case 1:
-        result = eorRegister(pContext, instr);
-        break;
-    case 2:
-        result = lslRegister(pContext, instr);
-        break;
-    case 3:
-        result = lsrRegister(pContext, instr);
-        break;
-    case 4:
-        result = asrRegister(pContext, instr);
-        break;
-    case 5:
-        result = adcRegister(pContext, instr);
-        break;
-    case 6:
-        result = sbcRegister(pContext, instr);
-        break;
-    case 7:
-        result = rorRegister(pContext, instr);
-        break;
-    case 8:
-        result = tstRegister(pContext, instr);
-        break;
-    case 9:
-        result = rsbRegister(pContext, instr);
-        break;
-    case 10:
-        result = cmpRegisterT1(pContext, instr);
-        break;
-    case 11:
-        result = cmnRegister(pContext, instr);
-        break;
-    case 12:
-        result = orrRegister(pContext, instr);
-        break;
-    case 13:
-        result = mulRegister(pContext, instr);
-        break;
-    case 14:
-        result = bicRegister(pContext, instr);
-        break;
-    case 15:
-        result = mvnRegister(pContext, instr);
-        break;
-    }
-    return result;
+        andRegister,
+        eorRegister,
+        lslRegister,
+        lsrRegister,
+        asrRegister,
+        adcRegister,
+        sbcRegister,
+        rorRegister,
+        tstRegister,
+        rsbRegister,
+        cmpRegisterT1,
+        cmnRegister,
+        orrRegister,
+        mulRegister,
+        bicRegister,
+        mvnRegister
+    };
+
+    return handlers[(instr & 0x03C0) >> 6];
 }
 
 static int andRegister(PinkySimContext* pContext, uint16_t instr)
@@ -807,7 +2841,7 @@ static int lslRegister(PinkySimContext* pContext, uint16_t instr)
     ShiftResults shiftResults;
 
     shiftN = getReg(pContext, fields.m) & 0xFF;
-    shiftResults = shift_C(getReg(pContext, fields.n), SRType_LSL, shiftN, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.n), SRType_LSL, shiftN, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -819,7 +2853,7 @@ static int lsrRegister(PinkySimContext* pContext, uint16_t instr)
     ShiftResults shiftResults;
 
     shiftN = getReg(pContext, fields.m) & 0xFF;
-    shiftResults = shift_C(getReg(pContext, fields.n), SRType_LSR, shiftN, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.n), SRType_LSR, shiftN, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -831,7 +2865,7 @@ static int asrRegister(PinkySimContext* pContext, uint16_t instr)
     ShiftResults shiftResults;
 
     shiftN = getReg(pContext, fields.m) & 0xFF;
-    shiftResults = shift_C(getReg(pContext, fields.n), SRType_ASR, shiftN, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.n), SRType_ASR, shiftN, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -841,7 +2875,7 @@ static int adcRegister(PinkySimContext* pContext, uint16_t instr)
     Fields     fields = decodeRm5to3_Rdn2to0(instr);
     AddResults addResults;
 
-    addResults = addWithCarry(getReg(pContext, fields.n), getReg(pContext, fields.m), pContext->xPSR & APSR_C);
+    addResults = addWithCarry(getReg(pContext, fields.n), getReg(pContext, fields.m), getCarryFlag(pContext));
     updateRdAndNZCV(pContext, &fields, &addResults);
     return PINKYSIM_STEP_OK;
 }
@@ -851,7 +2885,7 @@ static int sbcRegister(PinkySimContext* pContext, uint16_t instr)
     Fields      fields = decodeRm5to3_Rdn2to0(instr);
     AddResults  addResults;
 
-    addResults = addWithCarry(getReg(pContext, fields.n), ~getReg(pContext, fields.m), pContext->xPSR & APSR_C);
+    addResults = addWithCarry(getReg(pContext, fields.n), ~getReg(pContext, fields.m), getCarryFlag(pContext));
     updateRdAndNZCV(pContext, &fields, &addResults);
     return PINKYSIM_STEP_OK;
 }
@@ -863,7 +2897,7 @@ static int rorRegister(PinkySimContext* pContext, uint16_t instr)
     ShiftResults shiftResults;
 
     shiftN = getReg(pContext, fields.m) & 0xFF;
-    shiftResults = shift_C(getReg(pContext, fields.n), SRType_ROR, shiftN, pContext->xPSR & APSR_C);
+    shiftResults = shift_C(getReg(pContext, fields.n), SRType_ROR, shiftN, getCarryFlag(pContext));
     updateRdAndNZC(pContext, &fields, &shiftResults);
     return PINKYSIM_STEP_OK;
 }
@@ -969,23 +3003,20 @@ static int mvnRegister(PinkySimContext* pContext, uint16_t instr)
     return PINKYSIM_STEP_OK;
 }
 
-static int specialDataAndBranchExchange(PinkySimContext* pContext, uint16_t instr)
+static InstructionHandler16 specialDataAndBranchExchange(uint16_t instr)
 {
-    int result = PINKYSIM_STEP_UNDEFINED;
-
     if ((instr & 0x0300) == 0x0000)
-        result = addRegisterT2(pContext, instr);
+        return addRegisterT2;
     else if ((instr & 0x03C0) == 0x0100)
-        __throw(unpredictableException)
+        return throwUnpredictable16;
     else if (((instr & 0x03C0) == 0x0140) || ((instr & 0x0380) == 0x0180))
-        result = cmpRegisterT2(pContext, instr);
+        return cmpRegisterT2;
     else if ((instr & 0x0300) == 0x0200)
-        result = movRegister(pContext, instr);
+        return movRegister;
     else if ((instr & 0x0380) == 0x0300)
-        result = bx(pContext, instr);
-    else if ((instr & 0x0380) == 0x0380)
-        result = blx(pContext, instr);
-    return result;
+        return bx;
+    else
+        return blx;
 }
 
 static int addRegisterT2(PinkySimContext* pContext, uint16_t instr)
@@ -1148,6 +3179,16 @@ static uint32_t alignedMemRead(PinkySimContext* pContext, uint32_t address, uint
     if (!isAligned(address, size))
         __throw(alignmentException);
 
+    if (pContext->cycleCounter.enabled)
+    {
+        PinkySimCycleCounter* pCounter = &pContext->cycleCounter;
+
+        if (address == DWT_CYCCNT && size == 4)
+            return (uint32_t)(pCounter->count - pCounter->cyccntBase);
+        if (isFlashAddress(pCounter, address))
+            pCounter->count += pCounter->flashWaitStates;
+    }
+
     switch (size)
     {
     case 1:
@@ -1170,43 +3211,40 @@ static int isAligned(uint32_t address, uint32_t size)
     return address == (address & ~(size - 1));
 }
 
-static int loadStoreSingleDataItem(PinkySimContext* pContext, uint16_t instr)
+static InstructionHandler16 loadStoreSingleDataItem(uint16_t instr)
 {
-    int result = PINKYSIM_STEP_UNDEFINED;
-
     if ((instr & 0xFE00) == 0x5000)
-        result = strRegister(pContext, instr);
+        return strRegister;
     else if ((instr & 0xFE00) == 0x5200)
-        result = strhRegister(pContext, instr);
+        return strhRegister;
     else if ((instr & 0xFE00) == 0x5400)
-        result = strbRegister(pContext, instr);
+        return strbRegister;
     else if ((instr & 0xFE00) == 0x5600)
-        result = ldrsbRegister(pContext, instr);
+        return ldrsbRegister;
     else if ((instr & 0xFE00) == 0x5800)
-        result = ldrRegister(pContext, instr);
+        return ldrRegister;
     else if ((instr & 0xFE00) == 0x5A00)
-        result = ldrhRegister(pContext, instr);
+        return ldrhRegister;
     else if ((instr & 0xFE00) == 0x5C00)
-        result = ldrbRegister(pContext, instr);
+        return ldrbRegister;
     else if ((instr & 0xFE00) == 0x5E00)
-        result = ldrshRegister(pContext, instr);
+        return ldrshRegister;
     else if ((instr & 0xF800) == 0x6000)
-        result = strImmediateT1(pContext, instr);
+        return strImmediateT1;
     else if ((instr & 0xF800) == 0x6800)
-        result = ldrImmediateT1(pContext, instr);
+        return ldrImmediateT1;
     else if ((instr & 0xF800) == 0x7000)
-        result = strbImmediate(pContext, instr);
+        return strbImmediate;
     else if ((instr & 0xF800) == 0x7800)
-        result = ldrbImmediate(pContext, instr);
+        return ldrbImmediate;
     else if ((instr & 0xF800) == 0x8000)
-        result = strhImmediate(pContext, instr);
+        return strhImmediate;
     else if ((instr & 0xF800) == 0x8800)
-        result = ldrhImmediate(pContext, instr);
+        return ldrhImmediate;
     else if ((instr & 0xF800) == 0x9000)
-        result = strImmediateT2(pContext, instr);
-    else if ((instr & 0xF800) == 0x9800)
-        result = ldrImmediateT2(pContext, instr);
-    return result;
+        return strImmediateT2;
+    else
+        return ldrImmediateT2;
 }
 
 static int strRegister(PinkySimContext* pContext, uint16_t instr)
@@ -1242,6 +3280,12 @@ static void alignedMemWrite(PinkySimContext* pContext, uint32_t address, uint32_
     if (!isAligned(address, size))
         __throw(alignmentException);
 
+    if (pContext->cycleCounter.enabled && address == DWT_CYCCNT && size == 4)
+    {
+        pContext->cycleCounter.cyccntBase = pContext->cycleCounter.count - value;
+        return;
+    }
+
     switch (size)
     {
     case 4:
@@ -1254,6 +3298,43 @@ static void alignedMemWrite(PinkySimContext* pContext, uint32_t address, uint32_
         IMemory_Write8(pContext->pMemory, address, value);
         break;
     }
+    if (pContext->pDecodeCache)
+        pinkySimInvalidateDecodeCache(pContext, address, size);
+}
+
+static void alignedMemReadWords(PinkySimContext* pContext, uint32_t address, uint32_t* pWords, uint32_t count)
+{
+    uint32_t i;
+
+    /* The cycle counter needs to see each word for flash wait states and reads of DWT_CYCCNT. */
+    if (pContext->cycleCounter.enabled)
+    {
+        for (i = 0 ; i < count ; i++)
+            pWords[i] = alignedMemRead(pContext, address + 4 * i, 4);
+        return;
+    }
+
+    if (!isAligned(address, 4))
+        __throw(alignmentException);
+    IMemory_ReadWords(pContext->pMemory, address, pWords, count);
+}
+
+static void alignedMemWriteWords(PinkySimContext* pContext, uint32_t address, const uint32_t* pWords, uint32_t count)
+{
+    uint32_t i;
+
+    if (pContext->cycleCounter.enabled)
+    {
+        for (i = 0 ; i < count ; i++)
+            alignedMemWrite(pContext, address + 4 * i, 4, pWords[i]);
+        return;
+    }
+
+    if (!isAligned(address, 4))
+        __throw(alignmentException);
+    IMemory_WriteWords(pContext->pMemory, address, pWords, count);
+    if (pContext->pDecodeCache)
+        pinkySimInvalidateDecodeCache(pContext, address, 4 * count);
 }
 
 static int strhRegister(PinkySimContext* pContext, uint16_t instr)
@@ -1462,39 +3543,37 @@ static int addSPT1(PinkySimContext* pContext, uint16_t instr)
     return PINKYSIM_STEP_OK;
 }
 
-static int misc16BitInstructions(PinkySimContext* pContext, uint16_t instr)
+static InstructionHandler16 misc16BitInstructions(uint16_t instr)
 {
-    int result = PINKYSIM_STEP_UNDEFINED;
-
     if ((instr & 0x0F80) == 0x0000)
-        result = addSPT2(pContext, instr);
+        return addSPT2;
     else if ((instr & 0x0F80) == 0x0080)
-        result = subSP(pContext, instr);
+        return subSP;
     else if ((instr & 0x0FC0) == 0x0200)
-        result = sxth(pContext, instr);
+        return sxth;
     else if ((instr & 0x0FC0) == 0x0240)
-        result = sxtb(pContext, instr);
+        return sxtb;
     else if ((instr & 0x0FC0) == 0x0280)
-        result = uxth(pContext, instr);
+        return uxth;
     else if ((instr & 0x0FC0) == 0x02C0)
-        result = uxtb(pContext, instr);
+        return uxtb;
     else if ((instr & 0x0E00) == 0x0400)
-        result = push(pContext, instr);
+        return push;
     else if ((instr & 0x0FE0) == 0x0660)
-        result = cps(pContext, instr);
+        return cps;
     else if ((instr & 0x0FC0) == 0x0A00)
-        result = rev(pContext, instr);
+        return rev;
     else if ((instr & 0x0FC0) == 0x0A40)
-        result = rev16(pContext, instr);
+        return rev16;
     else if ((instr & 0x0FC0) == 0x0AC0)
-        result = revsh(pContext, instr);
+        return revsh;
     else if ((instr & 0x0E00) == 0x0C00)
-        result = pop(pContext, instr);
+        return pop;
     else if ((instr & 0x0F00) == 0x0E00)
-        __throw(bkptException)
+        return bkpt;
     else if ((instr & 0x0F00) == 0x0F00)
-        result = hints(pContext, instr);
-    return result;
+        return hints(instr);
+    return undefinedInstruction16;
 }
 
 static int addSPT2(PinkySimContext* pContext, uint16_t instr)
@@ -1561,22 +3640,20 @@ static int uxtb(PinkySimContext* pContext, uint16_t instr)
 static int push(PinkySimContext* pContext, uint16_t instr)
 {
     uint32_t    registers = ((instr & (1 << 8)) << 6) | (instr & 0xFF);
-    uint32_t    address;
+    uint32_t    values[9];
+    uint32_t    count = 0;
     int         i;
 
     if (bitCount(registers) < 1)
         __throw(unpredictableException);
 
-    address = getReg(pContext, SP) - 4 * bitCount(registers);
     for (i = 0 ; i <= 14 ; i++)
     {
         if (registers & (1 << i))
-        {
-            alignedMemWrite(pContext, address, 4, getReg(pContext, i));
-            address += 4;
-        }
+            values[count++] = getReg(pContext, i);
     }
-    setReg(pContext, SP, getReg(pContext, SP) - 4 * bitCount(registers));
+    alignedMemWriteWords(pContext, getReg(pContext, SP) - 4 * count, values, count);
+    setReg(pContext, SP, getReg(pContext, SP) - 4 * count);
     return PINKYSIM_STEP_OK;
 }
 
@@ -1654,24 +3731,23 @@ static int revsh(PinkySimContext* pContext, uint16_t instr)
 static int pop(PinkySimContext* pContext, uint16_t instr)
 {
     uint32_t    registers = ((instr & (1 << 8)) << 7) | (instr & 0xFF);
-    uint32_t    address;
+    uint32_t    values[9];
+    uint32_t    count = bitCount(registers);
+    uint32_t    next = 0;
     int         i;
 
-    if (bitCount(registers) < 1)
+    if (count < 1)
         __throw(unpredictableException);
 
-    address = getReg(pContext, SP);
+    alignedMemReadWords(pContext, getReg(pContext, SP), values, count);
     for (i = 0 ; i <= 7 ; i++)
     {
         if (registers & (1 << i))
-        {
-            setReg(pContext, i, alignedMemRead(pContext, address, 4));
-            address += 4;
-        }
+            setReg(pContext, i, values[next++]);
     }
     if (registers & (1 << 15))
-        loadWritePC(pContext, alignedMemRead(pContext, address, 4));
-    setReg(pContext, SP, getReg(pContext, SP) + 4 * bitCount(registers));
+        loadWritePC(pContext, values[next]);
+    setReg(pContext, SP, getReg(pContext, SP) + 4 * count);
     return PINKYSIM_STEP_OK;
 }
 
@@ -1680,36 +3756,33 @@ static void loadWritePC(PinkySimContext* pContext, uint32_t address)
     bxWritePC(pContext, address);
 }
 
-static int hints(PinkySimContext* pContext, uint16_t instr)
+static int bkpt(PinkySimContext* pContext, uint16_t instr)
+{
+    __throw(bkptException);
+}
+
+static InstructionHandler16 hints(uint16_t instr)
 {
     uint32_t opA = (instr & (0x00F0)) >> 4;
     uint32_t opB = instr & 0x000F;
-    int      result = PINKYSIM_STEP_UNDEFINED;
 
     if (opB != 0x0000)
-        __throw(undefinedException);
+        return throwUndefined16;
     switch (opA)
     {
     case 0:
-        result = nop(pContext, instr);
-        break;
+        return nop;
     case 1:
-        result = yield(pContext, instr);
-        break;
+        return yield;
     case 2:
-        result = wfe(pContext, instr);
-        break;
+        return wfe;
     case 3:
-        result = wfi(pContext, instr);
-        break;
+        return wfi;
     case 4:
-        result = sev(pContext, instr);
-        break;
+        return sev;
     default:
-        result = treatAsNop(pContext, instr);
-        break;
+        return treatAsNop;
     }
-    return result;
 }
 
 static int nop(PinkySimContext* pContext, uint16_t instr)
@@ -1745,7 +3818,8 @@ static int treatAsNop(PinkySimContext* pContext, uint16_t instr)
 static int stm(PinkySimContext* pContext, uint16_t instr)
 {
     Fields   fields = decodeRn10to8RegisterList7to0(instr);
-    uint32_t address;
+    uint32_t values[8];
+    uint32_t count = 0;
     int      i;
 
     if (bitCount(fields.registers) < 1)
@@ -1753,16 +3827,13 @@ static int stm(PinkySimContext* pContext, uint16_t instr)
     if ((fields.registers & (1 << fields.n)) && isNotLowestBitSet(fields.registers, fields.n))
         __throw(unpredictableException);
 
-    address = getReg(pContext, fields.n);
-    for (i = 0 ; i <= 14 ; i++)
+    for (i = 0 ; i <= 7 ; i++)
     {
         if (fields.registers & (1 << i))
-        {
-            alignedMemWrite(pContext, address, 4, getReg(pContext, i));
-            address += 4;
-        }
+            values[count++] = getReg(pContext, i);
     }
-    setReg(pContext, fields.n, getReg(pContext, fields.n) + 4 * bitCount(fields.registers));
+    alignedMemWriteWords(pContext, getReg(pContext, fields.n), values, count);
+    setReg(pContext, fields.n, getReg(pContext, fields.n) + 4 * count);
     return PINKYSIM_STEP_OK;
 }
 
@@ -1784,34 +3855,33 @@ static int ldm(PinkySimContext* pContext, uint16_t instr)
 {
     Fields   fields = decodeRn10to8RegisterList7to0(instr);
     int      wback = (0 == (fields.registers & (1 << fields.n)));
-    uint32_t address;
+    uint32_t values[8];
+    uint32_t count = bitCount(fields.registers);
+    uint32_t next = 0;
     int      i;
 
-    if (bitCount(fields.registers) < 1)
+    if (count < 1)
         __throw(unpredictableException);
 
-    address = getReg(pContext, fields.n);
+    alignedMemReadWords(pContext, getReg(pContext, fields.n), values, count);
     for (i = 0 ; i <= 7 ; i++)
     {
         if (fields.registers & (1 << i))
-        {
-            setReg(pContext, i, alignedMemRead(pContext, address, 4));
-            address += 4;
-        }
+            setReg(pContext, i, values[next++]);
     }
     if (wback)
-        setReg(pContext, fields.n, getReg(pContext, fields.n) + 4 * bitCount(fields.registers));
+        setReg(pContext, fields.n, getReg(pContext, fields.n) + 4 * count);
     return PINKYSIM_STEP_OK;
 }
 
-static int conditionalBranchAndSupervisor(PinkySimContext* pContext, uint16_t instr)
+static InstructionHandler16 conditionalBranchAndSupervisor(uint16_t instr)
 {
     if ((instr & 0x0F00) == 0x0E00)
-        __throw(undefinedException)
+        return throwUndefined16;
     else if ((instr & 0x0F00) == 0x0F00)
-        return svc(pContext, instr);
+        return svc;
     else
-        return conditionalBranch(pContext, instr);
+        return conditionalBranch;
 }
 
 static int svc(PinkySimContext* pContext, uint16_t instr)
@@ -1833,9 +3903,12 @@ static int conditionalBranch(PinkySimContext* pContext, uint16_t instr)
 static int conditionPassedForBranchInstr(PinkySimContext* pContext, uint16_t instr)
 {
     uint32_t cond = (instr & 0x0F00) >> 8;
-    uint32_t apsr = pContext->xPSR;
+    uint32_t apsr;
     int      result = FALSE;
 
+    updateFlagsFromLazyFlags(pContext);
+    apsr = pContext->xPSR;
+
     switch (cond >> 1)
     {
     case 0:
@@ -1876,31 +3949,34 @@ static int unconditionalBranch(PinkySimContext* pContext, uint16_t instr)
     return PINKYSIM_STEP_OK;
 }
 
-static int executeInstruction32(PinkySimContext* pContext, uint16_t instr1)
+static InstructionHandler32 decodeInstruction32(uint16_t instr1, uint16_t instr2)
 {
-    int      result = PINKYSIM_STEP_UNDEFINED;
-    uint16_t instr2;
+    if ((instr1 & 0x1800) == 0x1000 && (instr2 & 0x8000) == 0x8000)
+        return branchAndMiscellaneousControl(instr1, instr2);
+    return undefinedInstruction32;
+}
 
-    pContext->newPC = pContext->pc + 4;
-    instr2 =  IMemory_Read16(pContext->pMemory, pContext->pc + 2);
+static int undefinedInstruction32(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
+{
+    return PINKYSIM_STEP_UNDEFINED;
+}
 
-    if ((instr1 & 0x1800) == 0x1000 && (instr2 & 0x8000) == 0x8000)
-        result = branchAndMiscellaneousControl(pContext, instr1, instr2);
-    return result;
+static int throwUndefined32(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
+{
+    __throw(undefinedException);
 }
 
-static int branchAndMiscellaneousControl(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
+static InstructionHandler32 branchAndMiscellaneousControl(uint16_t instr1, uint16_t instr2)
 {
     if ((instr2 & 0x5000) == 0x0000 && (instr1 & 0x07E0) == 0x0380)
-        return msr(pContext, instr1, instr2);
+        return msr;
     else if ((instr2 & 0x5000) == 0x0000 && (instr1 & 0x07F0) == 0x03B0)
-        return miscellaneousControl(pContext, instr1, instr2);
+        return miscellaneousControl(instr2);
     else if ((instr2 & 0x5000) == 0x0000 && (instr1 & 0x07E0) == 0x03E0)
-        return mrs(pContext, instr1, instr2);
+        return mrs;
     else if ((instr2 & 0x5000) == 0x5000)
-        return bl(pContext, instr1, instr2);
-
-    __throw(undefinedException);
+        return bl;
+    return throwUndefined32;
 }
 
 static int msr(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
@@ -1921,7 +3997,10 @@ static int msr(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
     {
     case 0:
         if ((SYSm & (1 << 2)) == 0)
+        {
+            updateFlagsFromLazyFlags(pContext);
             pContext->xPSR = (pContext->xPSR & ~APSR_NZCV) | (value & APSR_NZCV);
+        }
         break;
     case 1:
         if (currentModeIsPrivileged(pContext))
@@ -1955,17 +4034,15 @@ static int msr(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
     return PINKYSIM_STEP_OK;
 }
 
-static int miscellaneousControl(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
+static InstructionHandler32 miscellaneousControl(uint16_t instr2)
 {
-    int      result = PINKYSIM_STEP_UNDEFINED;
-
     if ((instr2 & 0x00F0) == 0x0040)
-        result = dsb(pContext, instr1, instr2);
+        return dsb;
     else if ((instr2 & 0x00F0) == 0x0050)
-        result = dmb(pContext, instr1, instr2);
+        return dmb;
     else if ((instr2 & 0x00F0) == 0x0060)
-        result = isb(pContext, instr1, instr2);
-    return result;
+        return isb;
+    return undefinedInstruction32;
 }
 
 static int dsb(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
@@ -2010,7 +4087,10 @@ static int mrs(PinkySimContext* pContext, uint16_t instr1, uint16_t instr2)
         if ((SYSm & (1 << 1)))
             value |= 0; /* T-bit reads as zero on ARMv-6m */
         if ((SYSm & (1 << 2)) == 0)
+        {
+            updateFlagsFromLazyFlags(pContext);
             value |= pContext->xPSR & APSR_NZCV;
+        }
         break;
     case 1:
         if (currentModeIsPrivileged(pContext))
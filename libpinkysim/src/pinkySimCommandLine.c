@@ -11,6 +11,7 @@
     GNU General Public License for more details.
 */
 #include <common.h>
+#include <ElfImage.h>
 #include <FileFailureInject.h>
 #include <MemorySim.h>
 #include <MallocFailureInject.h>
@@ -36,8 +37,13 @@ static void displayCopyrightNotice(void)
 static void displayUsage(void)
 {
     printf("Usage: pinkySim [--ram baseAddress size] [--flash baseAddress size] [--gdbPort tcpPortNumber]\n"
-           "                [--breakOnStart] [--codecov application.elf resultsDirectory] [--restrict sourcePathPrefix]\n"
-           "                imageFilename.bin [args]\n"
+           "                [--breakOnStart] [--codecov application.elf resultsDirectory] [--codecovHitsOnly]\n"
+           "                [--restrict sourcePathPrefix] [--jit] [--max-instructions count] [--cycles flashWaitStates]\n"
+           "                [--ramUsage] [--save-state stateFilename address] [--load-state stateFilename]\n"
+           "                imageFilename [args]\n"
+           "       pinkySim --batch [--jobs threadCount] manifestFilename\n"
+           "       pinkySim --fork-server socketPath [--run-to symbolOrAddress] [--run-to-input]\n"
+           "                [options] imageFilename [args]\n"
            "Where: --ram is used to specify an address range that should be treated as read-write.  More than one of\n"
            "         these can be specified on the command line to create multiple read-write memory regions.\n"
            "       --flash is used to specify and address range that should be treated as read-only.  More than one of\n"
@@ -50,18 +56,47 @@ static void displayUsage(void)
            "         symbols for the binary being simulated.  The resultsDirectory indicates in which directory the\n"
            "         code coverage result files should be placed.  The results include a summary.txt and a file for\n"
            "         each source file providing details on which lines were executed and which were not, similar\n"
-           "         to GCOV.\n"
+           "         to GCOV.  FLASH fetches are only counted when this option is used.\n"
+           "       --codecovHitsOnly can be used along with --codecov to only record whether each instruction was\n"
+           "         executed rather than how many times.  This needs 1 bit of bookkeeping per halfword of FLASH\n"
+           "         instead of 4 bytes.  Executed lines are then reported with a count of 1.\n"
            "       --restrict options can be used to specify if the code coverage results generated by the --codecov\n"
            "         option should be restricted to source files which have the specified sourcePathPrefix.  More than\n"
            "         one of these options can be specified on the command line.\n"
-           "       imageFilename.bin is the required name of the image to be loaded into memory starting at address\n"
-           "         0x00000000.  By default a read-only memory region is created starting at address 0x00000000 and\n"
-           "         extends large enough to contain the whole image file.  A read-write section will be created\n"
-           "         based on the initial stack pointer found in the first word of the image file.  This section will\n"
-           "         start at the nearest 256MB page below this initial SP value and extend to the address just below\n"
-           "         this initial SP value. This behaviour can be overridden by specifying --ram and --flash options\n"
-           "         on the command line.  Execution will start at the address found in the second word of this image.\n"
-           "       [args] are optional arguments to be passed into program running under simulation.\n");
+           "       --jit can be used to have frequently executed code translated to native code on x86-64 hosts.  The\n"
+           "         interpreter is still used while single stepping or when breakpoints/watchpoints are set.\n"
+           "       --max-instructions can be used to stop the simulation and exit with an error once the specified\n"
+           "         number of instructions have been executed.  Useful for making sure that a hung test will\n"
+           "         eventually fail.\n"
+           "       --cycles can be used to estimate how many clock cycles a Cortex-M0 would take to run the program.\n"
+           "         flashWaitStates is the number of wait states added to each fetch from the first --flash region\n"
+           "         (or the image when no --flash option is given).  The total is displayed on exit and the program\n"
+           "         can read the low 32 bits from the DWT_CYCCNT register at 0xE0001004.\n"
+           "       --ramUsage can be used to display how much of the read-write memory was actually touched on exit.\n"
+           "       --save-state can be used to save the registers and memory contents to stateFilename the first time\n"
+           "         execution reaches address (the address of main() for example).  The simulation then continues.\n"
+           "       --load-state can be used to start from the state saved by --save-state instead of from reset.  The\n"
+           "         same image and memory options must be used as when it was saved.  [args] are ignored since they\n"
+           "         have already been handed to the program in the saved state.\n"
+           "       imageFilename is the required name of the image to be loaded into memory.  It can be a raw .bin\n"
+           "         image or an .elf executable.  A .bin image is loaded starting at address 0x00000000.  By default a\n"
+           "         read-only memory region is created starting at address 0x00000000 and extends large enough to\n"
+           "         contain the whole image file.  A read-write section will be created based on the initial stack\n"
+           "         pointer found in the first word of the image file.  This section will start at the nearest 256MB\n"
+           "         page below this initial SP value and extend to the address just below this initial SP value.\n"
+           "         This behaviour can be overridden by specifying --ram and --flash options on the command line.\n"
+           "         Execution will start at the address found in the second word of this image.  For an .elf file,\n"
+           "         a read-only region is created for each read-only segment (and the load image of .data) at its\n"
+           "         load address instead and writable segments are placed in RAM at their run address.  Execution\n"
+           "         starts at the ELF entry point.\n"
+           "       [args] are optional arguments to be passed into program running under simulation.\n"
+           "       --batch runs each test listed in manifestFilename, one line of [options] imageFilename [args] per\n"
+           "         test, in parallel on --jobs threads (default is one per CPU) and then displays a summary of the\n"
+           "         results.  Debug events end a test instead of waiting for GDB.\n"
+           "       --fork-server loads the image once and then runs it in a forked child process for each connection\n"
+           "         to the Unix domain socket at socketPath.  --run-to first runs the program until it reaches the\n"
+           "         named ELF symbol or address and --run-to-input until it first reads from stdin so that each run\n"
+           "         starts from there.  Run pinkySim --fork-server without other arguments for more details.\n");
 }
 
 
@@ -72,15 +107,39 @@ static int parseFlashOption(pinkySimCommandLine* pThis, int argc, const char** p
 static int parseRegionOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs, int readOnly);
 static int parseRamOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
 static int parseBreakOnStartOption(pinkySimCommandLine* pThis);
+static int parseJitOption(pinkySimCommandLine* pThis);
+static int parseMaxInstructionsOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
+static int parseCyclesOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
+static int parseRamUsageOption(pinkySimCommandLine* pThis);
+static int parseSaveStateOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
+static int parseLoadStateOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
 static int parseGdbPortOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
 static int parseCodeCovOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
+static int parseCodeCovHitsOnlyOption(pinkySimCommandLine* pThis);
 static int parseRestrictOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs);
 static int parseFilenameArgument(pinkySimCommandLine* pThis, int index, int argc, const char* pArgument);
 static void throwIfRequiredArgumentNotSpecified(pinkySimCommandLine* pThis);
 static void loadImageFile(pinkySimCommandLine* pThis);
+static void loadBinaryImage(pinkySimCommandLine* pThis, FILE* pFile, uint32_t fileSize);
+static void loadElfImage(pinkySimCommandLine* pThis, FILE* pFile, uint32_t fileSize);
+static void enableFlashReadCountingIfCoverageRequested(pinkySimCommandLine* pThis);
 
 
 __throws void pinkySimCommandLine_Init(pinkySimCommandLine* pThis, int argc, const char** argv)
+{
+    __try
+    {
+        pinkySimCommandLine_InitQuietly(pThis, argc, argv);
+    }
+    __catch
+    {
+        displayCopyrightNotice();
+        displayUsage();
+        __rethrow;
+    }
+}
+
+__throws void pinkySimCommandLine_InitQuietly(pinkySimCommandLine* pThis, int argc, const char** argv)
 {
     __try
     {
@@ -98,11 +157,10 @@ __throws void pinkySimCommandLine_Init(pinkySimCommandLine* pThis, int argc, con
         }
         throwIfRequiredArgumentNotSpecified(pThis);
         loadImageFile(pThis);
+        enableFlashReadCountingIfCoverageRequested(pThis);
     }
     __catch
     {
-        displayCopyrightNotice();
-        displayUsage();
         MemorySim_Uninit(pThis->pMemory);
         pThis->pMemory = NULL;
         __rethrow;
@@ -134,8 +192,22 @@ static int parseFlagArgument(pinkySimCommandLine* pThis, int argc, const char**
         return parseGdbPortOption(pThis, argc - 1, &ppArgs[1]);
     else if (0 == strcasecmp(*ppArgs, "--codecov"))
         return parseCodeCovOption(pThis, argc - 1, &ppArgs[1]);
+    else if (0 == strcasecmp(*ppArgs, "--codecovHitsOnly"))
+        return parseCodeCovHitsOnlyOption(pThis);
     else if (0 == strcasecmp(*ppArgs, "--restrict"))
         return parseRestrictOption(pThis, argc - 1, &ppArgs[1]);
+    else if (0 == strcasecmp(*ppArgs, "--jit"))
+        return parseJitOption(pThis);
+    else if (0 == strcasecmp(*ppArgs, "--max-instructions"))
+        return parseMaxInstructionsOption(pThis, argc - 1, &ppArgs[1]);
+    else if (0 == strcasecmp(*ppArgs, "--cycles"))
+        return parseCyclesOption(pThis, argc - 1, &ppArgs[1]);
+    else if (0 == strcasecmp(*ppArgs, "--ramUsage"))
+        return parseRamUsageOption(pThis);
+    else if (0 == strcasecmp(*ppArgs, "--save-state"))
+        return parseSaveStateOption(pThis, argc - 1, &ppArgs[1]);
+    else if (0 == strcasecmp(*ppArgs, "--load-state"))
+        return parseLoadStateOption(pThis, argc - 1, &ppArgs[1]);
     else
         __throw(invalidArgumentException);
 }
@@ -158,6 +230,11 @@ static int parseRegionOption(pinkySimCommandLine* pThis, int argc, const char**
     MemorySim_CreateRegion(pThis->pMemory, baseAddress, size);
     if (readOnly)
         MemorySim_MakeRegionReadOnly(pThis->pMemory, baseAddress);
+    if (readOnly && !pThis->flashSize)
+    {
+        pThis->flashBaseAddress = baseAddress;
+        pThis->flashSize = size;
+    }
     pThis->manualMemoryRegions = 1;
     return 3;
 }
@@ -173,6 +250,62 @@ static int parseBreakOnStartOption(pinkySimCommandLine* pThis)
     return 1;
 }
 
+static int parseJitOption(pinkySimCommandLine* pThis)
+{
+    pThis->useJit = 1;
+    return 1;
+}
+
+static int parseMaxInstructionsOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs)
+{
+    uint64_t maxInstructions = 0;
+
+    if (argc < 1)
+        __throw(invalidArgumentException);
+
+    maxInstructions = strtoull(ppArgs[0], NULL, 0);
+    if (maxInstructions == 0)
+        __throw(invalidArgumentException);
+    pThis->maxInstructions = maxInstructions;
+    return 2;
+}
+
+static int parseCyclesOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs)
+{
+    if (argc < 1)
+        __throw(invalidArgumentException);
+
+    pThis->flashWaitStates = strtoul(ppArgs[0], NULL, 0);
+    pThis->countCycles = 1;
+    return 2;
+}
+
+static int parseRamUsageOption(pinkySimCommandLine* pThis)
+{
+    pThis->reportRamUsage = 1;
+    return 1;
+}
+
+static int parseSaveStateOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs)
+{
+    if (argc < 2)
+        __throw(invalidArgumentException);
+
+    pThis->pSaveStateFilename = ppArgs[0];
+    /* Thumb function addresses from the symbol table have their low bit set. */
+    pThis->saveStateAddress = strtoul(ppArgs[1], NULL, 0) & 0xFFFFFFFE;
+    return 3;
+}
+
+static int parseLoadStateOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs)
+{
+    if (argc < 1)
+        __throw(invalidArgumentException);
+
+    pThis->pLoadStateFilename = ppArgs[0];
+    return 2;
+}
+
 static int parseGdbPortOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs)
 {
     uint32_t portNumber = 0;
@@ -197,6 +330,12 @@ static int parseCodeCovOption(pinkySimCommandLine* pThis, int argc, const char**
     return 3;
 }
 
+static int parseCodeCovHitsOnlyOption(pinkySimCommandLine* pThis)
+{
+    pThis->coverageHitsOnly = 1;
+    return 1;
+}
+
 static int parseRestrictOption(pinkySimCommandLine* pThis, int argc, const char** ppArgs)
 {
     uint32_t      pathCount = pThis->coverageRestrictPathCount + 1;
@@ -232,43 +371,71 @@ static void throwIfRequiredArgumentNotSpecified(pinkySimCommandLine* pThis)
 static void loadImageFile(pinkySimCommandLine* pThis)
 {
     FILE* volatile pFile = NULL;
-    char* volatile pBuffer = NULL;
 
     __try
     {
-        long   fileSize = 0;
-        size_t bytesRead = 0;
+        long fileSize = 0;
 
         pFile = fopen(pThis->pImageFilename, "r");
         if (!pFile)
             __throw(fileException);
         fileSize = GetFileSize(pFile);
 
-        pBuffer = malloc(fileSize);
-        if (!pBuffer)
-            __throw(outOfMemoryException);
-
-        bytesRead = fread(pBuffer, 1, fileSize, pFile);
-        if ((long)bytesRead != fileSize)
-            __throw(fileException);
-
-        if (pThis->manualMemoryRegions)
-            MemorySim_LoadFromFlashImage(pThis->pMemory, pBuffer, fileSize);
+        if (ElfImage_IsElfFile(pFile))
+            loadElfImage(pThis, pFile, fileSize);
         else
-            MemorySim_CreateRegionsFromFlashImage(pThis->pMemory, pBuffer, fileSize);
+            loadBinaryImage(pThis, pFile, fileSize);
 
-        free(pBuffer);
         fclose(pFile);
     }
     __catch
     {
-        free(pBuffer);
         if (pFile)
             fclose(pFile);
         __rethrow;
     }
 }
 
+static void loadBinaryImage(pinkySimCommandLine* pThis, FILE* pFile, uint32_t fileSize)
+{
+    if (pThis->manualMemoryRegions)
+    {
+        MemorySim_LoadFromFlashImageFile(pThis->pMemory, pFile, fileSize);
+    }
+    else
+    {
+        MemorySim_CreateRegionsFromFlashImageFile(pThis->pMemory, pFile, fileSize);
+        pThis->flashBaseAddress = 0x00000000;
+        pThis->flashSize = fileSize;
+    }
+}
+
+static void loadElfImage(pinkySimCommandLine* pThis, FILE* pFile, uint32_t fileSize)
+{
+    ElfImageInfo info;
+
+    if (pThis->manualMemoryRegions)
+    {
+        ElfImage_Load(pThis->pMemory, pFile, fileSize, &info);
+    }
+    else
+    {
+        ElfImage_CreateRegions(pThis->pMemory, pFile, fileSize, &info);
+        pThis->flashBaseAddress = info.flashBaseAddress;
+        pThis->flashSize = info.flashSize;
+    }
+    pThis->entryPoint = info.entryPoint;
+    pThis->isElfImage = 1;
+}
+
+static void enableFlashReadCountingIfCoverageRequested(pinkySimCommandLine* pThis)
+{
+    if (!pThis->pCoverageElfFilename)
+        return;
+    MemorySim_EnableFlashReadCounting(pThis->pMemory, pThis->coverageHitsOnly ? FLASH_READ_COUNT_HITS :
+                                                                                FLASH_READ_COUNT_FULL);
+}
+
 void pinkySimCommandLine_Uninit(pinkySimCommandLine* pThis)
 {
     MemorySim_Uninit(pThis->pMemory);
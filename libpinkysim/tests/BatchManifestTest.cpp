@@ -0,0 +1,198 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <string.h>
+
+// Include headers from C modules under test.
+extern "C"
+{
+    #include <BatchManifest.h>
+    #include <FileFailureInject.h>
+    #include <MallocFailureInject.h>
+}
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+static const char* g_manifestFilename = "BatchManifestTest.txt";
+
+
+TEST_GROUP(BatchManifest)
+{
+    BatchManifest m_manifest;
+
+    void setup()
+    {
+        memset(&m_manifest, 0xff, sizeof(m_manifest));
+    }
+
+    void teardown()
+    {
+        CHECK_EQUAL(noException, getExceptionCode());
+        MallocFailureInject_Restore();
+        freadRestore();
+        BatchManifest_Uninit(&m_manifest);
+        remove(g_manifestFilename);
+    }
+
+    void createManifest(const char* pText)
+    {
+        FILE* pFile = fopen(g_manifestFilename, "w");
+        fwrite(pText, 1, strlen(pText), pFile);
+        fclose(pFile);
+    }
+
+    void validateEntry(uint32_t index, uint32_t lineNumber, int argCount, ...)
+    {
+        va_list args;
+
+        CHECK_TRUE(index < m_manifest.entryCount);
+        CHECK_EQUAL(lineNumber, m_manifest.pEntries[index].lineNumber);
+        CHECK_EQUAL(argCount, m_manifest.pEntries[index].argCount);
+        va_start(args, argCount);
+        for (int i = 0 ; i < argCount ; i++)
+            STRCMP_EQUAL(va_arg(args, const char*), m_manifest.pEntries[index].ppArgs[i]);
+        va_end(args);
+    }
+};
+
+
+TEST(BatchManifest, MissingFile_ShouldThrow)
+{
+    __try_and_catch( BatchManifest_Init(&m_manifest, g_manifestFilename) );
+    CHECK_EQUAL(fileException, getExceptionCode());
+    CHECK_EQUAL(0, m_manifest.entryCount);
+    clearExceptionCode();
+}
+
+TEST(BatchManifest, EmptyFile_ShouldHaveNoEntries)
+{
+    createManifest("");
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(0, m_manifest.entryCount);
+}
+
+TEST(BatchManifest, OneImageWithoutTrailingNewline_ShouldHaveOneEntry)
+{
+    createManifest("test.elf");
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(1, m_manifest.entryCount);
+    validateEntry(0, 1, 1, "test.elf");
+}
+
+TEST(BatchManifest, OptionsImageAndArgs_ShouldBeSplitOnSpacesAndTabs)
+{
+    createManifest("--max-instructions 1000\ttest.elf  arg1 arg2 \n");
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(1, m_manifest.entryCount);
+    validateEntry(0, 1, 5, "--max-instructions", "1000", "test.elf", "arg1", "arg2");
+}
+
+TEST(BatchManifest, BlankAndCommentLines_ShouldBeSkippedButCountedInLineNumbers)
+{
+    createManifest("# Tests for the foo module.\n"
+                   "\n"
+                   "foo.elf 1\n"
+                   "   \t\n"
+                   "  # foo.elf 2\n"
+                   "bar.bin\n");
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(2, m_manifest.entryCount);
+    validateEntry(0, 3, 2, "foo.elf", "1");
+    validateEntry(1, 6, 1, "bar.bin");
+}
+
+TEST(BatchManifest, WindowsLineEndings_ShouldBeStripped)
+{
+    createManifest("foo.elf 1\r\nbar.elf 2\r\n");
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(2, m_manifest.entryCount);
+    validateEntry(0, 1, 2, "foo.elf", "1");
+    validateEntry(1, 2, 2, "bar.elf", "2");
+}
+
+TEST(BatchManifest, QuotedArguments_ShouldKeepSpacesAndDropQuotes)
+{
+    createManifest("\"my tests/foo.elf\" \"hello world\" \"\"\n");
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(1, m_manifest.entryCount);
+    validateEntry(0, 1, 3, "my tests/foo.elf", "hello world", "");
+}
+
+TEST(BatchManifest, UnterminatedQuote_ShouldThrow)
+{
+    createManifest("foo.elf \"hello\n");
+    __try_and_catch( BatchManifest_Init(&m_manifest, g_manifestFilename) );
+    CHECK_EQUAL(invalidArgumentException, getExceptionCode());
+    CHECK_EQUAL(0, m_manifest.entryCount);
+    clearExceptionCode();
+}
+
+TEST(BatchManifest, ManyEntries_ShouldGrowArrays)
+{
+    char text[100 * 16];
+    char* p = text;
+
+    for (int i = 0 ; i < 100 ; i++)
+        p += sprintf(p, "t%d.elf %d\n", i, i);
+    createManifest(text);
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(100, m_manifest.entryCount);
+    validateEntry(0, 1, 2, "t0.elf", "0");
+    validateEntry(57, 58, 2, "t57.elf", "57");
+    validateEntry(99, 100, 2, "t99.elf", "99");
+}
+
+TEST(BatchManifest, FailReadingFile_ShouldThrow)
+{
+    createManifest("foo.elf\n");
+    freadFail(0);
+    __try_and_catch( BatchManifest_Init(&m_manifest, g_manifestFilename) );
+    CHECK_EQUAL(fileException, getExceptionCode());
+    clearExceptionCode();
+}
+
+TEST(BatchManifest, FailAllocations_ShouldThrow)
+{
+    createManifest("foo.elf\n");
+    for (unsigned int i = 1 ; i <= 3 ; i++)
+    {
+        MallocFailureInject_FailAllocation(i);
+        __try_and_catch( BatchManifest_Init(&m_manifest, g_manifestFilename) );
+        CHECK_EQUAL(outOfMemoryException, getExceptionCode());
+        CHECK_EQUAL(0, m_manifest.entryCount);
+        clearExceptionCode();
+    }
+    MallocFailureInject_Restore();
+    BatchManifest_Init(&m_manifest, g_manifestFilename);
+    CHECK_EQUAL(1, m_manifest.entryCount);
+}
+
+TEST(BatchManifest, InitFromText_ShouldParseSameAsFile)
+{
+    char text[] = "# comment\n\"hello world\" 2\n";
+
+    BatchManifest_InitFromText(&m_manifest, text);
+    text[0] = '\0';
+    CHECK_EQUAL(1, m_manifest.entryCount);
+    validateEntry(0, 2, 2, "hello world", "2");
+}
+
+TEST(BatchManifest, InitFromTextFailAllocation_ShouldThrow)
+{
+    MallocFailureInject_FailAllocation(1);
+    __try_and_catch( BatchManifest_InitFromText(&m_manifest, "foo.elf\n") );
+    CHECK_EQUAL(outOfMemoryException, getExceptionCode());
+    CHECK_EQUAL(0, m_manifest.entryCount);
+    clearExceptionCode();
+}
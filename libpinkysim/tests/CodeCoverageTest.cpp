@@ -36,6 +36,7 @@ TEST_GROUP(CodeCoverage)
         static const uint32_t flashImage[] = { 0x10000008, 0, 0, 0,
                                                0,          0, 0, 0 };
         m_pMemory = MemorySim_Init();
+        MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
         MemorySim_CreateRegionsFromFlashImage(m_pMemory, flashImage, sizeof(flashImage));
         m_pBuffer = NULL;
         cleanupFiles();
@@ -268,7 +269,7 @@ TEST(CodeCoverage, OneLineInElf_SingleLineSource_ExecutedOnce_VerifyOutputFiles)
                             "CodeCoverageTest1.S 1 0x4\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x4);
     createSourceFile("CodeCoverageTest1.S", "Line 1");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", NULL, 0);
     checkFileMatches("./summary.txt", "100.00%  CodeCoverageTest1.S\n");
@@ -281,8 +282,8 @@ TEST(CodeCoverage, OneLineInElf_SingleLineSource_ExecutedTwice_VerifyOutputFiles
                             "CodeCoverageTest1.S 1 0x4\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
-    IMemory_Read16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x4);
     createSourceFile("CodeCoverageTest1.S", "Line 1");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", NULL, 0);
     checkFileMatches("./summary.txt", "100.00%  CodeCoverageTest1.S\n");
@@ -297,9 +298,9 @@ TEST(CodeCoverage, TwoLinesInElf_FirstAddressExecutedMoreThanSecond_SingleLineSo
                             "CodeCoverageTest1.S 1 0x8\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
-    IMemory_Read16(m_pMemory, 0x4);
-    IMemory_Read16(m_pMemory, 0x8);
+    IMemory_Fetch16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x8);
     createSourceFile("CodeCoverageTest1.S", "Line 1");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", NULL, 0);
     checkFileMatches("./summary.txt", "100.00%  CodeCoverageTest1.S\n");
@@ -314,9 +315,9 @@ TEST(CodeCoverage, TwoLinesInElf_FirstAddressExecutedLessThanSecond_SingleLineSo
                             "CodeCoverageTest1.S 1 0x8\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
-    IMemory_Read16(m_pMemory, 0x8);
-    IMemory_Read16(m_pMemory, 0x8);
+    IMemory_Fetch16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x8);
+    IMemory_Fetch16(m_pMemory, 0x8);
     createSourceFile("CodeCoverageTest1.S", "Line 1");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", NULL, 0);
     checkFileMatches("./summary.txt", "100.00%  CodeCoverageTest1.S\n");
@@ -343,7 +344,7 @@ TEST(CodeCoverage, TwoLinesInElf_MultiLineSource_Executed_NotExecuted_NonExecuta
                             "CodeCoverageTest1.S 2 0x8\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x4);
     createSourceFile("CodeCoverageTest1.S", "Line 1\n"
                                             "Line 2\n"
                                             "Line 3\n");
@@ -381,8 +382,8 @@ TEST(CodeCoverage, TwoLinesInElf_TwoSourceFiles_Executed_VerifyOutputFiles)
                             "CodeCoverageTest2.S 1 0x8\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
-    IMemory_Read16(m_pMemory, 0x8);
+    IMemory_Fetch16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x8);
     createSourceFile("CodeCoverageTest1.S", "Line 1\n");
     createSourceFile("CodeCoverageTest2.S", "Line 1\n");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", NULL, 0);
@@ -401,7 +402,7 @@ TEST(CodeCoverage, TwoLinesInElf_TwoSourceFiles_MixOfExecutedAndNotExecuted_Veri
                             "CodeCoverageTest2.S 1 0x8\n" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x8);
+    IMemory_Fetch16(m_pMemory, 0x8);
     createSourceFile("CodeCoverageTest1.S", "Line 1\n");
     createSourceFile("CodeCoverageTest2.S", "Line 1\n");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", NULL, 0);
@@ -445,8 +446,8 @@ TEST(CodeCoverage, RestrictToOnlyProcessOneSourceFileOfTwoPossibleFiles_VerifyOu
     const char* restrict[] = { "CodeCoverageTest2.S" };
 
     mockFileIo_SetFgetsData(lines, ARRAY_SIZE(lines));
-    IMemory_Read16(m_pMemory, 0x4);
-    IMemory_Read16(m_pMemory, 0x8);
+    IMemory_Fetch16(m_pMemory, 0x4);
+    IMemory_Fetch16(m_pMemory, 0x8);
     createSourceFile("CodeCoverageTest1.S", "Line 1\n");
     createSourceFile("CodeCoverageTest2.S", "Line 1\n");
         CodeCoverage_Run("foo.elf", m_pMemory, ".", restrict, ARRAY_SIZE(restrict));
@@ -0,0 +1,471 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <string.h>
+
+// Include headers from C modules under test.
+extern "C"
+{
+    #include <ElfImage.h>
+    #include <FileFailureInject.h>
+    #include <MemorySim.h>
+}
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+#define ELF_HEADER_SIZE         52
+#define PROGRAM_HEADER_OFFSET   ELF_HEADER_SIZE
+#define PROGRAM_HEADER_SIZE     32
+#define SECTION_HEADER_SIZE     40
+#define SYMBOL_SIZE             16
+#define SHT_SYMTAB              2
+#define SHT_STRTAB              3
+#define PT_LOAD                 1
+#define PT_NOTE                 4
+#define PF_X                    1
+#define PF_W                    2
+#define PF_R                    4
+
+// Segment data starts at file offsets which aren't host page aligned so that the mapping offset logic is exercised.
+#define TEXT_OFFSET             0x100
+#define DATA_OFFSET             0x180
+#define INITIAL_SP              0x10000100
+#define RESET_HANDLER           0x00000041
+#define STRTAB_OFFSET           0x200
+#define SYMTAB_OFFSET           0x210
+#define SECTION_HEADER_OFFSET   0x240
+#define IMAGE_SIZE              0x300
+
+TEST_GROUP(ElfImage)
+{
+    IMemory*     m_pMemory;
+    FILE*        m_pFile;
+    ElfImageInfo m_info;
+    uint8_t      m_image[IMAGE_SIZE];
+    uint32_t     m_segmentCount;
+
+    void setup()
+    {
+        m_pMemory = MemorySim_Init();
+        m_pFile = NULL;
+        m_segmentCount = 0;
+        memset(&m_info, 0xFF, sizeof(m_info));
+        memset(m_image, 0, sizeof(m_image));
+        initElfHeader();
+    }
+
+    void teardown()
+    {
+        CHECK_EQUAL(noException, getExceptionCode());
+        clearExceptionCode();
+        MemorySim_Uninit(m_pMemory);
+        mmapRestore();
+        if (m_pFile)
+            fclose(m_pFile);
+    }
+
+    void initElfHeader()
+    {
+        static const uint8_t ident[] = { 0x7F, 'E', 'L', 'F', 1 /* 32-bit */, 1 /* little endian */, 1 /* version */ };
+
+        memcpy(m_image, ident, sizeof(ident));
+        write16(16, 2);                     // e_type = ET_EXEC
+        write16(18, 40);                    // e_machine = EM_ARM
+        write32(20, 1);                     // e_version
+        write32(24, RESET_HANDLER);         // e_entry
+        write32(28, PROGRAM_HEADER_OFFSET); // e_phoff
+        write16(40, ELF_HEADER_SIZE);       // e_ehsize
+        write16(42, PROGRAM_HEADER_SIZE);   // e_phentsize
+    }
+
+    void write16(uint32_t offset, uint16_t value)
+    {
+        memcpy(&m_image[offset], &value, sizeof(value));
+    }
+
+    void write32(uint32_t offset, uint32_t value)
+    {
+        memcpy(&m_image[offset], &value, sizeof(value));
+    }
+
+    void addSegment(uint32_t type, uint32_t offset, uint32_t vaddr, uint32_t paddr,
+                    uint32_t fileSize, uint32_t memSize, uint32_t flags)
+    {
+        uint32_t headerOffset = PROGRAM_HEADER_OFFSET + m_segmentCount * PROGRAM_HEADER_SIZE;
+
+        write32(headerOffset + 0, type);
+        write32(headerOffset + 4, offset);
+        write32(headerOffset + 8, vaddr);
+        write32(headerOffset + 12, paddr);
+        write32(headerOffset + 16, fileSize);
+        write32(headerOffset + 20, memSize);
+        write32(headerOffset + 24, flags);
+        write32(headerOffset + 28, 4);
+        m_segmentCount++;
+        write16(44, m_segmentCount);        // e_phnum
+    }
+
+    void addTextSegment()
+    {
+        write32(TEXT_OFFSET + 0, INITIAL_SP);
+        write32(TEXT_OFFSET + 4, RESET_HANDLER);
+        write32(TEXT_OFFSET + 8, 0xBE00BF00);
+        addSegment(PT_LOAD, TEXT_OFFSET, 0x00000000, 0x00000000, 12, 12, PF_R | PF_X);
+    }
+
+    void addDataSegment(uint32_t vaddr)
+    {
+        write32(DATA_OFFSET + 0, 0x12345678);
+        write32(DATA_OFFSET + 4, 0xBAADF00D);
+        addSegment(PT_LOAD, DATA_OFFSET, vaddr, 0x0000000C, 8, 16, PF_R | PF_W);
+    }
+
+    void addSymbolTable()
+    {
+        static const char names[] = "\0main_loop\0main";
+
+        memcpy(&m_image[STRTAB_OFFSET], names, sizeof(names));
+        addSymbol(1, 1, 0x00000051, 1);     // main_loop
+        addSymbol(2, 11, RESET_HANDLER, 1); // main
+        addSectionHeader(1, SHT_SYMTAB, SYMTAB_OFFSET, 3 * SYMBOL_SIZE, 2);
+        addSectionHeader(2, SHT_STRTAB, STRTAB_OFFSET, sizeof(names), 0);
+        write32(32, SECTION_HEADER_OFFSET); // e_shoff
+        write16(46, SECTION_HEADER_SIZE);   // e_shentsize
+        write16(48, 3);                     // e_shnum
+    }
+
+    void addSymbol(uint32_t index, uint32_t nameOffset, uint32_t value, uint16_t sectionIndex)
+    {
+        uint32_t symbolOffset = SYMTAB_OFFSET + index * SYMBOL_SIZE;
+
+        write32(symbolOffset + 0, nameOffset);
+        write32(symbolOffset + 4, value);
+        write16(symbolOffset + 14, sectionIndex);
+    }
+
+    void addSectionHeader(uint32_t index, uint32_t type, uint32_t offset, uint32_t size, uint32_t link)
+    {
+        uint32_t headerOffset = SECTION_HEADER_OFFSET + index * SECTION_HEADER_SIZE;
+
+        write32(headerOffset + 4, type);
+        write32(headerOffset + 16, offset);
+        write32(headerOffset + 20, size);
+        write32(headerOffset + 24, link);
+    }
+
+    uint32_t findSymbol(const char* pName)
+    {
+        return ElfImage_FindSymbol(m_pFile, sizeof(m_image), pName);
+    }
+
+    void createImageFile(size_t imageSize = IMAGE_SIZE)
+    {
+        m_pFile = tmpfile();
+        CHECK(m_pFile != NULL);
+        CHECK_EQUAL(imageSize, fwrite(m_image, 1, imageSize, m_pFile));
+        fflush(m_pFile);
+        rewind(m_pFile);
+    }
+
+    void createRegions()
+    {
+        ElfImage_CreateRegions(m_pMemory, m_pFile, sizeof(m_image), &m_info);
+    }
+
+    void validateExceptionThrown(int expectedExceptionCode)
+    {
+        CHECK_EQUAL(expectedExceptionCode, getExceptionCode());
+        clearExceptionCode();
+    }
+};
+
+
+TEST(ElfImage, IsElfFile_WithElfMagic_ShouldReturnTrueAndLeaveFilePositionAlone)
+{
+    createImageFile();
+    CHECK_TRUE(ElfImage_IsElfFile(m_pFile));
+    CHECK_EQUAL(0, ftell(m_pFile));
+}
+
+TEST(ElfImage, IsElfFile_WithRawBinary_ShouldReturnFalse)
+{
+    memset(m_image, 0, 4);
+    createImageFile();
+    CHECK_FALSE(ElfImage_IsElfFile(m_pFile));
+    CHECK_EQUAL(0, ftell(m_pFile));
+}
+
+TEST(ElfImage, IsElfFile_WithFileSmallerThanMagic_ShouldReturnFalse)
+{
+    createImageFile(2);
+    CHECK_FALSE(ElfImage_IsElfFile(m_pFile));
+}
+
+TEST(ElfImage, CreateRegions_TextSegmentOnly_ShouldMapFlashAndCreateRamFromInitialStackPointer)
+{
+    addTextSegment();
+    createImageFile();
+        createRegions();
+    CHECK_EQUAL(RESET_HANDLER, m_info.entryPoint);
+    CHECK_EQUAL(0x00000000, m_info.flashBaseAddress);
+    CHECK_EQUAL(12, m_info.flashSize);
+    CHECK_EQUAL(INITIAL_SP, IMemory_Read32(m_pMemory, 0x00000000));
+    CHECK_EQUAL(0xBE00BF00, IMemory_Read32(m_pMemory, 0x00000008));
+    __try_and_catch( IMemory_Write32(m_pMemory, 0x00000000, 0) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x0000000C) );
+    validateExceptionThrown(busErrorException);
+
+    IMemory_Write32(m_pMemory, 0x10000000, 0xFFFFFFFF);
+    IMemory_Write32(m_pMemory, INITIAL_SP - 4, 0xFFFFFFFF);
+    __try_and_catch( IMemory_Write32(m_pMemory, INITIAL_SP, 0xFFFFFFFF) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(ElfImage, CreateRegions_DataSegment_ShouldMapLoadImageAndCopyToRamWithZeroedBss)
+{
+    addTextSegment();
+    addDataSegment(0x10000000);
+    createImageFile();
+        createRegions();
+    CHECK_EQUAL(0x00000000, m_info.flashBaseAddress);
+    CHECK_EQUAL(12 + 8, m_info.flashSize);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x0000000C));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x00000010));
+    __try_and_catch( IMemory_Write32(m_pMemory, 0x0000000C, 0) );
+    validateExceptionThrown(busErrorException);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x10000000));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x10000004));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x10000008));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x1000000C));
+}
+
+TEST(ElfImage, CreateRegions_DataSegmentOutsideStackRegion_ShouldGetItsOwnRegion)
+{
+    addTextSegment();
+    addDataSegment(0x20000000);
+    createImageFile();
+        createRegions();
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x20000000));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x2000000C));
+    IMemory_Write32(m_pMemory, 0x2000000C, 0xFFFFFFFF);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x20000010) );
+    validateExceptionThrown(busErrorException);
+    IMemory_Write32(m_pMemory, 0x10000000, 0xFFFFFFFF);
+}
+
+TEST(ElfImage, CreateRegions_ShouldIgnoreSegmentsWhichArentLoadable)
+{
+    addSegment(PT_NOTE, 0, 0x30000000, 0x30000000, 4, 4, PF_R);
+    addTextSegment();
+    createImageFile();
+        createRegions();
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x30000000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(ElfImage, CreateRegions_LoadingOverFlash_ShouldNotModifyFile)
+{
+    uint32_t newImage = 0xFFFFFFFF;
+    uint32_t word = 0;
+    addTextSegment();
+    createImageFile();
+    createRegions();
+        MemorySim_LoadImage(m_pMemory, 0x00000008, &newImage, sizeof(newImage));
+    CHECK_EQUAL(0xFFFFFFFF, IMemory_Read32(m_pMemory, 0x00000008));
+    fseek(m_pFile, TEXT_OFFSET + 8, SEEK_SET);
+    CHECK_EQUAL(1, fread(&word, sizeof(word), 1, m_pFile));
+    CHECK_EQUAL(0xBE00BF00, word);
+}
+
+TEST(ElfImage, CreateRegions_NoReadOnlySegments_ShouldThrow)
+{
+    addDataSegment(0x10000000);
+    write32(PROGRAM_HEADER_OFFSET + 12, 0x10000000);    // p_paddr == p_vaddr
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_NotElfFile_ShouldThrow)
+{
+    addTextSegment();
+    m_image[0] = 0;
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_64BitElf_ShouldThrow)
+{
+    addTextSegment();
+    m_image[4] = 2;
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_BigEndianElf_ShouldThrow)
+{
+    addTextSegment();
+    m_image[5] = 2;
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_NotArmMachine_ShouldThrow)
+{
+    addTextSegment();
+    write16(18, 3);
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_ProgramHeadersPastEndOfFile_ShouldThrow)
+{
+    addTextSegment();
+    write32(28, sizeof(m_image) - PROGRAM_HEADER_SIZE + 4);
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_SegmentDataPastEndOfFile_ShouldThrow)
+{
+    addSegment(PT_LOAD, TEXT_OFFSET, 0x00000000, 0x00000000, sizeof(m_image), sizeof(m_image), PF_R | PF_X);
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_SegmentFileSizeLargerThanMemorySize_ShouldThrow)
+{
+    addSegment(PT_LOAD, TEXT_OFFSET, 0x00000000, 0x00000000, 12, 8, PF_R | PF_X);
+    createImageFile();
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_FileSmallerThanElfHeader_ShouldThrow)
+{
+    createImageFile(ELF_HEADER_SIZE - 1);
+    __try_and_catch( ElfImage_CreateRegions(m_pMemory, m_pFile, ELF_HEADER_SIZE - 1, &m_info) );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_FailMap_ShouldThrow)
+{
+    addTextSegment();
+    createImageFile();
+    mmapFail(MAP_FAILED);
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, CreateRegions_FailSegmentMap_ShouldThrow)
+{
+    addTextSegment();
+    createImageFile();
+    mmapFail(MAP_FAILED);
+    mmapSetCallsBeforeFailure(1);
+    __try_and_catch( createRegions() );
+    validateExceptionThrown(fileException);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x00000000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(ElfImage, Load_IntoExistingRegions_ShouldCopyToLoadAndRunAddresses)
+{
+    addTextSegment();
+    addDataSegment(0x10000000);
+    createImageFile();
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 0x100);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x00000000);
+    MemorySim_CreateRegion(m_pMemory, 0x10000000, 0x100);
+        ElfImage_Load(m_pMemory, m_pFile, sizeof(m_image), &m_info);
+    CHECK_EQUAL(RESET_HANDLER, m_info.entryPoint);
+    CHECK_EQUAL(INITIAL_SP, IMemory_Read32(m_pMemory, 0x00000000));
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x0000000C));
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x10000000));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x10000004));
+}
+
+TEST(ElfImage, Load_WithoutRegions_ShouldThrow)
+{
+    addTextSegment();
+    createImageFile();
+    __try_and_catch( ElfImage_Load(m_pMemory, m_pFile, sizeof(m_image), &m_info) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(ElfImage, FindSymbol_ShouldReturnValueOfSymbolWithExactName)
+{
+    addTextSegment();
+    addSymbolTable();
+    createImageFile();
+    CHECK_EQUAL(RESET_HANDLER, findSymbol("main"));
+    CHECK_EQUAL(0x00000051, findSymbol("main_loop"));
+}
+
+TEST(ElfImage, FindSymbol_MissingOrUndefinedSymbol_ShouldThrow)
+{
+    addTextSegment();
+    addSymbolTable();
+    addSymbol(2, 11, RESET_HANDLER, 0);
+    createImageFile();
+    __try_and_catch( findSymbol("main_") );
+    validateExceptionThrown(notFoundException);
+    __try_and_catch( findSymbol("main") );
+    validateExceptionThrown(notFoundException);
+}
+
+TEST(ElfImage, FindSymbol_StrippedImage_ShouldThrow)
+{
+    addTextSegment();
+    createImageFile();
+    __try_and_catch( findSymbol("main") );
+    validateExceptionThrown(notFoundException);
+}
+
+TEST(ElfImage, FindSymbol_SectionHeadersPastEndOfFile_ShouldThrow)
+{
+    addTextSegment();
+    addSymbolTable();
+    write32(32, sizeof(m_image) - SECTION_HEADER_SIZE);
+    createImageFile();
+    __try_and_catch( findSymbol("main") );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, FindSymbol_StringTableLinkOutOfRange_ShouldThrow)
+{
+    addTextSegment();
+    addSymbolTable();
+    addSectionHeader(1, SHT_SYMTAB, SYMTAB_OFFSET, 3 * SYMBOL_SIZE, 3);
+    createImageFile();
+    __try_and_catch( findSymbol("main") );
+    validateExceptionThrown(fileException);
+}
+
+TEST(ElfImage, FindSymbol_SymbolTablePastEndOfFile_ShouldThrow)
+{
+    addTextSegment();
+    addSymbolTable();
+    addSectionHeader(1, SHT_SYMTAB, SYMTAB_OFFSET, sizeof(m_image), 2);
+    createImageFile();
+    __try_and_catch( findSymbol("main") );
+    validateExceptionThrown(fileException);
+}
@@ -10,10 +10,13 @@
     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
     GNU General Public License for more details.
 */
+#include <unistd.h>
+
 // Include headers from C modules under test.
 extern "C"
 {
     #include <MemorySim.h>
+    #include <FileFailureInject.h>
     #include <MallocFailureInject.h>
 }
 
@@ -21,13 +24,41 @@ extern "C"
 #include "CppUTest/TestHarness.h"
 
 
+// Fake peripheral for MMIO regions which records the last access made to it.
+struct FakePeripheral
+{
+    uint32_t offset;
+    uint32_t size;
+    uint32_t writeValue;
+    uint32_t readValue;
+};
+
+static uint32_t fakePeripheralRead(void* pContext, uint32_t offset, uint32_t size)
+{
+    FakePeripheral* pPeripheral = (FakePeripheral*)pContext;
+    pPeripheral->offset = offset;
+    pPeripheral->size = size;
+    return pPeripheral->readValue;
+}
+
+static void fakePeripheralWrite(void* pContext, uint32_t offset, uint32_t size, uint32_t value)
+{
+    FakePeripheral* pPeripheral = (FakePeripheral*)pContext;
+    pPeripheral->offset = offset;
+    pPeripheral->size = size;
+    pPeripheral->writeValue = value;
+}
+
+
 TEST_GROUP(MemorySim)
 {
     IMemory* m_pMemory;
+    FILE*    m_pImageFile;
 
     void setup()
     {
         m_pMemory = MemorySim_Init();
+        m_pImageFile = NULL;
     }
 
     void teardown()
@@ -36,6 +67,26 @@ TEST_GROUP(MemorySim)
         clearExceptionCode();
         MemorySim_Uninit(m_pMemory);
         MallocFailureInject_Restore();
+        mmapRestore();
+        fwriteRestore();
+        if (m_pImageFile)
+            fclose(m_pImageFile);
+    }
+
+    void createImageFile(const void* pImage, size_t imageSize)
+    {
+        m_pImageFile = tmpfile();
+        CHECK(m_pImageFile != NULL);
+        CHECK_EQUAL(imageSize, fwrite(pImage, 1, imageSize, m_pImageFile));
+        fflush(m_pImageFile);
+    }
+
+    uint32_t readWordFromImageFile(long offset)
+    {
+        uint32_t word = 0;
+        fseek(m_pImageFile, offset, SEEK_SET);
+        CHECK_EQUAL(1, fread(&word, sizeof(word), 1, m_pImageFile));
+        return word;
     }
 
     void validateExceptionThrown(int expectedExceptionCode)
@@ -43,6 +94,27 @@ TEST_GROUP(MemorySim)
         CHECK_EQUAL(expectedExceptionCode, getExceptionCode());
         clearExceptionCode();
     }
+
+    void createRegionsForState(IMemory* pMemory, uint32_t ramSize = 0x20000)
+    {
+        static FakePeripheral peripheral;
+
+        MemorySim_CreateRegion(pMemory, 0x00000000, 0x1000);
+        MemorySim_MakeRegionReadOnly(pMemory, 0x00000000);
+        MemorySim_CreateRegion(pMemory, 0x20000000, ramSize);
+        MemorySim_CreateRegisterFileRegion(pMemory, 0x40000000, 2, NULL);
+        MemorySim_CreateMmioRegion(pMemory, 0x50000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    }
+
+    FILE* saveStateToTemporaryFile()
+    {
+        FILE* pFile = tmpfile();
+        CHECK(pFile != NULL);
+        MemorySim_SaveState(m_pMemory, pFile);
+        fflush(pFile);
+        rewind(pFile);
+        return pFile;
+    }
 };
 
 TEST(MemorySim, BasicInitTakenCareOfInSetup)
@@ -75,7 +147,8 @@ TEST(MemorySim, ShouldThrowIfOutOfMemory)
 {
     // Each region has two allocations.
     // 1. The MemoryRegion structure which describes the region.
-    // 2. The array of bytes used to simulate the memory.
+    // 2. The page table covering the region (when not already allocated for an earlier region).
+    // The memory itself is mmap()ed rather than allocated from the heap.
     static const size_t allocationsToFail = 2;
     size_t i;
 
@@ -89,6 +162,128 @@ TEST(MemorySim, ShouldThrowIfOutOfMemory)
     MemorySim_CreateRegion(m_pMemory, 0x00000004, 4);
 }
 
+TEST(MemorySim, OutOfMemoryForRegionData_ShouldLeaveAddressUnmapped)
+{
+    mmapFail(MAP_FAILED);
+    __try_and_catch( MemorySim_CreateRegion(m_pMemory, 0x00001000, 4) );
+    validateExceptionThrown(outOfMemoryException);
+    mmapRestore();
+
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x00001000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, CreateZeroSizedRegion_ShouldSucceedButNotBeAccessible)
+{
+    MemorySim_CreateRegion(m_pMemory, 0x00001000, 0);
+    __try_and_catch( IMemory_Read8(m_pMemory, 0x00001000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, CreateLargeRegion_ShouldBeZeroFilledWhenFirstTouched)
+{
+    static const uint32_t regionSize = 256 * 1024 * 1024;
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, regionSize);
+    CHECK_EQUAL(0, IMemory_Read32(m_pMemory, 0x20000000 + regionSize / 2));
+    IMemory_Write32(m_pMemory, 0x20000000 + regionSize - 4, 0x12345678);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x20000000 + regionSize - 4));
+}
+
+TEST(MemorySim, GetRAMUsage_NoRegions_ShouldReturnZeroes)
+{
+    uint64_t totalBytes = ~0ULL;
+    uint64_t touchedBytes = ~0ULL;
+    MemorySim_GetRAMUsage(m_pMemory, &totalBytes, &touchedBytes);
+    CHECK_EQUAL(0, totalBytes);
+    CHECK_EQUAL(0, touchedBytes);
+}
+
+TEST(MemorySim, GetRAMUsage_UntouchedRegion_ShouldReportNothingTouched)
+{
+    uint64_t totalBytes = 0;
+    uint64_t touchedBytes = ~0ULL;
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 1024 * 1024);
+    MemorySim_GetRAMUsage(m_pMemory, &totalBytes, &touchedBytes);
+    CHECK_EQUAL(1024 * 1024, totalBytes);
+    CHECK_EQUAL(0, touchedBytes);
+}
+
+TEST(MemorySim, GetRAMUsage_TouchTwoHostPages_ShouldOnlyReportThosePagesAndSkipFlash)
+{
+    long     hostPageSize = sysconf(_SC_PAGESIZE);
+    uint64_t totalBytes = 0;
+    uint64_t touchedBytes = 0;
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 1024 * 1024);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x00000000);
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 1024 * 1024);
+    IMemory_Read32(m_pMemory, 0x00000000);
+    IMemory_Write32(m_pMemory, 0x20000000, 0x11111111);
+    IMemory_Write32(m_pMemory, 0x20080000, 0x22222222);
+    MemorySim_GetRAMUsage(m_pMemory, &totalBytes, &touchedBytes);
+    CHECK_EQUAL(1024 * 1024, totalBytes);
+    CHECK_EQUAL(2 * hostPageSize, (long)touchedBytes);
+}
+
+TEST(MemorySim, GetRAMUsage_TouchedRegionSmallerThanHostPage_ShouldBeClippedToRegionSize)
+{
+    uint64_t totalBytes = 0;
+    uint64_t touchedBytes = 0;
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 16);
+    IMemory_Write32(m_pMemory, 0x20000000, 0x11111111);
+    MemorySim_GetRAMUsage(m_pMemory, &totalBytes, &touchedBytes);
+    CHECK_EQUAL(16, totalBytes);
+    CHECK_EQUAL(16, touchedBytes);
+}
+
+TEST(MemorySim, TwoRegionsSharingSamePage_ShouldBothBeAccessible)
+{
+    MemorySim_CreateRegion(m_pMemory, 0x00001000, 0x10);
+    MemorySim_CreateRegion(m_pMemory, 0x00001010, 0x10);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x00001010);
+
+    IMemory_Write32(m_pMemory, 0x0000100C, 0x11111111);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x0000100C));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x00001010));
+    __try_and_catch( IMemory_Write32(m_pMemory, 0x00001010, 0x22222222) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x00001020) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, OverlappingRegions_FirstRegionCreatedShouldTakePrecedence)
+{
+    MemorySim_CreateRegion(m_pMemory, 0x00001000, 0x10);
+    MemorySim_CreateRegion(m_pMemory, 0x00001000, 0x2000);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x00001000);
+
+    __try_and_catch( IMemory_Write32(m_pMemory, 0x00001000, 0x11111111) );
+    validateExceptionThrown(busErrorException);
+    IMemory_Write32(m_pMemory, 0x00001010, 0x22222222);
+    CHECK_EQUAL(0x22222222, IMemory_Read32(m_pMemory, 0x00001010));
+    IMemory_Write32(m_pMemory, 0x00002FFC, 0x33333333);
+    CHECK_EQUAL(0x33333333, IMemory_Read32(m_pMemory, 0x00002FFC));
+}
+
+TEST(MemorySim, RegionSpanningTwoPageTables_ShouldBeAccessibleOnBothSides)
+{
+    MemorySim_CreateRegion(m_pMemory, 0x003FF000, 0x2000);
+
+    IMemory_Write32(m_pMemory, 0x003FFFFC, 0x11111111);
+    IMemory_Write32(m_pMemory, 0x00400000, 0x22222222);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x003FFFFC));
+    CHECK_EQUAL(0x22222222, IMemory_Read32(m_pMemory, 0x00400000));
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x00401000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, RegionAtTopOfAddressSpace_ShouldBeAccessible)
+{
+    MemorySim_CreateRegion(m_pMemory, 0xFFFFF000, 0x1000);
+
+    IMemory_Write32(m_pMemory, 0xFFFFFFFC, 0x11111111);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0xFFFFFFFC));
+}
+
 TEST(MemorySim, SimulateFourBytes_ShouldBeZeroFilledByDefault)
 {
     MemorySim_CreateRegion(m_pMemory, 0x00000004, 4);
@@ -282,6 +477,167 @@ TEST(MemorySim, AttemptLoadFromFlashImageToInvalidRegions_ShouldThrow)
     validateExceptionThrown(busErrorException);
 }
 
+TEST(MemorySim, LoadFromFlashImage_SpanningTwoAdjacentRegions)
+{
+    uint32_t flashBinary[3] = { 0x10000004, 0x00000200, 0x12345678 };
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 6);
+    MemorySim_CreateRegion(m_pMemory, 0x00000006, 6);
+        MemorySim_LoadFromFlashImage(m_pMemory, flashBinary, sizeof(flashBinary));
+    CHECK_EQUAL(flashBinary[0], IMemory_Read32(m_pMemory, 0x00000000));
+    CHECK_EQUAL(0x0200, IMemory_Read16(m_pMemory, 0x00000004));
+    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, 0x00000006));
+    CHECK_EQUAL(flashBinary[2], IMemory_Read32(m_pMemory, 0x00000008));
+}
+
+TEST(MemorySim, LoadFromFlashImage_LargerThanRegion_ShouldThrow)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 6);
+    __try_and_catch( MemorySim_LoadFromFlashImage(m_pMemory, flashBinary, sizeof(flashBinary)) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, LoadFromFlashImageFile)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    createImageFile(flashBinary, sizeof(flashBinary));
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 8);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x00000000);
+        MemorySim_LoadFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary));
+    CHECK_EQUAL(flashBinary[0], IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS));
+    CHECK_EQUAL(flashBinary[1], IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS + 4));
+}
+
+TEST(MemorySim, LoadFromFlashImageFile_ToInvalidRegion_ShouldThrow)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    createImageFile(flashBinary, sizeof(flashBinary));
+    __try_and_catch( MemorySim_LoadFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary)) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, LoadFromFlashImageFile_FailMap_ShouldThrow)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    createImageFile(flashBinary, sizeof(flashBinary));
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 8);
+    mmapFail(MAP_FAILED);
+    __try_and_catch( MemorySim_LoadFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary)) );
+    validateExceptionThrown(fileException);
+}
+
+TEST(MemorySim, LoadImage_ShouldSpanMultipleRegions)
+{
+    uint32_t image[3] = { 0x11111111, 0x22222222, 0x33333333 };
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 8);
+    MemorySim_CreateRegion(m_pMemory, 0x20000008, 8);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x20000008);
+        MemorySim_LoadImage(m_pMemory, 0x20000004, image, sizeof(image));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x20000000));
+    CHECK_EQUAL(image[0], IMemory_Read32(m_pMemory, 0x20000004));
+    CHECK_EQUAL(image[1], IMemory_Read32(m_pMemory, 0x20000008));
+    CHECK_EQUAL(image[2], IMemory_Read32(m_pMemory, 0x2000000C));
+}
+
+TEST(MemorySim, CreateRegionFromFile_AtOffsetWhichIsNotPageAligned)
+{
+    static const uint32_t offset = 0x1004;
+    uint32_t              fileImage[(offset + 8) / sizeof(uint32_t)];
+
+    memset(fileImage, 0, sizeof(fileImage));
+    fileImage[offset / sizeof(uint32_t)] = 0x12345678;
+    fileImage[offset / sizeof(uint32_t) + 1] = 0xBAADF00D;
+    createImageFile(fileImage, sizeof(fileImage));
+        MemorySim_CreateRegionFromFile(m_pMemory, 0x00001000, 8, m_pImageFile, offset);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x00001000));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x00001004));
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x00001008) );
+    validateExceptionThrown(busErrorException);
+    IMemory_Write32(m_pMemory, 0x00001000, 0xFFFFFFFF);
+    CHECK_EQUAL(0xFFFFFFFF, IMemory_Read32(m_pMemory, 0x00001000));
+    CHECK_EQUAL(0x12345678, readWordFromImageFile(offset));
+}
+
+TEST(MemorySim, CreateRegionFromFile_FailMap_ShouldThrow)
+{
+    uint32_t fileImage[2] = { 0x10000004, 0x00000200 };
+    createImageFile(fileImage, sizeof(fileImage));
+    mmapFail(MAP_FAILED);
+    __try_and_catch( MemorySim_CreateRegionFromFile(m_pMemory, 0x00001000, 4, m_pImageFile, 4) );
+    validateExceptionThrown(fileException);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x00001000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, CreateRegionsFromFlashImageFile_TwoWordsOfFLASH_OneWordOfRAM_CheckRanges)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    createImageFile(flashBinary, sizeof(flashBinary));
+    MemorySim_CreateRegionsFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary));
+
+    CHECK_EQUAL(flashBinary[0], IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS));
+    CHECK_EQUAL(flashBinary[1], IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS + 4));
+    __try_and_catch( IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS + 8) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_Write32(m_pMemory, FLASH_BASE_ADDRESS, 0x12345678) );
+    validateExceptionThrown(busErrorException);
+
+    IMemory_Write32(m_pMemory, 0x10000000, 0x12345678);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x10000000));
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x10000004) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, CreateRegionsFromFlashImageFile_LoadNewImageOverFlash_ShouldNotModifyFile)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    uint32_t newBinary[2] = { 0x10000004, 0xBAADF00D };
+    createImageFile(flashBinary, sizeof(flashBinary));
+    MemorySim_CreateRegionsFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary));
+        MemorySim_LoadFromFlashImage(m_pMemory, newBinary, sizeof(newBinary));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS + 4));
+    CHECK_EQUAL(flashBinary[1], readWordFromImageFile(4));
+}
+
+TEST(MemorySim, CreateRegionsFromFlashImageFile_ShouldThrowIfNotBigEnoughForInitialStackPointer)
+{
+    uint32_t flashBinary = 0x10000004;
+    createImageFile(&flashBinary, sizeof(flashBinary) - 1);
+    __try_and_catch( MemorySim_CreateRegionsFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary) - 1) );
+    validateExceptionThrown(bufferOverrunException);
+}
+
+TEST(MemorySim, CreateRegionsFromFlashImageFile_FailMap_ShouldThrow)
+{
+    uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
+    createImageFile(flashBinary, sizeof(flashBinary));
+    mmapFail(MAP_FAILED);
+    __try_and_catch( MemorySim_CreateRegionsFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary)) );
+    validateExceptionThrown(fileException);
+    __try_and_catch( IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, CreateRegionsFromFlashImageFile_ShouldThrowIfOutOfMemory)
+{
+    // Each region only allocates its MemoryRegion structure and page table so there are a total of 2 + 2 = 4
+    // allocations.
+    static const size_t allocationsToFail = 4;
+    uint32_t            flashBinary[2] = { 0x10000004, 0x00000200 };
+    size_t              i;
+
+    createImageFile(flashBinary, sizeof(flashBinary));
+    for (i = 1 ; i <= allocationsToFail ; i++)
+    {
+        MallocFailureInject_FailAllocation(i);
+        __try_and_catch( MemorySim_CreateRegionsFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary)) );
+        validateExceptionThrown(outOfMemoryException);
+    }
+    MallocFailureInject_FailAllocation(i);
+    MemorySim_CreateRegionsFromFlashImageFile(m_pMemory, m_pImageFile, sizeof(flashBinary));
+    CHECK_EQUAL(flashBinary[1], IMemory_Read32(m_pMemory, FLASH_BASE_ADDRESS + 4));
+}
+
 TEST(MemorySim, CreateRegionsBasedOnFlashImage_TwoWordsOfFLASH_OneWordOfRAM_CheckRanges)
 {
     uint32_t flashBinary[2] = { 0x10000004, 0x00000200 };
@@ -321,10 +677,11 @@ TEST(MemorySim, CreateRegionsFromFlashImage_ShouldThrowIfOutOfMemory)
 {
     // Each region has two allocations:
     // 1. The MemoryRegion structure which describes the region.
-    // 2. The array of bytes used to simulate the memory.
-    // The FLASH region has an additional allocation for the read count array.
-    // This API creates two regions (FLASH and RAM) so there are a total of 3 + 2 = 5 allocations.
-    static const size_t allocationsToFail = 5;
+    // 2. The page table covering the region.
+    // The memory itself is mmap()ed rather than allocated from the heap.
+    // This API creates two regions (FLASH and RAM) so there are a total of 2 + 2 = 4 allocations.
+    // FLASH read counting isn't enabled so there is no read count array allocation.
+    static const size_t allocationsToFail = 4;
     uint32_t            flashBinary[2] = { 0x10000004, 0x00000200 };
     size_t              i;
 
@@ -345,10 +702,11 @@ TEST(MemorySim, CreateRegionsFromFlashImage_MakeSureItHandlesOutOfMemoryWhenTher
 
     // Each region has two allocations:
     // 1. The MemoryRegion structure which describes the region.
-    // 2. The array of bytes used to simulate the memory.
-    // The FLASH region has an additional allocation for the read count array.
-    // This API creates two regions (FLASH and RAM) so there are a total of 3 + 2 = 5 allocations.
-    static const size_t allocationsToFail = 5;
+    // 2. The page table covering the region.
+    // The memory itself is mmap()ed rather than allocated from the heap.
+    // This API creates two regions (FLASH and RAM) so there are a total of 2 + 2 = 4 allocations.
+    // FLASH read counting isn't enabled so there is no read count array allocation.
+    static const size_t allocationsToFail = 4;
     uint32_t            flashBinary[2] = { 0x10000004, 0x00000200 };
     size_t              i;
 
@@ -409,13 +767,13 @@ TEST(MemorySim, SetAndClear2ByteHardwareBreakpoint_IssueReadsWhichHitAndMissBrea
     MemorySim_CreateRegion(m_pMemory, testBase, 3 * sizeof(uint16_t));
 
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
 
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetWordSizedHardwareBreakpoint_HitOnHalfWordAccessWithinRange)
@@ -424,9 +782,9 @@ TEST(MemorySim, SetWordSizedHardwareBreakpoint_HitOnHalfWordAccessWithinRange)
     MemorySim_CreateRegion(m_pMemory, testBase, 3 * sizeof(uint32_t));
 
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint32_t), sizeof(uint32_t));
-    __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint32_t)) );
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint32_t)) );
     validateExceptionThrown(hardwareBreakpointException);
-    __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint32_t) + sizeof(uint16_t)) );
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint32_t) + sizeof(uint16_t)) );
     validateExceptionThrown(hardwareBreakpointException);
 }
 
@@ -459,12 +817,12 @@ TEST(MemorySim, SetAndVerifyTwoHardwareBreakpoints_SetInAscendingAddressOrder)
 
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetAndVerifyTwoHardwareBreakpoints_SetInDescendingAddressOrder)
@@ -474,12 +832,12 @@ TEST(MemorySim, SetAndVerifyTwoHardwareBreakpoints_SetInDescendingAddressOrder)
 
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetAndClearTwoHardwareBreakpoints_ClearInSameOrderAsSet)
@@ -489,23 +847,23 @@ TEST(MemorySim, SetAndClearTwoHardwareBreakpoints_ClearInSameOrderAsSet)
 
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
 
     // Clear first breakpoint.
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
-    __try_and_catch( IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
     validateExceptionThrown(hardwareBreakpointException);
 
     // Clear second breakpoint.
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetAndClearTwoHardwareBreakpoints_ClearInOppositeOrderAsSet)
@@ -515,23 +873,23 @@ TEST(MemorySim, SetAndClearTwoHardwareBreakpoints_ClearInOppositeOrderAsSet)
 
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 3 * sizeof(uint16_t)));
 
     // Clear second breakpoint.
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
-    __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
     validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
 
     // Clear first breakpoint.
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetAndVerifyThreeHardwareBreakpoints)
@@ -542,14 +900,14 @@ TEST(MemorySim, SetAndVerifyThreeHardwareBreakpoints)
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 2 * sizeof(uint16_t), sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 3 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 2 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-        __try_and_catch( IMemory_Read16(m_pMemory, testBase + 3 * sizeof(uint16_t)) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 3 * sizeof(uint16_t)) );
         validateExceptionThrown(hardwareBreakpointException);
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 4 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 4 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetSameBreakpointTwice_SecondShouldBeIgnored)
@@ -560,12 +918,35 @@ TEST(MemorySim, SetSameBreakpointTwice_SecondShouldBeIgnored)
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase, sizeof(uint16_t));
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase, sizeof(uint16_t));
 
-    __try_and_catch( IMemory_Read16(m_pMemory, testBase) );
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase) );
     validateExceptionThrown(hardwareBreakpointException);
 
     // Clear breakpoint once and it should now be completely cleared.
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase, sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase));
+}
+
+TEST(MemorySim, IsHardwareBreakpointSet_ShouldOnlyReturnTrueWhileSet)
+{
+    uint32_t testBase = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testBase, 4 * sizeof(uint16_t));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 2));
+
+    MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 2, sizeof(uint32_t));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 0));
+    CHECK_TRUE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 2));
+    CHECK_TRUE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 4));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 6));
+
+    MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 2, sizeof(uint32_t));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 2));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pMemory, testBase + 4));
+}
+
+TEST(MemorySim, IsHardwareBreakpointSetAtInvalidAddress_ShouldThrow)
+{
+    __try_and_catch( MemorySim_IsHardwareBreakpointSet(m_pMemory, 0x00000000) );
+    validateExceptionThrown(busErrorException);
 }
 
 TEST(MemorySim, TryClearingBreakpointWhichNoExist_ShouldBeIgnored)
@@ -575,7 +956,7 @@ TEST(MemorySim, TryClearingBreakpointWhichNoExist_ShouldBeIgnored)
     MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
 
     MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase + 0 * sizeof(uint16_t), sizeof(uint16_t));
-    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + 0 * sizeof(uint16_t)));
 }
 
 TEST(MemorySim, SetZeroLengthBreakpointInZeroLengthRegion_NoThrow)
@@ -599,11 +980,11 @@ TEST(MemorySim, SetAndVerifySeveralBreakpoints)
         MemorySim_SetHardwareBreakpoint(m_pMemory, address, sizeof(uint16_t));
 
     for (address = startAddress + sizeof(uint16_t) ; address < endAddress ; address += 2 * sizeof(uint16_t))
-        CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, address));
+        CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, address));
 
     for (address = startAddress ; address < endAddress ; address += 2 * sizeof(uint16_t))
     {
-        __try_and_catch( IMemory_Read16(m_pMemory, address) );
+        __try_and_catch( IMemory_Fetch16(m_pMemory, address) );
         validateExceptionThrown(hardwareBreakpointException);
     }
 }
@@ -624,7 +1005,8 @@ TEST(MemorySim, AttemptToClearWatchpointAtInvalidAddress_ShouldThrow)
 
 TEST(MemorySim, SetWatchpointShouldThrowIfOutOfMemory)
 {
-    static const size_t allocationsToFail = 1;
+    // The first watchpoint in a region allocates its watchpoint array and the flags for the pages it overlaps.
+    static const size_t allocationsToFail = 2;
     uint32_t            testBase = 0x00000000;
     size_t              i;
 
@@ -965,6 +1347,7 @@ TEST(MemorySim, GetReadCount_AddressOfHalfWordOverflowingOutOfRegion_ShouldThrow
 TEST(MemorySim, GetReadCount_CheckFlashRegionWithNoReads_ShouldReadCountOfZero)
 {
     static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
     MemorySim_CreateRegion(m_pMemory, testAddress, 2);
     MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
         uint32_t readCount = MemorySim_GetFlashReadCount(m_pMemory, testAddress);
@@ -974,9 +1357,10 @@ TEST(MemorySim, GetReadCount_CheckFlashRegionWithNoReads_ShouldReadCountOfZero)
 TEST(MemorySim, GetReadCount_CheckFlashRegionWithOneReads_ShouldReadCountOfOne)
 {
     static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
     MemorySim_CreateRegion(m_pMemory, testAddress, 2);
     MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
-    IMemory_Read16(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress);
         uint32_t readCount = MemorySim_GetFlashReadCount(m_pMemory, testAddress);
     CHECK_EQUAL(1, readCount);
 }
@@ -984,10 +1368,11 @@ TEST(MemorySim, GetReadCount_CheckFlashRegionWithOneReads_ShouldReadCountOfOne)
 TEST(MemorySim, GetReadCount_CheckFlashRegionWithTwoReads_ShouldReadCountOfTwo)
 {
     static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
     MemorySim_CreateRegion(m_pMemory, testAddress, 2);
     MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
-    IMemory_Read16(m_pMemory, testAddress);
-    IMemory_Read16(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress);
         uint32_t readCount = MemorySim_GetFlashReadCount(m_pMemory, testAddress);
     CHECK_EQUAL(2, readCount);
 }
@@ -995,10 +1380,934 @@ TEST(MemorySim, GetReadCount_CheckFlashRegionWithTwoReads_ShouldReadCountOfTwo)
 TEST(MemorySim, GetReadCount_CheckFlashRegionWithMultipleHalfWordOnlyReadFromOne_ShouldReadCountsOfZeroAnd1)
 {
     static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
     MemorySim_CreateRegion(m_pMemory, testAddress, 6);
     MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
-    IMemory_Read16(m_pMemory, testAddress + 2);
+    IMemory_Fetch16(m_pMemory, testAddress + 2);
     CHECK_EQUAL(0, MemorySim_GetFlashReadCount(m_pMemory, testAddress));
     CHECK_EQUAL(1, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 2));
     CHECK_EQUAL(0, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 4));
 }
+
+TEST(MemorySim, GetReadCount_CountingNotEnabled_ShouldAlwaysReturnZero)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 2);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress);
+        uint32_t readCount = MemorySim_GetFlashReadCount(m_pMemory, testAddress);
+    CHECK_EQUAL(0, readCount);
+}
+
+TEST(MemorySim, GetReadCount_DataReadsOfFlash_ShouldNotBeCounted)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
+    MemorySim_CreateRegion(m_pMemory, testAddress, 4);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_Read16(m_pMemory, testAddress);
+    IMemory_Read32(m_pMemory, testAddress);
+    CHECK_EQUAL(0, MemorySim_GetFlashReadCount(m_pMemory, testAddress));
+    CHECK_EQUAL(0, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 2));
+}
+
+TEST(MemorySim, GetReadCount_HitsOnlyModeWithTwoReads_ShouldReadCountOfOne)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_HITS);
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x100);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress + 0x42);
+    IMemory_Fetch16(m_pMemory, testAddress + 0x42);
+    CHECK_EQUAL(0, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 0x40));
+    CHECK_EQUAL(1, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 0x42));
+    CHECK_EQUAL(0, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 0x44));
+}
+
+TEST(MemorySim, GetReadCount_EnableCountingAfterRegionIsReadOnly_ShouldStartCounting)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 2);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress);
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
+    IMemory_Fetch16(m_pMemory, testAddress);
+    CHECK_EQUAL(1, MemorySim_GetFlashReadCount(m_pMemory, testAddress));
+}
+
+TEST(MemorySim, EnableFlashReadCounting_ShouldThrowIfOutOfMemory)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 2);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    MallocFailureInject_FailAllocation(1);
+        __try_and_catch( MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL) );
+    validateExceptionThrown(outOfMemoryException);
+}
+
+TEST(MemorySim, HasFetchSideEffects_ReadWriteRegionOnly_ShouldReturnFalse)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 4);
+    CHECK_FALSE(MemorySim_HasFetchSideEffects(m_pMemory));
+}
+
+TEST(MemorySim, HasFetchSideEffects_ReadOnlyRegionCountsReads_ShouldReturnTrue)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
+    MemorySim_CreateRegion(m_pMemory, testAddress, 4);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    CHECK_TRUE(MemorySim_HasFetchSideEffects(m_pMemory));
+}
+
+TEST(MemorySim, HasFetchSideEffects_ReadOnlyRegionWithoutCounting_ShouldReturnFalse)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 4);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    CHECK_FALSE(MemorySim_HasFetchSideEffects(m_pMemory));
+}
+
+TEST(MemorySim, HasFetchSideEffects_SetAndClearBreakpoint_ShouldOnlyReturnTrueWhileSet)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 4);
+    MemorySim_SetHardwareBreakpoint(m_pMemory, testAddress, sizeof(uint16_t));
+    CHECK_TRUE(MemorySim_HasFetchSideEffects(m_pMemory));
+    MemorySim_ClearHardwareBreakpoint(m_pMemory, testAddress, sizeof(uint16_t));
+    CHECK_FALSE(MemorySim_HasFetchSideEffects(m_pMemory));
+}
+
+TEST(MemorySim, GetFetchWindow_ReadWriteRegion_ShouldPointDirectlyAtRegionDataForRestOfPage)
+{
+    static const uint32_t testAddress = 0x10000000;
+    IMemoryFetchWindow    window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x2000);
+    IMemory_Write16(m_pMemory, testAddress + 0x1002, 0xBAAD);
+    IMemory_GetFetchWindow(m_pMemory, testAddress + 0x1002, &window);
+    CHECK_EQUAL(testAddress + 0x1000, window.start);
+    CHECK_EQUAL(0x1000, window.size);
+    CHECK(window.pHost != NULL);
+    CHECK_EQUAL(0xBAAD, *(const uint16_t*)(window.pHost + 2));
+}
+
+TEST(MemorySim, GetFetchWindow_RegionSmallerThanPage_ShouldBeClippedToRegion)
+{
+    static const uint32_t testAddress = 0x10000100;
+    IMemoryFetchWindow    window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x20);
+    IMemory_GetFetchWindow(m_pMemory, testAddress + 4, &window);
+    CHECK_EQUAL(testAddress, window.start);
+    CHECK_EQUAL(0x20, window.size);
+    CHECK(window.pHost != NULL);
+}
+
+TEST(MemorySim, GetFetchWindow_UnmappedAddress_ShouldBeEmpty)
+{
+    IMemoryFetchWindow window;
+    IMemory_GetFetchWindow(m_pMemory, 0x10000000, &window);
+    CHECK_EQUAL(0, window.size);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetFetchWindow_ReadOnlyRegionCountsReads_ShouldHaveNoHostPointer)
+{
+    static const uint32_t testAddress = 0x00000000;
+    IMemoryFetchWindow    window;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x100);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_GetFetchWindow(m_pMemory, testAddress, &window);
+    CHECK_EQUAL(0x100, window.size);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetFetchWindow_SetAndClearBreakpoint_ShouldOnlyHaveNoHostPointerWhileSet)
+{
+    static const uint32_t testAddress = 0x00000000;
+    IMemoryFetchWindow    window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x100);
+    MemorySim_SetHardwareBreakpoint(m_pMemory, testAddress + 0x10, sizeof(uint16_t));
+    IMemory_GetFetchWindow(m_pMemory, testAddress, &window);
+    POINTERS_EQUAL(NULL, window.pHost);
+    MemorySim_ClearHardwareBreakpoint(m_pMemory, testAddress + 0x10, sizeof(uint16_t));
+    IMemory_GetFetchWindow(m_pMemory, testAddress, &window);
+    CHECK(window.pHost != NULL);
+}
+
+TEST(MemorySim, GetFetchWindow_BreakpointInOtherPageOfRegion_ShouldStillHaveHostPointer)
+{
+    static const uint32_t testAddress = 0x00000000;
+    IMemoryFetchWindow    window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x2000);
+    MemorySim_SetHardwareBreakpoint(m_pMemory, testAddress + 0x1010, sizeof(uint16_t));
+    IMemory_GetFetchWindow(m_pMemory, testAddress, &window);
+    CHECK(window.pHost != NULL);
+    IMemory_GetFetchWindow(m_pMemory, testAddress + 0x1000, &window);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetDataWindow_ReadWriteRegion_ShouldPointDirectlyAtRegionDataForRestOfPage)
+{
+    static const uint32_t testAddress = 0x10000000;
+    IMemoryDataWindow     window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x2000);
+    IMemory_GetDataWindow(m_pMemory, testAddress + 0x1004, 1, &window);
+    CHECK_EQUAL(testAddress + 0x1000, window.start);
+    CHECK_EQUAL(0x1000, window.size);
+    CHECK(window.pHost != NULL);
+    *(uint32_t*)(window.pHost + 4) = 0xBAADF00D;
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, testAddress + 0x1004));
+}
+
+TEST(MemorySim, GetDataWindow_RegionNotWordAligned_ShouldBeClippedToWholeWordsInRegion)
+{
+    static const uint32_t testAddress = 0x10000102;
+    IMemoryDataWindow     window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x20);
+    IMemory_GetDataWindow(m_pMemory, testAddress + 6, 0, &window);
+    CHECK_EQUAL(testAddress + 2, window.start);
+    CHECK_EQUAL(0x1C, window.size);
+    CHECK(window.pHost != NULL);
+}
+
+TEST(MemorySim, GetDataWindow_ReadOnlyRegion_ShouldOnlyHaveHostPointerForReading)
+{
+    static const uint32_t testAddress = 0x00000000;
+    IMemoryDataWindow     window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x100);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_GetDataWindow(m_pMemory, testAddress, 0, &window);
+    CHECK(window.pHost != NULL);
+    IMemory_GetDataWindow(m_pMemory, testAddress, 1, &window);
+    CHECK_EQUAL(0x100, window.size);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetDataWindow_MmioRegion_ShouldHaveNoHostPointer)
+{
+    FakePeripheral    peripheral = { 0, 0, 0, 0 };
+    IMemoryDataWindow window;
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    IMemory_GetDataWindow(m_pMemory, 0x40000010, 0, &window);
+    CHECK_EQUAL(0x100, window.size);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetDataWindow_UnmappedAddress_ShouldBeEmpty)
+{
+    IMemoryDataWindow window;
+    IMemory_GetDataWindow(m_pMemory, 0x10000000, 0, &window);
+    CHECK_EQUAL(0, window.size);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetDataWindow_WatchpointInPage_ShouldOnlyHaveNoHostPointerForThatPage)
+{
+    static const uint32_t testAddress = 0x00000000;
+    IMemoryDataWindow     window;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x2000);
+    MemorySim_SetHardwareWatchpoint(m_pMemory, testAddress + 0x1010, sizeof(uint32_t), WATCHPOINT_WRITE);
+    IMemory_GetDataWindow(m_pMemory, testAddress, 0, &window);
+    CHECK(window.pHost != NULL);
+    IMemory_GetDataWindow(m_pMemory, testAddress + 0x1000, 0, &window);
+    POINTERS_EQUAL(NULL, window.pHost);
+    IMemory_GetDataWindow(m_pMemory, testAddress + 0x1000, 1, &window);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, GetDataWindow_ForWritingAfterCheckpoint_ShouldMarkPageDirty)
+{
+    uint32_t          pages[4];
+    IMemoryDataWindow window;
+    createRegionsForState(m_pMemory);
+    MemorySim_Checkpoint(m_pMemory);
+    IMemory_GetDataWindow(m_pMemory, 0x20001000, 0, &window);
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_pMemory, pages, 4));
+    IMemory_GetDataWindow(m_pMemory, 0x20001000, 1, &window);
+    CHECK_EQUAL(1, MemorySim_GetDirtyPages(m_pMemory, pages, 4));
+    CHECK_EQUAL(0x20001000, pages[0]);
+}
+
+TEST(MemorySim, WatchpointSpanningPageBoundary_ShouldHitOnBothPages)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testAddress, 0x2000);
+    MemorySim_SetHardwareWatchpoint(m_pMemory, testAddress + 0xFFC, 8, WATCHPOINT_READ);
+    IMemory_Read32(m_pMemory, testAddress + 0xFFC);
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    IMemory_Read32(m_pMemory, testAddress + 0x1000);
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    IMemory_Read32(m_pMemory, testAddress + 0x1004);
+    CHECK_FALSE(MemorySim_WasWatchpointEncountered(m_pMemory));
+}
+
+TEST(MemorySim, HardwareBreakpoint_NoHitOnDataReads)
+{
+    uint32_t testBase = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testBase, 3 * sizeof(uint16_t));
+
+    MemorySim_SetHardwareBreakpoint(m_pMemory, testBase + 1 * sizeof(uint16_t), sizeof(uint16_t));
+    CHECK_EQUAL(0x0000, IMemory_Read16(m_pMemory, testBase + 1 * sizeof(uint16_t)));
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase + 1 * sizeof(uint16_t)) );
+    validateExceptionThrown(hardwareBreakpointException);
+}
+
+TEST(MemorySim, SetThreeByteHardwareBreakpoint_ShouldOnlyHitOnFirstHalfWord)
+{
+    uint32_t testBase = 0x00000000;
+    MemorySim_CreateRegion(m_pMemory, testBase, 3 * sizeof(uint16_t));
+
+    MemorySim_SetHardwareBreakpoint(m_pMemory, testBase, 3);
+    __try_and_catch( IMemory_Fetch16(m_pMemory, testBase) );
+    validateExceptionThrown(hardwareBreakpointException);
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase + sizeof(uint16_t)));
+    MemorySim_ClearHardwareBreakpoint(m_pMemory, testBase, 3);
+    CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testBase));
+}
+
+TEST(MemorySim, Fetch16FromReadOnlyRegion_ShouldCountRead)
+{
+    static const uint32_t testAddress = 0x00000000;
+    MemorySim_EnableFlashReadCounting(m_pMemory, FLASH_READ_COUNT_FULL);
+    MemorySim_CreateRegion(m_pMemory, testAddress, 4);
+    MemorySim_MakeRegionReadOnly(m_pMemory, testAddress);
+    IMemory_Fetch16(m_pMemory, testAddress + 2);
+    CHECK_EQUAL(1, MemorySim_GetFlashReadCount(m_pMemory, testAddress + 2));
+}
+
+TEST(MemorySim, SetAndClearBreakpointsInManyPages_ShouldOnlyHitWhileSet)
+{
+    static const uint32_t testAddress = 0x00000000;
+    static const uint32_t breakpointCount = 512;
+    uint32_t              i;
+
+    MemorySim_CreateRegion(m_pMemory, testAddress, breakpointCount * 0x100);
+    for (i = 0 ; i < breakpointCount ; i++)
+        MemorySim_SetHardwareBreakpoint(m_pMemory, testAddress + i * 0x100, sizeof(uint16_t));
+    for (i = 0 ; i < breakpointCount ; i++)
+    {
+        __try_and_catch( IMemory_Fetch16(m_pMemory, testAddress + i * 0x100) );
+        validateExceptionThrown(hardwareBreakpointException);
+        CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testAddress + i * 0x100 + sizeof(uint16_t)));
+    }
+    for (i = 0 ; i < breakpointCount ; i++)
+        MemorySim_ClearHardwareBreakpoint(m_pMemory, testAddress + i * 0x100, sizeof(uint16_t));
+    CHECK_FALSE(MemorySim_HasFetchSideEffects(m_pMemory));
+    for (i = 0 ; i < breakpointCount ; i++)
+        CHECK_EQUAL(0x0000, IMemory_Fetch16(m_pMemory, testAddress + i * 0x100));
+}
+
+TEST(MemorySim, MmioRegion_ReadsOfEachSize_ShouldCallReadCallbackWithOffsetAndSize)
+{
+    FakePeripheral peripheral = { 0, 0, 0, 0x12345678 };
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x40000010));
+    CHECK_EQUAL(0x10, peripheral.offset);
+    CHECK_EQUAL(4, peripheral.size);
+    peripheral.readValue = 0x5678;
+    CHECK_EQUAL(0x5678, IMemory_Read16(m_pMemory, 0x40000022));
+    CHECK_EQUAL(0x22, peripheral.offset);
+    CHECK_EQUAL(2, peripheral.size);
+    peripheral.readValue = 0x78;
+    CHECK_EQUAL(0x78, IMemory_Read8(m_pMemory, 0x400000FF));
+    CHECK_EQUAL(0xFF, peripheral.offset);
+    CHECK_EQUAL(1, peripheral.size);
+}
+
+TEST(MemorySim, MmioRegion_WritesOfEachSize_ShouldCallWriteCallbackWithOffsetSizeAndValue)
+{
+    FakePeripheral peripheral = { 0, 0, 0, 0 };
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    IMemory_Write32(m_pMemory, 0x40000010, 0x12345678);
+    CHECK_EQUAL(0x10, peripheral.offset);
+    CHECK_EQUAL(4, peripheral.size);
+    CHECK_EQUAL(0x12345678, peripheral.writeValue);
+    IMemory_Write16(m_pMemory, 0x40000022, 0xBAAD);
+    CHECK_EQUAL(0x22, peripheral.offset);
+    CHECK_EQUAL(2, peripheral.size);
+    CHECK_EQUAL(0xBAAD, peripheral.writeValue);
+    IMemory_Write8(m_pMemory, 0x40000003, 0xFE);
+    CHECK_EQUAL(0x03, peripheral.offset);
+    CHECK_EQUAL(1, peripheral.size);
+    CHECK_EQUAL(0xFE, peripheral.writeValue);
+}
+
+TEST(MemorySim, MmioRegion_WithoutCallbacks_ShouldThrowOnReadsAndWrites)
+{
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, NULL, NULL, NULL);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x40000000) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_Write8(m_pMemory, 0x40000000, 0) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, MmioRegion_AccessPastEnd_ShouldThrow)
+{
+    FakePeripheral peripheral = { 0, 0, 0, 0 };
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x400000FE) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, MmioRegion_ShouldThrowIfOutOfMemory)
+{
+    FakePeripheral peripheral = { 0, 0, 0, 0 };
+    MallocFailureInject_FailAllocation(1);
+    __try_and_catch( MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite,
+                                                &peripheral) );
+    validateExceptionThrown(outOfMemoryException);
+    MallocFailureInject_FailAllocation(2);
+    __try_and_catch( MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite,
+                                                &peripheral) );
+    validateExceptionThrown(outOfMemoryException);
+    MallocFailureInject_Restore();
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x40000000) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, MmioRegion_SharingPageWithRamRegion_ShouldDispatchEachAccessToTheRightRegion)
+{
+    FakePeripheral peripheral = { 0, 0, 0, 0xBAADF00D };
+    MemorySim_CreateRegion(m_pMemory, 0x40000000, 0x10);
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000010, 0x10, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    IMemory_Write32(m_pMemory, 0x4000000C, 0x12345678);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x4000000C));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x40000010));
+    CHECK_EQUAL(0x0, peripheral.offset);
+}
+
+TEST(MemorySim, MmioRegion_Fetch_ShouldThrow)
+{
+    FakePeripheral     peripheral = { 0, 0, 0, 0xBF00 };
+    IMemoryFetchWindow window;
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    __try_and_catch( IMemory_Fetch16(m_pMemory, 0x40000000) );
+    validateExceptionThrown(busErrorException);
+    IMemory_GetFetchWindow(m_pMemory, 0x40000000, &window);
+    POINTERS_EQUAL(NULL, window.pHost);
+}
+
+TEST(MemorySim, MmioRegion_MapToHostAddressOrLoadImage_ShouldThrow)
+{
+    uint32_t       image = 0xFFFFFFFF;
+    FakePeripheral peripheral = { 0, 0, 0, 0 };
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    __try_and_catch( MemorySim_MapSimulatedAddressToHostAddressForRead(m_pMemory, 0x40000000, 4) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( MemorySim_MapSimulatedAddressToHostAddressForWrite(m_pMemory, 0x40000000, 4) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( MemorySim_LoadImage(m_pMemory, 0x40000000, &image, sizeof(image)) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, MmioRegion_Watchpoint_ShouldHitOnAccess)
+{
+    FakePeripheral peripheral = { 0, 0, 0, 0 };
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    MemorySim_SetHardwareWatchpoint(m_pMemory, 0x40000004, 4, WATCHPOINT_WRITE);
+    IMemory_Write32(m_pMemory, 0x40000000, 1);
+    CHECK_FALSE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    IMemory_Write32(m_pMemory, 0x40000004, 1);
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    CHECK_EQUAL(1, peripheral.writeValue);
+}
+
+TEST(MemorySim, MmioRegion_ShouldNotCountTowardsRAMUsage)
+{
+    uint64_t totalBytes;
+    uint64_t touchedBytes;
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, NULL, NULL, NULL);
+    MemorySim_GetRAMUsage(m_pMemory, &totalBytes, &touchedBytes);
+    CHECK_EQUAL(0, totalBytes);
+    CHECK_EQUAL(0, touchedBytes);
+}
+
+TEST(MemorySim, RegisterFile_WritesShouldReadBack)
+{
+    MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 4, NULL);
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x4000000C));
+    IMemory_Write32(m_pMemory, 0x40000004, 0x12345678);
+    IMemory_Write32(m_pMemory, 0x4000000C, 0xBAADF00D);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x40000004));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x4000000C));
+    CHECK_EQUAL(0x12345678, MemorySim_GetRegisterFileValue(m_pMemory, 0x40000004));
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x40000010) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, RegisterFile_ByteAndHalfWordAccesses_ShouldOnlyTouchThoseBytes)
+{
+    MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 1, NULL);
+    IMemory_Write32(m_pMemory, 0x40000000, 0x12345678);
+    IMemory_Write8(m_pMemory, 0x40000001, 0xAB);
+    IMemory_Write16(m_pMemory, 0x40000002, 0xCDEF);
+    CHECK_EQUAL(0xCDEFAB78, IMemory_Read32(m_pMemory, 0x40000000));
+    CHECK_EQUAL(0xAB, IMemory_Read8(m_pMemory, 0x40000001));
+    CHECK_EQUAL(0xCDEF, IMemory_Read16(m_pMemory, 0x40000002));
+}
+
+TEST(MemorySim, RegisterFile_AccessStraddlingTwoRegisters_ShouldThrow)
+{
+    MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 2, NULL);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x40000002) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_Write16(m_pMemory, 0x40000003, 0) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, RegisterFile_WriteMask_ShouldProtectStatusBitsWhichHostCanSet)
+{
+    static const uint32_t writeMasks[2] = { 0x000000FF, 0xFFFFFFFF };
+    MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 2, writeMasks);
+    MemorySim_SetRegisterFileValue(m_pMemory, 0x40000000, 0x80000000);
+    IMemory_Write32(m_pMemory, 0x40000000, 0x0000FF12);
+    CHECK_EQUAL(0x80000012, IMemory_Read32(m_pMemory, 0x40000000));
+    IMemory_Write32(m_pMemory, 0x40000004, 0xFFFFFFFF);
+    CHECK_EQUAL(0xFFFFFFFF, IMemory_Read32(m_pMemory, 0x40000004));
+}
+
+TEST(MemorySim, RegisterFile_GetOrSetValueOfNonRegister_ShouldThrow)
+{
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x100);
+    MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 2, NULL);
+    __try_and_catch( MemorySim_GetRegisterFileValue(m_pMemory, 0x20000000) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( MemorySim_SetRegisterFileValue(m_pMemory, 0x40000002, 0) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( MemorySim_SetRegisterFileValue(m_pMemory, 0x40000008, 0) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, RegisterFile_ZeroRegisters_ShouldThrow)
+{
+    __try_and_catch( MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 0, NULL) );
+    validateExceptionThrown(invalidArgumentException);
+}
+
+TEST(MemorySim, RegisterFile_ShouldThrowIfOutOfMemory)
+{
+    // The register values/masks, the MemoryRegion structure and its page table.
+    static const size_t allocationsToFail = 3;
+    size_t              i;
+
+    for (i = 1 ; i <= allocationsToFail ; i++)
+    {
+        MallocFailureInject_FailAllocation(i);
+        __try_and_catch( MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 2, NULL) );
+        validateExceptionThrown(outOfMemoryException);
+    }
+    MallocFailureInject_FailAllocation(i);
+    MemorySim_CreateRegisterFileRegion(m_pMemory, 0x40000000, 2, NULL);
+    IMemory_Write32(m_pMemory, 0x40000004, 0x12345678);
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x40000004));
+}
+
+TEST(MemorySim, WriteBlockThenReadBlock_ShouldRoundTripAcrossPages)
+{
+    uint8_t writeBuffer[0x1800];
+    uint8_t readBuffer[sizeof(writeBuffer)];
+    for (size_t i = 0 ; i < sizeof(writeBuffer) ; i++)
+        writeBuffer[i] = (uint8_t)i;
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x2000);
+    IMemory_WriteBlock(m_pMemory, 0x20000401, writeBuffer, sizeof(writeBuffer));
+    IMemory_ReadBlock(m_pMemory, 0x20000401, readBuffer, sizeof(readBuffer));
+    CHECK_EQUAL(0, memcmp(writeBuffer, readBuffer, sizeof(writeBuffer)));
+    CHECK_EQUAL(0x00, IMemory_Read8(m_pMemory, 0x20000400));
+    CHECK_EQUAL(0xFF, IMemory_Read8(m_pMemory, 0x20000401 + 0xFFF));
+}
+
+TEST(MemorySim, WriteWordsThenReadWords_ShouldMatchWordAccesses)
+{
+    static const uint32_t writeWords[] = { 0x11111111, 0x22222222, 0x33333333 };
+    uint32_t              readWords[3];
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x100);
+    IMemory_WriteWords(m_pMemory, 0x20000010, writeWords, 3);
+    CHECK_EQUAL(0x22222222, IMemory_Read32(m_pMemory, 0x20000014));
+    IMemory_Write32(m_pMemory, 0x20000018, 0x44444444);
+    IMemory_ReadWords(m_pMemory, 0x20000010, readWords, 3);
+    CHECK_EQUAL(0x11111111, readWords[0]);
+    CHECK_EQUAL(0x22222222, readWords[1]);
+    CHECK_EQUAL(0x44444444, readWords[2]);
+}
+
+TEST(MemorySim, ZeroSizedBlockAccessesToUnmappedMemory_ShouldBeIgnored)
+{
+    uint32_t buffer = 0;
+    IMemory_ReadBlock(m_pMemory, 0x20000000, &buffer, 0);
+    IMemory_WriteBlock(m_pMemory, 0x20000000, &buffer, 0);
+    IMemory_ReadWords(m_pMemory, 0x20000000, &buffer, 0);
+    IMemory_WriteWords(m_pMemory, 0x20000000, &buffer, 0);
+}
+
+TEST(MemorySim, ReadBlockAndReadWords_OverWatchpoint_ShouldStillHitWatchpoint)
+{
+    uint32_t words[4];
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x2000);
+    IMemory_Write32(m_pMemory, 0x20001008, 0x12345678);
+    MemorySim_SetHardwareWatchpoint(m_pMemory, 0x20001008, sizeof(uint32_t), WATCHPOINT_READ);
+
+    IMemory_ReadBlock(m_pMemory, 0x20000000, words, sizeof(words));
+    CHECK_FALSE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    IMemory_ReadBlock(m_pMemory, 0x20000FFC, words, sizeof(words));
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    CHECK_EQUAL(0x12345678, words[3]);
+
+    IMemory_ReadWords(m_pMemory, 0x20001000, words, 4);
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    CHECK_EQUAL(0x12345678, words[2]);
+}
+
+TEST(MemorySim, WriteBlockAndWriteWords_OverWatchpoint_ShouldStillHitWatchpoint)
+{
+    static const uint32_t words[] = { 1, 2, 3, 4 };
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x100);
+    MemorySim_SetHardwareWatchpoint(m_pMemory, 0x2000000C, sizeof(uint32_t), WATCHPOINT_WRITE);
+
+    IMemory_WriteBlock(m_pMemory, 0x20000000, words, sizeof(words));
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    IMemory_WriteWords(m_pMemory, 0x20000000, words, 4);
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    CHECK_EQUAL(4, IMemory_Read32(m_pMemory, 0x2000000C));
+}
+
+TEST(MemorySim, ReadBlockAndReadWords_StraddlingEndOfRegion_ShouldThrow)
+{
+    uint32_t words[2];
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x100);
+    __try_and_catch( IMemory_ReadBlock(m_pMemory, 0x200000FC, words, sizeof(words)) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_ReadWords(m_pMemory, 0x200000FC, words, 2) );
+    validateExceptionThrown(busErrorException);
+}
+
+TEST(MemorySim, WriteBlockAndWriteWords_ToReadOnlyRegion_ShouldThrow)
+{
+    static const uint32_t words[] = { 1, 2 };
+    MemorySim_CreateRegion(m_pMemory, 0x00000000, 0x100);
+    MemorySim_MakeRegionReadOnly(m_pMemory, 0x00000000);
+    __try_and_catch( IMemory_WriteBlock(m_pMemory, 0x00000000, words, sizeof(words)) );
+    validateExceptionThrown(busErrorException);
+    __try_and_catch( IMemory_WriteWords(m_pMemory, 0x00000000, words, 2) );
+    validateExceptionThrown(busErrorException);
+    CHECK_EQUAL(0, IMemory_Read32(m_pMemory, 0x00000000));
+}
+
+TEST(MemorySim, ReadWordsAndWriteWords_ToMmioRegion_ShouldIssueWordAccesses)
+{
+    static const uint32_t writeWords[] = { 0x11111111, 0x22222222 };
+    uint32_t              readWords[2];
+    FakePeripheral        peripheral = { 0, 0, 0, 0xBAADF00D };
+    MemorySim_CreateMmioRegion(m_pMemory, 0x40000000, 0x100, fakePeripheralRead, fakePeripheralWrite, &peripheral);
+    IMemory_WriteWords(m_pMemory, 0x40000010, writeWords, 2);
+    CHECK_EQUAL(0x14, peripheral.offset);
+    CHECK_EQUAL(4, peripheral.size);
+    CHECK_EQUAL(0x22222222, peripheral.writeValue);
+    IMemory_ReadWords(m_pMemory, 0x40000020, readWords, 2);
+    CHECK_EQUAL(0x24, peripheral.offset);
+    CHECK_EQUAL(4, peripheral.size);
+    CHECK_EQUAL(0xBAADF00D, readWords[0]);
+    CHECK_EQUAL(0xBAADF00D, readWords[1]);
+}
+
+TEST(MemorySim, Init_ShouldThrowIfOutOfMemory)
+{
+    IMemory* pMemory = NULL;
+    MallocFailureInject_FailAllocation(1);
+    __try_and_catch( pMemory = MemorySim_Init() );
+    validateExceptionThrown(outOfMemoryException);
+    POINTERS_EQUAL(NULL, pMemory);
+}
+
+TEST(MemorySim, SecondInstance_ShouldBeIndependentOfFirst)
+{
+    IMemory* pOther = MemorySim_Init();
+    CHECK(pOther != m_pMemory);
+    MemorySim_CreateRegion(m_pMemory, 0x20000000, 0x100);
+    MemorySim_CreateRegion(pOther, 0x20000000, 0x100);
+    MemorySim_SetHardwareWatchpoint(pOther, 0x20000000, sizeof(uint32_t), WATCHPOINT_WRITE);
+    IMemory_Write32(m_pMemory, 0x20000000, 0x11111111);
+    IMemory_Write32(pOther, 0x20000000, 0x22222222);
+    CHECK_FALSE(MemorySim_WasWatchpointEncountered(m_pMemory));
+    CHECK_TRUE(MemorySim_WasWatchpointEncountered(pOther));
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x20000000));
+    CHECK_EQUAL(0x22222222, IMemory_Read32(pOther, 0x20000000));
+    MemorySim_Uninit(pOther);
+    __try_and_catch( IMemory_Read32(m_pMemory, 0x20000100) );
+    validateExceptionThrown(busErrorException);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x20000000));
+}
+
+TEST(MemorySim, SaveStateThenRestoreState_ShouldRevertMemoryAndRegisterFileContents)
+{
+    createRegionsForState(m_pMemory);
+    MemorySim_LoadImage(m_pMemory, 0x00000000, "\x11\x22\x33\x44", 4);
+    IMemory_Write32(m_pMemory, 0x20000000, 0xBAADF00D);
+    IMemory_Write32(m_pMemory, 0x2001FFFC, 0x12345678);
+    IMemory_Write32(m_pMemory, 0x40000004, 0xCAFEBABE);
+    FILE* pState = saveStateToTemporaryFile();
+
+    MemorySim_LoadImage(m_pMemory, 0x00000000, "\x00\x00\x00\x00", 4);
+    IMemory_Write32(m_pMemory, 0x20000000, 0);
+    IMemory_Write32(m_pMemory, 0x20010000, 0xFFFFFFFF);
+    IMemory_Write32(m_pMemory, 0x2001FFFC, 0);
+    IMemory_Write32(m_pMemory, 0x40000004, 0);
+    MemorySim_RestoreState(m_pMemory, pState);
+    CHECK_EQUAL(0x44332211, IMemory_Read32(m_pMemory, 0x00000000));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x20000000));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x20010000));
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x2001FFFC));
+    CHECK_EQUAL(0xCAFEBABE, IMemory_Read32(m_pMemory, 0x40000004));
+    __try_and_catch( IMemory_Write32(m_pMemory, 0x00000000, 0) );
+    validateExceptionThrown(busErrorException);
+    fclose(pState);
+}
+
+TEST(MemorySim, RestoreState_WritesAfterRestoring_ShouldNotChangeTheSavedState)
+{
+    createRegionsForState(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000100, 0x11111111);
+    FILE* pState = saveStateToTemporaryFile();
+
+    MemorySim_RestoreState(m_pMemory, pState);
+    IMemory_Write32(m_pMemory, 0x20000100, 0x22222222);
+    rewind(pState);
+    MemorySim_RestoreState(m_pMemory, pState);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x20000100));
+    fclose(pState);
+}
+
+TEST(MemorySim, RestoreState_IntoSecondInstanceWithSameRegions_ShouldCopyItsContents)
+{
+    IMemory* pOther = MemorySim_Init();
+    createRegionsForState(m_pMemory);
+    createRegionsForState(pOther);
+    IMemory_Write32(m_pMemory, 0x20000100, 0x11111111);
+    FILE* pState = saveStateToTemporaryFile();
+
+    MemorySim_RestoreState(pOther, pState);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(pOther, 0x20000100));
+    MemorySim_Uninit(pOther);
+    fclose(pState);
+}
+
+TEST(MemorySim, RestoreState_WithDifferentRegions_ShouldThrowAndLeaveContentsAlone)
+{
+    IMemory* pOther = MemorySim_Init();
+    createRegionsForState(m_pMemory);
+    createRegionsForState(pOther, 0x10000);
+    IMemory_Write32(pOther, 0x20000100, 0x22222222);
+    FILE* pState = saveStateToTemporaryFile();
+
+    __try_and_catch( MemorySim_RestoreState(pOther, pState) );
+    validateExceptionThrown(invalidArgumentException);
+    CHECK_EQUAL(0x22222222, IMemory_Read32(pOther, 0x20000100));
+    MemorySim_Uninit(pOther);
+    fclose(pState);
+}
+
+TEST(MemorySim, RestoreState_FromTruncatedFile_ShouldThrowFileException)
+{
+    createRegionsForState(m_pMemory);
+    FILE* pState = saveStateToTemporaryFile();
+
+    CHECK_EQUAL(0, ftruncate(fileno(pState), 0x10000));
+    __try_and_catch( MemorySim_RestoreState(m_pMemory, pState) );
+    validateExceptionThrown(fileException);
+    fclose(pState);
+}
+
+TEST(MemorySim, RestoreState_FailingToMapSecondRegion_ShouldThrowAndLeaveContentsAlone)
+{
+    createRegionsForState(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000100, 0x11111111);
+    FILE* pState = saveStateToTemporaryFile();
+
+    IMemory_Write32(m_pMemory, 0x20000100, 0x22222222);
+    mmapFail(MAP_FAILED);
+    mmapSetCallsBeforeFailure(1);
+    __try_and_catch( MemorySim_RestoreState(m_pMemory, pState) );
+    validateExceptionThrown(fileException);
+    CHECK_EQUAL(0x22222222, IMemory_Read32(m_pMemory, 0x20000100));
+    fclose(pState);
+}
+
+TEST(MemorySim, SaveState_FailingToWrite_ShouldThrowFileException)
+{
+    FILE* pState = tmpfile();
+    createRegionsForState(m_pMemory);
+    fwriteFail(0);
+    __try_and_catch( MemorySim_SaveState(m_pMemory, pState) );
+    validateExceptionThrown(fileException);
+    fclose(pState);
+}
+
+
+TEST(MemorySim, Checkpoint_ShouldReturnNonZeroIdWhichIsCurrentUntilReplaced)
+{
+    createRegionsForState(m_pMemory);
+    CHECK_EQUAL(0, MemorySim_GetCheckpoint(m_pMemory));
+    uint32_t first = MemorySim_Checkpoint(m_pMemory);
+    CHECK(first != 0);
+    CHECK_EQUAL(first, MemorySim_GetCheckpoint(m_pMemory));
+    uint32_t second = MemorySim_Checkpoint(m_pMemory);
+    CHECK(second != first);
+    CHECK_EQUAL(second, MemorySim_GetCheckpoint(m_pMemory));
+}
+
+TEST(MemorySim, GetDirtyPages_WithoutCheckpoint_ShouldReturnZero)
+{
+    createRegionsForState(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000000, 0xFFFFFFFF);
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_pMemory, NULL, 0));
+}
+
+TEST(MemorySim, GetDirtyPages_WritesThroughEachPath_ShouldListTheirPagesInOrder)
+{
+    static const uint32_t words[2] = { 0x11111111, 0x22222222 };
+    uint32_t              pages[16];
+    createRegionsForState(m_pMemory);
+    MemorySim_Checkpoint(m_pMemory);
+
+    IMemory_Write32(m_pMemory, 0x20000000, 0xFFFFFFFF);
+    IMemory_Write16(m_pMemory, 0x20002000, 0xFFFF);
+    IMemory_Write8(m_pMemory, 0x20002FFF, 0xFF);
+    IMemory_WriteBlock(m_pMemory, 0x20004FFE, "\xFF\xFF\xFF\xFF", 4);
+    IMemory_WriteWords(m_pMemory, 0x20007000, words, 2);
+    MemorySim_MapSimulatedAddressToHostAddressForWrite(m_pMemory, 0x20009000, 4);
+    MemorySim_LoadImage(m_pMemory, 0x00000000, "\x11\x22\x33\x44", 4);
+    IMemory_Write32(m_pMemory, 0x40000000, 0xFFFFFFFF);
+    IMemory_Read32(m_pMemory, 0x2000A000);
+
+    CHECK_EQUAL(7, MemorySim_GetDirtyPages(m_pMemory, pages, 16));
+    CHECK_EQUAL(0x00000000, pages[0]);
+    CHECK_EQUAL(0x20000000, pages[1]);
+    CHECK_EQUAL(0x20002000, pages[2]);
+    CHECK_EQUAL(0x20004000, pages[3]);
+    CHECK_EQUAL(0x20005000, pages[4]);
+    CHECK_EQUAL(0x20007000, pages[5]);
+    CHECK_EQUAL(0x20009000, pages[6]);
+}
+
+TEST(MemorySim, GetDirtyPages_WithSmallerArray_ShouldFillItAndStillReturnTotal)
+{
+    uint32_t pages[2] = { 0, 0xFFFFFFFF };
+    createRegionsForState(m_pMemory);
+    MemorySim_Checkpoint(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000000, 0xFFFFFFFF);
+    IMemory_Write32(m_pMemory, 0x20001000, 0xFFFFFFFF);
+
+    CHECK_EQUAL(2, MemorySim_GetDirtyPages(m_pMemory, pages, 1));
+    CHECK_EQUAL(0x20000000, pages[0]);
+    CHECK_EQUAL(0xFFFFFFFF, pages[1]);
+}
+
+TEST(MemorySim, ResetToCheckpoint_ShouldRestoreDirtyPagesAndRegisterFileAndMarkThemClean)
+{
+    createRegionsForState(m_pMemory);
+    MemorySim_LoadImage(m_pMemory, 0x00000000, "\x11\x22\x33\x44", 4);
+    IMemory_Write32(m_pMemory, 0x20000000, 0xBAADF00D);
+    IMemory_Write32(m_pMemory, 0x2001FFFC, 0x12345678);
+    IMemory_Write32(m_pMemory, 0x40000004, 0xCAFEBABE);
+    MemorySim_Checkpoint(m_pMemory);
+
+    MemorySim_LoadImage(m_pMemory, 0x00000000, "\x00\x00\x00\x00", 4);
+    IMemory_Write32(m_pMemory, 0x20000000, 0);
+    IMemory_Write32(m_pMemory, 0x20010000, 0xFFFFFFFF);
+    IMemory_Write32(m_pMemory, 0x2001FFFC, 0);
+    IMemory_Write32(m_pMemory, 0x40000004, 0);
+    MemorySim_ResetToCheckpoint(m_pMemory);
+    CHECK_EQUAL(0x44332211, IMemory_Read32(m_pMemory, 0x00000000));
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_pMemory, 0x20000000));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x20010000));
+    CHECK_EQUAL(0x12345678, IMemory_Read32(m_pMemory, 0x2001FFFC));
+    CHECK_EQUAL(0xCAFEBABE, IMemory_Read32(m_pMemory, 0x40000004));
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_pMemory, NULL, 0));
+}
+
+TEST(MemorySim, ResetToCheckpoint_CalledRepeatedly_ShouldAlwaysReturnToCheckpointContents)
+{
+    createRegionsForState(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000100, 0x11111111);
+    MemorySim_Checkpoint(m_pMemory);
+
+    IMemory_Write32(m_pMemory, 0x20000100, 0x22222222);
+    MemorySim_ResetToCheckpoint(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000104, 0x33333333);
+    MemorySim_ResetToCheckpoint(m_pMemory);
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x20000100));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x20000104));
+}
+
+TEST(MemorySim, ResetToCheckpoint_RegionNotAlignedToPages_ShouldOnlyCopyBytesWithinRegion)
+{
+    MemorySim_CreateRegion(m_pMemory, 0x20000800, 0x1000);
+    MemorySim_CreateRegion(m_pMemory, 0x20001800, 0x800);
+    IMemory_Write32(m_pMemory, 0x20001800, 0x11111111);
+    MemorySim_Checkpoint(m_pMemory);
+
+    IMemory_Write32(m_pMemory, 0x20000800, 0xFFFFFFFF);
+    IMemory_Write32(m_pMemory, 0x200017FC, 0xFFFFFFFF);
+    IMemory_Write32(m_pMemory, 0x20001800, 0x22222222);
+    uint32_t pages[4];
+    CHECK_EQUAL(3, MemorySim_GetDirtyPages(m_pMemory, pages, 4));
+    CHECK_EQUAL(0x20000000, pages[0]);
+    CHECK_EQUAL(0x20001000, pages[1]);
+    CHECK_EQUAL(0x20001000, pages[2]);
+    MemorySim_ResetToCheckpoint(m_pMemory);
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x20000800));
+    CHECK_EQUAL(0x00000000, IMemory_Read32(m_pMemory, 0x200017FC));
+    CHECK_EQUAL(0x11111111, IMemory_Read32(m_pMemory, 0x20001800));
+}
+
+TEST(MemorySim, ResetToCheckpoint_WithoutCheckpoint_ShouldThrowInvalidArgumentException)
+{
+    createRegionsForState(m_pMemory);
+    __try_and_catch( MemorySim_ResetToCheckpoint(m_pMemory) );
+    validateExceptionThrown(invalidArgumentException);
+}
+
+TEST(MemorySim, Checkpoint_CreatingRegionAfterwards_ShouldDiscardIt)
+{
+    createRegionsForState(m_pMemory);
+    MemorySim_Checkpoint(m_pMemory);
+    IMemory_Write32(m_pMemory, 0x20000000, 0xFFFFFFFF);
+    MemorySim_CreateRegion(m_pMemory, 0x30000000, 0x1000);
+    CHECK_EQUAL(0, MemorySim_GetCheckpoint(m_pMemory));
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_pMemory, NULL, 0));
+    __try_and_catch( MemorySim_ResetToCheckpoint(m_pMemory) );
+    validateExceptionThrown(invalidArgumentException);
+}
+
+TEST(MemorySim, Checkpoint_RestoringStateAfterwards_ShouldDiscardIt)
+{
+    createRegionsForState(m_pMemory);
+    FILE* pState = saveStateToTemporaryFile();
+    MemorySim_Checkpoint(m_pMemory);
+    MemorySim_RestoreState(m_pMemory, pState);
+    CHECK_EQUAL(0, MemorySim_GetCheckpoint(m_pMemory));
+    IMemory_Write32(m_pMemory, 0x20000000, 0xFFFFFFFF);
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_pMemory, NULL, 0));
+    fclose(pState);
+}
+
+TEST(MemorySim, Checkpoint_FailingToMapCopy_ShouldThrowAndLeaveNoCheckpoint)
+{
+    createRegionsForState(m_pMemory);
+    mmapFail(MAP_FAILED);
+    __try_and_catch( MemorySim_Checkpoint(m_pMemory) );
+    validateExceptionThrown(outOfMemoryException);
+    CHECK_EQUAL(0, MemorySim_GetCheckpoint(m_pMemory));
+    IMemory_Write32(m_pMemory, 0x20000000, 0xFFFFFFFF);
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_pMemory, NULL, 0));
+}
+
+TEST(MemorySim, Checkpoint_FailingToAllocateBitmap_ShouldThrowAndLeaveNoCheckpoint)
+{
+    createRegionsForState(m_pMemory);
+    MallocFailureInject_FailAllocation(2);
+    __try_and_catch( MemorySim_Checkpoint(m_pMemory) );
+    validateExceptionThrown(outOfMemoryException);
+    CHECK_EQUAL(0, MemorySim_GetCheckpoint(m_pMemory));
+}
@@ -0,0 +1,265 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <string.h>
+#include <unistd.h>
+
+// Include headers from C modules under test.
+extern "C"
+{
+    #include <FileFailureInject.h>
+    #include <MallocFailureInject.h>
+    #include <MemorySim.h>
+    #include <Snapshot.h>
+}
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+static const char* g_stateFilename = "SnapshotTest.state";
+
+
+TEST_GROUP(Snapshot)
+{
+    PinkySimContext m_context;
+    Snapshot*       m_pSnapshot;
+
+    void setup()
+    {
+        memset(&m_context, 0, sizeof(m_context));
+        m_context.pMemory = MemorySim_Init();
+        MemorySim_CreateRegion(m_context.pMemory, 0x00000000, 0x1000);
+        MemorySim_MakeRegionReadOnly(m_context.pMemory, 0x00000000);
+        MemorySim_CreateRegion(m_context.pMemory, 0x20000000, 0x8000);
+        m_pSnapshot = NULL;
+    }
+
+    void teardown()
+    {
+        CHECK_EQUAL(noException, getExceptionCode());
+        MallocFailureInject_Restore();
+        fopenRestore();
+        fwriteRestore();
+        Snapshot_Free(m_pSnapshot);
+        pinkySimDisableDecodeCache(&m_context);
+        MemorySim_Uninit(m_context.pMemory);
+        remove(g_stateFilename);
+    }
+
+    void setMachineState(uint32_t seed)
+    {
+        for (int i = 0 ; i < 13 ; i++)
+            m_context.R[i] = seed + i;
+        m_context.spMain = 0x20008000 - seed;
+        m_context.lr = seed + 0x100;
+        m_context.pc = seed + 0x200;
+        m_context.xPSR = EPSR_T | (seed & APSR_NZCV);
+        m_context.PRIMASK = seed & PRIMASK_PM;
+        m_context.CONTROL = seed & 2;
+        m_context.cycleCounter.count = 0x100000000ULL + seed;
+        m_context.cycleCounter.cyccntBase = seed;
+        IMemory_Write32(m_context.pMemory, 0x20000000, seed);
+        IMemory_Write32(m_context.pMemory, 0x20007FFC, ~seed);
+    }
+
+    void validateMachineState(uint32_t seed)
+    {
+        for (int i = 0 ; i < 13 ; i++)
+            CHECK_EQUAL(seed + i, m_context.R[i]);
+        CHECK_EQUAL(0x20008000 - seed, m_context.spMain);
+        CHECK_EQUAL(seed + 0x100, m_context.lr);
+        CHECK_EQUAL(seed + 0x200, m_context.pc);
+        CHECK_EQUAL(EPSR_T | (seed & APSR_NZCV), m_context.xPSR);
+        CHECK_EQUAL(seed & PRIMASK_PM, m_context.PRIMASK);
+        CHECK_EQUAL(seed & 2, m_context.CONTROL);
+        CHECK_TRUE(0x100000000ULL + seed == m_context.cycleCounter.count);
+        CHECK_TRUE(seed == m_context.cycleCounter.cyccntBase);
+        CHECK_EQUAL(seed, IMemory_Read32(m_context.pMemory, 0x20000000));
+        CHECK_EQUAL(~seed, IMemory_Read32(m_context.pMemory, 0x20007FFC));
+    }
+
+    void validateStateException(const char* pExpectedErrorText)
+    {
+        CHECK_EQUAL(stateException, getExceptionCode());
+        STRCMP_EQUAL(pExpectedErrorText, Snapshot_GetErrorText());
+        clearExceptionCode();
+    }
+
+    void createFile(const char* pFilename, const char* pContents)
+    {
+        FILE* pFile = fopen(pFilename, "w");
+        fwrite(pContents, 1, strlen(pContents), pFile);
+        fclose(pFile);
+    }
+};
+
+
+TEST(Snapshot, SaveThenLoad_ShouldRestoreRegistersAndMemory)
+{
+    setMachineState(0xF0000001);
+    Snapshot_Save(&m_context, g_stateFilename);
+    setMachineState(0x12345678);
+    Snapshot_Load(&m_context, g_stateFilename);
+    validateMachineState(0xF0000001);
+}
+
+TEST(Snapshot, LoadIntoSecondSimulationWithSameRegions_ShouldStartWhereFirstWasSaved)
+{
+    PinkySimContext first = m_context;
+
+    setMachineState(0xF0000001);
+    Snapshot_Save(&m_context, g_stateFilename);
+    MemorySim_Uninit(first.pMemory);
+    memset(&m_context, 0, sizeof(m_context));
+    m_context.pMemory = MemorySim_Init();
+    MemorySim_CreateRegion(m_context.pMemory, 0x00000000, 0x1000);
+    MemorySim_MakeRegionReadOnly(m_context.pMemory, 0x00000000);
+    MemorySim_CreateRegion(m_context.pMemory, 0x20000000, 0x8000);
+    Snapshot_Load(&m_context, g_stateFilename);
+    validateMachineState(0xF0000001);
+}
+
+TEST(Snapshot, TakeThenRestoreTwice_ShouldReturnToSnapshotEachTime)
+{
+    setMachineState(0x00000003);
+    m_pSnapshot = Snapshot_Take(&m_context);
+    setMachineState(0x80000000);
+    Snapshot_Restore(m_pSnapshot, &m_context);
+    validateMachineState(0x00000003);
+    setMachineState(0x40000000);
+    Snapshot_Restore(m_pSnapshot, &m_context);
+    validateMachineState(0x00000003);
+}
+
+TEST(Snapshot, TakeThenRestore_ShouldOnlyResetPagesWrittenSinceTaking)
+{
+    setMachineState(0x00000003);
+    m_pSnapshot = Snapshot_Take(&m_context);
+    uint32_t checkpoint = MemorySim_GetCheckpoint(m_context.pMemory);
+    CHECK(checkpoint != 0);
+    setMachineState(0x80000000);
+    CHECK_EQUAL(2, MemorySim_GetDirtyPages(m_context.pMemory, NULL, 0));
+    Snapshot_Restore(m_pSnapshot, &m_context);
+    validateMachineState(0x00000003);
+    CHECK_EQUAL(checkpoint, MemorySim_GetCheckpoint(m_context.pMemory));
+    CHECK_EQUAL(0, MemorySim_GetDirtyPages(m_context.pMemory, NULL, 0));
+}
+
+TEST(Snapshot, RestoreAfterLoadingOtherState_ShouldReadWholeSnapshotAndCheckpointAgain)
+{
+    setMachineState(0x00000003);
+    m_pSnapshot = Snapshot_Take(&m_context);
+    setMachineState(0x80000000);
+    Snapshot_Save(&m_context, g_stateFilename);
+    Snapshot_Load(&m_context, g_stateFilename);
+    CHECK_EQUAL(0, MemorySim_GetCheckpoint(m_context.pMemory));
+    Snapshot_Restore(m_pSnapshot, &m_context);
+    validateMachineState(0x00000003);
+    CHECK(MemorySim_GetCheckpoint(m_context.pMemory) != 0);
+    setMachineState(0x40000000);
+    Snapshot_Restore(m_pSnapshot, &m_context);
+    validateMachineState(0x00000003);
+}
+
+TEST(Snapshot, Restore_ShouldFlushDecodeCache)
+{
+    // MOVS R0, #1 and then MOVS R0, #2 at the same address.
+    MemorySim_CreateRegion(m_context.pMemory, 0x10000000, 0x1000);
+    IMemory_Write16(m_context.pMemory, 0x10000000, 0x2001);
+    m_context.pc = 0x10000000;
+    m_context.xPSR = EPSR_T;
+    m_pSnapshot = Snapshot_Take(&m_context);
+    pinkySimEnableDecodeCache(&m_context);
+    pinkySimStep(&m_context);
+    CHECK_EQUAL(1, m_context.R[0]);
+
+    IMemory_Write16(m_context.pMemory, 0x10000000, 0x2002);
+    pinkySimFlushDecodeCache(&m_context);
+    m_context.pc = 0x10000000;
+    pinkySimStep(&m_context);
+    CHECK_EQUAL(2, m_context.R[0]);
+
+    Snapshot_Restore(m_pSnapshot, &m_context);
+    pinkySimStep(&m_context);
+    CHECK_EQUAL(1, m_context.R[0]);
+}
+
+TEST(Snapshot, Free_ShouldHandleNULLPointer)
+{
+    Snapshot_Free(NULL);
+}
+
+TEST(Snapshot, LoadMissingFile_ShouldThrow)
+{
+    __try_and_catch( Snapshot_Load(&m_context, g_stateFilename) );
+    validateStateException("Failed to open SnapshotTest.state.");
+}
+
+TEST(Snapshot, LoadFileWhichIsNotState_ShouldThrowWithoutChangingRegisters)
+{
+    createFile(g_stateFilename, "This isn't the machine state that you are looking for.\n"
+                                "This isn't the machine state that you are looking for.\n");
+    setMachineState(0x00000001);
+    __try_and_catch( Snapshot_Load(&m_context, g_stateFilename) );
+    validateStateException("SnapshotTest.state isn't a pinkySim machine state file.");
+    validateMachineState(0x00000001);
+}
+
+TEST(Snapshot, LoadIntoSimulationWithDifferentRegions_ShouldThrowWithoutChangingRegisters)
+{
+    Snapshot_Save(&m_context, g_stateFilename);
+    MemorySim_CreateRegion(m_context.pMemory, 0x30000000, 0x1000);
+    setMachineState(0x00000001);
+    __try_and_catch( Snapshot_Load(&m_context, g_stateFilename) );
+    validateStateException("SnapshotTest.state was saved from a simulation with different memory regions.");
+    validateMachineState(0x00000001);
+}
+
+TEST(Snapshot, LoadTruncatedFile_ShouldThrow)
+{
+    Snapshot_Save(&m_context, g_stateFilename);
+    CHECK_EQUAL(0, truncate(g_stateFilename, 0x1000));
+    __try_and_catch( Snapshot_Load(&m_context, g_stateFilename) );
+    validateStateException("Failed to read machine state from SnapshotTest.state.");
+}
+
+TEST(Snapshot, SaveFailingToCreateFile_ShouldThrow)
+{
+    fopenFail(NULL);
+    __try_and_catch( Snapshot_Save(&m_context, g_stateFilename) );
+    validateStateException("Failed to create SnapshotTest.state.");
+}
+
+TEST(Snapshot, SaveFailingToWrite_ShouldThrowAndRemovePartialFile)
+{
+    fwriteFail(0);
+    __try_and_catch( Snapshot_Save(&m_context, g_stateFilename) );
+    validateStateException("Failed to write machine state to SnapshotTest.state.");
+    CHECK_EQUAL(-1, access(g_stateFilename, F_OK));
+}
+
+TEST(Snapshot, TakeFailingToAllocate_ShouldThrow)
+{
+    MallocFailureInject_FailAllocation(1);
+    __try_and_catch( m_pSnapshot = Snapshot_Take(&m_context) );
+    validateStateException("Failed to allocate memory for temporary snapshot file.");
+    POINTERS_EQUAL(NULL, m_pSnapshot);
+}
+
+TEST(Snapshot, TakeFailingToWrite_ShouldThrow)
+{
+    fwriteFail(0);
+    __try_and_catch( m_pSnapshot = Snapshot_Take(&m_context) );
+    validateStateException("Failed to write machine state to temporary snapshot file.");
+    POINTERS_EQUAL(NULL, m_pSnapshot);
+}
@@ -10,10 +10,12 @@
     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
     GNU General Public License for more details.
 */
+#include <signal.h>
 #include <string.h>
 
 extern "C"
 {
+    #include <MallocFailureInject.h>
     #include <mockSock.h>
     #include <SocketIComm.h>
 }
@@ -35,6 +37,7 @@ TEST_GROUP(SockIComm)
         CHECK_EQUAL(noException, getExceptionCode());
         SocketIComm_Uninit(m_pComm);
         mockSock_Uninit();
+        MallocFailureInject_Restore();
     }
 };
 
@@ -53,6 +56,15 @@ TEST(SockIComm, FailSocketCallDuringInit_ShouldThrow)
     clearExceptionCode();
 }
 
+TEST(SockIComm, FailAllocationDuringInit_ShouldThrow)
+{
+    MallocFailureInject_FailAllocation(1);
+        __try_and_catch( m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL) );
+    CHECK_EQUAL(outOfMemoryException, getExceptionCode());
+    POINTERS_EQUAL(NULL, m_pComm);
+    clearExceptionCode();
+}
+
 TEST(SockIComm, FailBindCallDuringInit_ShouldThrow)
 {
     mockSock_bindSetReturn(-1);
@@ -238,3 +250,81 @@ TEST(SockIComm, IsGdbConnected_CallApiWhichWaitsForConnection_ShouldReturnTrueAf
     mockSock_selectSetReturn(0);
     CHECK_TRUE(IComm_IsGdbConnected(m_pComm));
 }
+
+TEST(SockIComm, HasReceiveData_AsyncEnabled_ShouldOnlySelectAfterSigIo)
+{
+    mockSock_fcntlSetReturn(0);
+    m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL);
+    mockSock_selectSetReturn(0);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+
+    mockSock_selectSetReturn(1);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+
+    raise(SIGIO);
+    CHECK_TRUE(IComm_HasReceiveData(m_pComm));
+}
+
+TEST(SockIComm, HasReceiveData_AsyncEnabled_ShouldKeepReturningTrueUntilDataIsRead)
+{
+    mockSock_fcntlSetReturn(0);
+    m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL);
+    mockSock_selectSetReturn(1);
+    CHECK_TRUE(IComm_HasReceiveData(m_pComm));
+    CHECK_TRUE(IComm_HasReceiveData(m_pComm));
+
+    mockSock_selectSetReturn(0);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+    mockSock_selectSetReturn(1);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+}
+
+TEST(SockIComm, HasReceiveData_FcntlFails_ShouldFallBackToSelectOnEveryCall)
+{
+    mockSock_fcntlSetReturn(-1);
+    m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL);
+    mockSock_selectSetReturn(0);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+    mockSock_selectSetReturn(1);
+    CHECK_TRUE(IComm_HasReceiveData(m_pComm));
+}
+
+TEST(SockIComm, IsGdbConnected_AsyncEnabled_ShouldOnlySelectListenSocketAfterSigIo)
+{
+    mockSock_fcntlSetReturn(0);
+    m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL);
+    mockSock_selectSetReturn(0);
+    CHECK_FALSE(IComm_IsGdbConnected(m_pComm));
+
+    mockSock_selectSetReturn(1);
+    CHECK_FALSE(IComm_IsGdbConnected(m_pComm));
+
+    raise(SIGIO);
+    CHECK_TRUE(IComm_IsGdbConnected(m_pComm));
+}
+
+TEST(SockIComm, SecondInstance_ShouldFallBackToSelectOnEveryCallSinceFirstOwnsSigIo)
+{
+    mockSock_fcntlSetReturn(0);
+    m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL);
+    IComm* pSecond = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT + 1, NULL);
+    CHECK(pSecond != m_pComm);
+
+    mockSock_selectSetReturn(0);
+    CHECK_FALSE(IComm_HasReceiveData(pSecond));
+    mockSock_selectSetReturn(1);
+    CHECK_TRUE(IComm_HasReceiveData(pSecond));
+    SocketIComm_Uninit(pSecond);
+}
+
+TEST(SockIComm, InstanceCreatedAfterSigIoOwnerIsFreed_ShouldUseSigIo)
+{
+    mockSock_fcntlSetReturn(0);
+    SocketIComm_Uninit(SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL));
+    m_pComm = SocketIComm_Init(SOCKET_ICOMM_DEFAULT_PORT, NULL);
+    mockSock_selectSetReturn(0);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+
+    mockSock_selectSetReturn(1);
+    CHECK_FALSE(IComm_HasReceiveData(m_pComm));
+}
@@ -0,0 +1,138 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include <string.h>
+#include <unistd.h>
+
+// Include headers from C modules under test.
+extern "C"
+{
+    #include <MallocFailureInject.h>
+    #include <WorkPool.h>
+}
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+#define MAX_ITEMS 1000
+
+struct WorkLog
+{
+    volatile uint32_t runCounts[MAX_ITEMS];
+    volatile uint32_t order[MAX_ITEMS];
+    volatile uint32_t completedCount;
+    volatile uint32_t otherItemsDoneBeforeFirstFinished;
+};
+
+static void logItem(void* pContext, uint32_t itemIndex)
+{
+    WorkLog* pLog = (WorkLog*)pContext;
+    uint32_t slot;
+
+    __sync_fetch_and_add(&pLog->runCounts[itemIndex], 1);
+    slot = __sync_fetch_and_add(&pLog->completedCount, 1);
+    pLog->order[slot] = itemIndex;
+}
+
+// Item 0 doesn't finish until every other item has been run, which can only happen if the rest of its owner's share
+// is stolen by another thread.
+static void blockFirstItemUntilRestAreDone(void* pContext, uint32_t itemIndex)
+{
+    WorkLog* pLog = (WorkLog*)pContext;
+    int      i;
+
+    if (itemIndex == 0)
+    {
+        for (i = 0 ; i < 5000 && pLog->completedCount < 9 ; i++)
+            usleep(1000);
+        pLog->otherItemsDoneBeforeFirstFinished = pLog->completedCount;
+    }
+    logItem(pContext, itemIndex);
+}
+
+
+TEST_GROUP(WorkPool)
+{
+    WorkLog m_log;
+
+    void setup()
+    {
+        memset(&m_log, 0, sizeof(m_log));
+    }
+
+    void teardown()
+    {
+        MallocFailureInject_Restore();
+        clearExceptionCode();
+    }
+
+    void validateEachItemRunOnce(uint32_t itemCount)
+    {
+        CHECK_EQUAL(itemCount, m_log.completedCount);
+        for (uint32_t i = 0 ; i < itemCount ; i++)
+            CHECK_EQUAL(1, m_log.runCounts[i]);
+    }
+};
+
+
+TEST(WorkPool, GetDefaultThreadCount_ShouldBeAtLeastOne)
+{
+    CHECK_TRUE(WorkPool_GetDefaultThreadCount() >= 1);
+}
+
+TEST(WorkPool, RunNoItems_ShouldNotInvokeCallback)
+{
+    WorkPool_Run(4, 0, logItem, &m_log);
+    CHECK_EQUAL(0, m_log.completedCount);
+}
+
+TEST(WorkPool, RunOnOneThread_ShouldInvokeEachItemOnceInOrder)
+{
+    WorkPool_Run(1, 10, logItem, &m_log);
+    validateEachItemRunOnce(10);
+    for (uint32_t i = 0 ; i < 10 ; i++)
+        CHECK_EQUAL(i, m_log.order[i]);
+}
+
+TEST(WorkPool, RunManyItemsOnSeveralThreads_ShouldInvokeEachItemOnce)
+{
+    WorkPool_Run(8, MAX_ITEMS, logItem, &m_log);
+    validateEachItemRunOnce(MAX_ITEMS);
+}
+
+TEST(WorkPool, RunWithMoreThreadsThanItems_ShouldInvokeEachItemOnce)
+{
+    WorkPool_Run(16, 3, logItem, &m_log);
+    validateEachItemRunOnce(3);
+}
+
+TEST(WorkPool, RunWithDefaultThreadCount_ShouldInvokeEachItemOnce)
+{
+    WorkPool_Run(0, 100, logItem, &m_log);
+    validateEachItemRunOnce(100);
+}
+
+TEST(WorkPool, SlowItemAtFrontOfShare_ShouldHaveRestOfShareStolen)
+{
+    WorkPool_Run(2, 10, blockFirstItemUntilRestAreDone, &m_log);
+    validateEachItemRunOnce(10);
+    CHECK_EQUAL(9, m_log.otherItemsDoneBeforeFirstFinished);
+}
+
+TEST(WorkPool, FailAllocation_ShouldThrow)
+{
+    MallocFailureInject_FailAllocation(1);
+    __try_and_catch( WorkPool_Run(2, 10, logItem, &m_log) );
+    CHECK_EQUAL(outOfMemoryException, getExceptionCode());
+    CHECK_EQUAL(0, m_log.completedCount);
+}
@@ -44,7 +44,7 @@ TEST(breakpointTests, Set16bitBreakpointAndRunUntilHit)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$Z1,%x,2#", INITIAL_PC + 6);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -52,7 +52,7 @@ TEST(breakpointTests, Set16bitBreakpointAndRunUntilHit)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(4);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -72,7 +72,7 @@ TEST(breakpointTests, Set32bitBreakpointAndRunUntilHit)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$Z1,%x,3#", INITIAL_PC + 6);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -80,7 +80,7 @@ TEST(breakpointTests, Set32bitBreakpointAndRunUntilHit)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(4);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -95,7 +95,7 @@ TEST(breakpointTests, AttemptToSetInvalidBreakpoint_ShouldReturnErrorMessage)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$Z1,%x,1#", INITIAL_PC);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_INVALID_ARGUMENT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -113,7 +113,7 @@ TEST(breakpointTests, FailMemoryAllocationOnBreakpointSet_ShouldReturnErrorMessa
     snprintf(commands, sizeof(commands), "+$Z1,%x,2#", INITIAL_PC + 6);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     MallocFailureInject_FailAllocation(1);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_NO_FREE_BREAKPOINT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -126,7 +126,7 @@ TEST(breakpointTests, AttemptToClearInvalidBreakpointType_ShouldReturnErrorMessa
     char commands[64];
     snprintf(commands, sizeof(commands), "+$z1,%x,1#", INITIAL_PC);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_INVALID_ARGUMENT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -137,7 +137,7 @@ TEST(breakpointTests, AttemptToSetBreakpointAtInvalidAddress_ShouldReturnErrorMe
     emitBKPT(0);
 
     mockIComm_InitReceiveChecksummedData("+$Z1,fffffffe,2#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_NO_FREE_BREAKPOINT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -148,7 +148,7 @@ TEST(breakpointTests, AttemptToClearBreakpointAtInvalidAddress_ShouldReturnError
     emitBKPT(0);
 
     mockIComm_InitReceiveChecksummedData("+$z1,fffffffe,2#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_INVALID_ARGUMENT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -165,7 +165,7 @@ TEST(breakpointTests, SetBreakpointHit_LeaveBreakpointSet_ContinueAndHitAgain)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$Z1,%x,2#", INITIAL_PC + 4);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -173,7 +173,7 @@ TEST(breakpointTests, SetBreakpointHit_LeaveBreakpointSet_ContinueAndHitAgain)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(3);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 4);
     appendExpectedString("+");
@@ -183,7 +183,7 @@ TEST(breakpointTests, SetBreakpointHit_LeaveBreakpointSet_ContinueAndHitAgain)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(3);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 4);
     appendExpectedString("+");
@@ -201,7 +201,7 @@ TEST(breakpointTests, SetBreakpointHit_ClearBreakpoint_ContinueAndRunPast)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$Z1,%x,2#", INITIAL_PC + 4);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -210,7 +210,7 @@ TEST(breakpointTests, SetBreakpointHit_ClearBreakpoint_ContinueAndRunPast)
     snprintf(commands, sizeof(commands), "+$z1,%x,2#", INITIAL_PC + 4);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     mockIComm_DelayReceiveData(3);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 4);
     appendExpectedString("+$OK#+");
@@ -220,7 +220,7 @@ TEST(breakpointTests, SetBreakpointHit_ClearBreakpoint_ContinueAndRunPast)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(3);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 8);
     appendExpectedString("+");
@@ -239,7 +239,7 @@ TEST(breakpointTests, Set32bitBreakpoint_RunUntilHit_Clear32bitBreakpoint)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$Z1,%x,3#", INITIAL_PC + 6);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -248,7 +248,7 @@ TEST(breakpointTests, Set32bitBreakpoint_RunUntilHit_Clear32bitBreakpoint)
     snprintf(commands, sizeof(commands), "+$z1,%x,3#", INITIAL_PC + 6);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     mockIComm_DelayReceiveData(4);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+$OK#+");
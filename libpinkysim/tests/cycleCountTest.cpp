@@ -0,0 +1,251 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+TEST_GROUP_BASE(cycleCount, pinkySimBase)
+{
+    void setup()
+    {
+        pinkySimBase::setup();
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 4, 0, READ_WRITE);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 8, 0, READ_WRITE);
+    }
+
+    void teardown()
+    {
+        pinkySimDisableDecodeCache(&m_context);
+        pinkySimBase::teardown();
+    }
+
+    void enableCycleCounterWithoutFlash()
+    {
+        pinkySimEnableCycleCounter(&m_context, 0, 0, 0);
+    }
+
+    void emitBKPT(uint32_t immediate)
+    {
+        emitInstruction16("10111110iiiiiiii", immediate);
+    }
+
+    void emitNOP()
+    {
+        emitInstruction16("1011111100000000");
+    }
+
+    void emitLDRImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01101iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitSTRImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01100iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitLDRLiteral(uint32_t Rt, uint32_t immediate)
+    {
+        emitInstruction16("01001tttiiiiiiii", Rt, immediate);
+    }
+
+    void emitPUSH(uint32_t M, uint32_t registerList)
+    {
+        emitInstruction16("1011010Mrrrrrrrr", M, registerList);
+    }
+
+    void emitB(int32_t offset)
+    {
+        emitInstruction16("11100iiiiiiiiiii", ((uint32_t)offset >> 1) & 0x7FF);
+    }
+
+    void emitBEQ(int32_t offset)
+    {
+        emitInstruction16("1101cccciiiiiiii", COND_EQ, ((uint32_t)offset >> 1) & 0xFF);
+    }
+
+    void emitMRS(uint32_t Rd, uint32_t SYSm)
+    {
+        emitInstruction32("1111001111101111", "1000ddddssssssss", Rd, SYSm);
+    }
+
+    void runToBreakpoint(int (*run)(PinkySimContext*, int (*)(PinkySimContext*)) = pinkySimRun)
+    {
+        int result = run(&m_context, NULL);
+        CHECK_EQUAL(PINKYSIM_STEP_BKPT, result);
+        validateXPSR();
+        validateRegisters();
+    }
+};
+
+
+TEST(cycleCount, Disabled_ShouldNotCount)
+{
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runToBreakpoint();
+    CHECK_EQUAL(0, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, TwoNOPs_ShouldTakeOneCycleEach)
+{
+    enableCycleCounterWithoutFlash();
+    emitNOP();
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runToBreakpoint();
+    CHECK_EQUAL(2, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, LDR_ShouldTakeTwoCycles)
+{
+    enableCycleCounterWithoutFlash();
+    emitLDRImmediate(R0, R1, 0);
+    emitBKPT(0);
+    setRegisterValue(R1, INITIAL_PC + 8);
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runToBreakpoint();
+    CHECK_EQUAL(2, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, PUSHThreeRegisters_ShouldTakeOnePlusThreeCycles)
+{
+    enableCycleCounterWithoutFlash();
+    emitPUSH(1, (1 << R0) | (1 << R1));
+    emitBKPT(0);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_SP - 4, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_SP - 8, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_SP - 12, 0, READ_WRITE);
+    setExpectedRegisterValue(SP, INITIAL_SP - 12);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runToBreakpoint();
+    CHECK_EQUAL(4, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, TakenBranch_ShouldTakeThreeCycles)
+{
+    enableCycleCounterWithoutFlash();
+    emitB(0);
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runToBreakpoint();
+    CHECK_EQUAL(3, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, ConditionalBranchNotTaken_ShouldTakeOneCycle)
+{
+    enableCycleCounterWithoutFlash();
+    emitBEQ(0);
+    emitBKPT(0);
+    setExpectedXPSRflags("z");
+    clearZero();
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runToBreakpoint();
+    CHECK_EQUAL(1, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, MRS_ShouldTakeFourCycles)
+{
+    enableCycleCounterWithoutFlash();
+    emitMRS(R0, SYS_PRIMASK);
+    emitBKPT(0);
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runToBreakpoint();
+    CHECK_EQUAL(4, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, FourNOPsFromFlashWithTwoWaitStates_ShouldAddWaitStatesOncePerWordFetched)
+{
+    pinkySimEnableCycleCounter(&m_context, INITIAL_PC, 0x100, 2);
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 8);
+        runToBreakpoint();
+    CHECK_EQUAL(4 + 2 * 2, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, LDRLiteralFromFlashWithOneWaitState_ShouldAddWaitStateForFetchAndLoad)
+{
+    pinkySimEnableCycleCounter(&m_context, INITIAL_PC, 0x100, 1);
+    emitLDRLiteral(R0, 1);
+    emitBKPT(0);
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runToBreakpoint();
+    CHECK_EQUAL(2 + 1 + 1, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, ReadDWT_CYCCNT_ShouldReturnCyclesBeforeLoad)
+{
+    enableCycleCounterWithoutFlash();
+    emitNOP();
+    emitNOP();
+    emitLDRImmediate(R0, R1, 0);
+    emitBKPT(0);
+    setRegisterValue(R1, DWT_CYCCNT);
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+        runToBreakpoint();
+    CHECK_EQUAL(4, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, WriteDWT_CYCCNT_ShouldRestartRegisterButNotTotal)
+{
+    enableCycleCounterWithoutFlash();
+    emitNOP();
+    emitSTRImmediate(R2, R1, 0);
+    emitLDRImmediate(R0, R1, 0);
+    emitBKPT(0);
+    setRegisterValue(R1, DWT_CYCCNT);
+    setRegisterValue(R2, 100);
+    setExpectedRegisterValue(R0, 102);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+        runToBreakpoint();
+    CHECK_EQUAL(5, m_context.cycleCounter.count);
+}
+
+TEST(cycleCount, ReadDWT_CYCCNTWhenDisabled_ShouldHardFault)
+{
+    emitLDRImmediate(R0, R1, 0);
+    setRegisterValue(R1, DWT_CYCCNT);
+    setExpectedRegisterValue(PC, INITIAL_PC);
+        CHECK_EQUAL(PINKYSIM_STEP_HARDFAULT, pinkySimRun(&m_context, NULL));
+    validateRegisters();
+}
+
+static int g_blockCount;
+
+static int stopAfterTwentyBlocksCallback(PinkySimContext* pContext)
+{
+    return ++g_blockCount > 20 ? PINKYSIM_RUN_INTERRUPT : PINKYSIM_STEP_OK;
+}
+
+TEST(cycleCount, RunBlocksWithJitEnabled_ShouldStillCountEveryInstruction)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    pinkySimEnableJit(&m_context);
+    enableCycleCounterWithoutFlash();
+    emitNOP();
+    emitB(-6);
+    g_blockCount = 0;
+    setExpectedRegisterValue(PC, INITIAL_PC);
+        CHECK_EQUAL(PINKYSIM_RUN_INTERRUPT, pinkySimRunBlocks(&m_context, stopAfterTwentyBlocksCallback));
+    validateRegisters();
+    CHECK_EQUAL(20 * (1 + 3), m_context.cycleCounter.count);
+}
@@ -0,0 +1,181 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+extern "C"
+{
+    #include <MallocFailureInject.h>
+}
+
+TEST_GROUP_BASE(decodeCache, pinkySimBase)
+{
+    void setup()
+    {
+        pinkySimBase::setup();
+        pinkySimEnableDecodeCache(&m_context);
+    }
+
+    void teardown()
+    {
+        pinkySimDisableDecodeCache(&m_context);
+        MallocFailureInject_Restore();
+        clearExceptionCode();
+        pinkySimBase::teardown();
+    }
+
+    void emitMOVImmediate(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("00100dddiiiiiiii", Rd, immediate);
+    }
+
+    void emitSTRHImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("10000iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitMRS(uint32_t Rd, uint32_t SYSm)
+    {
+        emitInstruction32("1111001111101111", "1000ddddssssssss", Rd, SYSm);
+    }
+
+    void overwriteInstructionAt(uint32_t address, uint32_t Rd, uint32_t immediate)
+    {
+        m_emitAddress = address;
+        emitMOVImmediate(Rd, immediate);
+    }
+};
+
+
+TEST(decodeCache, ExecuteSameInstructionTwice_ShouldUseCachedDecodeEvenIfMemoryChangedBehindItsBack)
+{
+    emitMOVImmediate(R0, 1);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    pinkySimStep(&m_context);
+
+    overwriteInstructionAt(INITIAL_PC, R0, 2);
+    setRegisterValue(PC, INITIAL_PC);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, FlushCache_ShouldRefetchModifiedInstruction)
+{
+    emitMOVImmediate(R0, 1);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    pinkySimStep(&m_context);
+
+    overwriteInstructionAt(INITIAL_PC, R0, 2);
+    pinkySimFlushDecodeCache(&m_context);
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(R0, 2);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, InvalidateAddress_ShouldRefetchModifiedInstruction)
+{
+    emitMOVImmediate(R0, 1);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    pinkySimStep(&m_context);
+
+    overwriteInstructionAt(INITIAL_PC, R0, 2);
+    pinkySimInvalidateDecodeCache(&m_context, INITIAL_PC, sizeof(uint16_t));
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(R0, 2);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, InvalidateSecondHalfOf32BitInstruction_ShouldRefetchWholeInstruction)
+{
+    emitMRS(R0, SYS_PRIMASK);
+    setRegisterValue(R0, 0xFFFFFFFF);
+    setExpectedRegisterValue(R0, 0);
+    pinkySimStep(&m_context);
+
+    m_emitAddress = INITIAL_PC + 2;
+    emitInstruction16("1000ddddssssssss", R1, SYS_PRIMASK);
+    pinkySimInvalidateDecodeCache(&m_context, INITIAL_PC + 2, sizeof(uint16_t));
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    setExpectedRegisterValue(R1, 0);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, SimulatedStoreOverCachedInstruction_ShouldInvalidateItAutomatically)
+{
+    // Cache MOVS r0, #1 at INITIAL_PC + 2 and then have the STRH at INITIAL_PC overwrite it with MOVS r0, #2.
+    emitSTRHImmediate(R1, R2, 0);
+    emitMOVImmediate(R0, 1);
+    setRegisterValue(PC, INITIAL_PC + 2);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    pinkySimStep(&m_context);
+
+    setRegisterValue(PC, INITIAL_PC);
+    setRegisterValue(R1, 0x2002);
+    setRegisterValue(R2, INITIAL_PC + 2);
+    pinkySimStep(&m_context);
+
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, FetchFromInvalidAddress_ShouldHardFaultAndNotPolluteCache)
+{
+    setRegisterValue(PC, 0xFFFFFFF0);
+    setExpectedStepReturn(PINKYSIM_STEP_HARDFAULT);
+    setExpectedRegisterValue(PC, 0xFFFFFFF0);
+    pinkySimStep(&m_context);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, EnableTwice_ShouldKeepExistingCacheAllocation)
+{
+    PinkySimDecodeCache* pOrig = m_context.pDecodeCache;
+    pinkySimEnableDecodeCache(&m_context);
+    POINTERS_EQUAL(pOrig, m_context.pDecodeCache);
+}
+
+TEST(decodeCache, Disable_ShouldFreeCacheAndFallBackToUncachedExecution)
+{
+    emitMOVImmediate(R0, 1);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    pinkySimStep(&m_context);
+
+    pinkySimDisableDecodeCache(&m_context);
+    POINTERS_EQUAL(NULL, m_context.pDecodeCache);
+    overwriteInstructionAt(INITIAL_PC, R0, 2);
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(R0, 2);
+    pinkySimStep(&m_context);
+}
+
+TEST(decodeCache, FlushAndInvalidateWithCacheDisabled_ShouldBeIgnored)
+{
+    pinkySimDisableDecodeCache(&m_context);
+    pinkySimFlushDecodeCache(&m_context);
+    pinkySimInvalidateDecodeCache(&m_context, INITIAL_PC, sizeof(uint16_t));
+    POINTERS_EQUAL(NULL, m_context.pDecodeCache);
+}
+
+TEST(decodeCache, FailAllocation_ShouldThrowAndLeaveCacheDisabled)
+{
+    pinkySimDisableDecodeCache(&m_context);
+    MallocFailureInject_FailAllocation(1);
+    __try_and_catch( pinkySimEnableDecodeCache(&m_context) );
+    CHECK_EQUAL(outOfMemoryException, getExceptionCode());
+    POINTERS_EQUAL(NULL, m_context.pDecodeCache);
+}
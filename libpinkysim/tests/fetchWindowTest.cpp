@@ -0,0 +1,101 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+// Include headers from C modules under test.
+extern "C"
+{
+    #include <pinkySim.h>
+    #include <MemorySim.h>
+}
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+// Instruction fetches from MemorySim regions are read directly from host memory through the fetch window.  These
+// tests run code from a real MemorySim region to make sure that the window is refilled and discarded when needed.
+#define CODE_BASE   0x10000000
+#define CODE_SIZE   0x2000
+#define NOP         0xBF00
+#define BKPT        0xBE00
+
+TEST_GROUP(fetchWindow)
+{
+    PinkySimContext m_context;
+    uint32_t        m_emitAddress;
+
+    void setup()
+    {
+        memset(&m_context, 0, sizeof(m_context));
+        m_context.pMemory = MemorySim_Init();
+        MemorySim_CreateRegion(m_context.pMemory, CODE_BASE, CODE_SIZE);
+        m_context.pc = CODE_BASE;
+        m_context.xPSR = EPSR_T;
+        m_emitAddress = CODE_BASE;
+    }
+
+    void teardown()
+    {
+        clearExceptionCode();
+        MemorySim_Uninit(m_context.pMemory);
+    }
+
+    void emit(uint16_t instruction)
+    {
+        IMemory_Write16(m_context.pMemory, m_emitAddress, instruction);
+        m_emitAddress += 2;
+    }
+};
+
+
+TEST(fetchWindow, RunNOPsAcrossPageBoundary_ShouldStopAtBKPTInNextPage)
+{
+    m_emitAddress = CODE_BASE + 0x1000 - 4;
+    m_context.pc = m_emitAddress;
+    emit(NOP);
+    emit(NOP);
+    emit(NOP);
+    emit(BKPT);
+    CHECK_EQUAL(PINKYSIM_STEP_BKPT, pinkySimRun(&m_context, NULL));
+    CHECK_EQUAL(CODE_BASE + 0x1000 + 2, m_context.pc);
+}
+
+TEST(fetchWindow, RunOffEndOfRegion_ShouldHardFault)
+{
+    m_emitAddress = CODE_BASE + CODE_SIZE - 4;
+    m_context.pc = m_emitAddress;
+    emit(NOP);
+    emit(NOP);
+    CHECK_EQUAL(PINKYSIM_STEP_HARDFAULT, pinkySimRun(&m_context, NULL));
+    CHECK_EQUAL(CODE_BASE + CODE_SIZE, m_context.pc);
+}
+
+TEST(fetchWindow, WriteToCodeBetweenSteps_ShouldFetchNewInstruction)
+{
+    emit(NOP);
+    emit(NOP);
+    CHECK_EQUAL(PINKYSIM_STEP_OK, pinkySimStep(&m_context));
+    IMemory_Write16(m_context.pMemory, CODE_BASE + 2, BKPT);
+    CHECK_EQUAL(PINKYSIM_STEP_BKPT, pinkySimStep(&m_context));
+    CHECK_EQUAL(CODE_BASE + 2, m_context.pc);
+}
+
+TEST(fetchWindow, SetBreakpointInCurrentPageBetweenSteps_ShouldStopAtBreakpoint)
+{
+    emit(NOP);
+    emit(NOP);
+    emit(NOP);
+    emit(BKPT);
+    CHECK_EQUAL(PINKYSIM_STEP_OK, pinkySimStep(&m_context));
+    MemorySim_SetHardwareBreakpoint(m_context.pMemory, CODE_BASE + 4, sizeof(uint16_t));
+    CHECK_EQUAL(PINKYSIM_STEP_BKPT, pinkySimRun(&m_context, NULL));
+    CHECK_EQUAL(CODE_BASE + 4, m_context.pc);
+}
@@ -0,0 +1,216 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+// Common pairs of instructions are executed together by pinkySimRunBlocks().  These tests make sure that the results
+// match executing them one at a time.
+TEST_GROUP_BASE(instructionPair, pinkySimBase)
+{
+    void setup()
+    {
+        pinkySimBase::setup();
+        pinkySimEnableDecodeCache(&m_context);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 4, 0, READ_WRITE);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 8, 0, READ_WRITE);
+    }
+
+    void teardown()
+    {
+        pinkySimDisableDecodeCache(&m_context);
+        pinkySimBase::teardown();
+    }
+
+    void emitBKPT(uint32_t immediate)
+    {
+        emitInstruction16("10111110iiiiiiii", immediate);
+    }
+
+    void emitNOP()
+    {
+        emitInstruction16("1011111100000000");
+    }
+
+    void emitUND(uint32_t immediate)
+    {
+        emitInstruction16("11011110iiiiiiii", immediate);
+    }
+
+    void emitMOVSImmediate(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("00100dddiiiiiiii", Rd, immediate);
+    }
+
+    void emitLSLSImmediate(uint32_t Rd, uint32_t Rm, uint32_t immediate)
+    {
+        emitInstruction16("00000iiiiimmmddd", immediate, Rm, Rd);
+    }
+
+    void emitADDSImmediate(uint32_t Rdn, uint32_t immediate)
+    {
+        emitInstruction16("00110dddiiiiiiii", Rdn, immediate);
+    }
+
+    void emitSUBSImmediate(uint32_t Rdn, uint32_t immediate)
+    {
+        emitInstruction16("00111dddiiiiiiii", Rdn, immediate);
+    }
+
+    void emitCMPImmediate(uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("00101nnniiiiiiii", Rn, immediate);
+    }
+
+    void emitCMPRegister(uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0100001010mmmnnn", Rm, Rn);
+    }
+
+    void emitLDRLiteral(uint32_t Rt, uint32_t immediate)
+    {
+        emitInstruction16("01001tttiiiiiiii", Rt, immediate);
+    }
+
+    void emitLDRImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01101iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitBcc(uint32_t cond, int32_t offset)
+    {
+        emitInstruction16("1101cccciiiiiiii", cond, ((uint32_t)offset >> 1) & 0xFF);
+    }
+
+    void runBlocksAndValidate(int expectedResult)
+    {
+        int result = pinkySimRunBlocks(&m_context, NULL);
+        CHECK_EQUAL(expectedResult, result);
+        validateXPSR();
+        validateRegisters();
+    }
+};
+
+
+TEST(instructionPair, CMPImmediateAndBEQNotTaken)
+{
+    emitCMPImmediate(R0, 1);
+    emitBcc(COND_EQ, 0);
+    emitBKPT(0);
+    setExpectedXPSRflags("nzCV");
+    setRegisterValue(R0, 0x80000000);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, CMPRegisterAndBEQTaken)
+{
+    emitCMPRegister(R1, R2);
+    emitBcc(COND_EQ, 0);
+    emitUND(0);
+    emitBKPT(0);
+    setExpectedXPSRflags("nZCv");
+    setRegisterValue(R1, 0x12345678);
+    setRegisterValue(R2, 0x12345678);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, SUBSAndBNECountdownLoop)
+{
+    emitSUBSImmediate(R1, 1);
+    emitBcc(COND_NE, -6);
+    emitBKPT(0);
+    setExpectedXPSRflags("nZCv");
+    setRegisterValue(R1, 5);
+    setExpectedRegisterValue(R1, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, ADDSAndCMPLoopCounter)
+{
+    emitADDSImmediate(R0, 1);
+    emitCMPImmediate(R0, 10);
+    emitBcc(COND_NE, -8);
+    emitBKPT(0);
+    setExpectedXPSRflags("nZCv");
+    setRegisterValue(R0, 0);
+    setExpectedRegisterValue(R0, 10);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, MOVSAndLSLSConstantBuilding)
+{
+    emitMOVSImmediate(R0, 0x80);
+    emitLSLSImmediate(R0, R0, 24);
+    emitBKPT(0);
+    setExpectedXPSRflags("Nzc");
+    setExpectedRegisterValue(R0, 0x80000000);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, LDRLiteralAndLDRImmediate)
+{
+    emitLDRLiteral(R0, 2);
+    emitLDRImmediate(R1, R0, 0);
+    emitBKPT(0);
+    emitNOP();
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 12, INITIAL_PC + 16, READ_ONLY);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 16, 0xBAADFEED, READ_ONLY);
+    setExpectedRegisterValue(R0, INITIAL_PC + 16);
+    setExpectedRegisterValue(R1, 0xBAADFEED);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, LDRLiteralAndUnalignedLDRImmediate_ShouldFaultAtSecondInstruction)
+{
+    emitLDRLiteral(R0, 2);
+    emitLDRImmediate(R1, R0, 0);
+    emitBKPT(0);
+    emitNOP();
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 12, INITIAL_PC + 17, READ_ONLY);
+    setExpectedRegisterValue(R0, INITIAL_PC + 17);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runBlocksAndValidate(PINKYSIM_STEP_HARDFAULT);
+}
+
+TEST(instructionPair, BranchToSecondInstructionOfPair_ShouldOnlyExecuteSecondInstruction)
+{
+    emitMOVSImmediate(R0, 1);
+    emitLSLSImmediate(R2, R2, 1);
+    emitCMPImmediate(R2, 8);
+    emitBcc(COND_NE, -8);
+    emitBKPT(0);
+    setExpectedXPSRflags("nZCv");
+    setRegisterValue(R0, 0);
+    setRegisterValue(R2, 1);
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(R2, 8);
+    setExpectedRegisterValue(PC, INITIAL_PC + 8);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(instructionPair, WithCycleCountingEnabled_ShouldStillCountBothInstructions)
+{
+    pinkySimEnableCycleCounter(&m_context, 0, 0, 0);
+    emitCMPImmediate(R0, 1);
+    emitBcc(COND_EQ, 0);
+    emitBKPT(0);
+    setExpectedXPSRflags("nzCV");
+    setRegisterValue(R0, 0x80000000);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksAndValidate(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(2, m_context.cycleCounter.count);
+}
@@ -0,0 +1,607 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+// The loops in these tests iterate enough times for their blocks to be translated by the JIT on hosts which support
+// it.  On other hosts they just run through the interpreter.
+TEST_GROUP_BASE(jit, pinkySimBase)
+{
+    void setup()
+    {
+        pinkySimBase::setup();
+        pinkySimEnableDecodeCache(&m_context);
+        pinkySimEnableJit(&m_context);
+
+        /* Make room for a few more instructions and data around the word at INITIAL_PC. */
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC - 8, 0, READ_WRITE);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 4, 0, READ_WRITE);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 8, 0, READ_WRITE);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 12, 0, READ_WRITE);
+    }
+
+    void teardown()
+    {
+        pinkySimDisableDecodeCache(&m_context);
+        pinkySimBase::teardown();
+    }
+
+    void emitSUBSImmediateT1(uint32_t Rd, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("0001111iiinnnddd", immediate, Rn, Rd);
+    }
+
+    void emitSUBSImmediateT2(uint32_t Rdn, uint32_t immediate)
+    {
+        emitInstruction16("00111dddiiiiiiii", Rdn, immediate);
+    }
+
+    void emitLSRSImmediate(uint32_t Rd, uint32_t Rm, uint32_t immediate)
+    {
+        emitInstruction16("00001iiiiimmmddd", immediate, Rm, Rd);
+    }
+
+    void emitLSLSImmediate(uint32_t Rd, uint32_t Rm, uint32_t immediate)
+    {
+        emitInstruction16("00000iiiiimmmddd", immediate, Rm, Rd);
+    }
+
+    void emitLDRRegister(uint32_t Rt, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0101100mmmnnnttt", Rm, Rn, Rt);
+    }
+
+    void emitSTRHRegister(uint32_t Rt, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0101001mmmnnnttt", Rm, Rn, Rt);
+    }
+
+    void emitMOVImmediate(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("00100dddiiiiiiii", Rd, immediate);
+    }
+
+    void emitADDSImmediateT1(uint32_t Rd, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("0001110iiinnnddd", immediate, Rn, Rd);
+    }
+
+    void emitADDSImmediateT2(uint32_t Rdn, uint32_t immediate)
+    {
+        emitInstruction16("00110dddiiiiiiii", Rdn, immediate);
+    }
+
+    void emitADDSRegister(uint32_t Rd, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0001100mmmnnnddd", Rm, Rn, Rd);
+    }
+
+    void emitSUBSRegister(uint32_t Rd, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0001101mmmnnnddd", Rm, Rn, Rd);
+    }
+
+    void emitCMPImmediate(uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("00101nnniiiiiiii", Rn, immediate);
+    }
+
+    void emitCMPRegister(uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0100001010mmmnnn", Rm, Rn);
+    }
+
+    void emitCMNRegister(uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0100001011mmmnnn", Rm, Rn);
+    }
+
+    void emitANDSRegister(uint32_t Rdn, uint32_t Rm)
+    {
+        emitInstruction16("0100000000mmmddd", Rm, Rdn);
+    }
+
+    void emitEORSRegister(uint32_t Rdn, uint32_t Rm)
+    {
+        emitInstruction16("0100000001mmmddd", Rm, Rdn);
+    }
+
+    void emitADCSRegister(uint32_t Rdn, uint32_t Rm)
+    {
+        emitInstruction16("0100000101mmmddd", Rm, Rdn);
+    }
+
+    void emitTSTRegister(uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0100001000mmmnnn", Rm, Rn);
+    }
+
+    void emitORRSRegister(uint32_t Rdn, uint32_t Rm)
+    {
+        emitInstruction16("0100001100mmmddd", Rm, Rdn);
+    }
+
+    void emitBICSRegister(uint32_t Rdn, uint32_t Rm)
+    {
+        emitInstruction16("0100001110mmmddd", Rm, Rdn);
+    }
+
+    void emitMVNSRegister(uint32_t Rd, uint32_t Rm)
+    {
+        emitInstruction16("0100001111mmmddd", Rm, Rd);
+    }
+
+    void emitASRSImmediate(uint32_t Rd, uint32_t Rm, uint32_t immediate)
+    {
+        emitInstruction16("00010iiiiimmmddd", immediate, Rm, Rd);
+    }
+
+    void emitMOVRegister(uint32_t Rd, uint32_t Rm)
+    {
+        emitInstruction16("01000110dmmmmddd", Rd, Rm);
+    }
+
+    void emitADDSPT1(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("10101dddiiiiiiii", Rd, immediate >> 2);
+    }
+
+    void emitADDSPT2(uint32_t immediate)
+    {
+        emitInstruction16("101100000iiiiiii", immediate >> 2);
+    }
+
+    void emitSUBSP(uint32_t immediate)
+    {
+        emitInstruction16("101100001iiiiiii", immediate >> 2);
+    }
+
+    void emitADR(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("10100dddiiiiiiii", Rd, immediate >> 2);
+    }
+
+    void emitLDRLiteral(uint32_t Rt, uint32_t immediate)
+    {
+        emitInstruction16("01001tttiiiiiiii", Rt, immediate >> 2);
+    }
+
+    void emitLDRSP(uint32_t Rt, uint32_t immediate)
+    {
+        emitInstruction16("10011tttiiiiiiii", Rt, immediate >> 2);
+    }
+
+    void emitSTRSP(uint32_t Rt, uint32_t immediate)
+    {
+        emitInstruction16("10010tttiiiiiiii", Rt, immediate >> 2);
+    }
+
+    void emitLDRBImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01111iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitSTRBImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01110iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitLDRHImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("10001iiiiinnnttt", immediate >> 1, Rn, Rt);
+    }
+
+    void emitSTRHImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("10000iiiiinnnttt", immediate >> 1, Rn, Rt);
+    }
+
+    void emitLDRHRegister(uint32_t Rt, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0101101mmmnnnttt", Rm, Rn, Rt);
+    }
+
+    void emitSTRBRegister(uint32_t Rt, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0101010mmmnnnttt", Rm, Rn, Rt);
+    }
+
+    void emitSTRRegister(uint32_t Rt, uint32_t Rn, uint32_t Rm)
+    {
+        emitInstruction16("0101000mmmnnnttt", Rm, Rn, Rt);
+    }
+
+    void emitB(int32_t offset)
+    {
+        emitInstruction16("11100iiiiiiiiiii", (uint32_t)offset >> 1);
+    }
+
+    void emitBranch(uint32_t cond, int32_t offset)
+    {
+        emitInstruction16("1101cccciiiiiiii", cond, (uint32_t)offset >> 1);
+    }
+
+    void emitBKPT(uint32_t immediate)
+    {
+        emitInstruction16("10111110iiiiiiii", immediate);
+    }
+
+    int32_t offsetTo(uint32_t target)
+    {
+        return (int32_t)(target - (m_emitAddress + 4));
+    }
+
+    void runAndValidate(int expectedResult)
+    {
+        int result = pinkySimRunBlocks(&m_context, NULL);
+        CHECK_EQUAL(expectedResult, result);
+        validateXPSR();
+        validateRegisters();
+    }
+
+    void runAndCompareWithInterpreter(int expectedResult)
+    {
+        PinkySimContext initialContext = m_context;
+
+        // The interpreter provides the state which the translated code must end up in.
+        pinkySimDisableJit(&m_context);
+        CHECK_EQUAL(expectedResult, pinkySimRunBlocks(&m_context, NULL));
+        memcpy(m_expectedRegisterValues, m_context.R, sizeof(m_expectedRegisterValues));
+        m_expectedSPmain = m_context.spMain;
+        m_expectedLR = m_context.lr;
+        m_expectedPC = m_context.pc;
+        m_expectedXPSRflags = m_context.xPSR & (APSR_NZCV | EPSR_T);
+
+        memcpy(m_context.R, initialContext.R, sizeof(m_context.R));
+        m_context.spMain = initialContext.spMain;
+        m_context.lr = initialContext.lr;
+        m_context.pc = initialContext.pc;
+        m_context.xPSR = initialContext.xPSR;
+        pinkySimEnableJit(&m_context);
+        runAndValidate(expectedResult);
+    }
+
+    void runForAndValidate(uint64_t maxInstructions, int expectedResult, uint64_t expectedRetired)
+    {
+        uint64_t retired = ~0ULL;
+        int      result = pinkySimRunBlocksFor(&m_context, NULL, maxInstructions, &retired);
+        CHECK_EQUAL(expectedResult, result);
+        CHECK_EQUAL(expectedRetired, retired);
+        validateXPSR();
+        validateRegisters();
+    }
+};
+
+
+TEST(jit, CountdownLoop_ShouldEndWithSameStateAsInterpreter)
+{
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setExpectedXPSRflags("nZCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(jit, FaultInMiddleOfTranslatedBlock_ShouldStopAtFaultingInstructionWithEarlierResultsCommitted)
+{
+    // R4 is 0 until R0 reaches 0 and then becomes 1 to trigger an unaligned LDR.
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitLDRRegister(R2, R3, R4);
+    emitSUBSImmediateT2(R0, 1);
+    emitB(offsetTo(INITIAL_PC));
+    setRegisterValue(R0, 30);
+    setRegisterValue(R3, INITIAL_PC);
+    setExpectedXPSRflags("nzCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(R2, IMemory_Read32(m_context.pMemory, INITIAL_PC));
+    setExpectedRegisterValue(R4, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_HARDFAULT);
+}
+
+TEST(jit, StoreOverLaterInstructionOfTranslatedBlock_ShouldExecuteNewInstruction)
+{
+    // R4 is 0 until R0 reaches 0 and then becomes 16 to redirect the STRH from data onto the MOVS which follows it.
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitLSLSImmediate(R4, R4, 4);
+    emitSTRHRegister(R1, R2, R4);
+    emitMOVImmediate(R5, 1);
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_PL, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 20);
+    setRegisterValue(R1, 0x2502);
+    setRegisterValue(R2, INITIAL_PC - 8);
+    setExpectedXPSRflags("Nzcv");
+    setExpectedRegisterValue(R0, 0xFFFFFFFF);
+    setExpectedRegisterValue(R4, 16);
+    setExpectedRegisterValue(R5, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 14);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(0x2502, IMemory_Read16(m_context.pMemory, INITIAL_PC - 8));
+}
+
+TEST(jit, StoreOverLaterInstructionOfTranslatedBlockWithInstructionLimit_ShouldCountStoreOnce)
+{
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitLSLSImmediate(R4, R4, 4);
+    emitSTRHRegister(R1, R2, R4);
+    emitMOVImmediate(R5, 1);
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_PL, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 20);
+    setRegisterValue(R1, 0x2502);
+    setRegisterValue(R2, INITIAL_PC - 8);
+    setExpectedXPSRflags("Nzcv");
+    setExpectedRegisterValue(R0, 0xFFFFFFFF);
+    setExpectedRegisterValue(R4, 16);
+    setExpectedRegisterValue(R5, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 14);
+    runForAndValidate(1000, PINKYSIM_STEP_BKPT, 21 * 7);
+}
+
+TEST(jit, FlushAfterTranslation_ShouldRetranslateModifiedCode)
+{
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setExpectedXPSRflags("nZCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+
+    m_emitAddress = INITIAL_PC;
+    emitSUBSImmediateT2(R1, 1);
+    pinkySimFlushDecodeCache(&m_context);
+    setRegisterValue(PC, INITIAL_PC);
+    setRegisterValue(R0, 100);
+    setRegisterValue(R1, 50);
+    setExpectedRegisterValue(R0, 100);
+    setExpectedRegisterValue(R1, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(jit, EnableWithoutDecodeCache_ShouldBeIgnored)
+{
+    pinkySimDisableDecodeCache(&m_context);
+    pinkySimEnableJit(&m_context);
+    POINTERS_EQUAL(NULL, m_context.pDecodeCache);
+}
+
+TEST(jit, DisableJit_ShouldKeepRunningThroughInterpreter)
+{
+    pinkySimDisableJit(&m_context);
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setExpectedXPSRflags("nZCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(jit, CountdownLoopWithInstructionLimit_ShouldStopPartWayThroughTranslatedBlock)
+{
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setExpectedXPSRflags("nzCv");
+    setExpectedRegisterValue(R0, 69);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runForAndValidate(61, PINKYSIM_RUN_LIMIT, 61);
+}
+
+TEST(jit, FaultInMiddleOfTranslatedBlockWithInstructionLimit_ShouldCountInstructionsBeforeFault)
+{
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitLDRRegister(R2, R3, R4);
+    emitSUBSImmediateT2(R0, 1);
+    emitB(offsetTo(INITIAL_PC));
+    setRegisterValue(R0, 30);
+    setRegisterValue(R3, INITIAL_PC);
+    setExpectedXPSRflags("nzCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(R2, IMemory_Read32(m_context.pMemory, INITIAL_PC));
+    setExpectedRegisterValue(R4, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runForAndValidate(1000, PINKYSIM_STEP_HARDFAULT, 30 * 5 + 2);
+}
+
+TEST(jit, TranslatedArithmeticInstructions_ShouldEndWithSameStateAsInterpreter)
+{
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 16, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 20, 0, READ_WRITE);
+    emitMOVImmediate(R1, 200);
+    emitADDSImmediateT1(R2, R1, 5);
+    emitADDSImmediateT2(R2, 77);
+    emitSUBSRegister(R3, R2, R0);
+    emitADDSRegister(R4, R4, R3);
+    emitLSRSImmediate(R5, R3, 0);
+    emitMOVRegister(R6, PC);
+    emitSUBSImmediateT2(R0, 1);
+    emitCMPImmediate(R0, 0);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setRegisterValue(R4, 0x7FFFF000);
+    runAndCompareWithInterpreter(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(0, m_context.R[R0]);
+    CHECK_EQUAL(INITIAL_PC + 20, m_context.pc);
+}
+
+TEST(jit, TranslatedLogicalAndMoveInstructions_ShouldEndWithSameStateAsInterpreter)
+{
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 16, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 20, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 24, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 28, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 32, 0, READ_WRITE);
+    emitADDSRegister(R1, R1, R0);
+    emitASRSImmediate(R2, R1, 3);
+    emitEORSRegister(R2, R0);
+    emitMVNSRegister(R3, R2);
+    emitORRSRegister(R3, R1);
+    emitBICSRegister(R3, R0);
+    emitANDSRegister(R3, R2);
+    emitMOVRegister(R8, R3);
+    emitMOVRegister(R4, R8);
+    emitCMNRegister(R1, R2);
+    emitADCSRegister(R4, R1);
+    emitCMPRegister(R1, R3);
+    emitADCSRegister(R4, R2);
+    emitADR(R7, 4);
+    emitSUBSImmediateT2(R0, 1);
+    emitTSTRegister(R0, R5);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setRegisterValue(R1, 0x80000000);
+    setRegisterValue(R5, 0xFFFFFFFF);
+    runAndCompareWithInterpreter(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(0, m_context.R[R0]);
+    CHECK_EQUAL(INITIAL_PC + 34, m_context.pc);
+}
+
+TEST(jit, TranslatedLoadAndStoreInstructions_ShouldEndWithSameStateAsInterpreter)
+{
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 16, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 20, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 24, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 28, 0, READ_WRITE);
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 32, 0x12345678, READ_WRITE);
+    emitLDRLiteral(R1, 28);
+    emitSUBSRegister(R1, R1, R0);
+    emitSTRSP(R1, 8);
+    emitLDRBImmediate(R2, R3, 1);
+    emitSTRBImmediate(R2, R3, 2);
+    emitLDRHImmediate(R4, R3, 2);
+    emitSTRHImmediate(R4, R3, 0);
+    emitLDRSP(R5, 8);
+    emitLDRHRegister(R6, R3, R7);
+    emitSTRBRegister(R6, R3, R7);
+    emitSUBSP(8);
+    emitADDSPT1(R2, 16);
+    emitADDSPT2(8);
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitBKPT(0);
+    setRegisterValue(R0, 100);
+    setRegisterValue(R3, INITIAL_PC - 8);
+    setRegisterValue(R7, 2);
+    setRegisterValue(SP, INITIAL_PC - 16);
+    runAndCompareWithInterpreter(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(0x12561256, IMemory_Read32(m_context.pMemory, INITIAL_PC - 8));
+    CHECK_EQUAL(INITIAL_PC - 16, m_context.spMain);
+}
+
+TEST(jit, FaultOnStoreInMiddleOfTranslatedBlock_ShouldStopAtStoreWithEarlierResultsCommitted)
+{
+    // R4 is 0 until R0 reaches 0 and then becomes 1 to trigger an unaligned STR.
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitSTRRegister(R2, R3, R4);
+    emitSUBSImmediateT2(R0, 1);
+    emitB(offsetTo(INITIAL_PC));
+    setRegisterValue(R0, 30);
+    setRegisterValue(R2, 0xBAADF00D);
+    setRegisterValue(R3, INITIAL_PC - 8);
+    setExpectedXPSRflags("nzCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(R4, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runForAndValidate(1000, PINKYSIM_STEP_HARDFAULT, 30 * 5 + 2);
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_context.pMemory, INITIAL_PC - 8));
+}
+
+TEST(jit, StoreToReadOnlyMemoryAfterTranslatedStoresToRAM_ShouldHardFaultAtStore)
+{
+    // R4 is 0 until R0 reaches 0 and then becomes 32 to redirect the STR from RAM onto a read-only word.
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 24, 0, READ_ONLY);
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitLSLSImmediate(R4, R4, 5);
+    emitSTRRegister(R2, R3, R4);
+    emitSUBSImmediateT2(R0, 1);
+    emitB(offsetTo(INITIAL_PC));
+    setRegisterValue(R0, 30);
+    setRegisterValue(R2, 0xBAADF00D);
+    setRegisterValue(R3, INITIAL_PC - 8);
+    setExpectedXPSRflags("nzcv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(R4, 32);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+    runAndValidate(PINKYSIM_STEP_HARDFAULT);
+    CHECK_EQUAL(0xBAADF00D, IMemory_Read32(m_context.pMemory, INITIAL_PC - 8));
+    CHECK_EQUAL(0, IMemory_Read32(m_context.pMemory, INITIAL_PC + 24));
+}
+
+TEST(jit, TranslatedStoresToDataWhichIsThenExecuted_ShouldInvalidateItWhenStoredAgain)
+{
+    // The translated loop writes MOVS R5, #1 into INITIAL_PC - 8 before anything there has been decoded.  It then runs
+    // it, goes around once more to write MOVS R5, #2 over it and runs that.
+    emitSTRHImmediate(R1, R2, 0);
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_NE, offsetTo(INITIAL_PC));
+    emitB(offsetTo(INITIAL_PC - 8));
+    emitMOVImmediate(R0, 1);
+    emitADDSImmediateT2(R1, 1);
+    emitB(offsetTo(INITIAL_PC));
+    m_emitAddress = INITIAL_PC - 6;
+    emitB(offsetTo(INITIAL_PC + 8));
+    setRegisterValue(R0, 30);
+    setRegisterValue(R1, 0x2501);
+    setRegisterValue(R2, INITIAL_PC - 8);
+    setExpectedXPSRflags("nzCv");
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(R1, 0x2502);
+    setExpectedRegisterValue(R5, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC - 6);
+    runForAndValidate(101, PINKYSIM_RUN_LIMIT, 101);
+}
+
+TEST(jit, TranslatedStoresNextToCachedCode_ShouldStillInvalidateItWhenStoredOver)
+{
+    // R4 is 0 until R0 reaches 0 and then becomes 2 to redirect the STRH from the halfword at INITIAL_PC - 8 onto the
+    // branch after it, which has already been executed, turning it into a BKPT.
+    m_emitAddress = INITIAL_PC - 6;
+    emitB(offsetTo(INITIAL_PC));
+    m_emitAddress = INITIAL_PC;
+    emitSUBSImmediateT1(R4, R0, 1);
+    emitLSRSImmediate(R4, R4, 31);
+    emitLSLSImmediate(R4, R4, 1);
+    emitSTRHRegister(R1, R2, R4);
+    emitSUBSImmediateT2(R0, 1);
+    emitBranch(COND_PL, offsetTo(INITIAL_PC));
+    emitB(offsetTo(INITIAL_PC - 6));
+    setRegisterValue(PC, INITIAL_PC - 6);
+    setRegisterValue(R0, 30);
+    setRegisterValue(R1, 0xBE00);
+    setRegisterValue(R2, INITIAL_PC - 8);
+    setExpectedXPSRflags("Nzcv");
+    setExpectedRegisterValue(R0, 0xFFFFFFFF);
+    setExpectedRegisterValue(R4, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC - 6);
+    runForAndValidate(1000, PINKYSIM_STEP_BKPT, 188);
+    CHECK_EQUAL(0xBE00BE00, IMemory_Read32(m_context.pMemory, INITIAL_PC - 8));
+}
@@ -0,0 +1,176 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+static uint32_t g_xPSRSeenByCallback;
+
+static int recordFlagsCallback(PinkySimContext* pContext)
+{
+    g_xPSRSeenByCallback = pContext->xPSR & APSR_NZCV;
+    return PINKYSIM_STEP_OK;
+}
+
+
+// Flag setting instructions only record their operands.  These tests make sure that the flags are still correct when
+// several flag setting instructions are executed back to back before anything reads them.
+TEST_GROUP_BASE(lazyFlags, pinkySimBase)
+{
+    void setup()
+    {
+        pinkySimBase::setup();
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 4, 0, READ_WRITE);
+        g_xPSRSeenByCallback = 0;
+    }
+
+    void teardown()
+    {
+        pinkySimBase::teardown();
+    }
+
+    void emitADDSImmediate(uint32_t Rd, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("0001110iiinnnddd", immediate, Rn, Rd);
+    }
+
+    void emitMOVSImmediate(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("00100dddiiiiiiii", Rd, immediate);
+    }
+
+    void emitLSLSImmediate(uint32_t Rd, uint32_t Rm, uint32_t immediate)
+    {
+        emitInstruction16("00000iiiiimmmddd", immediate, Rm, Rd);
+    }
+
+    void emitCMPImmediate(uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("00101nnniiiiiiii", Rn, immediate);
+    }
+
+    void emitBEQ(int32_t offset)
+    {
+        emitInstruction16("1101cccciiiiiiii", COND_EQ, (uint32_t)offset >> 1);
+    }
+
+    void emitMRS(uint32_t Rd, uint32_t SYSm)
+    {
+        emitInstruction32("1111001111101111", "1000ddddssssssss", Rd, SYSm);
+    }
+
+    void emitUND(uint32_t immediate)
+    {
+        emitInstruction16("11011110iiiiiiii", immediate);
+    }
+
+    void emitBKPT(uint32_t immediate)
+    {
+        emitInstruction16("10111110iiiiiiii", immediate);
+    }
+
+    void runAndValidate(int (*callback)(PinkySimContext*), int expectedResult)
+    {
+        int result = pinkySimRun(&m_context, callback);
+        CHECK_EQUAL(expectedResult, result);
+        validateXPSR();
+        validateRegisters();
+    }
+};
+
+
+TEST(lazyFlags, ADDSThenMOVS_ShouldKeepCarryAndOverflowFromADDS)
+{
+    emitADDSImmediate(R0, R1, 1);
+    emitMOVSImmediate(R2, 0);
+    emitBKPT(0);
+    setRegisterValue(R1, 0x7FFFFFFF);
+    setExpectedRegisterValue(R0, 0x80000000);
+    setExpectedRegisterValue(R2, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    setExpectedXPSRflags("nZcV");
+        runAndValidate(NULL, PINKYSIM_STEP_BKPT);
+}
+
+TEST(lazyFlags, ADDSThenLSLS_ShouldTakeCarryFromShiftAndOverflowFromADDS)
+{
+    emitADDSImmediate(R0, R1, 1);
+    emitLSLSImmediate(R2, R4, 1);
+    emitBKPT(0);
+    setRegisterValue(R1, 0x7FFFFFFF);
+    setRegisterValue(R4, 0x80000000);
+    setExpectedRegisterValue(R0, 0x80000000);
+    setExpectedRegisterValue(R2, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    setExpectedXPSRflags("nZCV");
+        runAndValidate(NULL, PINKYSIM_STEP_BKPT);
+}
+
+TEST(lazyFlags, LSLSThenADDS_ShouldTakeCarryFromADDS)
+{
+    emitLSLSImmediate(R2, R4, 1);
+    emitADDSImmediate(R0, R1, 1);
+    emitBKPT(0);
+    setRegisterValue(R4, 0x80000000);
+    setRegisterValue(R1, 1);
+    setExpectedRegisterValue(R2, 0);
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    setExpectedXPSRflags("nzcv");
+        runAndValidate(NULL, PINKYSIM_STEP_BKPT);
+}
+
+TEST(lazyFlags, CMPThenBEQ_ShouldSeeZeroFlagFromCMP)
+{
+    emitCMPImmediate(R0, 0);
+    emitBEQ(0);
+    emitUND(0);
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+    setExpectedXPSRflags("nZCv");
+        runAndValidate(NULL, PINKYSIM_STEP_BKPT);
+}
+
+TEST(lazyFlags, ADDSThenMRS_ShouldReadPendingFlags)
+{
+    emitADDSImmediate(R0, R1, 1);
+    emitMRS(R2, SYS_APSR);
+    emitBKPT(0);
+    setRegisterValue(R1, 0x7FFFFFFF);
+    setExpectedRegisterValue(R0, 0x80000000);
+    setExpectedRegisterValue(R2, APSR_N | APSR_V);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+    setExpectedXPSRflags("NzcV");
+        runAndValidate(NULL, PINKYSIM_STEP_BKPT);
+}
+
+TEST(lazyFlags, Callback_ShouldSeeFlagsFromPreviousInstruction)
+{
+    emitADDSImmediate(R0, R1, 1);
+    emitBKPT(0);
+    setRegisterValue(R1, 0xFFFFFFFF);
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    setExpectedXPSRflags("nZCv");
+        runAndValidate(recordFlagsCallback, PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(APSR_Z | APSR_C, g_xPSRSeenByCallback);
+}
+
+TEST(lazyFlags, FaultAfterADDS_ShouldStillReturnFlagsFromADDS)
+{
+    emitADDSImmediate(R0, R1, 1);
+    emitUND(0);
+    setRegisterValue(R1, 0xFFFFFFFF);
+    setExpectedRegisterValue(R0, 0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    setExpectedXPSRflags("nZCv");
+        runAndValidate(NULL, PINKYSIM_STEP_UNDEFINED);
+}
@@ -12,6 +12,7 @@
 */
 #include <signal.h>
 #include <mri.h>
+#include <NewlibSemihost.h>
 #include "mri4simBaseTest.h"
 
 TEST_GROUP_BASE(memoryTests, mri4simBase)
@@ -34,7 +35,7 @@ TEST(memoryTests, ReadByte)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,1#", INITIAL_SP - 1);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$5a#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -46,7 +47,7 @@ TEST(memoryTests, ReadHalfWord)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,2#", INITIAL_SP - 2);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$0df0#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -58,7 +59,7 @@ TEST(memoryTests, ReadWord)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,4#", INITIAL_SP - 4);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$0df0adba#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -69,7 +70,7 @@ TEST(memoryTests, WriteByte)
     char command[64];
     snprintf(command, sizeof(command), "+$M%x,1:5A#", INITIAL_SP - 1);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -81,7 +82,7 @@ TEST(memoryTests, WriteHalfWord)
     char command[64];
     snprintf(command, sizeof(command), "+$M%x,2:0DF0#", INITIAL_SP - 2);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -93,7 +94,7 @@ TEST(memoryTests, WriteWord)
     char command[64];
     snprintf(command, sizeof(command), "+$M%x,4:0DF0ADBA#", INITIAL_SP - 4);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -105,7 +106,7 @@ TEST(memoryTests, ReadByte_InvalidAddress_ShouldSendNoDataBack)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,1#", INITIAL_SP);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -116,7 +117,7 @@ TEST(memoryTests, ReadHalfWord_InvalidAddress_ShouldSendNoDataBack)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,2#", INITIAL_SP);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -127,7 +128,7 @@ TEST(memoryTests, ReadWord_InvalidAddress_ShouldSendNoDataBack)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,4#", INITIAL_SP);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -138,7 +139,7 @@ TEST(memoryTests, ReadBytes_InvalidAddressForLastByte_ShouldSendPartialDataBack)
     char command[64];
     snprintf(command, sizeof(command), "+$m%x,8#", INITIAL_SP - 7);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$00000000000000#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -149,7 +150,7 @@ TEST(memoryTests, WriteByte_InvalidAddress_ShouldSendErrorBack)
     char command[64];
     snprintf(command, sizeof(command), "+$M%x,1:5A#", INITIAL_SP);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_MEMORY_ACCESS_FAILURE "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -160,7 +161,7 @@ TEST(memoryTests, WriteHalfWord_InvalidAddress_ShouldSendErrorBack)
     char command[64];
     snprintf(command, sizeof(command), "+$M%x,2:BAAD#", INITIAL_SP);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_MEMORY_ACCESS_FAILURE "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -171,8 +172,27 @@ TEST(memoryTests, WriteWord_InvalidAddress_ShouldSendErrorBack)
     char command[64];
     snprintf(command, sizeof(command), "+$M%x,4:BAADF00D#", INITIAL_SP);
     mockIComm_InitReceiveChecksummedData(command, "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_MEMORY_ACCESS_FAILURE "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
-}
\ No newline at end of file
+}
+
+TEST(memoryTests, WriteOverAlreadyExecutedInstruction_ShouldRunNewInstructionAfterContinue)
+{
+    emitNOP();
+    emitBKPT(0);
+    /* Branch back to INITIAL_PC. */
+    emitInstruction16("11100iiiiiiiiiii", -4 & 0x7FF);
+    uint16_t exitInstruction = 0xbe00 | NEWLIB_EXIT;
+    char command[64];
+    snprintf(command, sizeof(command), "+$M%x,2:%02x%02x#", INITIAL_PC, exitInstruction & 0xFF, exitInstruction >> 8);
+    mockIComm_InitReceiveChecksummedData(command, "+$c#");
+    mockIComm_DelayReceiveData(2);
+        mri4simRun(m_pSim, FALSE);
+    appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
+    appendExpectedString("+$OK#+");
+    STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simDidProgramExit(m_pSim));
+    CHECK_EQUAL(INITIAL_PC, m_pContext->pc);
+}
@@ -99,6 +99,17 @@ TEST(mockSock, select_ReturnNegative1)
     CHECK_EQUAL(-1, select(-1, NULL, NULL, NULL, NULL));
 }
 
+TEST(mockSock, fcntl_DefaultToReturnNegative1)
+{
+    CHECK_EQUAL(-1, fcntl(-1, F_GETFL));
+}
+
+TEST(mockSock, fcntl_ReturnZero)
+{
+    mockSock_fcntlSetReturn(0);
+    CHECK_EQUAL(0, fcntl(-1, F_SETFL, O_ASYNC));
+}
+
 TEST(mockSock, close_CallWithInvalidParams_ShouldBeIgnored)
 {
     CHECK_EQUAL(0, close(-1));
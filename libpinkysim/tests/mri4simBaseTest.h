@@ -37,6 +37,7 @@ class mri4simBase : public Utest
 {
 protected:
     IMemory*         m_pMemory;
+    Mri4Sim*         m_pSim;
     PinkySimContext* m_pContext;
     uint32_t         m_emitAddress;
     char             m_buffer[2048];
@@ -48,8 +49,8 @@ protected:
         static const uint32_t flashImage[] = { INITIAL_SP, INITIAL_PC | 1 };
         m_pMemory = MemorySim_Init();
         MemorySim_CreateRegionsFromFlashImage(m_pMemory, flashImage, sizeof(flashImage));
-        mri4simInit(m_pMemory);
-        m_pContext = mri4simGetContext();
+        m_pSim = mri4simInit(m_pMemory, mockIComm_Get());
+        m_pContext = mri4simGetContext(m_pSim);
 
         /* Setup to buffer a maximum of 1024 characters sent by MRI. */
         mockIComm_InitTransmitDataBuffer(1024);
@@ -72,6 +73,7 @@ protected:
     void teardown()
     {
         printfSpy_Unhook();
+        mri4simUninit(m_pSim);
         MemorySim_Uninit(m_pMemory);
         mockIComm_Uninit();
     }
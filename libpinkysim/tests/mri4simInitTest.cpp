@@ -25,15 +25,18 @@ extern "C"
 TEST_GROUP(mri4simInit)
 {
     IMemory* m_pMem;
+    Mri4Sim* m_pSim;
 
     void setup()
     {
+        m_pSim = NULL;
         m_pMem = MemorySim_Init();
     }
 
     void teardown()
     {
         CHECK_EQUAL(noException, getExceptionCode());
+        mri4simUninit(m_pSim);
         MemorySim_Uninit(m_pMem);
         clearExceptionCode();
     }
@@ -44,7 +47,7 @@ TEST(mri4simInit, ResetVectorNotAvailable_ShouldThrowBusError)
 {
     MemorySim_CreateRegion(m_pMem, FLASH_BASE_ADDRESS, sizeof(uint32_t));
     MemorySim_MakeRegionReadOnly(m_pMem, FLASH_BASE_ADDRESS);
-        __try_and_catch ( mri4simInit(m_pMem) );
+        __try_and_catch ( m_pSim = mri4simInit(m_pMem, NULL) );
     CHECK_EQUAL(busErrorException, getExceptionCode());
     clearExceptionCode();
 }
@@ -53,7 +56,7 @@ TEST(mri4simInit, InitialStackValueNotAvailable_ShouldThrowBusError)
 {
     MemorySim_CreateRegion(m_pMem, FLASH_BASE_ADDRESS, sizeof(uint32_t) - 1);
     MemorySim_MakeRegionReadOnly(m_pMem, FLASH_BASE_ADDRESS);
-        __try_and_catch ( mri4simInit(m_pMem) );
+        __try_and_catch ( m_pSim = mri4simInit(m_pMem, NULL) );
     CHECK_EQUAL(busErrorException, getExceptionCode());
     clearExceptionCode();
 }
@@ -62,9 +65,8 @@ TEST(mri4simInit, ShouldInitializeContextSPandPCfromFirstTwoFlashWordsAndRestOfR
 {
     uint32_t flashVectors[] = {0x10008000, 0x00000101};
     MemorySim_CreateRegionsFromFlashImage(m_pMem, flashVectors, sizeof(flashVectors));
-    PinkySimContext* pContext = mri4simGetContext();
-    memset(pContext, 0xFF, sizeof(*pContext));
-        mri4simInit(m_pMem);
+        m_pSim = mri4simInit(m_pMem, NULL);
+    PinkySimContext* pContext = mri4simGetContext(m_pSim);
     CHECK_EQUAL(0x10008000, pContext->spMain);
     CHECK_EQUAL(0x00000100, pContext->pc);
     for (int i = 0 ; i <= 12 ; i++)
@@ -78,7 +80,7 @@ TEST(mri4simInit, MriCoreShouldBeSuccessfullyInitialized)
 {
     uint32_t flashVectors[] = {0x10008000, 0x00000101};
     MemorySim_CreateRegionsFromFlashImage(m_pMem, flashVectors, sizeof(flashVectors));
-        mri4simInit(m_pMem);
+        m_pSim = mri4simInit(m_pMem, NULL);
     CHECK_TRUE( IsFirstException() );
     CHECK_TRUE( WasSuccessfullyInit() );
 }
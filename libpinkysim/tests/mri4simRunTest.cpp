@@ -11,9 +11,12 @@
     GNU General Public License for more details.
 */
 #include <signal.h>
+#include <stdio.h>
 #include <NewlibSemihost.h>
 #include "mri4simBaseTest.h"
 
+static const char* g_stateFilename = "mri4simRunTest.state";
+
 TEST_GROUP_BASE(mri4simRun, mri4simBase)
 {
     void setup()
@@ -23,6 +26,7 @@ TEST_GROUP_BASE(mri4simRun, mri4simBase)
 
     void teardown()
     {
+        remove(g_stateFilename);
         mri4simBase::teardown();
     }
 };
@@ -31,7 +35,7 @@ TEST_GROUP_BASE(mri4simRun, mri4simBase)
 TEST(mri4simRun, QueueUpDebuggerContinueCommand_ShouldInterruptSimAndGoStraightToMri)
 {
     mockIComm_InitReceiveChecksummedData("+$c#");
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedTPacket(SIGINT, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -44,7 +48,7 @@ TEST(mri4simRun, DontInterruptSimAndLetRunToBreakpoint_SendContinue_ShouldAdvanc
     emitBKPT(0);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -57,7 +61,7 @@ TEST(mri4simRun, BreakOnStart_SendContinue)
     emitBKPT(0);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -72,7 +76,7 @@ TEST(mri4simRun, BreakOnStart_SendContinueWithSpecificAddressToSkipSomeInstructi
     char commands[64];
     snprintf(commands, sizeof(commands), "+$c%x#", INITIAL_PC + 4);
     mockIComm_InitReceiveChecksummedData(commands);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -82,7 +86,7 @@ TEST(mri4simRun, BreakOnStart_SendContinueWithSpecificAddressToSkipSomeInstructi
 TEST(mri4simRun, IssueExitSemihostCall_ShouldExitRunLoopImmediately_NotEnterDebugger)
 {
     emitBKPT(NEWLIB_EXIT);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL(INITIAL_PC, m_pContext->pc);
 }
@@ -94,7 +98,7 @@ TEST(mri4simRun, UnalignedAccess_WillHardfault_ShouldStopImmediately_DumpHardFau
     setRegisterValue(R3, INITIAL_PC + 2);
     mockIComm_InitReceiveChecksummedData("++$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedOPacket(expectedMessage);
     appendExpectedTPacket(SIGSEGV, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
@@ -110,7 +114,7 @@ TEST(mri4simRun, InvalidMemoryAddress_WillHardfault_ShouldStopImmediately_DumpHa
     setRegisterValue(R3, 0xFFFFFFFC);
     mockIComm_InitReceiveChecksummedData("++$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedOPacket(expectedMessage);
     appendExpectedTPacket(SIGSEGV, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
@@ -125,7 +129,7 @@ TEST(mri4simRun, UndefinedInstruction_ShouldStopImmediately_DumpUndefinedMessage
     emitUND(0);
     mockIComm_InitReceiveChecksummedData("++$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedOPacket(expectedMessage);
     appendExpectedTPacket(SIGILL, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
@@ -140,7 +144,7 @@ TEST(mri4simRun, UnpredictableInstruction_ShouldStopImmediately_DumpUnpredictabl
     emitInstruction16("0100010100000000");
     mockIComm_InitReceiveChecksummedData("++$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedOPacket(expectedMessage);
     appendExpectedTPacket(SIGILL, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
@@ -155,7 +159,7 @@ TEST(mri4simRun, UnsupportedInstruction_ShouldStopAfter_DumpUnsupportedMessage)
     emitYIELD();
     mockIComm_InitReceiveChecksummedData("++$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedOPacket(expectedMessage);
     appendExpectedTPacket(SIGILL, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
     appendExpectedString("+");
@@ -170,7 +174,7 @@ TEST(mri4simRun, UnsupportedSVCInstruction_ShouldStopAfter_DumpUnsupportedMessag
     emitSVC(0);
     mockIComm_InitReceiveChecksummedData("++$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedOPacket(expectedMessage);
     appendExpectedTPacket(SIGILL, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
     appendExpectedString("+");
@@ -178,3 +182,137 @@ TEST(mri4simRun, UnsupportedSVCInstruction_ShouldStopAfter_DumpUnsupportedMessag
     STRCMP_EQUAL(expectedMessage, printfSpy_GetLastOutput());
     CHECK_EQUAL(INITIAL_PC + 2, m_pContext->pc);
 }
+
+TEST(mri4simRun, InstructionLimitReached_ShouldExitRunLoop_NotEnterDebugger)
+{
+    emitInstruction16("11100iiiiiiiiiii", -2 & 0x7FF);
+    mri4simSetInstructionLimit(m_pSim, 100);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simWasInstructionLimitReached(m_pSim));
+    CHECK_EQUAL(INITIAL_PC, m_pContext->pc);
+}
+
+TEST(mri4simRun, ExitBeforeInstructionLimit_ShouldNotReportLimitReached)
+{
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    mri4simSetInstructionLimit(m_pSim, 100);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_FALSE(mri4simWasInstructionLimitReached(m_pSim));
+    CHECK_EQUAL(INITIAL_PC + 2, m_pContext->pc);
+}
+
+TEST(mri4simRun, SaveStateAt_ShouldSaveAndCarryOnWithoutEnteringDebugger)
+{
+    emitNOP();
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    mri4simSaveStateAt(m_pSim, g_stateFilename, INITIAL_PC + 2);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simDidProgramExit(m_pSim));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pContext->pMemory, INITIAL_PC + 2));
+    FILE* pFile = fopen(g_stateFilename, "r");
+    CHECK_TRUE(pFile != NULL);
+    fclose(pFile);
+}
+
+TEST(mri4simRun, SaveStateAtExistingGdbBreakpoint_ShouldStillReportItAndLeaveItSet)
+{
+    emitNOP();
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    MemorySim_SetHardwareBreakpoint(m_pContext->pMemory, INITIAL_PC + 2, sizeof(uint16_t));
+    mri4simSaveStateAt(m_pSim, g_stateFilename, INITIAL_PC + 2);
+    mockIComm_InitReceiveChecksummedData("+$c#");
+    mockIComm_DelayReceiveData(4);
+        mri4simRun(m_pSim, FALSE);
+    appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
+    appendExpectedString("+");
+    STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
+    CHECK_TRUE(MemorySim_IsHardwareBreakpointSet(m_pContext->pMemory, INITIAL_PC + 2));
+}
+
+TEST(mri4simRun, SaveStateAtThenGdbSetsAndClearsBreakpointThere_ShouldStillSaveWithoutEnteringDebugger)
+{
+    emitNOP();
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    mri4simSaveStateAt(m_pSim, g_stateFilename, INITIAL_PC + 2);
+    char commands[64];
+    snprintf(commands, sizeof(commands), "+$Z1,%x,2#+$z1,%x,2#", INITIAL_PC + 2, INITIAL_PC + 2);
+    mockIComm_InitReceiveChecksummedData(commands, "+$c#");
+        mri4simRun(m_pSim, TRUE);
+    appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
+    appendExpectedString("+$OK#+$OK#+");
+    STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simDidProgramExit(m_pSim));
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pContext->pMemory, INITIAL_PC + 2));
+}
+
+TEST(mri4simRun, StopAt_ShouldReturnBeforeRunningAddressAndThenCarryOnFromThere)
+{
+    emitNOP();
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    mri4simStopAt(m_pSim, INITIAL_PC + 2);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simWasStopReached(m_pSim));
+    CHECK_FALSE(mri4simDidProgramExit(m_pSim));
+    CHECK_EQUAL(INITIAL_PC + 2, m_pContext->pc);
+        mri4simRun(m_pSim, FALSE);
+    CHECK_FALSE(mri4simWasStopReached(m_pSim));
+    CHECK_TRUE(mri4simDidProgramExit(m_pSim));
+    CHECK_EQUAL(INITIAL_PC + 4, m_pContext->pc);
+}
+
+TEST(mri4simRun, StopAtExistingGdbBreakpoint_ShouldReturnAndThenReportBreakpointToGdbOnNextRun)
+{
+    emitNOP();
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    MemorySim_SetHardwareBreakpoint(m_pContext->pMemory, INITIAL_PC + 2, sizeof(uint16_t));
+    mri4simStopAt(m_pSim, INITIAL_PC + 2);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simWasStopReached(m_pSim));
+    CHECK_TRUE(MemorySim_IsHardwareBreakpointSet(m_pContext->pMemory, INITIAL_PC + 2));
+
+    mockIComm_InitReceiveChecksummedData("+$c#");
+    mockIComm_DelayReceiveData(4);
+        mri4simRun(m_pSim, FALSE);
+    appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
+    appendExpectedString("+");
+    STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
+}
+
+TEST(mri4simRun, SaveStateAtAndStopAtSameAddress_ShouldSaveThenStopAndClearBreakpoint)
+{
+    emitNOP();
+    emitNOP();
+    emitBKPT(NEWLIB_EXIT);
+    mri4simSaveStateAt(m_pSim, g_stateFilename, INITIAL_PC + 2);
+    mri4simStopAt(m_pSim, INITIAL_PC + 2);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simWasStopReached(m_pSim));
+    CHECK_EQUAL(INITIAL_PC + 2, m_pContext->pc);
+    CHECK_FALSE(MemorySim_IsHardwareBreakpointSet(m_pContext->pMemory, INITIAL_PC + 2));
+    FILE* pFile = fopen(g_stateFilename, "r");
+    CHECK_TRUE(pFile != NULL);
+    fclose(pFile);
+}
+
+TEST(mri4simRun, StopBeforeInput_ShouldReturnBeforeReadSemihostCallForStdin)
+{
+    emitMOVimmediate(0, 0);
+    emitBKPT(NEWLIB_READ);
+    mri4simStopBeforeInput(m_pSim);
+        mri4simRun(m_pSim, FALSE);
+    STRCMP_EQUAL("", mockIComm_GetTransmittedData());
+    CHECK_TRUE(mri4simWasStopReached(m_pSim));
+    CHECK_EQUAL(INITIAL_PC + 2, m_pContext->pc);
+}
@@ -18,6 +18,7 @@ extern "C"
     #include <common.h>
     #include <FileFailureInject.h>
     #include <MallocFailureInject.h>
+    #include <MemorySim.h>
     #include <pinkySimCommandLine.h>
     #include <printfSpy.h>
     #include <SocketIComm.h>
@@ -30,6 +31,14 @@ extern "C"
 static const char     g_usageString[] = "Usage:";
 static const char*    g_imageFilename = "image.bin";
 static const uint32_t g_imageData[2] = { 0x10000004, 0x00000100 };
+// ELF header, one PT_LOAD program header and then the same 2 words as g_imageData for the segment contents.
+static const uint32_t g_elfImageData[13 + 8 + 2] =
+{
+    0x464C457F, 0x00010101, 0x00000000, 0x00000000, 0x00280002, 0x00000001, 0x00000101, 52, 0x00000000, 0x00000000,
+    0x00200034, 0x00000001, 0x00000000,
+    1, 84, 0x00000000, 0x00000000, 8, 8, 5, 4,
+    0x10000004, 0x00000100
+};
 
 
 TEST_GROUP(pinkySimCommandLine)
@@ -55,6 +64,7 @@ TEST_GROUP(pinkySimCommandLine)
         ftellRestore();
         freadRestore();
         fwriteRestore();
+        mmapRestore();
         printfSpy_Unhook();
         MallocFailureInject_Restore();
         pinkySimCommandLine_Uninit(&m_commandLine);
@@ -122,12 +132,17 @@ TEST_GROUP(pinkySimCommandLine)
         clearExceptionCode();
     }
 
-    void createTestImageFile()
+    void createTestImageFile(const void* pImageData = g_imageData, size_t imageSize = sizeof(g_imageData))
     {
         FILE* pFile = fopen(g_imageFilename, "w");
-        fwrite(g_imageData, 1, sizeof(g_imageData), pFile);
+        fwrite(pImageData, 1, imageSize, pFile);
         fclose(pFile);
     }
+
+    void createTestElfFile()
+    {
+        createTestImageFile(g_elfImageData, sizeof(g_elfImageData));
+    }
 };
 
 
@@ -138,6 +153,8 @@ TEST(pinkySimCommandLine, NoParameters)
     CHECK(m_commandLine.pImageFilename == NULL);
     CHECK(m_commandLine.pMemory == NULL);
     CHECK_FALSE(m_commandLine.breakOnStart);
+    CHECK_FALSE(m_commandLine.useJit);
+    CHECK_EQUAL(0, m_commandLine.maxInstructions);
     CHECK_EQUAL(SOCKET_ICOMM_DEFAULT_PORT, m_commandLine.gdbPort);
     CHECK_EQUAL(NULL, m_commandLine.pCoverageElfFilename);
     CHECK_EQUAL(NULL, m_commandLine.pCoverageResultsDirectory);
@@ -145,6 +162,15 @@ TEST(pinkySimCommandLine, NoParameters)
     CHECK_EQUAL(NULL, m_commandLine.ppCoverageRestrictPaths);
 }
 
+TEST(pinkySimCommandLine, NoParametersInitQuietly_ShouldThrowWithoutDisplayingUsage)
+{
+    __try_and_catch( pinkySimCommandLine_InitQuietly(&m_commandLine, m_argc, m_argv) );
+    CHECK_EQUAL(invalidArgumentException, getExceptionCode());
+    STRCMP_EQUAL("", printfSpy_GetLastOutput());
+    CHECK(m_commandLine.pMemory == NULL);
+    clearExceptionCode();
+}
+
 TEST(pinkySimCommandLine, OneImageFilename_CheckRegions)
 {
     addArg(g_imageFilename);
@@ -154,6 +180,51 @@ TEST(pinkySimCommandLine, OneImageFilename_CheckRegions)
     CHECK_EQUAL(g_imageData[0], IMemory_Read32(m_commandLine.pMemory, 0x00000000));
     CHECK_EQUAL(g_imageData[1], IMemory_Read32(m_commandLine.pMemory, 0x00000004));
     CHECK_EQUAL(0, IMemory_Read32(m_commandLine.pMemory, 0x10000000));
+    CHECK_FALSE(m_commandLine.isElfImage);
+}
+
+TEST(pinkySimCommandLine, OneElfImageFilename_CheckRegionsAndEntryPoint)
+{
+    addArg(g_imageFilename);
+    createTestElfFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    CHECK_TRUE(m_commandLine.isElfImage);
+    CHECK_EQUAL(0x00000101, m_commandLine.entryPoint);
+    CHECK_EQUAL(0x00000000, m_commandLine.flashBaseAddress);
+    CHECK_EQUAL(8, m_commandLine.flashSize);
+    CHECK_EQUAL(g_imageData[0], IMemory_Read32(m_commandLine.pMemory, 0x00000000));
+    CHECK_EQUAL(g_imageData[1], IMemory_Read32(m_commandLine.pMemory, 0x00000004));
+    __try_and_catch( IMemory_Write32(m_commandLine.pMemory, 0x00000000, 0) );
+    CHECK_EQUAL(busErrorException, getExceptionCode());
+    clearExceptionCode();
+    CHECK_EQUAL(0, IMemory_Read32(m_commandLine.pMemory, 0x10000000));
+}
+
+TEST(pinkySimCommandLine, ElfImageWithFlashAndRamOptions_ShouldLoadIntoSpecifiedRegions)
+{
+    addArg("--flash");
+    addArg("0x00000000");
+    addArg("0x100");
+    addArg("--ram");
+    addArg("0x10000000");
+    addArg("0x100");
+    addArg(g_imageFilename);
+    createTestElfFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    CHECK_TRUE(m_commandLine.isElfImage);
+    CHECK_EQUAL(0x00000101, m_commandLine.entryPoint);
+    CHECK_EQUAL(0x100, m_commandLine.flashSize);
+    CHECK_EQUAL(g_imageData[1], IMemory_Read32(m_commandLine.pMemory, 0x00000004));
+    CHECK_EQUAL(0, IMemory_Read32(m_commandLine.pMemory, 0x00000008));
+}
+
+TEST(pinkySimCommandLine, FailElfImageFileMap)
+{
+    addArg(g_imageFilename);
+    createTestElfFile();
+    mmapFail(MAP_FAILED);
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed(fileException);
 }
 
 TEST(pinkySimCommandLine, FailImageFileOpen)
@@ -193,24 +264,37 @@ TEST(pinkySimCommandLine, FailSecondImageFileSeek)
     validateExceptionThrownAndUsageStringDisplayed(fileException);
 }
 
-TEST(pinkySimCommandLine, FailImageFileBufferAllocation)
+TEST(pinkySimCommandLine, FailImageFileMap)
 {
     addArg(g_imageFilename);
     createTestImageFile();
-    MallocFailureInject_FailAllocation(1);
+    mmapFail(MAP_FAILED);
         __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
-    validateExceptionThrownAndUsageStringDisplayed(outOfMemoryException);
+    validateExceptionThrownAndUsageStringDisplayed(fileException);
 }
 
-TEST(pinkySimCommandLine, FailImageFileRead)
+TEST(pinkySimCommandLine, FailImageFileMapWithFlashOption)
 {
+    addArg("--flash");
+    addArg("0x00000000");
+    addArg("0x100");
     addArg(g_imageFilename);
     createTestImageFile();
-    freadFail(-1);
+    mmapFail(MAP_FAILED);
+    mmapSetCallsBeforeFailure(1);
         __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
     validateExceptionThrownAndUsageStringDisplayed(fileException);
 }
 
+TEST(pinkySimCommandLine, FailMemorySimAllocation)
+{
+    addArg(g_imageFilename);
+    createTestImageFile();
+    MallocFailureInject_FailAllocation(1);
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed(outOfMemoryException);
+}
+
 TEST(pinkySimCommandLine, FailMemoryRegionAllocation)
 {
     addArg(g_imageFilename);
@@ -269,7 +353,7 @@ TEST(pinkySimCommandLine, FlashOption_FailMemoryAllocation_ShouldThrow)
     addArg("0x00000000");
     addArg("8");
     addArg(g_imageFilename);
-    MallocFailureInject_FailAllocation(1);
+    MallocFailureInject_FailAllocation(2);
         __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
     validateExceptionThrownAndUsageStringDisplayed(outOfMemoryException);
 }
@@ -300,7 +384,7 @@ TEST(pinkySimCommandLine, RamOption_FailMemoryAllocation_ShouldThrow)
     addArg("0x00000000");
     addArg("8");
     addArg(g_imageFilename);
-    MallocFailureInject_FailAllocation(1);
+    MallocFailureInject_FailAllocation(2);
         __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
     validateExceptionThrownAndUsageStringDisplayed(outOfMemoryException);
 }
@@ -339,6 +423,144 @@ TEST(pinkySimCommandLine, SetBreakOnStartFlag)
     validateParamsAndNoErrorMessage(g_imageFilename, 1, 1);
 }
 
+TEST(pinkySimCommandLine, SetJitFlag)
+{
+    addArg("--jit");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 1);
+    CHECK_TRUE(m_commandLine.useJit);
+}
+
+TEST(pinkySimCommandLine, SetRamUsageFlag)
+{
+    addArg("--ramUsage");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 1);
+    CHECK_TRUE(m_commandLine.reportRamUsage);
+}
+
+TEST(pinkySimCommandLine, SetMaxInstructions)
+{
+    addArg("--max-instructions");
+    addArg("5000000000");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 2);
+    CHECK_TRUE(m_commandLine.maxInstructions == 5000000000ULL);
+}
+
+TEST(pinkySimCommandLine, SetMaxInstructions_FailWithTooFewParams)
+{
+    addArg("--max-instructions");
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed();
+}
+
+TEST(pinkySimCommandLine, SetMaxInstructions_FailWithZeroCount)
+{
+    addArg("--max-instructions");
+    addArg("0");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed();
+}
+
+TEST(pinkySimCommandLine, SetCycles_ShouldUseImageAsFlashRegion)
+{
+    addArg("--cycles");
+    addArg("3");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 2);
+    CHECK_TRUE(m_commandLine.countCycles);
+    CHECK_EQUAL(3, m_commandLine.flashWaitStates);
+    CHECK_EQUAL(0x00000000, m_commandLine.flashBaseAddress);
+    CHECK_EQUAL(sizeof(g_imageData), m_commandLine.flashSize);
+}
+
+TEST(pinkySimCommandLine, SetCyclesWithFlashOptions_ShouldUseFirstFlashRegion)
+{
+    addArg("--flash");
+    addArg("0x00000000");
+    addArg("8");
+    addArg("--flash");
+    addArg("0x00001000");
+    addArg("16");
+    addArg("--cycles");
+    addArg("0");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 8);
+    CHECK_TRUE(m_commandLine.countCycles);
+    CHECK_EQUAL(0, m_commandLine.flashWaitStates);
+    CHECK_EQUAL(0x00000000, m_commandLine.flashBaseAddress);
+    CHECK_EQUAL(8, m_commandLine.flashSize);
+}
+
+TEST(pinkySimCommandLine, SetCycles_FailWithTooFewParams)
+{
+    addArg("--cycles");
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed();
+}
+
+TEST(pinkySimCommandLine, NoStateOptions_ShouldLeaveStateFilenamesNULL)
+{
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 0);
+    CHECK_EQUAL(NULL, m_commandLine.pSaveStateFilename);
+    CHECK_EQUAL(NULL, m_commandLine.pLoadStateFilename);
+}
+
+TEST(pinkySimCommandLine, SaveState_ShouldClearThumbBitOfAddress)
+{
+    addArg("--save-state");
+    addArg("main.state");
+    addArg("0x00000101");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 3);
+    STRCMP_EQUAL("main.state", m_commandLine.pSaveStateFilename);
+    CHECK_EQUAL(0x00000100, m_commandLine.saveStateAddress);
+}
+
+TEST(pinkySimCommandLine, SaveState_FailWithTooFewParams)
+{
+    addArg("--save-state");
+    addArg("main.state");
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed();
+}
+
+TEST(pinkySimCommandLine, LoadState)
+{
+    addArg("--load-state");
+    addArg("main.state");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 2);
+    STRCMP_EQUAL("main.state", m_commandLine.pLoadStateFilename);
+}
+
+TEST(pinkySimCommandLine, LoadState_FailWithTooFewParams)
+{
+    addArg("--load-state");
+        __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
+    validateExceptionThrownAndUsageStringDisplayed();
+}
+
 TEST(pinkySimCommandLine, SetGdbPort)
 {
     addArg("--gdbPort");
@@ -409,6 +631,33 @@ TEST(pinkySimCommandLine, CodeCovOptionWithTwoValidArguments)
     validateParamsAndNoErrorMessage(g_imageFilename, 3,
                                     0, SOCKET_ICOMM_DEFAULT_PORT,
                                     "filename.elf", "resultsDirectory");
+    CHECK_TRUE(MemorySim_HasFetchSideEffects(m_commandLine.pMemory));
+    CHECK_FALSE(m_commandLine.coverageHitsOnly);
+}
+
+TEST(pinkySimCommandLine, CodeCovOptionNotSpecified_ShouldNotCountFlashReads)
+{
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 0);
+    CHECK_FALSE(MemorySim_HasFetchSideEffects(m_commandLine.pMemory));
+}
+
+TEST(pinkySimCommandLine, CodeCovHitsOnlyOption)
+{
+    addArg("--codecov");
+    addArg("filename.elf");
+    addArg("resultsDirectory");
+    addArg("--codecovHitsOnly");
+    addArg(g_imageFilename);
+    createTestImageFile();
+        pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv);
+    validateParamsAndNoErrorMessage(g_imageFilename, 4,
+                                    0, SOCKET_ICOMM_DEFAULT_PORT,
+                                    "filename.elf", "resultsDirectory");
+    CHECK_TRUE(m_commandLine.coverageHitsOnly);
+    CHECK_TRUE(MemorySim_HasFetchSideEffects(m_commandLine.pMemory));
 }
 
 TEST(pinkySimCommandLine, RestrictOptionWithArgMissing_ShouldThrow)
@@ -455,7 +704,7 @@ TEST(pinkySimCommandLine, RestrictPathOption_FailMemoryAllocation_ShouldThrow)
     addArg("--restrict");
     addArg("testPath");
     addArg(g_imageFilename);
-    MallocFailureInject_FailAllocation(1);
+    MallocFailureInject_FailAllocation(2);
         __try_and_catch( pinkySimCommandLine_Init(&m_commandLine, m_argc, m_argv) );
     validateExceptionThrownAndUsageStringDisplayed(outOfMemoryException);
 }
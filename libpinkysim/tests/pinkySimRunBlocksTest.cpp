@@ -0,0 +1,259 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+static int g_callbackCount;
+
+static int countingCallback(PinkySimContext* pContext)
+{
+    g_callbackCount++;
+    return PINKYSIM_STEP_OK;
+}
+
+
+TEST_GROUP_BASE(pinkySimRunBlocks, pinkySimBase)
+{
+    void setup()
+    {
+        pinkySimBase::setup();
+        pinkySimEnableDecodeCache(&m_context);
+        g_callbackCount = 0;
+
+        /* Make room for a few more instructions after the word at INITIAL_PC. */
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 4, 0, READ_WRITE);
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 8, 0, READ_WRITE);
+    }
+
+    void teardown()
+    {
+        pinkySimDisableDecodeCache(&m_context);
+        pinkySimBase::teardown();
+    }
+
+    void emitBKPT(uint32_t immediate)
+    {
+        emitInstruction16("10111110iiiiiiii", immediate);
+    }
+
+    void emitNOP()
+    {
+        emitInstruction16("1011111100000000");
+    }
+
+    void emitSVC(uint32_t immediate)
+    {
+        emitInstruction16("11011111iiiiiiii", immediate);
+    }
+
+    void emitMOVImmediate(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("00100dddiiiiiiii", Rd, immediate);
+    }
+
+    void emitLDRImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01101iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitSTRHImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("10000iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitB(int32_t offset)
+    {
+        emitInstruction16("11100iiiiiiiiiii", (uint32_t)offset >> 1);
+    }
+
+    void emitBEQ(int32_t offset)
+    {
+        emitInstruction16("1101cccciiiiiiii", COND_EQ, (uint32_t)offset >> 1);
+    }
+
+    void runAndValidate(int expectedResult)
+    {
+        int result = pinkySimRunBlocks(&m_context, countingCallback);
+        CHECK_EQUAL(expectedResult, result);
+        validateXPSR();
+        validateRegisters();
+    }
+};
+
+
+TEST(pinkySimRunBlocks, ShouldStopImmediatelyOnBreakpoint)
+{
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(1, g_callbackCount);
+}
+
+TEST(pinkySimRunBlocks, ExecuteStraightLineCodeAsSingleBlockAndStopOnSVC)
+{
+    emitNOP();
+    emitMOVImmediate(R0, 1);
+    emitNOP();
+    emitSVC(0);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 8);
+    runAndValidate(PINKYSIM_STEP_SVC);
+    CHECK_EQUAL(1, g_callbackCount);
+}
+
+TEST(pinkySimRunBlocks, UnconditionalBranchShouldEndBlock)
+{
+    emitB(0);
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(2, g_callbackCount);
+}
+
+TEST(pinkySimRunBlocks, ConditionalBranchNotTakenShouldContinueWithNextBlock)
+{
+    emitMOVImmediate(R0, 1);
+    emitBEQ(0);
+    emitMOVImmediate(R1, 2);
+    emitBKPT(0);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(R1, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 6);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(2, g_callbackCount);
+}
+
+TEST(pinkySimRunBlocks, FaultInMiddleOfBlock_ShouldKeepEarlierResultsAndStopAtFaultingInstruction)
+{
+    emitMOVImmediate(R0, 1);
+    emitLDRImmediate(R2, R3, 0);
+    emitNOP();
+    emitBKPT(0);
+    setRegisterValue(R3, INITIAL_PC + 2);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_HARDFAULT);
+}
+
+TEST(pinkySimRunBlocks, StoreOverLaterInstructionInSameBlock_ShouldExecuteNewInstruction)
+{
+    // STRH overwrites the MOVS r0, #1 which follows it with MOVS r0, #2.
+    emitSTRHImmediate(R1, R2, 0);
+    emitMOVImmediate(R0, 1);
+    emitBKPT(0);
+    setRegisterValue(R1, 0x2002);
+    setRegisterValue(R2, INITIAL_PC + 2);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(pinkySimRunBlocks, RunTwice_ShouldReuseCachedBlock)
+{
+    emitMOVImmediate(R0, 1);
+    emitBKPT(0);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+
+    // Modify memory behind the cache's back so that it is obvious if the block is decoded again.
+    m_emitAddress = INITIAL_PC;
+    emitMOVImmediate(R0, 2);
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(pinkySimRunBlocks, FlushCache_ShouldDecodeBlockAgain)
+{
+    emitMOVImmediate(R0, 1);
+    emitBKPT(0);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+
+    m_emitAddress = INITIAL_PC;
+    emitMOVImmediate(R0, 2);
+    pinkySimFlushDecodeCache(&m_context);
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(pinkySimRunBlocks, InvalidateMiddleOfBlock_ShouldDecodeBlockAgain)
+{
+    emitNOP();
+    emitMOVImmediate(R0, 1);
+    emitBKPT(0);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+
+    m_emitAddress = INITIAL_PC + 2;
+    emitMOVImmediate(R0, 2);
+    pinkySimInvalidateDecodeCache(&m_context, INITIAL_PC + 2, sizeof(uint16_t));
+    setRegisterValue(PC, INITIAL_PC);
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(pinkySimRunBlocks, InvalidateBlockStartingInPreviousPage_ShouldDecodeBlockAgain)
+{
+    /* INITIAL_PC is page aligned so this block straddles the page boundary. */
+    SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC - 4, 0, READ_WRITE);
+    m_emitAddress = INITIAL_PC - 4;
+    emitNOP();
+    emitNOP();
+    emitMOVImmediate(R0, 1);
+    emitBKPT(0);
+    setRegisterValue(PC, INITIAL_PC - 4);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+
+    m_emitAddress = INITIAL_PC;
+    emitMOVImmediate(R0, 2);
+    pinkySimInvalidateDecodeCache(&m_context, INITIAL_PC, sizeof(uint16_t));
+    setRegisterValue(PC, INITIAL_PC - 4);
+    setExpectedRegisterValue(R0, 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+}
+
+TEST(pinkySimRunBlocks, FetchFromInvalidAddress_ShouldHardFault)
+{
+    setRegisterValue(PC, 0xFFFFFFF0);
+    setExpectedRegisterValue(PC, 0xFFFFFFF0);
+    runAndValidate(PINKYSIM_STEP_HARDFAULT);
+}
+
+TEST(pinkySimRunBlocks, DecodeCacheDisabled_ShouldFallBackToCallbackPerInstruction)
+{
+    pinkySimDisableDecodeCache(&m_context);
+    emitNOP();
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+    runAndValidate(PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(3, g_callbackCount);
+}
@@ -0,0 +1,252 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+#include "pinkySimBaseTest.h"
+
+TEST_GROUP_BASE(pinkySimRunFor, pinkySimBase)
+{
+    uint64_t m_retired;
+
+    void setup()
+    {
+        pinkySimBase::setup();
+        SimpleMemory_SetMemory(m_context.pMemory, INITIAL_PC + 4, 0, READ_WRITE);
+        m_retired = ~0ULL;
+    }
+
+    void teardown()
+    {
+        pinkySimBase::teardown();
+    }
+
+    void emitBKPT(uint32_t immediate)
+    {
+        emitInstruction16("10111110iiiiiiii", immediate);
+    }
+
+    void emitNOP()
+    {
+        emitInstruction16("1011111100000000");
+    }
+
+    void emitLDRImmediate(uint32_t Rt, uint32_t Rn, uint32_t immediate)
+    {
+        emitInstruction16("01101iiiiinnnttt", immediate, Rn, Rt);
+    }
+
+    void emitBranchToSelf()
+    {
+        emitInstruction16("11100iiiiiiiiiii", -2 & 0x7FF);
+    }
+
+    void emitMOVImmediate(uint32_t Rd, uint32_t immediate)
+    {
+        emitInstruction16("00100dddiiiiiiii", Rd, immediate);
+    }
+
+    void emitLSLSImmediate(uint32_t Rd, uint32_t Rm, uint32_t immediate)
+    {
+        emitInstruction16("00000iiiiimmmddd", immediate, Rm, Rd);
+    }
+
+    void runFor(uint64_t maxInstructions, int (*callback)(PinkySimContext*), int expectedResult)
+    {
+        int result = pinkySimRunFor(&m_context, callback, maxInstructions, &m_retired);
+        CHECK_EQUAL(expectedResult, result);
+        validateXPSR();
+        validateRegisters();
+    }
+
+    void runBlocksFor(uint64_t maxInstructions, int (*callback)(PinkySimContext*), int expectedResult)
+    {
+        int result = pinkySimRunBlocksFor(&m_context, callback, maxInstructions, &m_retired);
+        CHECK_EQUAL(expectedResult, result);
+        validateXPSR();
+        validateRegisters();
+    }
+};
+
+
+TEST(pinkySimRunFor, ZeroInstructions_ShouldReturnLimitWithoutExecutingAnything)
+{
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC);
+    runFor(0, NULL, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(0, m_retired);
+}
+
+TEST(pinkySimRunFor, ExecuteTwoOfFourNOPs_ShouldStopAfterSecond)
+{
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runFor(2, NULL, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(2, m_retired);
+}
+
+TEST(pinkySimRunFor, BranchToSelf_ShouldStopAfterRequestedIterations)
+{
+    emitBranchToSelf();
+    setExpectedRegisterValue(PC, INITIAL_PC);
+        runFor(1000, NULL, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(1000, m_retired);
+}
+
+TEST(pinkySimRunFor, BreakpointBeforeLimit_ShouldStopOnBreakpointAndNotCountIt)
+{
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runFor(10, NULL, PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(1, m_retired);
+}
+
+TEST(pinkySimRunFor, HardfaultBeforeLimit_ShouldLeavePCAtFaultingInstruction)
+{
+    emitNOP();
+    emitLDRImmediate(R2, R3, 0);
+    setRegisterValue(R3, INITIAL_PC + 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runFor(10, NULL, PINKYSIM_STEP_HARDFAULT);
+    CHECK_EQUAL(1, m_retired);
+}
+
+TEST(pinkySimRunFor, NullRetiredPointer_ShouldBeIgnored)
+{
+    emitNOP();
+    emitNOP();
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+    CHECK_EQUAL(PINKYSIM_RUN_LIMIT, pinkySimRunFor(&m_context, NULL, 1, NULL));
+    validateRegisters();
+}
+
+static int g_callbackCount;
+
+static int countingCallback(PinkySimContext* pContext)
+{
+    return ++g_callbackCount == 3 ? PINKYSIM_RUN_INTERRUPT : PINKYSIM_STEP_OK;
+}
+
+TEST(pinkySimRunFor, CallbackInterruptsBeforeLimit_ShouldReturnCallbackResult)
+{
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    g_callbackCount = 0;
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runFor(10, countingCallback, PINKYSIM_RUN_INTERRUPT);
+    CHECK_EQUAL(2, m_retired);
+    CHECK_EQUAL(3, g_callbackCount);
+}
+
+TEST(pinkySimRunFor, WithDecodeCacheEnabled_ShouldStillStopAtExactLimit)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitBranchToSelf();
+    setExpectedRegisterValue(PC, INITIAL_PC);
+        runFor(100, NULL, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(100, m_retired);
+    pinkySimDisableDecodeCache(&m_context);
+}
+
+TEST(pinkySimRunFor, RunBlocksForWithoutDecodeCache_ShouldFallBackToRunningAnInstructionAtATime)
+{
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    g_callbackCount = 0;
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksFor(2, countingCallback, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(2, m_retired);
+    CHECK_EQUAL(2, g_callbackCount);
+}
+
+TEST(pinkySimRunFor, RunBlocksFor_ShouldCutBlockShortAtLimit)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    emitNOP();
+    g_callbackCount = 0;
+    setExpectedRegisterValue(PC, INITIAL_PC + 4);
+        runBlocksFor(2, countingCallback, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(2, m_retired);
+    CHECK_EQUAL(1, g_callbackCount);
+    pinkySimDisableDecodeCache(&m_context);
+}
+
+TEST(pinkySimRunFor, RunBlocksFor_ShouldCallCallbackOncePerBlock)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitNOP();
+    emitBranchToSelf();
+    g_callbackCount = 0;
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runBlocksFor(2, countingCallback, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(2, m_retired);
+    CHECK_EQUAL(1, g_callbackCount);
+        runBlocksFor(10, countingCallback, PINKYSIM_RUN_INTERRUPT);
+    CHECK_EQUAL(1, m_retired);
+    CHECK_EQUAL(3, g_callbackCount);
+    pinkySimDisableDecodeCache(&m_context);
+}
+
+TEST(pinkySimRunFor, RunBlocksForBranchToSelf_ShouldStopAfterRequestedIterations)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitBranchToSelf();
+    setExpectedRegisterValue(PC, INITIAL_PC);
+        runBlocksFor(1000, NULL, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(1000, m_retired);
+    pinkySimDisableDecodeCache(&m_context);
+}
+
+TEST(pinkySimRunFor, RunBlocksForLimitBetweenInstructionPair_ShouldOnlyRunFirstOfPair)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitMOVImmediate(R0, 1);
+    emitLSLSImmediate(R0, R0, 4);
+    setExpectedXPSRflags("nz");
+    setExpectedRegisterValue(R0, 1);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runBlocksFor(1, NULL, PINKYSIM_RUN_LIMIT);
+    CHECK_EQUAL(1, m_retired);
+    pinkySimDisableDecodeCache(&m_context);
+}
+
+TEST(pinkySimRunFor, RunBlocksForBreakpointBeforeLimit_ShouldStopOnBreakpointAndNotCountIt)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitNOP();
+    emitBKPT(0);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runBlocksFor(10, NULL, PINKYSIM_STEP_BKPT);
+    CHECK_EQUAL(1, m_retired);
+    pinkySimDisableDecodeCache(&m_context);
+}
+
+TEST(pinkySimRunFor, RunBlocksForHardfaultBeforeLimit_ShouldLeavePCAtFaultingInstructionAndCountEarlierOnes)
+{
+    pinkySimEnableDecodeCache(&m_context);
+    emitNOP();
+    emitLDRImmediate(R2, R3, 0);
+    setRegisterValue(R3, INITIAL_PC + 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        runBlocksFor(10, NULL, PINKYSIM_STEP_HARDFAULT);
+    CHECK_EQUAL(1, m_retired);
+    pinkySimDisableDecodeCache(&m_context);
+}
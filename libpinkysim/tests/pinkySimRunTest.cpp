@@ -98,6 +98,18 @@ TEST(pinkySimRun, ShouldStopImmediatelyOnUnalignedHardfault)
     validateRegisters();
 }
 
+TEST(pinkySimRun, ExecuteNOPAndThenStopOnUnalignedHardfault_ShouldLeavePCAtFaultingInstruction)
+{
+    emitNOP();
+    emitLDRImmediate(R2, R3, 0);
+    setRegisterValue(R3, INITIAL_PC + 2);
+    setExpectedRegisterValue(PC, INITIAL_PC + 2);
+        int result = pinkySimRun(&m_context, NULL);
+    CHECK_EQUAL(PINKYSIM_STEP_HARDFAULT, result);
+    validateXPSR();
+    validateRegisters();
+}
+
 TEST(pinkySimRun, ShouldStopImmediatelyOnUndefinedInstruction)
 {
     emitUND(0);
@@ -31,7 +31,7 @@ TEST_GROUP_BASE(queryTests, mri4simBase)
 TEST(queryTests, qSupported_ReturnsExpectedOptionsAndCorrectPacketSizeOf16k)
 {
     mockIComm_InitReceiveChecksummedData("+$qSupported#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$qXfer:memory-map:read+;qXfer:features:read+;PacketSize=4000#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -40,7 +40,7 @@ TEST(queryTests, qSupported_ReturnsExpectedOptionsAndCorrectPacketSizeOf16k)
 TEST(queryTests, qXfer_TargetXML_ReturnsExpectedOutputForCortexM0)
 {
     mockIComm_InitReceiveChecksummedData("+$qXfer:features:read:target.xml:0,65536#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$l<?xml version=\"1.0\"?>\n"
                          "<!DOCTYPE feature SYSTEM \"gdb-target.dtd\">\n"
@@ -71,7 +71,7 @@ TEST(queryTests, qXfer_TargetXML_ReturnsExpectedOutputForCortexM0)
 TEST(queryTests, qXfer_MemoryMap_ReturnsTwoRegions)
 {
     mockIComm_InitReceiveChecksummedData("+$qXfer:memory-map:read::0,65536#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$l"
                          "<?xml version=\"1.0\"?>"
@@ -36,7 +36,7 @@ TEST(registerTests, ReadRegisters)
     m_pContext->pc = 0xFFFFFFFE;
 
     mockIComm_InitReceiveChecksummedData("+$g#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0xCCCCCCCC, 0xDDDDDDDD, 0xEEEEEEEE, 0xFFFFFFFE);
     appendExpectedString("+$00000000111111112222222233333333"
                            "44444444555555556666666677777777"
@@ -54,7 +54,7 @@ TEST(registerTests, WriteRegisters)
                                             "8888888899999999aaaaaaaabbbbbbbb"
                                             "ccccccccddddddddeeeeeeeefeffffff"
                                             "ffffffff#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
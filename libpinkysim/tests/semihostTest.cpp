@@ -69,7 +69,7 @@ TEST(semihostTests, WriteCall_NotConsole_VerifyTextWrittenToRegularFile)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     STRCMP_EQUAL("Test\n", mockFileIo_GetRegularFileData());
     CHECK_EQUAL(5, m_pContext->R[0]);
@@ -86,7 +86,7 @@ TEST(semihostTests, WriteCall_NotConsole_VerifyReturnCodeInR0AndErrnoInR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     STRCMP_EQUAL("", mockFileIo_GetRegularFileData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
@@ -103,7 +103,7 @@ TEST(semihostTests, WriteCall_NotConsole_UseInvalidBufferAddress_ShouldReturnErr
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     STRCMP_EQUAL("", mockFileIo_GetRegularFileData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
@@ -123,7 +123,7 @@ TEST(semihostTests, WriteCall_StdOut_VerifyTextSentToConsoleAndGdb)
 
     mockIComm_InitReceiveChecksummedData("+$F5#", "+$c#");
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     char expectedResult[64];
     snprintf(expectedResult, sizeof(expectedResult),
              "$Fwrite,01,%08lx,%02lx#+",
@@ -148,7 +148,7 @@ TEST(semihostTests, WriteCall_StdErr_VerifyTextSentToConsoleAndGdb)
 
     mockIComm_InitReceiveChecksummedData("+$F5#", "+$c#");
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     char expectedResult[64];
     snprintf(expectedResult, sizeof(expectedResult),
              "$Fwrite,02,%08lx,%02lx#+",
@@ -173,7 +173,7 @@ TEST(semihostTests, WriteCall_StdOut_GdbNotConnected_VerifyTextSentToConsoleOnly
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     STRCMP_EQUAL("Test\n", mockFileIo_GetStdOutData());
     CHECK_EQUAL(5, m_pContext->R[0]);
@@ -191,7 +191,7 @@ TEST(semihostTests, ReadCall_RegularFile_VerifyReturnCodeInR0)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)sizeof(testString) - 1, m_pContext->R[0]);
     validateBytesInSimulator(INITIAL_SP - sizeof(testString) + 1, testString, sizeof(testString) - 1);
@@ -209,7 +209,7 @@ TEST(semihostTests, ReadCall_RegularFile_HandleReturnedError)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -227,7 +227,7 @@ TEST(semihostTests, ReadCall_RegularFile_AttemptToUseInvalidBufferAddress_Should
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -241,7 +241,7 @@ TEST(semihostTests, ReadCall_StdIn_GdbConnected_ReadFromGdb)
 
     mockIComm_InitReceiveChecksummedData("+$F5#", "+$c#");
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedString("$Fread,00,02,03#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
     CHECK_EQUAL(5, m_pContext->R[0]);
@@ -255,7 +255,7 @@ TEST(semihostTests, ReadCall_StdIn_GdbConnected_HandleErrorFromGdb)
 
     mockIComm_InitReceiveChecksummedData("+$F-1,5#", "+$c#");
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     appendExpectedString("$Fread,00,02,03#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
@@ -275,7 +275,7 @@ TEST(semihostTests, ReadCall_StdIn_GdbNotConnected_ReadFromConsoleInsteadOfGdb)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)sizeof(testString) - 1, m_pContext->R[0]);
     validateBytesInSimulator(INITIAL_SP - sizeof(testString) + 1, testString, sizeof(testString) - 1);
@@ -296,7 +296,7 @@ TEST(semihostTests, ReadCall_StdIn_GdbNotConnected_FailReadCall_ShouldReturnErro
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -316,7 +316,7 @@ TEST(semihostTests, OpenCall_VerifyErrorCodeReturnedInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -334,7 +334,7 @@ TEST(semihostTests, OpenCall_AttemptToUseInvalidFilenamePointer_ShouldFail)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -352,7 +352,7 @@ TEST(semihostTests, RenameCall_VerifyErrorsReturnInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -370,7 +370,7 @@ TEST(semihostTests, RenameCall_AttemptToUseInvalidFilenamePointer_ShouldFail)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -386,7 +386,7 @@ TEST(semihostTests, UnlinkCall_VerifyErrorsReturnInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -402,7 +402,7 @@ TEST(semihostTests, UnlinkCall_AttemptToUseInvalidFilenamePointer_ShouldFail)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -428,7 +428,7 @@ TEST(semihostTests, StatCall_VerifyReturnValueAndOutputStructure)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL(0, m_pContext->R[0]);
     CommonStat expected = {0x1234, 0xbaadf00d, 0x87654321, 0xfeedfeed};
@@ -449,7 +449,7 @@ TEST(semihostTests, StatCall_VerifyErrorReturnsInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -467,7 +467,7 @@ TEST(semihostTests, StatCall_WithInvalidFilenamePointer_ShouldFail)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -486,7 +486,7 @@ TEST(semihostTests, StatCall_WithInvalidBufferPointer_ShouldFail)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -509,7 +509,7 @@ TEST(semihostTests, FStatCall_VerifyReturnValueAndOutputStructure)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL(0, m_pContext->R[0]);
     CommonStat expected = {0x1234, 0xbaadf00d, 0x87654321, 0xfeedfeed};
@@ -527,7 +527,7 @@ TEST(semihostTests, FStatCall_VerifyErrorReturnsInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -543,7 +543,7 @@ TEST(semihostTests, FStatCall_WithInvalidBufferPointer_ShouldFail)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EFAULT, m_pContext->R[1]);
@@ -558,7 +558,7 @@ TEST(semihostTests, SeekCall_VerifyReturnErrorsInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -573,7 +573,7 @@ TEST(semihostTests, CloseCall_VerifyReturnErrorsInR0andR1)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL((uint32_t)-1, m_pContext->R[0]);
     CHECK_EQUAL(EIO, m_pContext->R[1]);
@@ -588,7 +588,7 @@ TEST(semihostTests, CloseCall_AttemptToCloseStdIn_VerifyCallIsIgnored)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL(0, m_pContext->R[0]);
     CHECK_EQUAL(0, m_pContext->R[1]);
@@ -603,7 +603,7 @@ TEST(semihostTests, CloseCall_AttemptToCloseStdOut_VerifyCallIsIgnored)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL(0, m_pContext->R[0]);
     CHECK_EQUAL(0, m_pContext->R[1]);
@@ -618,7 +618,7 @@ TEST(semihostTests, CloseCall_AttemptToCloseStdErr_VerifyCallIsIgnored)
     emitBKPT(0);
 
     mockIComm_DelayReceiveData(2);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     STRCMP_EQUAL("", mockIComm_GetTransmittedData());
     CHECK_EQUAL(0, m_pContext->R[0]);
     CHECK_EQUAL(0, m_pContext->R[1]);
@@ -33,7 +33,7 @@ TEST(stepTests, StepOverNOP)
     emitNOP();
 
     mockIComm_InitReceiveChecksummedData("+$s#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -41,7 +41,7 @@ TEST(stepTests, StepOverNOP)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
     appendExpectedString("+");
@@ -55,7 +55,7 @@ TEST(stepTests, StepOverBKPT_JustAdvancesPCAndSendsTPacket)
     emitNOP();
 
     mockIComm_InitReceiveChecksummedData("+$s#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
@@ -73,7 +73,7 @@ TEST(stepTests, BreakOnStart_SendStepWithSpecificAddressToSkipSomeInstructions)
     char commands[64];
     snprintf(commands, sizeof(commands), "+$s%x#", INITIAL_PC + 4);
     mockIComm_InitReceiveChecksummedData(commands);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -82,7 +82,7 @@ TEST(stepTests, BreakOnStart_SendStepWithSpecificAddressToSkipSomeInstructions)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -98,7 +98,7 @@ TEST(stepTests, StepOverNOPAndThenContinueToBKPT)
     emitBKPT(0);
 
     mockIComm_InitReceiveChecksummedData("+$s#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -106,7 +106,7 @@ TEST(stepTests, StepOverNOPAndThenContinueToBKPT)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(1);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 2);
     appendExpectedString("+");
@@ -115,7 +115,7 @@ TEST(stepTests, StepOverNOPAndThenContinueToBKPT)
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(3);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -47,7 +47,7 @@ TEST(watchpointTests, Set4ByteReadWatchpoint_RunUntilThatAddressIsRead_ButHaltsO
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[1] = INITIAL_SP - 4;
     IMemory_Write32(m_pContext->pMemory, INITIAL_SP - 4, 0xBAADF00D);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -55,7 +55,7 @@ TEST(watchpointTests, Set4ByteReadWatchpoint_RunUntilThatAddressIsRead_ButHaltsO
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -77,7 +77,7 @@ TEST(watchpointTests, Set4ByteWriteWatchpoint_RunUntilThatAddressIsWritten_ButHa
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[0] = 0xBAADF00D;
     m_pContext->R[1] = INITIAL_SP - 4;
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -85,7 +85,7 @@ TEST(watchpointTests, Set4ByteWriteWatchpoint_RunUntilThatAddressIsWritten_ButHa
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -107,7 +107,7 @@ TEST(watchpointTests, Set4ByteReadWriteWatchpoint_RunUntilThatAddressIsWritten_B
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[0] = 0xBAADF00D;
     m_pContext->R[1] = INITIAL_SP - 4;
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -115,7 +115,7 @@ TEST(watchpointTests, Set4ByteReadWriteWatchpoint_RunUntilThatAddressIsWritten_B
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -137,7 +137,7 @@ TEST(watchpointTests, Set4ByteReadWriteWatchpoint_RunUntilThatAddressIsRead_ButH
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[1] = INITIAL_SP - 4;
     IMemory_Write32(m_pContext->pMemory, INITIAL_SP - 4, 0xBAADF00D);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -145,7 +145,7 @@ TEST(watchpointTests, Set4ByteReadWriteWatchpoint_RunUntilThatAddressIsRead_ButH
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -166,7 +166,7 @@ TEST(watchpointTests, Set4ByteReadWatchpoint_RunUntilThatAddressIsRead_ClearAndM
     snprintf(commands, sizeof(commands), "+$Z3,%x,4#", INITIAL_SP - 4);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[1] = INITIAL_SP - 4;
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -175,7 +175,7 @@ TEST(watchpointTests, Set4ByteReadWatchpoint_RunUntilThatAddressIsRead_ClearAndM
     snprintf(commands, sizeof(commands), "+$z3,%x,4#", INITIAL_SP - 4);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+$OK#+");
@@ -184,7 +184,7 @@ TEST(watchpointTests, Set4ByteReadWatchpoint_RunUntilThatAddressIsRead_ClearAndM
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 10);
     appendExpectedString("+");
@@ -205,7 +205,7 @@ TEST(watchpointTests, Set1ByteReadWatchpoint_RunUntilThatAddressIsRead_ButHaltsO
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[1] = INITIAL_SP - 4;
     IMemory_Write8(m_pContext->pMemory, INITIAL_SP - 4, 0x5A);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -213,7 +213,7 @@ TEST(watchpointTests, Set1ByteReadWatchpoint_RunUntilThatAddressIsRead_ButHaltsO
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -235,7 +235,7 @@ TEST(watchpointTests, Set2ByteWriteWatchpoint_RunUntilThatAddressIsWrite_ButHalt
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[0] = 0xBAADF00D;
     m_pContext->R[1] = INITIAL_SP - 4;
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -243,7 +243,7 @@ TEST(watchpointTests, Set2ByteWriteWatchpoint_RunUntilThatAddressIsWrite_ButHalt
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -265,7 +265,7 @@ TEST(watchpointTests, Set8ByteWriteWatchpoint_RunUntilThatAddressIsWrite_ButHalt
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[0] = 0xBAADF00D;
     m_pContext->R[1] = INITIAL_SP - 4;
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -273,7 +273,7 @@ TEST(watchpointTests, Set8ByteWriteWatchpoint_RunUntilThatAddressIsWrite_ButHalt
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -295,7 +295,7 @@ TEST(watchpointTests, Set8ByteReadWatchpoint_RunUntilSecondWordIsRead_ButHaltsOn
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     m_pContext->R[1] = INITIAL_SP - 4;
     IMemory_Write32(m_pContext->pMemory, INITIAL_SP - 4, 0xBAADF00D);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$OK#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -303,7 +303,7 @@ TEST(watchpointTests, Set8ByteReadWatchpoint_RunUntilSecondWordIsRead_ButHaltsOn
     mockIComm_InitTransmitDataBuffer(1024);
     mockIComm_InitReceiveChecksummedData("+$c#");
     mockIComm_DelayReceiveData(6);
-        mri4simRun(mockIComm_Get(), FALSE);
+        mri4simRun(m_pSim, FALSE);
     resetExpectedBuffer();
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC + 6);
     appendExpectedString("+");
@@ -317,7 +317,7 @@ TEST(watchpointTests, FailMemoryAllocation_AttemptToSet4ByteReadWatchpoint_Shoul
     snprintf(commands, sizeof(commands), "+$Z3,%x,4#", INITIAL_SP - 4);
     mockIComm_InitReceiveChecksummedData(commands, "+$c#");
     MallocFailureInject_FailAllocation(1);
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_NO_FREE_BREAKPOINT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -326,7 +326,7 @@ TEST(watchpointTests, FailMemoryAllocation_AttemptToSet4ByteReadWatchpoint_Shoul
 TEST(watchpointTests, AttemptToSet4ByteReadWatchpoint_AtInvalidAddress_ShouldReturnErrorMessage)
 {
     mockIComm_InitReceiveChecksummedData("+$Z3,fffffffc,4#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_NO_FREE_BREAKPOINT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -335,7 +335,7 @@ TEST(watchpointTests, AttemptToSet4ByteReadWatchpoint_AtInvalidAddress_ShouldRet
 TEST(watchpointTests, AttemptToClear4ByteReadWatchpoint_AtInvalidAddress_ShouldReturnErrorMessage)
 {
     mockIComm_InitReceiveChecksummedData("+$z3,fffffffc,4#", "+$c#");
-        mri4simRun(mockIComm_Get(), TRUE);
+        mri4simRun(m_pSim, TRUE);
     appendExpectedTPacket(SIGTRAP, 0, INITIAL_SP, INITIAL_LR, INITIAL_PC);
     appendExpectedString("+$" MRI_ERROR_INVALID_ARGUMENT "#+");
     STRCMP_EQUAL(checksumExpected(), mockIComm_GetTransmittedData());
@@ -24,8 +24,13 @@ static uint8_t read8(IMemory* pMem, uint32_t address);
 static void write32(IMemory* pMem, uint32_t address, uint32_t value);
 static void write16(IMemory* pMem, uint32_t address, uint16_t value);
 static void write8(IMemory* pMem, uint32_t address, uint8_t value);
+static void readBlock(IMemory* pMem, uint32_t address, void* pBuffer, uint32_t size);
+static void writeBlock(IMemory* pMem, uint32_t address, const void* pBuffer, uint32_t size);
+static void readWords(IMemory* pMem, uint32_t address, uint32_t* pWords, uint32_t count);
+static void writeWords(IMemory* pMem, uint32_t address, const uint32_t* pWords, uint32_t count);
 
-static IMemoryVTable g_vTable = {read32, read16, read8, write32, write16, write8};
+static IMemoryVTable g_vTable = {read32, read16, read8, write32, write16, write8, NULL, NULL,
+                                 readBlock, writeBlock, readWords, writeWords, NULL};
 
 struct SimpleMemory
 {
@@ -99,3 +104,24 @@ static void write8(IMemory* pMem, uint32_t address, uint8_t value)
 {
     gdbRemoteWriteMemory(address, &value, sizeof(value));
 }
+
+
+static void readBlock(IMemory* pMem, uint32_t address, void* pBuffer, uint32_t size)
+{
+    gdbRemoteReadMemory(address, pBuffer, size);
+}
+
+static void writeBlock(IMemory* pMem, uint32_t address, const void* pBuffer, uint32_t size)
+{
+    gdbRemoteWriteMemory(address, pBuffer, size);
+}
+
+static void readWords(IMemory* pMem, uint32_t address, uint32_t* pWords, uint32_t count)
+{
+    gdbRemoteReadMemory(address, pWords, count * sizeof(*pWords));
+}
+
+static void writeWords(IMemory* pMem, uint32_t address, const uint32_t* pWords, uint32_t count)
+{
+    gdbRemoteWriteMemory(address, pWords, count * sizeof(*pWords));
+}
@@ -13,6 +13,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -29,6 +30,7 @@ int    (*hook_fseek)(FILE* stream, long offset, int whence) = fseek;
 long   (*hook_ftell)(FILE* stream) = ftell;
 size_t (*hook_fwrite)(const void* ptr, size_t size, size_t nitems, FILE* stream) = fwrite;
 size_t (*hook_fread)(void* ptr, size_t size, size_t nitems, FILE* stream) = fread;
+void*  (*hook_mmap)(void* addr, size_t len, int prot, int flags, int fd, off_t offset) = mmap;
 
 int     (*hook_open)(const char *path, int oflag, ...) = open;
 ssize_t (*hook_read)(int fildes, void *buf, size_t nbyte) = read;
@@ -60,3 +62,4 @@ int (*hook_select)(int nfds,
                    struct timeval* timeout) = select;
 ssize_t (*hook_recv)(int socket, void *buffer, size_t length, int flags) = recv;
 ssize_t (*hook_send)(int socket, const void *buffer, size_t length, int flags) = send;
+int (*hook_fcntl)(int fildes, int cmd, ...) = fcntl;
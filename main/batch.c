@@ -0,0 +1,293 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* pinkySim --batch runs every test listed in a manifest file, several at a time, and summarizes the results. */
+#include <BatchManifest.h>
+#include <fcntl.h>
+#include <MallocFailureInject.h>
+#include <pthread.h>
+#include <Snapshot.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <WorkPool.h>
+#include "main.h"
+
+
+typedef struct BatchTestResult
+{
+    char*  pOutput;
+    size_t outputSize;
+    double seconds;
+    int    status;
+    int    exitCode;
+    int    isDone;
+} BatchTestResult;
+
+typedef struct Batch
+{
+    BatchManifest    manifest;
+    BatchTestResult* pResults;
+    pthread_mutex_t  displayLock;
+    uint32_t         nextToDisplay;
+    uint32_t         threadCount;
+    int              nullInputFileDescriptor;
+} Batch;
+
+
+static const char* parseBatchArguments(Batch* pBatch, int argc, const char** argv);
+static void displayBatchUsage(void);
+static void runTest(void* pContext, uint32_t index);
+static void runSimulation(BatchTestResult* pResult, const BatchManifestEntry* pEntry, FILE* pOutput, int inputFd);
+static void recordResult(BatchTestResult* pResult, Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, FILE* pOutput);
+static void captureOutput(BatchTestResult* pResult, FILE* pOutput);
+static double secondsSince(const struct timespec* pStart);
+static void displayCompletedResultsInOrder(Batch* pBatch, uint32_t index);
+static void displayResult(Batch* pBatch, uint32_t index);
+static void displayTestArguments(const BatchManifestEntry* pEntry);
+static int displaySummary(Batch* pBatch);
+static void freeBatch(Batch* pBatch);
+
+
+int runBatch(int argc, const char** argv)
+{
+    Batch                batch;
+    const char* volatile pManifestFilename = NULL;
+    volatile int         returnValue = -1;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.nullInputFileDescriptor = -1;
+    pthread_mutex_init(&batch.displayLock, NULL);
+    pManifestFilename = parseBatchArguments(&batch, argc, argv);
+    if (!pManifestFilename)
+    {
+        displayBatchUsage();
+        return -1;
+    }
+
+    __try
+    {
+        BatchManifest_Init(&batch.manifest, pManifestFilename);
+        batch.pResults = malloc(batch.manifest.entryCount * sizeof(*batch.pResults));
+        if (!batch.pResults && batch.manifest.entryCount)
+            __throw(outOfMemoryException);
+        memset(batch.pResults, 0, batch.manifest.entryCount * sizeof(*batch.pResults));
+        batch.nullInputFileDescriptor = open("/dev/null", O_RDONLY);
+        WorkPool_Run(batch.threadCount, batch.manifest.entryCount, runTest, &batch);
+        returnValue = displaySummary(&batch);
+    }
+    __catch
+    {
+        if (getExceptionCode() == fileException)
+            fprintf(stderr, "Failed to open %s\n", pManifestFilename);
+        else if (getExceptionCode() == invalidArgumentException)
+            fprintf(stderr, "Unterminated quote in %s\n", pManifestFilename);
+        else if (getExceptionCode() == outOfMemoryException)
+            fprintf(stderr, "Failed to allocate memory for running %s\n", pManifestFilename);
+    }
+    freeBatch(&batch);
+
+    return returnValue;
+}
+
+static const char* parseBatchArguments(Batch* pBatch, int argc, const char** argv)
+{
+    const char* pManifestFilename = NULL;
+
+    while (argc)
+    {
+        if (0 == strcasecmp(*argv, "--jobs") && argc >= 2)
+        {
+            pBatch->threadCount = strtoul(argv[1], NULL, 0);
+            if (pBatch->threadCount == 0)
+                return NULL;
+            argc -= 2;
+            argv += 2;
+        }
+        else if (!pManifestFilename && !(argv[0][0] == '-' && argv[0][1] == '-'))
+        {
+            pManifestFilename = *argv;
+            argc--;
+            argv++;
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    return pManifestFilename;
+}
+
+static void displayBatchUsage(void)
+{
+    printf("Usage: pinkySim --batch manifestFilename [--jobs threadCount]\n"
+           "Where: manifestFilename is a text file with one test per line.  Each line holds the options,\n"
+           "         imageFilename and [args] that would be given to pinkySim to run that test.  Tests are run with\n"
+           "         their console output captured and displayed in manifest order, followed by a tab separated\n"
+           "         summary of each test's status (pass, fail, timeout, fault or error), exit code, run time and\n"
+           "         manifest line.\n"
+           "         A fault is any crash or breakpoint which would have stopped to wait for GDB.\n"
+           "       --jobs sets how many tests are run at once.  Defaults to the number of processors on the host.\n"
+           "       pinkySim exits with 0 only if every test exits with 0.\n");
+}
+
+static void runTest(void* pContext, uint32_t index)
+{
+    Batch*                    pBatch = (Batch*)pContext;
+    const BatchManifestEntry* pEntry = &pBatch->manifest.pEntries[index];
+    BatchTestResult*          pResult = &pBatch->pResults[index];
+    struct timespec           start;
+    FILE*                     pOutput;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pResult->status = RUN_ERROR;
+    pResult->exitCode = -1;
+    pOutput = tmpfile();
+    if (pOutput)
+    {
+        runSimulation(pResult, pEntry, pOutput, pBatch->nullInputFileDescriptor);
+        captureOutput(pResult, pOutput);
+        fclose(pOutput);
+    }
+    pResult->seconds = secondsSince(&start);
+
+    displayCompletedResultsInOrder(pBatch, index);
+}
+
+static void runSimulation(BatchTestResult* pResult, const BatchManifestEntry* pEntry, FILE* pOutput, int inputFd)
+{
+    pinkySimCommandLine commandLine;
+    Mri4Sim* volatile   pSim = NULL;
+
+    __try
+    {
+        pinkySimCommandLine_InitQuietly(&commandLine, pEntry->argCount, pEntry->ppArgs);
+        pSim = mri4simInit(commandLine.pMemory, getUnattendedIComm());
+        prepareSimulation(pSim, &commandLine, pEntry->argCount, pEntry->ppArgs);
+        mri4simRedirectConsole(pSim, inputFd, fileno(pOutput));
+        mri4simStopOnDebugEvent(pSim);
+        mri4simRun(pSim, 0);
+        recordResult(pResult, pSim, &commandLine, pOutput);
+    }
+    __catch
+    {
+        if (getExceptionCode() == fileException)
+            fprintf(pOutput, "Failed to open %s\n", commandLine.pImageFilename);
+        else if (getExceptionCode() == invalidArgumentException)
+            fprintf(pOutput, "Invalid pinkySim options for this test.\n");
+        else if (getExceptionCode() == stateException)
+            fprintf(pOutput, "%s\n", Snapshot_GetErrorText());
+        pResult->status = RUN_ERROR;
+        pResult->exitCode = -1;
+    }
+    mri4simUninit(pSim);
+    pinkySimCommandLine_Uninit(&commandLine);
+}
+
+static void recordResult(BatchTestResult* pResult, Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, FILE* pOutput)
+{
+    /* The program's console output was written straight to the file so move past it before adding to the end. */
+    fseek(pOutput, 0, SEEK_END);
+    pResult->status = reportRunStatus(pSim, pCommandLine, pOutput, &pResult->exitCode);
+}
+
+static void captureOutput(BatchTestResult* pResult, FILE* pOutput)
+{
+    long size;
+
+    fflush(pOutput);
+    if (0 != fseek(pOutput, 0, SEEK_END) || (size = ftell(pOutput)) < 0)
+        return;
+    rewind(pOutput);
+    pResult->pOutput = malloc(size + 1);
+    if (!pResult->pOutput)
+        return;
+    pResult->outputSize = fread(pResult->pOutput, 1, size, pOutput);
+}
+
+static double secondsSince(const struct timespec* pStart)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - pStart->tv_sec) + (now.tv_nsec - pStart->tv_nsec) / 1e9;
+}
+
+static void displayCompletedResultsInOrder(Batch* pBatch, uint32_t index)
+{
+    /* Output is displayed in manifest order as soon as all of the tests before it have completed so that long runs
+       still show progress. */
+    pthread_mutex_lock(&pBatch->displayLock);
+    pBatch->pResults[index].isDone = 1;
+    while (pBatch->nextToDisplay < pBatch->manifest.entryCount && pBatch->pResults[pBatch->nextToDisplay].isDone)
+        displayResult(pBatch, pBatch->nextToDisplay++);
+    fflush(stdout);
+    pthread_mutex_unlock(&pBatch->displayLock);
+}
+
+static void displayResult(Batch* pBatch, uint32_t index)
+{
+    BatchTestResult* pResult = &pBatch->pResults[index];
+
+    printf("\n===== [%u/%u] ", index + 1, pBatch->manifest.entryCount);
+    displayTestArguments(&pBatch->manifest.pEntries[index]);
+    printf(": %s\n", getRunStatusName(pResult->status));
+    fwrite(pResult->pOutput, 1, pResult->outputSize, stdout);
+    free(pResult->pOutput);
+    pResult->pOutput = NULL;
+}
+
+static void displayTestArguments(const BatchManifestEntry* pEntry)
+{
+    int i;
+
+    for (i = 0 ; i < pEntry->argCount ; i++)
+        printf(i == 0 ? "%s" : " %s", pEntry->ppArgs[i]);
+}
+
+static int displaySummary(Batch* pBatch)
+{
+    uint32_t passCount = 0;
+    uint32_t i;
+
+    printf("\n===== Summary\n");
+    printf("status\texitCode\tseconds\tline\ttest\n");
+    for (i = 0 ; i < pBatch->manifest.entryCount ; i++)
+    {
+        BatchTestResult* pResult = &pBatch->pResults[i];
+
+        printf("%s\t%d\t%.3f\t%u\t", getRunStatusName(pResult->status), pResult->exitCode, pResult->seconds,
+               pBatch->manifest.pEntries[i].lineNumber);
+        displayTestArguments(&pBatch->manifest.pEntries[i]);
+        printf("\n");
+        if (pResult->status == RUN_PASSED)
+            passCount++;
+    }
+    printf("%u of %u tests passed.\n", passCount, pBatch->manifest.entryCount);
+
+    return passCount == pBatch->manifest.entryCount ? 0 : 1;
+}
+
+static void freeBatch(Batch* pBatch)
+{
+    uint32_t i;
+
+    if (pBatch->nullInputFileDescriptor >= 0)
+        close(pBatch->nullInputFileDescriptor);
+    for (i = 0 ; pBatch->pResults && i < pBatch->manifest.entryCount ; i++)
+        free(pBatch->pResults[i].pOutput);
+    free(pBatch->pResults);
+    BatchManifest_Uninit(&pBatch->manifest);
+    pthread_mutex_destroy(&pBatch->displayLock);
+}
+
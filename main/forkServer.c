@@ -0,0 +1,420 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* pinkySim --fork-server sets up the simulation once and then forks a child process to run it for each request made
+   on a Unix domain socket.  The children get their own copy-on-write view of the already initialized memory so a run
+   only pays for the pages that it touches. */
+#include <BatchManifest.h>
+#include <common.h>
+#include <ElfImage.h>
+#include <errno.h>
+#include <MallocFailureInject.h>
+#include <signal.h>
+#include <Snapshot.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "main.h"
+
+
+#define MAX_REQUEST_LENGTH 4096
+
+
+typedef struct ForkServer
+{
+    pinkySimCommandLine commandLine;
+    Mri4Sim*            pSim;
+    const char*         pSocketPath;
+    const char*         pRunTo;
+    const char**        ppArgs;
+    int                 argCount;
+    int                 runToInput;
+    int                 hasRunAhead;
+    int                 listenSocket;
+} ForkServer;
+
+
+static int parseForkServerArguments(ForkServer* pServer, int argc, const char** argv);
+static void displayForkServerUsage(void);
+static void runAheadIfRequested(ForkServer* pServer);
+static void stopAtRunToAddress(ForkServer* pServer);
+static uint32_t lookupRunToAddress(ForkServer* pServer);
+static uint32_t findSymbolInImage(const char* pImageFilename, const char* pSymbol);
+static void listenOnSocket(ForkServer* pServer);
+static void removeStaleSocket(const char* pSocketPath);
+static void serveRequests(ForkServer* pServer);
+static void runRequest(ForkServer* pServer, int connection);
+static void readRequest(BatchManifest* pRequest, int connection, FILE* pOutput);
+static void startRun(ForkServer* pServer, BatchManifest* pRequest, FILE* pOutput);
+static void prepareSimulationWithArguments(ForkServer* pServer, const BatchManifestEntry* pArgs);
+static void finishRequest(FILE* pOutput, int connection);
+
+
+int runForkServer(int argc, const char** argv)
+{
+    ForkServer server;
+
+    memset(&server, 0, sizeof(server));
+    server.listenSocket = -1;
+    if (!parseForkServerArguments(&server, argc, argv))
+    {
+        displayForkServerUsage();
+        return -1;
+    }
+
+    __try
+    {
+        pinkySimCommandLine_Init(&server.commandLine, server.argCount, server.ppArgs);
+        server.pSim = mri4simInit(server.commandLine.pMemory, getUnattendedIComm());
+        mri4simStopOnDebugEvent(server.pSim);
+        runAheadIfRequested(&server);
+        listenOnSocket(&server);
+        serveRequests(&server);
+    }
+    __catch
+    {
+        /* Most failures have already been described where they were detected. */
+        if (getExceptionCode() == fileException)
+            fprintf(stderr, "Failed to open %s\n", server.commandLine.pImageFilename);
+        else if (getExceptionCode() == stateException)
+            fprintf(stderr, "%s\n", Snapshot_GetErrorText());
+    }
+    if (server.listenSocket >= 0)
+        close(server.listenSocket);
+    mri4simUninit(server.pSim);
+    pinkySimCommandLine_Uninit(&server.commandLine);
+
+    return -1;
+}
+
+static int parseForkServerArguments(ForkServer* pServer, int argc, const char** argv)
+{
+    if (argc < 1 || (argv[0][0] == '-' && argv[0][1] == '-'))
+        return FALSE;
+    pServer->pSocketPath = argv[0];
+    argc--;
+    argv++;
+
+    while (argc)
+    {
+        if (0 == strcasecmp(*argv, "--run-to") && argc >= 2)
+        {
+            pServer->pRunTo = argv[1];
+            argc -= 2;
+            argv += 2;
+        }
+        else if (0 == strcasecmp(*argv, "--run-to-input"))
+        {
+            pServer->runToInput = TRUE;
+            argc--;
+            argv++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    pServer->argCount = argc;
+    pServer->ppArgs = argv;
+    return argc > 0;
+}
+
+static void displayForkServerUsage(void)
+{
+    printf("Usage: pinkySim --fork-server socketPath [--run-to symbolOrAddress] [--run-to-input]\n"
+           "                [options] imageFilename [args]\n"
+           "Where: socketPath is the Unix domain socket to listen on for requests.  A socket left behind at that path\n"
+           "         by an earlier server is replaced.  The server runs until it is killed.\n"
+           "       --run-to runs the program from reset until it reaches the named ELF symbol (main for example) or\n"
+           "         address before listening for requests.  Each request then carries on from there.\n"
+           "       --run-to-input does the same but stops when the program first tries to read from stdin.\n"
+           "       [options] imageFilename [args] are the same as for a normal pinkySim run.\n"
+           "       Each connection to the socket is one run of the program in its own process.  The client sends a\n"
+           "         line of arguments to use instead of [args] (a blank line keeps [args] and is the only choice\n"
+           "         after --run-to or --run-to-input) followed by whatever the program should read from stdin.  It\n"
+           "         then shuts down its side of the connection for writing.  The program's output is sent back\n"
+           "         followed by a line of the form \"===== status exitCode\", where status is pass, fail, timeout,\n"
+           "         fault or error, and the connection is closed.\n");
+}
+
+static void runAheadIfRequested(ForkServer* pServer)
+{
+    if (!pServer->pRunTo && !pServer->runToInput)
+        return;
+
+    prepareSimulation(pServer->pSim, &pServer->commandLine, pServer->argCount, pServer->ppArgs);
+    if (pServer->pRunTo)
+        stopAtRunToAddress(pServer);
+    if (pServer->runToInput)
+        mri4simStopBeforeInput(pServer->pSim);
+    mri4simRun(pServer->pSim, 0);
+    if (!mri4simWasStopReached(pServer->pSim))
+    {
+        fprintf(stderr, "Program stopped at 0x%08X without reaching the point that it was to be run to.\n",
+                mri4simGetContext(pServer->pSim)->pc);
+        __throw(invalidArgumentException);
+    }
+    pServer->hasRunAhead = TRUE;
+}
+
+static void stopAtRunToAddress(ForkServer* pServer)
+{
+    uint32_t address = lookupRunToAddress(pServer);
+
+    __try
+    {
+        mri4simStopAt(pServer->pSim, address);
+    }
+    __catch
+    {
+        fprintf(stderr, "--run-to address 0x%08X isn't in simulated memory.\n", address);
+        clearExceptionCode();
+        __throw(invalidArgumentException);
+    }
+}
+
+static uint32_t lookupRunToAddress(ForkServer* pServer)
+{
+    const char* pRunTo = pServer->pRunTo;
+    char*       pEnd = NULL;
+    uint32_t    address;
+
+    /* Clear the thumb bit from function addresses so that they match the pc. */
+    address = strtoul(pRunTo, &pEnd, 0);
+    if (*pRunTo && *pEnd == '\0')
+        return address & ~1;
+    if (!pServer->commandLine.isElfImage)
+    {
+        fprintf(stderr, "--run-to %s needs an .elf image to look up the symbol in.\n", pRunTo);
+        __throw(invalidArgumentException);
+    }
+    return findSymbolInImage(pServer->commandLine.pImageFilename, pRunTo) & ~1;
+}
+
+static uint32_t findSymbolInImage(const char* pImageFilename, const char* pSymbol)
+{
+    FILE* volatile    pFile = NULL;
+    volatile uint32_t address = 0;
+
+    __try
+    {
+        pFile = fopen(pImageFilename, "rb");
+        if (!pFile)
+            __throw(fileException);
+        address = ElfImage_FindSymbol(pFile, GetFileSize(pFile), pSymbol);
+    }
+    __catch
+    {
+        if (getExceptionCode() == notFoundException)
+            fprintf(stderr, "Failed to find %s in the symbol table of %s.\n", pSymbol, pImageFilename);
+        else
+            fprintf(stderr, "Failed to read the symbol table of %s.\n", pImageFilename);
+        if (pFile)
+            fclose(pFile);
+        clearExceptionCode();
+        __throw(invalidArgumentException);
+    }
+    fclose(pFile);
+
+    return address;
+}
+
+static void listenOnSocket(ForkServer* pServer)
+{
+    struct sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(pServer->pSocketPath) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "%s is too long to be used as a socket path.\n", pServer->pSocketPath);
+        __throw(socketException);
+    }
+    strcpy(address.sun_path, pServer->pSocketPath);
+
+    removeStaleSocket(pServer->pSocketPath);
+    pServer->listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (pServer->listenSocket < 0 ||
+        bind(pServer->listenSocket, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(pServer->listenSocket, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", pServer->pSocketPath, strerror(errno));
+        __throw(socketException);
+    }
+}
+
+static void removeStaleSocket(const char* pSocketPath)
+{
+    struct stat info;
+
+    /* A killed server leaves its socket behind.  Anything else at that path is left alone for bind() to fail on. */
+    if (0 == stat(pSocketPath, &info) && S_ISSOCK(info.st_mode))
+        unlink(pSocketPath);
+}
+
+static void serveRequests(ForkServer* pServer)
+{
+    /* Children are never waited for so have the kernel reap them.  A client which hangs up early shouldn't take down
+       the process writing to it. */
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Listening for requests on %s\n", pServer->pSocketPath);
+    fflush(stdout);
+
+    for (;;)
+    {
+        int   connection = accept(pServer->listenSocket, NULL, NULL);
+        pid_t pid;
+
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "Failed to accept request on %s: %s\n", pServer->pSocketPath, strerror(errno));
+            __throw(socketException);
+        }
+
+        pid = fork();
+        if (pid == 0)
+        {
+            close(pServer->listenSocket);
+            runRequest(pServer, connection);
+            _exit(0);
+        }
+        if (pid < 0)
+        {
+            dprintf(connection, "Failed to fork: %s\n===== %s -1\n", strerror(errno), getRunStatusName(RUN_ERROR));
+        }
+        close(connection);
+    }
+}
+
+static void runRequest(ForkServer* pServer, int connection)
+{
+    BatchManifest request;
+    FILE*         pOutput = fdopen(connection, "w");
+    volatile int  status = RUN_ERROR;
+    int           exitCode = -1;
+
+    if (!pOutput)
+        return;
+    memset(&request, 0, sizeof(request));
+    __try
+    {
+        readRequest(&request, connection, pOutput);
+        startRun(pServer, &request, pOutput);
+        mri4simRedirectConsole(pServer->pSim, connection, connection);
+        mri4simRun(pServer->pSim, 0);
+        status = reportRunStatus(pServer->pSim, &pServer->commandLine, pOutput, &exitCode);
+    }
+    __catch
+    {
+        if (getExceptionCode() == stateException)
+            fprintf(pOutput, "%s\n", Snapshot_GetErrorText());
+        else if (getExceptionCode() == outOfMemoryException)
+            fprintf(pOutput, "Failed to allocate memory for request.\n");
+        status = RUN_ERROR;
+        exitCode = -1;
+    }
+    fprintf(pOutput, "\n===== %s %d\n", getRunStatusName(status), exitCode);
+    finishRequest(pOutput, connection);
+    BatchManifest_Uninit(&request);
+}
+
+static void readRequest(BatchManifest* pRequest, int connection, FILE* pOutput)
+{
+    char   line[MAX_REQUEST_LENGTH + 1];
+    size_t length = 0;
+
+    /* Read a byte at a time so that none of the program's stdin which follows the request line is consumed. */
+    while (length < sizeof(line) && 1 == read(connection, &line[length], 1) && line[length] != '\n')
+        length++;
+    if (length == sizeof(line))
+    {
+        fprintf(pOutput, "Request is longer than %d characters.\n", MAX_REQUEST_LENGTH);
+        __throw(bufferOverrunException);
+    }
+    line[length] = '\0';
+
+    __try
+    {
+        BatchManifest_InitFromText(pRequest, line);
+    }
+    __catch
+    {
+        if (getExceptionCode() == invalidArgumentException)
+            fprintf(pOutput, "Unterminated quote in request.\n");
+        __rethrow;
+    }
+}
+
+static void startRun(ForkServer* pServer, BatchManifest* pRequest, FILE* pOutput)
+{
+    if (!pServer->hasRunAhead)
+    {
+        if (pRequest->entryCount == 0)
+            prepareSimulation(pServer->pSim, &pServer->commandLine, pServer->argCount, pServer->ppArgs);
+        else
+            prepareSimulationWithArguments(pServer, &pRequest->pEntries[0]);
+        return;
+    }
+
+    /* The arguments were handed to the program before it was run ahead. */
+    if (pRequest->entryCount != 0)
+    {
+        fprintf(pOutput, "Arguments can't be given once the server has used --run-to or --run-to-input.\n");
+        __throw(invalidArgumentException);
+    }
+    /* Each request gets the full instruction limit rather than what was left after running ahead. */
+    if (pServer->commandLine.maxInstructions)
+        mri4simSetInstructionLimit(pServer->pSim, pServer->commandLine.maxInstructions);
+}
+
+static void prepareSimulationWithArguments(ForkServer* pServer, const BatchManifestEntry* pArgs)
+{
+    int          imageIndex = pServer->commandLine.argIndexOfImageFilename;
+    int          argCount = imageIndex + 1 + pArgs->argCount;
+    const char** ppArgs = malloc(argCount * sizeof(*ppArgs));
+
+    if (!ppArgs)
+        __throw(outOfMemoryException);
+    /* Keep the options and image filename from the server's command line but replace the program's arguments. */
+    memcpy(ppArgs, pServer->ppArgs, (imageIndex + 1) * sizeof(*ppArgs));
+    memcpy(ppArgs + imageIndex + 1, pArgs->ppArgs, pArgs->argCount * sizeof(*ppArgs));
+    __try
+    {
+        prepareSimulation(pServer->pSim, &pServer->commandLine, argCount, ppArgs);
+    }
+    __catch
+    {
+        free(ppArgs);
+        __rethrow;
+    }
+    free(ppArgs);
+}
+
+static void finishRequest(FILE* pOutput, int connection)
+{
+    char buffer[256];
+
+    /* Closing a socket with unread input resets the connection and the client could lose the end of the response, so
+       discard whatever stdin the program didn't read before closing. */
+    fflush(pOutput);
+    shutdown(connection, SHUT_WR);
+    while (read(connection, buffer, sizeof(buffer)) > 0)
+    {
+    }
+    fclose(pOutput);
+}
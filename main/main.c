@@ -12,11 +12,14 @@
 */
 #include <assert.h>
 #include <CodeCoverage.h>
+#include <MemorySim.h>
 #include <mri4sim.h>
 #include <pinkySimCommandLine.h>
+#include <Snapshot.h>
 #include <SocketIComm.h>
 #include <stdio.h>
 #include <string.h>
+#include "main.h"
 
 
 static void copyCommandLineArgumentsToStack(PinkySimContext* pContext,
@@ -26,37 +29,68 @@ static void copyCommandLineArgumentsToStack(PinkySimContext* pContext,
 static void copyStringToIMemory(IMemory* pMem, uint32_t destAddress, const char* pSrc);
 static uint32_t roundDownToNearestDoubleWord(uint32_t value);
 static void waitingForGdbToConnect(void);
-static void runCodeCoverageIfRequested(pinkySimCommandLine* pCommandLine);
+static void displayRamUsage(IMemory* pMemory, FILE* pOutput);
+static void runCodeCoverageIfRequested(pinkySimCommandLine* pCommandLine, FILE* pOutput, FILE* pErrors);
 
 
 int main(int argc, const char** argv)
 {
     int                 returnValue = 0;
     IComm*              pComm = NULL;
+    Mri4Sim* volatile   pSim = NULL;
     pinkySimCommandLine commandLine;
 
+    if (argc > 1 && 0 == strcasecmp(argv[1], "--batch"))
+        return runBatch(argc - 2, argv + 2);
+    if (argc > 1 && 0 == strcasecmp(argv[1], "--fork-server"))
+        return runForkServer(argc - 2, argv + 2);
+
     __try
     {
         pinkySimCommandLine_Init(&commandLine, argc-1, argv+1);
         pComm = SocketIComm_Init(commandLine.gdbPort, waitingForGdbToConnect);
-        mri4simInit(commandLine.pMemory);
-        copyCommandLineArgumentsToStack(mri4simGetContext(), argc-1, argv+1, commandLine.argIndexOfImageFilename);
-        mri4simRun(pComm, commandLine.breakOnStart);
-        returnValue = mri4simGetContext()->R[0];
-        runCodeCoverageIfRequested(&commandLine);
+        pSim = mri4simInit(commandLine.pMemory, pComm);
+        prepareSimulation(pSim, &commandLine, argc-1, argv+1);
+        mri4simRun(pSim, commandLine.breakOnStart);
+        returnValue = reportSimulationResults(pSim, &commandLine, stdout, stderr);
     }
     __catch
     {
         if (getExceptionCode() == fileException)
             fprintf(stderr, "Failed to open %s\n", commandLine.pImageFilename);
+        else if (getExceptionCode() == stateException)
+            fprintf(stderr, "%s\n", Snapshot_GetErrorText());
         returnValue = -1;
     }
+    mri4simUninit(pSim);
     SocketIComm_Uninit(pComm);
     pinkySimCommandLine_Uninit(&commandLine);
 
     return returnValue;
 }
 
+__throws void prepareSimulation(Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, int argc, const char** argv)
+{
+    if (pCommandLine->useJit)
+        mri4simEnableJit(pSim);
+    if (pCommandLine->maxInstructions)
+        mri4simSetInstructionLimit(pSim, pCommandLine->maxInstructions);
+    if (pCommandLine->countCycles)
+        pinkySimEnableCycleCounter(mri4simGetContext(pSim), pCommandLine->flashBaseAddress, pCommandLine->flashSize,
+                                   pCommandLine->flashWaitStates);
+    if (pCommandLine->pSaveStateFilename)
+        mri4simSaveStateAt(pSim, pCommandLine->pSaveStateFilename, pCommandLine->saveStateAddress);
+    /* A loaded state has already been through reset and been given its arguments. */
+    if (pCommandLine->pLoadStateFilename)
+    {
+        Snapshot_Load(mri4simGetContext(pSim), pCommandLine->pLoadStateFilename);
+        return;
+    }
+    if (pCommandLine->isElfImage)
+        mri4simGetContext(pSim)->pc = pCommandLine->entryPoint & 0xFFFFFFFE;
+    copyCommandLineArgumentsToStack(mri4simGetContext(pSim), argc, argv, pCommandLine->argIndexOfImageFilename);
+}
+
 static void copyCommandLineArgumentsToStack(PinkySimContext* pContext,
                                            int               argc,
                                            const char**      argv,
@@ -97,11 +131,7 @@ static void copyCommandLineArgumentsToStack(PinkySimContext* pContext,
 
 static void copyStringToIMemory(IMemory* pMem, uint32_t destAddress, const char* pSrc)
 {
-    do
-    {
-        IMemory_Write8(pMem, destAddress, *pSrc);
-        destAddress++;
-    } while (*pSrc++);
+    IMemory_WriteBlock(pMem, destAddress, pSrc, strlen(pSrc) + 1);
 }
 
 static uint32_t roundDownToNearestDoubleWord(uint32_t value)
@@ -114,7 +144,36 @@ static void waitingForGdbToConnect(void)
     printf("\nWaiting for GDB to connect...\n");
 }
 
-static void runCodeCoverageIfRequested(pinkySimCommandLine* pCommandLine)
+__throws int reportSimulationResults(Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, FILE* pOutput, FILE* pErrors)
+{
+    int returnValue = mri4simGetContext(pSim)->R[0];
+
+    if (mri4simWasInstructionLimitReached(pSim))
+    {
+        fprintf(pErrors, "\nStopped after executing %llu instructions.\n",
+                (unsigned long long)pCommandLine->maxInstructions);
+        returnValue = -1;
+    }
+    if (pCommandLine->countCycles)
+        fprintf(pOutput, "\nExecuted %llu cycles.\n", (unsigned long long)mri4simGetContext(pSim)->cycleCounter.count);
+    if (pCommandLine->reportRamUsage)
+        displayRamUsage(pCommandLine->pMemory, pOutput);
+    runCodeCoverageIfRequested(pCommandLine, pOutput, pErrors);
+
+    return returnValue;
+}
+
+static void displayRamUsage(IMemory* pMemory, FILE* pOutput)
+{
+    uint64_t totalBytes;
+    uint64_t touchedBytes;
+
+    MemorySim_GetRAMUsage(pMemory, &totalBytes, &touchedBytes);
+    fprintf(pOutput, "\nTouched %llu KiB of %llu KiB of RAM.\n",
+            (unsigned long long)(touchedBytes + 1023) / 1024, (unsigned long long)(totalBytes + 1023) / 1024);
+}
+
+static void runCodeCoverageIfRequested(pinkySimCommandLine* pCommandLine, FILE* pOutput, FILE* pErrors)
 {
     if (!pCommandLine->pCoverageElfFilename)
         return;
@@ -126,16 +185,16 @@ static void runCodeCoverageIfRequested(pinkySimCommandLine* pCommandLine)
                          pCommandLine->pCoverageResultsDirectory,
                          pCommandLine->ppCoverageRestrictPaths,
                          pCommandLine->coverageRestrictPathCount);
-        printf("\nCode coverage results can be found in %s.\n", pCommandLine->pCoverageResultsDirectory);
+        fprintf(pOutput, "\nCode coverage results can be found in %s.\n", pCommandLine->pCoverageResultsDirectory);
     }
     __catch
     {
-        fprintf(stderr, "\n");
+        fprintf(pErrors, "\n");
         if (getExceptionCode() == outOfMemoryException)
-            fprintf(stderr, "Failed to allocate memory for processing code coverage results.\n");
+            fprintf(pErrors, "Failed to allocate memory for processing code coverage results.\n");
         else
-            fprintf(stderr, "%s\n", CodeCoverage_GetErrorText());
-        fprintf(stderr, "Failed to successfully process code coverage results.\n");
+            fprintf(pErrors, "%s\n", CodeCoverage_GetErrorText());
+        fprintf(pErrors, "Failed to successfully process code coverage results.\n");
         __throw(coverageException);
     }
 }
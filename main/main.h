@@ -0,0 +1,49 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* Functions shared by the normal, --batch and --fork-server ways of running pinkySim. */
+#ifndef _MAIN_H_
+#define _MAIN_H_
+
+#include <mri4sim.h>
+#include <pinkySimCommandLine.h>
+#include <stdio.h>
+
+
+/* Applies the command line options to the simulation and copies the program's arguments to the top of its stack. */
+__throws void prepareSimulation(Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, int argc, const char** argv);
+/* Displays the cycle count, RAM usage and code coverage results which were requested on the command line and returns
+   the program's exit code (-1 if it hit the instruction limit). */
+__throws int  reportSimulationResults(Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, FILE* pOutput, FILE* pErrors);
+
+
+/* Outcomes of a run reported by --batch and --fork-server. */
+#define RUN_PASSED  0
+#define RUN_FAILED  1
+#define RUN_TIMEOUT 2
+#define RUN_FAULT   3
+#define RUN_ERROR   4
+
+/* IComm for runs which never have GDB attached.  Used along with mri4simStopOnDebugEvent(). */
+         IComm*      getUnattendedIComm(void);
+/* "pass", "fail", etc. */
+         const char* getRunStatusName(int status);
+/* Calls reportSimulationResults() with everything going to pOutput and then works out which of the RUN_* outcomes
+   the run had.  Faults are described in pOutput and give an exit code of -1. */
+__throws int         reportRunStatus(Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, FILE* pOutput, int* pExitCode);
+
+/* Entry points for pinkySim --batch and --fork-server.  argv starts just after the flag. */
+         int         runBatch(int argc, const char** argv);
+         int         runForkServer(int argc, const char** argv);
+
+
+#endif /* _MAIN_H_ */
@@ -0,0 +1,108 @@
+/*  Copyright (C) 2014  Adam Green (https://github.com/adamgreen)
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/* Pieces shared by the ways of running pinkySim without GDB: --batch and --fork-server. */
+#include <IComm.h>
+#include <stdio.h>
+#include "main.h"
+
+
+static const char* g_statusNames[] = { "pass", "fail", "timeout", "fault", "error" };
+
+
+/* IComm for simulations which never have GDB attached.  mri4simStopOnDebugEvent() keeps the MRI core from ever
+   needing to talk to it. */
+static int  hasReceiveData(IComm* pComm);
+static int  receiveChar(IComm* pComm);
+static void sendChar(IComm* pComm, int character);
+static int  shouldStopRun(IComm* pComm);
+static int  isGdbConnected(IComm* pComm);
+
+static ICommVTable g_unattendedICommVTable = {hasReceiveData, receiveChar, sendChar, shouldStopRun, isGdbConnected};
+static IComm       g_unattendedIComm = {&g_unattendedICommVTable};
+
+
+static const char* describeRunResult(int runResult);
+
+
+IComm* getUnattendedIComm(void)
+{
+    return &g_unattendedIComm;
+}
+
+
+const char* getRunStatusName(int status)
+{
+    return g_statusNames[status];
+}
+
+
+__throws int reportRunStatus(Mri4Sim* pSim, pinkySimCommandLine* pCommandLine, FILE* pOutput, int* pExitCode)
+{
+    *pExitCode = reportSimulationResults(pSim, pCommandLine, pOutput, pOutput);
+    if (mri4simDidProgramExit(pSim))
+        return *pExitCode == 0 ? RUN_PASSED : RUN_FAILED;
+    if (mri4simWasInstructionLimitReached(pSim))
+        return RUN_TIMEOUT;
+
+    fprintf(pOutput, "\nStopped at 0x%08X on %s.\n",
+            mri4simGetContext(pSim)->pc, describeRunResult(mri4simGetRunResult(pSim)));
+    *pExitCode = -1;
+    return RUN_FAULT;
+}
+
+static const char* describeRunResult(int runResult)
+{
+    switch (runResult)
+    {
+    case PINKYSIM_STEP_UNDEFINED:
+        return "undefined instruction";
+    case PINKYSIM_STEP_UNPREDICTABLE:
+        return "unpredictable instruction encoding";
+    case PINKYSIM_STEP_HARDFAULT:
+        return "hard fault";
+    case PINKYSIM_STEP_UNSUPPORTED:
+        return "unsupported instruction";
+    case PINKYSIM_STEP_SVC:
+        return "SVC instruction";
+    case PINKYSIM_RUN_WATCHPOINT:
+        return "watchpoint";
+    default:
+        return "breakpoint";
+    }
+}
+
+
+static int hasReceiveData(IComm* pComm)
+{
+    return 0;
+}
+
+static int receiveChar(IComm* pComm)
+{
+    /* Only reachable if the MRI core tries to wait for GDB, so abandon this run rather than hanging. */
+    __throw(serialException);
+}
+
+static void sendChar(IComm* pComm, int character)
+{
+}
+
+static int shouldStopRun(IComm* pComm)
+{
+    return 0;
+}
+
+static int isGdbConnected(IComm* pComm)
+{
+    return 0;
+}